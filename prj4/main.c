@@ -1,11 +1,24 @@
 #include "y86.h"
 #include "yas.h"
 #include "ysim.h"
+#include "yimage.h"
+#include "ycache.h"
+#include "ymulti.h"
+#include "ydebug.h"
+#include "ydump.h"
+#include "ylockstep.h"
+#include "yinput.h"
+#include "ytrace.h"
+#include "yverify.h"
+#include "yresume.h"
+#include "yfuzz.h"
+#include "yloop.h"
 
 #include "errors.h"
 
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,47 +32,183 @@ typedef struct {
   int verbosity;
   bool isStep;
   bool isList;
+  Address memSize;   //size of paged memory; 0 for y86 default size
+  const char *imageName;  //write program image here instead of running
+  bool isNoCache;         //always assemble sources
+  int nCores;             //# of cores sharing memory
+  int numBreaks;
+  const char **breaks;    //breakpoint specs
+  int numWatches;
+  const char **watches;   //watchpoint specs
+  bool isDebug;           //stop in debugger before first instruction
+  long snapshotInterval;  //# of steps between history snapshots; 0 if none
+  const char *lockstepName;  //file of per-instance INT_INPUTS; NULL if none
+  const char *inputSpec;  //FILE[@ADDR] of bulk inputs; NULL if none
+  bool isTextInput;       //inputSpec file is text rather than binary
+  const char *traceName;  //write memory access analysis here; NULL if none
+  const char *checkpointName;  //resume from and save checkpoints here;
+                               //NULL if none
+  long fuzzCount;         //# of random programs to fuzz engines with
+  unsigned long fuzzSeed;
 } Args;
 
 enum { SILENT_VERBOSE, VERBOSE, VERY_VERBOSE };
 
+enum { MAX_CORES = 256 };
+
+enum { MAX_SNAPSHOTS = 64 };  //history kept for reverse execution
+
+enum { MAX_LOCKSTEP_PARAMS = 256, MAX_LOCKSTEP_LINE = 4096 };
+
+enum { TRACE_LINE_SIZE = 64 };  //line size for memory access analysis
+
+enum { CHECKPOINT_INTERVAL = 1 << 20 };  //# of steps between checkpoints
+
+enum { MAX_LOOP_ITERS = 1 << 20 };  //max # of loop iterations per kernel run
+
 /**************************** Y86 Parameter Setup ***********************/
 
 
-static void
-setup_params(const Args *args, Y86 *y86)
+/** Copy the parameters in args to the top of mem; return their address. */
+static Address
+setup_argv(const Args *args, YMem *mem)
 {
   Word argc = args->numParams;
+  Address top = get_size_ymem(mem);
+  Address argv = top - argc * sizeof(Word);
+  for (int i = 0; i < argc; i++) {
+    const Address argvi = argv + i * sizeof(Word);
+    printf("argvi = %08lx\n", argvi);
+    bool isOk = write_word_ymem(mem, argvi, args->params[i]);
+    assert(isOk);
+  }
+  return argv;
+}
+
+/** Copy the inputs specified by args into mem: the bulk input file
+ *  if any, else the INT_INPUTS.  Set *argv to their address and
+ *  return their #.
+ */
+static Word
+setup_inputs(const Args *args, YMem *mem, Address *argv)
+{
+  if (!args->inputSpec) {
+    *argv = setup_argv(args, mem);
+    return args->numParams;
+  }
+  const long argc = load_yinput(mem, args->inputSpec, args->isTextInput, argv);
+  if (argc < 0) exit(1);
+  return argc;
+}
+
+static void
+setup_params(const Args *args, Y86 *y86, YMem *mem)
+{
+  Address argv;
+  Word argc = setup_inputs(args, mem, &argv);
   if (argc > 0) {
-    Address top = get_memory_size_y86(y86);
-    Address argv = top - argc * sizeof(Word);
-    for (int i = 0; i < argc; i++) {
-      const Address argvi = argv + i * sizeof(Word);
-      printf("argvi = %08lx\n", argvi);
-      write_memory_word_y86(y86, argvi, args->params[i]);
-      assert(read_status_y86(y86) == STATUS_AOK);
-    }
     write_register_y86(y86, REG_RDI, argc);
     write_register_y86(y86, REG_RSI, argv);
   }
 }
 
+/** Set up cores[args->nCores] to start at the pc of cores[0], with
+ *  %rdi = core ID, %rsi = argv, %rdx = argc and %rcx = # of cores.
+ */
+static void
+setup_core_params(const Args *args, Y86 *cores[], YMem *mem)
+{
+  Address argv;
+  const Word argc = setup_inputs(args, mem, &argv);
+  for (int i = 0; i < args->nCores; i++) {
+    write_pc_y86(cores[i], read_pc_y86(cores[0]));
+    write_register_y86(cores[i], REG_RDI, i);
+    write_register_y86(cores[i], REG_RSI, argv);
+    write_register_y86(cores[i], REG_RDX, argc);
+    write_register_y86(cores[i], REG_RCX, args->nCores);
+  }
+}
+
 /*************************** Main Simulation ****************************/
 
+/** Return a debugger for y86 with the breakpoints and watchpoints
+ *  specified by args; NULL if none were requested.
+ */
+static YDebug *
+setup_debug(const Args *args, Y86 *y86, YMem *mem)
+{
+  if (!args->isDebug && args->numBreaks == 0 && args->numWatches == 0 &&
+      args->snapshotInterval == 0) {
+    return NULL;
+  }
+  YDebug *debug = new_ydebug(y86, mem);
+  if (args->snapshotInterval > 0) {
+    enable_reverse_ydebug(debug, args->snapshotInterval, MAX_SNAPSHOTS);
+  }
+  for (int i = 0; i < args->numBreaks; i++) {
+    if (!add_break_ydebug(debug, args->breaks[i])) {
+      fatal("bad breakpoint '%s'\n", args->breaks[i]);
+    }
+  }
+  for (int i = 0; i < args->numWatches; i++) {
+    if (!add_watch_ydebug(debug, args->watches[i])) {
+      fatal("bad watchpoint '%s'\n", args->watches[i]);
+    }
+  }
+  if (args->isDebug) stop_ydebug(debug);
+  return debug;
+}
+
+/** Run y86 with memory mem until it stops, dumping changes relative
+ *  to the baseline of dump.
+ */
 static void
-simulate(const Args *args, Y86 *y86, FILE *out)
+simulate(const Args *args, Y86 *y86, YMem *mem, YDump *dump, FILE *out)
 {
-  setup_params(args, y86);
+  setup_params(args, y86, mem);
+  YResume *resume = NULL;
+  if (args->checkpointName) {
+    resume = new_yresume(y86, mem, CHECKPOINT_INTERVAL);
+    const long nSkipped = resume_yresume(resume, args->checkpointName);
+    if (nSkipped > 0) {
+      fprintf(stderr, "resuming at step %ld from %s\n", nSkipped,
+              args->checkpointName);
+      mark_ydump(dump, ~0u);
+    }
+  }
+  YDebug *debug = setup_debug(args, y86, mem);
   bool isRunning = true;
   bool isVeryVerbose = (args->verbosity == VERY_VERBOSE);
+  //verified code is only run unchecked when no one looks between
+  //instructions
+  YVerify *verify =
+    (args->verbosity == SILENT_VERBOSE && !args->isStep && !debug)
+    ? new_yverify(mem, read_pc_y86(y86)) : NULL;
+  //hot loops skip whole iterations, so not when steps are recorded
+  YLoop *loop = (verify && !resume && !args->traceName) ? new_yloop() : NULL;
   while (isRunning) {
+    if (debug && !check_ydebug(debug, stdin, out)) break;
     Address pc = read_pc_y86(y86);
-    step_ysim(y86);
+    if (resume) record_yresume(resume);
+    if (verify) {
+      const YLoopBody *body = loop ? check_yloop(loop, y86, mem) : NULL;
+      if (body) run_yloop(body, y86, mem, MAX_LOOP_ITERS);
+      //resume counts each instruction as a step
+      if (resume) step_verified_ysim_mem(y86, mem, verify);
+      else step_fused_ysim_mem(y86, mem, verify);
+      mark_ydump(dump, ~0u);
+    }
+    else {
+      const unsigned changed = step_ysim_mem(y86, mem);
+      //the debugger may rewrite any register when going back in history
+      mark_ydump(dump, debug ? ~0u : changed);
+    }
     isRunning = read_status_y86(y86) == STATUS_AOK;
     if (isRunning) {
       if (args->verbosity != SILENT_VERBOSE) {
         fprintf(out, "pc: %0*lx\n", (int)sizeof(Address)*2, pc);
-        dump_changes_y86(y86, isVeryVerbose, out);
+        dump_changes_ydump(dump, isVeryVerbose, out);
+        dump_changes_ymem(mem, out);
         fprintf(out, "\n");
       }
       if (args->isStep) {
@@ -68,9 +217,174 @@ simulate(const Args *args, Y86 *y86, FILE *out)
       }
     }
   }
-  dump_changes_y86(y86, true, out);
+  if (debug) free_ydebug(debug);
+  if (verify) free_yverify(verify);
+  if (loop) free_yloop(loop);
+  if (resume) {
+    save_yresume(resume, args->checkpointName);
+    free_yresume(resume);
+  }
+  dump_changes_ydump(dump, true, out);
+  dump_changes_ymem(mem, out);
+}
+
+/** Like simulate(), but record all memory accesses and write their
+ *  analysis to args->traceName ("-" for stdout) after the run.
+ */
+static void
+simulate_traced(const Args *args, Y86 *y86, YMem *mem, YDump *dump,
+                FILE *out)
+{
+  YTrace *trace = new_ytrace();
+  trace_ysim(trace);
+  simulate(args, y86, mem, dump, out);
+  trace_ysim(NULL);
+  const bool isStdout = strcmp(args->traceName, "-") == 0;
+  FILE *report = isStdout ? stdout : fopen(args->traceName, "w");
+  if (!report) {
+    fprintf(stderr, "cannot write %s\n", args->traceName);
+  }
+  else {
+    analyze_ytrace(trace, TRACE_LINE_SIZE, report);
+    if (!isStdout) fclose(report);
+  }
+  free_ytrace(trace);
+}
+
+/** Run cores[args->nCores] in parallel until all have stopped, then
+ *  dump the final state of each core followed by memory changes.
+ */
+static void
+simulate_multicore(const Args *args, Y86 *cores[], YMem *mem, FILE *out)
+{
+  setup_core_params(args, cores, mem);
+  run_ymulti(cores, args->nCores, mem);
+  for (int i = 0; i < args->nCores; i++) {
+    fprintf(out, "core %d:\n", i);
+    YDump *dump = new_ydump(cores[i]);
+    dump_changes_ydump(dump, true, out);
+    free_ydump(dump);
+  }
+  dump_changes_ymem(mem, out);
+}
+
+/** Parse the INT_INPUTS in line into params[]; return their # or -1
+ *  if line has a bad or too many inputs.
+ */
+static int
+parse_lockstep_params(const char *line, Word params[])
+{
+  int n = 0;
+  const char *p = line;
+  for (;;) {
+    while (isspace(*p)) p++;
+    if (*p == '\0') return n;
+    char *end;
+    if (n == MAX_LOCKSTEP_PARAMS) return -1;
+    params[n++] = strtol(p, &end, 0);
+    if (end == p || !(isspace(*end) || *end == '\0')) return -1;
+    p = end;
+  }
+}
+
+/** Run one instance of the program loaded in y86 and mem for each
+ *  line of args->lockstepName, the line giving the INT_INPUTS of the
+ *  instance.  Up to MAX_LANES_YLOCKSTEP instances run in lockstep at
+ *  a time; the final state of each is dumped as for a single run.
+ */
+static void
+simulate_lockstep(const Args *args, Y86 *y86, YMem *mem, FILE *out)
+{
+  FILE *in = fopen(args->lockstepName, "r");
+  if (!in) fatal("cannot read %s\n", args->lockstepName);
+  static Word params[MAX_LANES_YLOCKSTEP][MAX_LOCKSTEP_PARAMS];
+  int nParams[MAX_LANES_YLOCKSTEP];
+  char line[MAX_LOCKSTEP_LINE];
+  int lineN = 0, nDone = 0;
+  bool isEof = false;
+  while (!isEof) {
+    int nLanes = 0;
+    while (nLanes < MAX_LANES_YLOCKSTEP && !isEof) {
+      if (!fgets(line, sizeof(line), in)) {
+        isEof = true;
+      }
+      else if ((nParams[nLanes] =
+                parse_lockstep_params(line, params[nLanes])) < 0) {
+        fatal("%s:%d: bad INT_INPUTS\n", args->lockstepName, lineN + 1);
+      }
+      else {
+        lineN++;
+        nLanes++;
+      }
+    }
+    if (nLanes == 0) break;
+    YLockstep *lockstep = new_ylockstep(mem, read_pc_y86(y86), nLanes);
+    for (int l = 0; l < nLanes; l++) {
+      set_params_ylockstep(lockstep, l, nParams[l], params[l]);
+    }
+    run_ylockstep(lockstep, LONG_MAX);
+    for (int l = 0; l < nLanes; l++) {
+      fprintf(out, "instance %d:\n", nDone + l);
+      dump_ylockstep(lockstep, l, out);
+    }
+    free_ylockstep(lockstep);
+    nDone += nLanes;
+  }
+  fclose(in);
+}
+
+/************************** Program Loading ****************************/
+
+static bool
+is_image_args(const Args *args)
+{
+  return args->numFileNames == 1 && is_yimage(args->fileNames[0]);
 }
 
+/** Return a new memory for y86 loaded with the program specified by
+ *  args: either a single precompiled image or assembler sources.  The
+ *  image of the sources is taken from cache if it is non-NULL, else
+ *  they are assembled into y86.  Return NULL on error.
+ */
+static YMem *
+load_program(const Args *args, Y86 *y86, YCache *cache)
+{
+  YImage *ownImage = NULL;
+  const YImage *image = NULL;
+  if (is_image_args(args)) {
+    if (!(image = ownImage = read_yimage(args->fileNames[0]))) return NULL;
+  }
+  else if (cache) {
+    image = get_ycache(cache, args->numFileNames, args->fileNames);
+    if (!image) return NULL;
+  }
+  else if (!yas_to_y86(y86, args->numFileNames, args->fileNames)) {
+    return NULL;
+  }
+  Address memSize =
+    (args->memSize > 0) ? args->memSize : get_memory_size_y86(y86);
+  YMem *mem = new_ymem(memSize);
+  if (!mem) fatal("cannot reserve %lu bytes of memory\n", memSize);
+  if (!image) {
+    load_y86_ymem(mem, y86);
+    return mem;
+  }
+  for (int i = 0; i < get_n_segments_yimage(image); i++) {
+    Address addr;
+    size_t size;
+    const Byte *bytes = get_segment_yimage(image, i, &addr, &size);
+    if (!load_bytes_ymem(mem, addr, bytes, size)) {
+      fprintf(stderr, "%s: segment at %08lx does not fit in memory\n",
+              args->fileNames[0], addr);
+      free_ymem(mem);
+      mem = NULL;
+      break;
+    }
+  }
+  write_pc_y86(y86, get_entry_yimage(image));
+  if (ownImage) free_yimage(ownImage);
+  return mem;
+}
 
 /************************* Parse Command Line **************************/
 
@@ -78,17 +392,77 @@ static void
 usage(const char *prog)
 {
   fprintf(stderr,
-          "usage: %s [-s] [-v] [-V] YAS_FILE_NAMES... INT_INPUTS...\n", prog);
+          "usage: %s [-s] [-v] [-V] [-n] [-g] [-R INTERVAL] [-b BREAK]... [-w WATCH]... [-c N] [-L INPUTS_FILE] [-i|-I FILE[@ADDR]] [-m SIZE] [-o IMAGE] [-T REPORT] [-C CHECKPOINTS] [-F COUNT[:SEED]] YAS_FILE_NAMES... INT_INPUTS...\n", prog);
   fprintf(stderr,
+          "          -b:  stop in debugger before executing instruction at\n"
+          "               BREAK = ADDR[:REG OP VALUE], e.g. 0x40:%%rax>=5\n"
+          "          -c:  run N cores sharing memory, each on its own host\n"
+          "               thread; core i starts with %%rdi = i, %%rsi = argv,\n"
+          "               %%rdx = argc and %%rcx = N (-s, -v, -V ignored;\n"
+          "               not with -g, -b, -w, -R or -C)\n"
+          "          -C:  checkpoint the run every %d instructions in file\n"
+          "               CHECKPOINTS; if CHECKPOINTS holds the checkpoints\n"
+          "               of an earlier run, skip to the last one taken\n"
+          "               before that run first touched memory which now\n"
+          "               differs (-v and -V show only the steps run;\n"
+          "               not with -c, -g, -b, -w, -L, -R or -T; stall-sim\n"
+          "               timing runs cannot be checkpointed)\n"
+          "          -F:  instead of simulating, run COUNT random programs\n"
+          "               (from SEED, default 0) on every execution engine\n"
+          "               on -c threads and write a minimized .ys\n"
+          "               reproducer for the first which diverges from\n"
+          "               step_ysim(); no YAS_FILE_NAMES needed\n"
+          "          -g:  stop in debugger before first instruction\n"
+          "          -i:  in place of INT_INPUTS, copy the 8-byte words in\n"
+          "               binary FILE to ADDR (default: top of memory);\n"
+          "               %%rdi = # of words, %%rsi = ADDR\n"
+          "          -I:  like -i, but FILE contains text integers\n"
+          "          -L:  run one instance per line of INPUTS_FILE, each\n"
+          "               line giving its INT_INPUTS, many at a time in\n"
+          "               lockstep (-s, -v, -V ignored; not with -g, -b,\n"
+          "               -w, -R or -C)\n"
           "          -l:  produce assembler listing only\n"
+          "          -m:  use a sparse paged memory of SIZE bytes (suffix\n"
+          "               K, M or G allowed; e.g. -m 16G)\n"
+          "          -n:  do not cache assembled programs (the cache is in\n"
+          "               $Y86_CACHE_DIR, else $HOME/.cache/y86)\n"
+          "          -o:  write precompiled program image to IMAGE and exit;\n"
+          "               an IMAGE may be given in place of YAS_FILE_NAMES\n"
+          "          -R:  allow reverse execution in debugger (rs, rc) by\n"
+          "               taking a snapshot every INTERVAL instructions;\n"
+          "               the last %d snapshots are kept\n"
           "          -s:  single-step program\n"
+          "          -T:  record all fetches and data accesses and write\n"
+          "               reuse distances, working sets and strides for\n"
+          "               %d-byte lines to file REPORT (- for stdout;\n"
+          "               not with -c or -L)\n"
           "          -v:  verbose: dump changes after each instruction\n"
           "          -V:  very verbose: dump all registers after each "
-          "instruction\n");
+          "instruction\n"
+          "          -w:  stop in debugger after an instruction changes the\n"
+          "               memory at WATCH = ADDR[:LEN] (LEN default 8)\n",
+          CHECKPOINT_INTERVAL, MAX_SNAPSHOTS, TRACE_LINE_SIZE);
   exit(1);
 }
 
 
+/** Return size specified by arg with an optional K, M or G suffix;
+ *  0 if arg is not a valid size.
+ */
+static Address
+parse_size(const char *arg)
+{
+  char *p;
+  Address size = strtoul(arg, &p, 0);
+  switch (toupper(*p)) {
+  case 'G': size <<= 10; //fallthrough
+  case 'M': size <<= 10; //fallthrough
+  case 'K': size <<= 10; p++; break;
+  default: break;
+  }
+  return (*p == '\0') ? size : 0;
+}
+
 static void
 first_pass_args(int argc, const char *argv[], Args *args)
 {
@@ -105,6 +479,86 @@ first_pass_args(int argc, const char *argv[], Args *args)
     else if (strcmp(argv[i], "-l") == 0) {
       args->isList = true;
     }
+    else if (strcmp(argv[i], "-m") == 0) {
+      if (i + 1 == argc || (args->memSize = parse_size(argv[++i])) == 0) {
+        fprintf(stderr, "bad or missing size for -m\n");
+        usage(argv[0]);
+      }
+    }
+    else if (strcmp(argv[i], "-c") == 0) {
+      char *p = "";
+      if (i + 1 < argc) args->nCores = strtol(argv[++i], &p, 0);
+      if (*p != '\0' || args->nCores < 1 || args->nCores > MAX_CORES) {
+        fprintf(stderr, "bad or missing # of cores for -c\n");
+        usage(argv[0]);
+      }
+    }
+    else if (strcmp(argv[i], "-R") == 0) {
+      char *p = "";
+      if (i + 1 < argc) args->snapshotInterval = strtol(argv[++i], &p, 0);
+      if (*p != '\0' || args->snapshotInterval < 1) {
+        fprintf(stderr, "bad or missing snapshot interval for -R\n");
+        usage(argv[0]);
+      }
+    }
+    else if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "-I") == 0) {
+      if (i + 1 == argc) {
+        fprintf(stderr, "missing input file name for %s\n", argv[i]);
+        usage(argv[0]);
+      }
+      args->isTextInput = argv[i++][1] == 'I';
+      args->inputSpec = argv[i];
+    }
+    else if (strcmp(argv[i], "-L") == 0) {
+      if (i + 1 == argc) {
+        fprintf(stderr, "missing inputs file name for -L\n");
+        usage(argv[0]);
+      }
+      args->lockstepName = argv[++i];
+    }
+    else if (strcmp(argv[i], "-T") == 0) {
+      if (i + 1 == argc) {
+        fprintf(stderr, "missing report file name for -T\n");
+        usage(argv[0]);
+      }
+      args->traceName = argv[++i];
+    }
+    else if (strcmp(argv[i], "-F") == 0) {
+      char *p = "";
+      if (i + 1 < argc) args->fuzzCount = strtol(argv[++i], &p, 0);
+      if (*p == ':') args->fuzzSeed = strtoul(p + 1, &p, 0);
+      if (*p != '\0' || args->fuzzCount < 1) {
+        fprintf(stderr, "bad or missing count for -F\n");
+        usage(argv[0]);
+      }
+    }
+    else if (strcmp(argv[i], "-C") == 0) {
+      if (i + 1 == argc) {
+        fprintf(stderr, "missing checkpoints file name for -C\n");
+        usage(argv[0]);
+      }
+      args->checkpointName = argv[++i];
+    }
+    else if (strcmp(argv[i], "-n") == 0) {
+      args->isNoCache = true;
+    }
+    else if (strcmp(argv[i], "-g") == 0) {
+      args->isDebug = true;
+    }
+    else if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "-w") == 0) {
+      if (i + 1 == argc) {
+        fprintf(stderr, "missing spec for %s\n", argv[i]);
+        usage(argv[0]);
+      }
+      if (argv[i++][1] == 'b') args->numBreaks++; else args->numWatches++;
+    }
+    else if (strcmp(argv[i], "-o") == 0) {
+      if (i + 1 == argc) {
+        fprintf(stderr, "missing image file name for -o\n");
+        usage(argv[0]);
+      }
+      args->imageName = argv[++i];
+    }
     else if (argv[i][0] == '-' && !isdigit(argv[i][1])) {
       fprintf(stderr, "unknown option '%s'\n", argv[i]);
       usage(argv[0]);
@@ -117,19 +571,59 @@ first_pass_args(int argc, const char *argv[], Args *args)
       args->numFileNames++;
     }
   }
-  if (args->numFileNames == 0) {
+  if (args->numFileNames == 0 && args->fuzzCount == 0) {
     fprintf(stderr, "no files specified\n");
     usage(argv[0]);
   }
+  if ((args->inputSpec || args->lockstepName) && args->numParams > 0) {
+    fprintf(stderr, "cannot give both an input file and INT_INPUTS\n");
+    usage(argv[0]);
+  }
+  if (args->inputSpec && args->lockstepName) {
+    fprintf(stderr, "cannot give both -i or -I and -L\n");
+    usage(argv[0]);
+  }
+  if (args->traceName && (args->nCores > 1 || args->lockstepName)) {
+    fprintf(stderr, "cannot give -T with -c or -L\n");
+    usage(argv[0]);
+  }
+  const bool isDebug = args->isDebug || args->numBreaks > 0 ||
+    args->numWatches > 0 || args->snapshotInterval > 0;
+  if (isDebug && (args->nCores > 1 || args->lockstepName)) {
+    fprintf(stderr, "cannot give -g, -b, -w or -R with -c or -L\n");
+    usage(argv[0]);
+  }
+  if (args->checkpointName && (args->nCores > 1 || args->lockstepName)) {
+    fprintf(stderr, "cannot give -C with -c or -L\n");
+    usage(argv[0]);
+  }
+  if (args->checkpointName && (isDebug || args->traceName)) {
+    fprintf(stderr, "cannot checkpoint with -g, -b, -w, -R or -T\n");
+    usage(argv[0]);
+  }
 }
 
 static void
 second_pass_args(int argc, const char *argv[], Args *args)
 {
   args->numFileNames = args->numParams = 0;
+  args->numBreaks = args->numWatches = 0;
   for (int i = 1; i < argc; i++) {
     const char *arg = argv[i];
     if (arg[0] == '-' && !isdigit(arg[1])) {
+      if (strcmp(arg, "-b") == 0) {
+        args->breaks[args->numBreaks++] = argv[++i];
+      }
+      else if (strcmp(arg, "-w") == 0) {
+        args->watches[args->numWatches++] = argv[++i];
+      }
+      else if (strcmp(arg, "-m") == 0 || strcmp(arg, "-o") == 0 ||
+          strcmp(arg, "-c") == 0 || strcmp(arg, "-R") == 0 ||
+          strcmp(arg, "-L") == 0 || strcmp(arg, "-i") == 0 ||
+          strcmp(arg, "-I") == 0 || strcmp(arg, "-T") == 0 ||
+          strcmp(arg, "-C") == 0 || strcmp(arg, "-F") == 0) {
+        i++;  //skip value
+      }
       continue;
     }
     else if (isdigit(arg[0]) || (arg[0] == '-' && isdigit(arg[1]))) {
@@ -154,19 +648,57 @@ main(int argc, const char *argv[])
   }
   Args args;
   memset(&args, 0, sizeof(args));
+  args.nCores = 1;
   first_pass_args(argc, argv, &args);
   const char *fileNames[args.numFileNames];
   Word params[args.numParams];
+  const char *breaks[args.numBreaks];
+  const char *watches[args.numWatches];
   args.fileNames = fileNames; args.params = params;
+  args.breaks = breaks; args.watches = watches;
   second_pass_args(argc, argv, &args);
-  if (args.isList) {
+  if (args.fuzzCount > 0) {
+    return run_yfuzz(args.fuzzCount, args.nCores, args.fuzzSeed, stdout)
+      ? 0 : 1;
+  }
+  if (args.imageName) {
+    return write_yimage(args.imageName, args.numFileNames, args.fileNames)
+      ? 0 : 1;
+  }
+  if (args.isList && is_image_args(&args)) {
+    YImage *image = read_yimage(args.fileNames[0]);
+    if (image) {
+      write_listing_yimage(image, stdout);
+      free_yimage(image);
+    }
+  }
+  else if (args.isList) {
     yas_to_listing(stdout, args.numFileNames, args.fileNames);
   }
   else {
     Y86 *y86 = new_y86_default();
-    if (yas_to_y86(y86, args.numFileNames, args.fileNames)) {
-      simulate(&args, y86, stdout);
+    YDump *dump = new_ydump(y86);
+    YCache *cache = args.isNoCache ? NULL : new_ycache(NULL);
+    YMem *mem = load_program(&args, y86, cache);
+    if (mem && args.lockstepName) {
+      simulate_lockstep(&args, y86, mem, stdout);
+    }
+    else if (mem && args.nCores > 1) {
+      Y86 *cores[args.nCores];
+      cores[0] = y86;
+      for (int i = 1; i < args.nCores; i++) cores[i] = new_y86_default();
+      simulate_multicore(&args, cores, mem, stdout);
+      for (int i = 1; i < args.nCores; i++) free_y86(cores[i]);
+    }
+    else if (mem && args.traceName) {
+      simulate_traced(&args, y86, mem, dump, stdout);
+    }
+    else if (mem) {
+      simulate(&args, y86, mem, dump, stdout);
     }
+    if (mem) free_ymem(mem);
+    if (cache) free_ycache(cache);
+    free_ydump(dump);
     free_y86(y86);
   }
 }
@@ -0,0 +1,55 @@
+#!/bin/sh
+
+#assumes simulator in current directory
+
+#a test X.ys is run once for each line of options in X.args and the
+#output of all the runs, each after a "## OPTIONS" line and with
+#stderr and any non-zero exit status, is compared with X.out.  An
+#options line may redirect stdin, e.g. to feed debugger commands, and
+#may name files in $SCRATCH, a directory emptied before each test; a
+#line ending in # comments out X.ys, e.g. to run an image instead.
+#Assembled programs are cached in $SCRATCH/cache
+
+TMPDIR=$HOME/tmp
+mkdir -p $TMPDIR
+
+PRG=./y86-sim
+
+#run_args ARGS_FILE YS_FILE: run YS_FILE with each line of ARGS_FILE
+run_args() {
+    while read -r opts
+    do
+	echo "## $opts"
+	eval "$PRG $opts $2" < /dev/null 2>&1
+	status=$?
+	if [ $status -ne 0 ]
+	then
+	    echo "## exit $status"
+	fi
+    done < $1
+}
+
+for f in "$@"
+do
+    gold=`echo $f | sed -e 's/\.ys$/.out/'`
+    args=`echo $f | sed -e 's/\.ys$/.args/'`
+
+    if [ -e $gold ] && [ -e $args ]
+    then
+    	tmp=$TMPDIR/$(basename $gold)
+	SCRATCH=$TMPDIR/$(basename $f .ys).d
+	rm -rf $SCRATCH
+	mkdir -p $SCRATCH
+	export Y86_CACHE_DIR=$SCRATCH/cache
+	run_args $args $f | sed -e "s|$SCRATCH|\$SCRATCH|g" > $tmp
+	if diff $gold $tmp
+	then
+	    rm -f $tmp
+	else
+	    echo "*** $f failed; see output in $tmp"
+	fi
+	rm -rf $SCRATCH
+    else
+    	echo "no out or args file for $f"
+    fi
+done
@@ -0,0 +1,112 @@
+#include "yatomic.h"
+
+#include "ycc.h"
+
+/** Read the word at addr of mem, or of y86's own memory if mem is
+ *  NULL, setting the status of y86 to STATUS_ADR on failure.
+ */
+static Word
+read_word(Y86 *y86, YMem *mem, Address addr)
+{
+  if (!mem) return read_memory_word_y86(y86, addr);
+  Word word = 0;
+  if (!read_word_ymem(mem, addr, &word)) write_status_y86(y86, STATUS_ADR);
+  return word;
+}
+
+/** Write word to addr of y86's own memory or of mem as for read_word(). */
+static void
+write_word(Y86 *y86, YMem *mem, Address addr, Word word)
+{
+  if (!mem) {
+    write_memory_word_y86(y86, addr, word);
+  }
+  else if (!write_word_ymem(mem, addr, word)) {
+    write_status_y86(y86, STATUS_ADR);
+  }
+}
+
+/** Execute atomic function fn with register regA on the word at addr
+ *  of mem, or of y86's own memory if mem is NULL; the pc of y86 is
+ *  not changed.  Set the status of y86 to STATUS_ADR if addr is not
+ *  word-aligned or not accessible and to STATUS_INS if fn is not a
+ *  valid function.  Return a mask with bit r set iff register r was
+ *  written.
+ */
+unsigned
+exec_yatomic(Y86 *y86, YMem *mem, Byte fn, Register regA, Address addr)
+{
+  const Word valA = read_register_y86(y86, regA);
+  if (read_status_y86(y86) != STATUS_AOK) return 0;
+  unsigned changedRegs = 0;
+  bool isOk = true;
+  switch (fn) {
+  case XADDQ_FN: {
+    Word old = 0;
+    if (mem) {
+      isOk = fetch_add_word_ymem(mem, addr, valA, &old);
+    }
+    else if ((isOk = addr % sizeof(Word) == 0)) {
+      old = read_word(y86, mem, addr);
+      isOk = read_status_y86(y86) == STATUS_AOK;
+      if (isOk) write_word(y86, mem, addr, old + valA);
+    }
+    if (!isOk) break;
+    write_cc_y86(y86, add_arith_cc(old, valA, old + valA));
+    write_register_y86(y86, regA, old);
+    changedRegs |= 1u << regA;
+    break;
+  }
+  case CMPXCHGQ_FN: {
+    const Word rax = read_register_y86(y86, REG_RAX);
+    Word old = rax;
+    bool isSwapped = false;
+    if (mem) {
+      isOk = compare_swap_word_ymem(mem, addr, &old, valA, &isSwapped);
+    }
+    else if ((isOk = addr % sizeof(Word) == 0)) {
+      old = read_word(y86, mem, addr);
+      isOk = read_status_y86(y86) == STATUS_AOK;
+      isSwapped = isOk && old == rax;
+      if (isSwapped) write_word(y86, mem, addr, valA);
+    }
+    if (!isOk) break;
+    write_cc_y86(y86, sub_arith_cc(rax, old, rax - old));
+    if (!isSwapped) {
+      write_register_y86(y86, REG_RAX, old);
+      changedRegs |= 1u << REG_RAX;
+    }
+    break;
+  }
+  default:
+    write_status_y86(y86, STATUS_INS);
+    return 0;
+  }
+  if (!isOk) write_status_y86(y86, STATUS_ADR);
+  return changedRegs;
+}
+
+/** If the instruction at the pc of y86 is xaddq or cmpxchgq, execute
+ *  it on y86's own memory, advancing the pc unless it faults, and
+ *  return true.  Otherwise return false with y86 unchanged.
+ */
+bool
+step_yatomic(Y86 *y86)
+{
+  const Address pc = read_pc_y86(y86);
+  const Status status = read_status_y86(y86);
+  const Byte op = read_memory_byte_y86(y86, pc);
+  if (read_status_y86(y86) != status || (op >> 4) != YATOMIC_CODE) {
+    write_status_y86(y86, status);
+    return false;
+  }
+  const Byte regs = read_memory_byte_y86(y86, pc + 1);
+  const Word disp = read_memory_word_y86(y86, pc + 2);
+  if (read_status_y86(y86) != STATUS_AOK) return true;
+  const Word valB = read_register_y86(y86, regs & 0xF);
+  if (read_status_y86(y86) != STATUS_AOK) return true;
+  exec_yatomic(y86, NULL, op & 0xF, regs >> 4, valB + disp);
+  if (read_status_y86(y86) != STATUS_AOK) return true;
+  write_pc_y86(y86, pc + 2 + sizeof(Word));
+  return true;
+}
@@ -0,0 +1,40 @@
+#ifndef _YATOMIC_H
+#define _YATOMIC_H
+
+#include "y86.h"
+#include "ymem.h"
+
+#include <stdbool.h>
+
+/** Atomic read-modify-write instructions for multicore programs.
+ *  Both are encoded like rmmovq as C{fn} rA:rB D and operate on the
+ *  word-aligned word at D(rB):
+ *
+ *    xaddq rA, D(rB)     (fn 0): M += rA; rA = old M; cc as for addq.
+ *    cmpxchgq rA, D(rB)  (fn 1): if M == %rax then M = rA else
+ *                                %rax = M; cc as for %rax - M.
+ *
+ *  Shared by the instruction step of y86-sim (ysim.c) and by the
+ *  multicore timing model of stall-sim (prj5/mc-sim.c), whose
+ *  library step does not know these instructions.
+ */
+enum { YATOMIC_CODE = 0xC };
+enum { XADDQ_FN, CMPXCHGQ_FN };
+
+/** Execute atomic function fn with register regA on the word at addr
+ *  of mem, or of y86's own memory if mem is NULL; the pc of y86 is
+ *  not changed.  Set the status of y86 to STATUS_ADR if addr is not
+ *  word-aligned or not accessible and to STATUS_INS if fn is not a
+ *  valid function.  Return a mask with bit r set iff register r was
+ *  written.
+ */
+unsigned exec_yatomic(Y86 *y86, YMem *mem, Byte fn, Register regA,
+                      Address addr);
+
+/** If the instruction at the pc of y86 is xaddq or cmpxchgq, execute
+ *  it on y86's own memory, advancing the pc unless it faults, and
+ *  return true.  Otherwise return false with y86 unchanged.
+ */
+bool step_yatomic(Y86 *y86);
+
+#endif //ifndef _YATOMIC_H
@@ -0,0 +1,217 @@
+#define _DEFAULT_SOURCE   //for mkstemp()
+
+#include "ycache.h"
+
+#include "errors.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum { MAX_PATH = 4096 };
+
+typedef struct EntryStruct {
+  uint64_t hash;
+  YImage *image;
+  struct EntryStruct *succ;
+} Entry;
+
+struct YCacheStruct {
+  char *dirName;    //NULL if in-process only
+  Entry *entries;
+};
+
+/****************************** Hashing ********************************/
+
+/** 64-bit FNV-1a */
+static const uint64_t FNV_OFFSET = 0xcbf29ce484222325UL;
+static const uint64_t FNV_PRIME = 0x100000001b3UL;
+
+static uint64_t
+hash_bytes(uint64_t hash, const void *bytes, size_t n)
+{
+  const Byte *p = bytes;
+  for (size_t i = 0; i < n; i++) {
+    hash = (hash ^ p[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+/** Hash the identity of the assembler.  The assembler is linked into
+ *  the running executable, so any change to it shows up as a change
+ *  in the executable's size or modification time.
+ */
+static uint64_t
+hash_assembler(uint64_t hash)
+{
+  struct stat st;
+  if (stat("/proc/self/exe", &st) == 0) {
+    hash = hash_bytes(hash, &st.st_size, sizeof(st.st_size));
+    hash = hash_bytes(hash, &st.st_mtime, sizeof(st.st_mtime));
+  }
+  else {
+    hash = hash_bytes(hash, __DATE__ __TIME__, strlen(__DATE__ __TIME__));
+  }
+  return hash;
+}
+
+/** Set *hash to the cache key for fileNames[nFiles].  Return false if
+ *  a file cannot be read.
+ */
+static bool
+hash_program(int nFiles, const char *fileNames[], uint64_t *hash)
+{
+  uint64_t h = hash_assembler(FNV_OFFSET);
+  for (int i = 0; i < nFiles; i++) {
+    FILE *f = fopen(fileNames[i], "rb");
+    if (!f) return false;
+    Byte buf[4096];
+    uint64_t size = 0;
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+      h = hash_bytes(h, buf, n);
+      size += n;
+    }
+    fclose(f);
+    //separate files so moving text between them changes the key
+    h = hash_bytes(h, &size, sizeof(size));
+  }
+  *hash = h;
+  return true;
+}
+
+/********************** Allocation / Deallocation **********************/
+
+/** Create dirName and any missing parents; return true iff dirName
+ *  then exists.
+ */
+static bool
+make_dirs(const char *dirName)
+{
+  char path[MAX_PATH];
+  if (strlen(dirName) >= sizeof(path)) return false;
+  strcpy(path, dirName);
+  for (char *p = path + 1; *p != '\0'; p++) {
+    if (*p == '/') {
+      *p = '\0';
+      if (mkdir(path, 0777) != 0 && errno != EEXIST) return false;
+      *p = '/';
+    }
+  }
+  return mkdir(path, 0777) == 0 || errno == EEXIST;
+}
+
+/** Return a new cache which keeps its images in directory dirName,
+ *  creating it if necessary.  If dirName is NULL, use $Y86_CACHE_DIR
+ *  if set, else $HOME/.cache/y86.  If the directory is unusable, the
+ *  cache is in-process only.
+ */
+YCache *
+new_ycache(const char *dirName)
+{
+  YCache *cache = calloc(1, sizeof(struct YCacheStruct));
+  if (!cache) fatal("out of memory\n");
+  char path[MAX_PATH];
+  const char *home = getenv("HOME");
+  if (!dirName) dirName = getenv("Y86_CACHE_DIR");
+  if (!dirName && home) {
+    snprintf(path, sizeof(path), "%s/.cache/y86", home);
+    dirName = path;
+  }
+  if (dirName && make_dirs(dirName)) {
+    cache->dirName = strdup(dirName);
+  }
+  return cache;
+}
+
+/** Free all resources allocated by new_ycache() in cache, including
+ *  all images returned by get_ycache().
+ */
+void
+free_ycache(YCache *cache)
+{
+  Entry *succ;
+  for (Entry *p = cache->entries; p != NULL; p = succ) {
+    succ = p->succ;
+    free_yimage(p->image);
+    free(p);
+  }
+  free(cache->dirName);
+  free(cache);
+}
+
+/***************************** Lookup **********************************/
+
+/** Assemble fileNames[nFiles] into a new image, storing it under hash
+ *  in cache's directory if it has one.  Return NULL on error.
+ */
+static YImage *
+assemble_image(YCache *cache, uint64_t hash,
+               int nFiles, const char *fileNames[])
+{
+  char tmpName[MAX_PATH];
+  int fd;
+  if (cache->dirName) {
+    snprintf(tmpName, sizeof(tmpName), "%s/%016lx.%ld.tmp",
+             cache->dirName, hash, (long)getpid());
+    fd = -1;
+  }
+  else {
+    snprintf(tmpName, sizeof(tmpName), "/tmp/y86-XXXXXX");
+    if ((fd = mkstemp(tmpName)) < 0) return NULL;
+  }
+  YImage *image = NULL;
+  if (write_yimage(tmpName, nFiles, fileNames)) {
+    char path[MAX_PATH];
+    if (cache->dirName) {
+      snprintf(path, sizeof(path), "%s/%016lx.yimg", cache->dirName, hash);
+    }
+    //rename() atomically publishes the image to concurrent runs
+    if (cache->dirName && rename(tmpName, path) == 0) {
+      image = read_yimage(path);
+    }
+    else {
+      image = read_yimage(tmpName);
+    }
+  }
+  unlink(tmpName);
+  if (fd >= 0) close(fd);
+  return image;
+}
+
+/** Return the image of the program assembled from fileNames[nFiles],
+ *  assembling and caching it only if it is not already cached.
+ *  Return NULL if the program cannot be read or assembled.  The
+ *  returned image is owned by cache.
+ */
+const YImage *
+get_ycache(YCache *cache, int nFiles, const char *fileNames[])
+{
+  uint64_t hash;
+  if (!hash_program(nFiles, fileNames, &hash)) {
+    fprintf(stderr, "cannot read program files\n");
+    return NULL;
+  }
+  for (Entry *p = cache->entries; p != NULL; p = p->succ) {
+    if (p->hash == hash) return p->image;
+  }
+  YImage *image = NULL;
+  if (cache->dirName) {
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), "%s/%016lx.yimg", cache->dirName, hash);
+    if (access(path, R_OK) == 0) image = read_yimage(path);
+  }
+  if (!image) image = assemble_image(cache, hash, nFiles, fileNames);
+  if (!image) return NULL;
+  Entry *entry = malloc(sizeof(Entry));
+  if (!entry) fatal("out of memory\n");
+  entry->hash = hash;
+  entry->image = image;
+  entry->succ = cache->entries;
+  cache->entries = entry;
+  return image;
+}
@@ -0,0 +1,33 @@
+#ifndef _YCACHE_H
+#define _YCACHE_H
+
+#include "yimage.h"
+
+/** A cache of assembled program images keyed on a hash of the
+ *  contents of the assembler sources and of the assembler version.
+ *  Images are kept both on disk, so that later runs can skip
+ *  assembly, and in-process, so that a run which loads the same
+ *  sources several times only maps them once.
+ */
+typedef struct YCacheStruct YCache;
+
+/** Return a new cache which keeps its images in directory dirName,
+ *  creating it if necessary.  If dirName is NULL, use $Y86_CACHE_DIR
+ *  if set, else $HOME/.cache/y86.  If the directory is unusable, the
+ *  cache is in-process only.
+ */
+YCache *new_ycache(const char *dirName);
+
+/** Free all resources allocated by new_ycache() in cache, including
+ *  all images returned by get_ycache().
+ */
+void free_ycache(YCache *cache);
+
+/** Return the image of the program assembled from fileNames[nFiles],
+ *  assembling and caching it only if it is not already cached.
+ *  Return NULL if the program cannot be read or assembled.  The
+ *  returned image is owned by cache.
+ */
+const YImage *get_ycache(YCache *cache, int nFiles, const char *fileNames[]);
+
+#endif //ifndef _YCACHE_H
@@ -0,0 +1,114 @@
+#ifndef _YCC_H
+#define _YCC_H
+
+#include "y86.h"
+
+#include <limits.h>
+#include <stdbool.h>
+
+/** Condition codes of the Y86 as pure functions of their operands, so
+ *  that the instruction step (ysim.c) and the loop kernel (yloop.c),
+ *  which keeps registers and condition codes outside the Y86, compute
+ *  identical flags.
+ */
+
+/** Conditions used in instructions */
+typedef enum {
+  ALWAYS_COND, LE_COND, LT_COND, EQ_COND, NE_COND, GE_COND, GT_COND
+} Condition;
+
+/** accessing condition code flags */
+static inline bool get_cc_flag(Byte cc, unsigned flagBitIndex) {
+  return !!(cc & (1 << flagBitIndex));
+}
+static inline bool get_zf(Byte cc) { return get_cc_flag(cc, ZF_CC); }
+static inline bool get_sf(Byte cc) { return get_cc_flag(cc, SF_CC); }
+static inline bool get_of(Byte cc) { return get_cc_flag(cc, OF_CC); }
+
+/** Return true iff condition, which must be at most GT_COND, holds
+ *  for condition codes cc.  Encoding of Figure 3.15 of Bryant's
+ *  CompSys3e.
+ */
+static inline bool
+holds_cc(Byte cc, Condition condition)
+{
+  bool ret = false;
+  switch (condition) {
+  case ALWAYS_COND:
+    ret = true;
+    break;
+  case LE_COND:
+    ret = (get_sf(cc) ^ get_of(cc)) | get_zf(cc);
+    break;
+  case LT_COND:
+    ret = (get_sf(cc) ^ get_of(cc));
+    break;
+  case EQ_COND:
+    ret = get_zf(cc);
+    break;
+  case NE_COND:
+    ret = !get_zf(cc);
+    break;
+  case GE_COND:
+    ret = !(get_sf(cc) ^ get_of(cc));
+    break;
+  case GT_COND:
+    ret = (!(get_sf(cc) ^ get_of(cc)) & !get_zf(cc));
+    break;
+  }
+  return ret;
+}
+
+/** return true iff word has its sign bit set */
+static inline bool
+isLt0(Word word) {
+  return (word & (1UL << (sizeof(Word)*CHAR_BIT - 1))) != 0;
+}
+
+/** Return condition codes for addition operation with operands opA,
+ *  opB and result with result == opA + opB.
+ */
+static inline Byte
+add_arith_cc(Word opA, Word opB, Word result)
+{
+  Byte cc = 0;
+  if(result == 0) cc |= 4; //set ZF if result is 0
+  if(isLt0(result)) cc |= 2; //set SF if result is negative
+  if(isLt0(opA) && isLt0(opB)){ //if opA and opB are both negative...
+    if(!isLt0(result)) cc |= 1; //set OF if result is positive
+  }
+  if(!isLt0(opA) && !isLt0(opB)){ //if opA and opB are both positive...
+    if(isLt0(result)) cc |= 1; //set OF if result is negative
+  }
+  return cc;
+}
+
+/** Return condition codes for subtraction operation with operands
+ *  opA, opB and result with result == opA - opB.
+ */
+static inline Byte
+sub_arith_cc(Word opA, Word opB, Word result)
+{
+  Byte cc = 0;
+  if(result == 0) cc |= 4; //set ZF if result is 0
+  if(isLt0(result)) cc |= 2; //set SF if result is negative
+  if(!isLt0(opA) && isLt0(opB)){ //if opA is positive and opB is negative...
+    if(isLt0(result)) cc |= 1; //set OF is result is negative
+  }
+  if(isLt0(opA) && !isLt0(opB)){ //if opA is negative and opB is positive...
+    if(!isLt0(result)) cc |= 1; //set OF if result is positive
+  }
+  return cc;
+}
+
+/** Return condition codes for logical operation with result. */
+static inline Byte
+logic_op_cc(Word result)
+{
+  Byte cc = 0;
+  if(result == 0) cc |= 4; //set ZF if result is 0
+  if(isLt0(result)) cc |= 2; //set SF if result is negative
+  return cc;
+}
+
+#endif //ifndef _YCC_H
@@ -0,0 +1,529 @@
+#define _DEFAULT_SOURCE   //for MAP_ANONYMOUS and MAP_NORESERVE
+
+#include "ydebug.h"
+#include "yhistory.h"
+#include "yregs.h"
+
+#include "errors.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+typedef enum { NO_CMP, EQ_CMP, NE_CMP, LE_CMP, LT_CMP, GE_CMP, GT_CMP } Cmp;
+
+static const char *cmps[] = { "", "==", "!=", "<=", "<", ">=", ">" };
+
+enum { N_REGS = sizeof(regNames)/sizeof(regNames[0]) };
+
+typedef struct {
+  Address pc;
+  Cmp cmp;           //NO_CMP for an unconditional breakpoint
+  Register reg;
+  Word value;
+} Breakpoint;
+
+typedef struct {
+  Address addr;      //word-aligned
+  size_t nWords;
+  Word *last;        //contents when last checked
+  Word *prev;        //contents before the last change
+  bool isChanged;
+} Watchpoint;
+
+struct YDebugStruct {
+  Y86 *y86;
+  YMem *mem;
+  uint64_t *breakBits;   //bit pc set iff there is a breakpoint at pc
+  size_t breakBitsSize;
+  Breakpoint *breaks;
+  int nBreaks, maxBreaks;
+  Watchpoint *watches;
+  int nWatches, maxWatches;
+  bool isStop;           //stop at next check
+  long nSteps;           //stop after this many more checks; 0 if none
+  YHistory *history;     //NULL unless reverse execution is enabled
+};
+
+/********************** Allocation / Deallocation **********************/
+
+/** Create a new debugger for y86 running with memory mem. */
+YDebug *
+new_ydebug(Y86 *y86, YMem *mem)
+{
+  YDebug *debug = calloc(1, sizeof(struct YDebugStruct));
+  if (!debug) fatal("out of memory\n");
+  debug->y86 = y86;
+  debug->mem = mem;
+  //one bit per address; sparse, like mem itself
+  debug->breakBitsSize = (get_size_ymem(mem) / 64 + 1) * sizeof(uint64_t);
+  debug->breakBits = mmap(NULL, debug->breakBitsSize, PROT_READ|PROT_WRITE,
+                          MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+  if (debug->breakBits == MAP_FAILED) fatal("cannot map breakpoints\n");
+  return debug;
+}
+
+/** Free all resources allocated by new_ydebug() in debug. */
+void
+free_ydebug(YDebug *debug)
+{
+  if (debug->history) free_yhistory(debug->history);
+  if (debug->nWatches > 0) clear_watches_ymem(debug->mem);
+  for (int i = 0; i < debug->nWatches; i++) {
+    free(debug->watches[i].last);
+    free(debug->watches[i].prev);
+  }
+  free(debug->watches);
+  free(debug->breaks);
+  munmap(debug->breakBits, debug->breakBitsSize);
+  free(debug);
+}
+
+/** Record execution history so that the prompt's rs (reverse-step)
+ *  and rc (reverse-continue) commands can go back up to
+ *  interval * maxSnapshots instructions; see yhistory.h.
+ */
+void
+enable_reverse_ydebug(YDebug *debug, long interval, int maxSnapshots)
+{
+  if (!debug->history) {
+    debug->history = new_yhistory(debug->y86, debug->mem,
+                                  interval, maxSnapshots);
+  }
+}
+
+/** Make the next call to check_ydebug() stop. */
+void
+stop_ydebug(YDebug *debug)
+{
+  debug->isStop = true;
+}
+
+/***************************** Breakpoints *****************************/
+
+static inline bool
+has_break(const YDebug *debug, Address pc)
+{
+  return pc / 64 < debug->breakBitsSize / sizeof(uint64_t) &&
+    ((debug->breakBits[pc / 64] >> (pc % 64)) & 1);
+}
+
+static void
+set_break_bit(YDebug *debug, Address pc, bool isSet)
+{
+  if (isSet) {
+    debug->breakBits[pc / 64] |= 1UL << (pc % 64);
+  }
+  else {
+    debug->breakBits[pc / 64] &= ~(1UL << (pc % 64));
+  }
+}
+
+/** Parse a register name (with optional leading %) at *p, advancing
+ *  *p past it.  Return N_REGS if there is none.
+ */
+static int
+parse_reg(const char **p)
+{
+  if (**p == '%') (*p)++;
+  for (int i = N_REGS - 1; i >= 0; i--) {  //r1x before r1
+    const size_t n = strlen(regNames[i]);
+    if (strncmp(*p, regNames[i], n) == 0) {
+      *p += n;
+      return i;
+    }
+  }
+  return N_REGS;
+}
+
+/** Add the breakpoint specified by spec.  Return false if spec is
+ *  invalid.
+ */
+bool
+add_break_ydebug(YDebug *debug, const char *spec)
+{
+  Breakpoint bp = { .cmp = NO_CMP };
+  char *end;
+  bp.pc = strtoul(spec, &end, 0);
+  if (end == spec || bp.pc >= get_size_ymem(debug->mem)) return false;
+  if (*end == ':') {
+    const char *p = end + 1;
+    const int reg = parse_reg(&p);
+    if (reg == N_REGS) return false;
+    bp.reg = reg;
+    for (Cmp c = EQ_CMP; c <= GT_CMP; c++) {
+      //two-character comparisons precede their one-character prefixes
+      if (strncmp(p, cmps[c], strlen(cmps[c])) == 0) {
+        bp.cmp = c;
+        p += strlen(cmps[c]);
+        break;
+      }
+    }
+    if (bp.cmp == NO_CMP) return false;
+    bp.value = strtol(p, &end, 0);
+    if (end == p) return false;
+  }
+  if (*end != '\0' && !isspace(*end)) return false;
+  if (debug->nBreaks == debug->maxBreaks) {
+    debug->maxBreaks = debug->maxBreaks ? 2 * debug->maxBreaks : 8;
+    debug->breaks =
+      realloc(debug->breaks, debug->maxBreaks * sizeof(Breakpoint));
+    if (!debug->breaks) fatal("out of memory\n");
+  }
+  debug->breaks[debug->nBreaks++] = bp;
+  set_break_bit(debug, bp.pc, true);
+  return true;
+}
+
+/** Delete all breakpoints at pc; return # deleted. */
+static int
+delete_breaks(YDebug *debug, Address pc)
+{
+  int n = 0;
+  for (int i = 0; i < debug->nBreaks; i++) {
+    if (debug->breaks[i].pc != pc) debug->breaks[n++] = debug->breaks[i];
+  }
+  const int nDeleted = debug->nBreaks - n;
+  debug->nBreaks = n;
+  if (has_break(debug, pc)) set_break_bit(debug, pc, false);
+  return nDeleted;
+}
+
+static bool
+holds(const YDebug *debug, const Breakpoint *bp)
+{
+  const int64_t v = read_register_y86(debug->y86, bp->reg);
+  const int64_t w = bp->value;
+  switch (bp->cmp) {
+  case NO_CMP: return true;
+  case EQ_CMP: return v == w;
+  case NE_CMP: return v != w;
+  case LE_CMP: return v <= w;
+  case LT_CMP: return v < w;
+  case GE_CMP: return v >= w;
+  case GT_CMP: return v > w;
+  }
+  return false;
+}
+
+/** Return the first breakpoint at pc whose condition holds; NULL if
+ *  there is none.
+ */
+static const Breakpoint *
+triggered_break(const YDebug *debug, Address pc)
+{
+  for (int i = 0; i < debug->nBreaks; i++) {
+    const Breakpoint *bp = &debug->breaks[i];
+    if (bp->pc == pc && holds(debug, bp)) return bp;
+  }
+  return NULL;
+}
+
+static void
+print_break(const Breakpoint *bp, FILE *out)
+{
+  fprintf(out, "breakpoint at %08lx", bp->pc);
+  if (bp->cmp != NO_CMP) {
+    fprintf(out, " if %%%s %s %ld",
+            regNames[bp->reg], cmps[bp->cmp], (long)bp->value);
+  }
+  fprintf(out, "\n");
+}
+
+/***************************** Watchpoints *****************************/
+
+static void
+read_watch(const YDebug *debug, const Watchpoint *wp, Word words[])
+{
+  for (size_t i = 0; i < wp->nWords; i++) {
+    words[i] = 0;
+    read_word_ymem(debug->mem, wp->addr + i * sizeof(Word), &words[i]);
+  }
+}
+
+/** YMemWatchFn: called after a write to a watched page. */
+static void
+on_watched_write(void *ctx, Address addr, size_t size)
+{
+  YDebug *debug = ctx;
+  for (int i = 0; i < debug->nWatches; i++) {
+    Watchpoint *wp = &debug->watches[i];
+    if (addr >= wp->addr + wp->nWords * sizeof(Word) ||
+        addr + size <= wp->addr) {
+      continue;
+    }
+    Word current[wp->nWords];
+    read_watch(debug, wp, current);
+    if (memcmp(current, wp->last, wp->nWords * sizeof(Word)) != 0) {
+      memcpy(wp->prev, wp->last, wp->nWords * sizeof(Word));
+      memcpy(wp->last, current, wp->nWords * sizeof(Word));
+      wp->isChanged = true;
+      debug->isStop = true;
+    }
+  }
+}
+
+/** Add the watchpoint specified by spec.  Return false if spec is
+ *  invalid.
+ */
+bool
+add_watch_ydebug(YDebug *debug, const char *spec)
+{
+  char *end;
+  Address addr = strtoul(spec, &end, 0);
+  size_t size = sizeof(Word);
+  if (end == spec) return false;
+  if (*end == ':') {
+    const char *p = end + 1;
+    size = strtoul(p, &end, 0);
+    if (end == p || size == 0) return false;
+  }
+  if (*end != '\0' && !isspace(*end)) return false;
+  const Address memSize = get_size_ymem(debug->mem);
+  if (addr >= memSize || size > memSize - addr) return false;
+  Watchpoint wp;
+  wp.addr = addr / sizeof(Word) * sizeof(Word);
+  wp.nWords = (addr + size - wp.addr + sizeof(Word) - 1) / sizeof(Word);
+  wp.last = malloc(wp.nWords * sizeof(Word));
+  wp.prev = malloc(wp.nWords * sizeof(Word));
+  if (!wp.last || !wp.prev) fatal("out of memory\n");
+  read_watch(debug, &wp, wp.last);
+  wp.isChanged = false;
+  if (debug->nWatches == debug->maxWatches) {
+    debug->maxWatches = debug->maxWatches ? 2 * debug->maxWatches : 8;
+    debug->watches =
+      realloc(debug->watches, debug->maxWatches * sizeof(Watchpoint));
+    if (!debug->watches) fatal("out of memory\n");
+  }
+  debug->watches[debug->nWatches++] = wp;
+  watch_ymem(debug->mem, wp.addr, wp.nWords * sizeof(Word),
+             on_watched_write, debug);
+  return true;
+}
+
+static void
+report_watches(YDebug *debug, FILE *out)
+{
+  for (int i = 0; i < debug->nWatches; i++) {
+    Watchpoint *wp = &debug->watches[i];
+    if (!wp->isChanged) continue;
+    for (size_t j = 0; j < wp->nWords; j++) {
+      if (wp->prev[j] != wp->last[j]) {
+        fprintf(out, "watchpoint W[%08lx]: %016lx -> %016lx\n",
+                wp->addr + j * sizeof(Word), wp->prev[j], wp->last[j]);
+      }
+    }
+    wp->isChanged = false;
+  }
+}
+
+/** Make the current contents of all watched locations their last
+ *  values, forgetting any changes made by going back in history.
+ */
+static void
+sync_watches(YDebug *debug)
+{
+  for (int i = 0; i < debug->nWatches; i++) {
+    Watchpoint *wp = &debug->watches[i];
+    read_watch(debug, wp, wp->last);
+    wp->isChanged = false;
+  }
+  debug->isStop = false;
+}
+
+/************************** Reverse Execution **************************/
+
+/** YHistoryStopFn: true iff a forward run would stop before the
+ *  current instruction.
+ */
+static bool
+is_stop_point(void *ctx)
+{
+  YDebug *debug = ctx;
+  const Address pc = read_pc_y86(debug->y86);
+  const bool isWatchHit = debug->isStop;
+  sync_watches(debug);
+  return isWatchHit || (has_break(debug, pc) && triggered_break(debug, pc));
+}
+
+/** Go back n instructions, or to the start of the history. */
+static void
+reverse_step(YDebug *debug, long n, FILE *out)
+{
+  YHistory *history = debug->history;
+  const long step = get_step_yhistory(history) - n;
+  const long first = get_first_step_yhistory(history);
+  goto_yhistory(history, (step > first) ? step : first);
+  sync_watches(debug);
+  if (step < first) fprintf(out, "reached start of history\n");
+}
+
+/** Go back to the most recent instruction at which a forward run would
+ *  have stopped, or to the start of the history.
+ */
+static void
+reverse_continue(YDebug *debug, FILE *out)
+{
+  YHistory *history = debug->history;
+  const long step = get_step_yhistory(history);
+  const long first = get_first_step_yhistory(history);
+  goto_yhistory(history, first);
+  sync_watches(debug);
+  const long found = find_yhistory(history, step, is_stop_point, debug);
+  goto_yhistory(history, (found >= 0) ? found : first);
+  sync_watches(debug);
+  if (found < 0) fprintf(out, "reached start of history\n");
+}
+
+/****************************** Commands *******************************/
+
+static void
+print_regs(const YDebug *debug, FILE *out)
+{
+  for (int i = 0; i < N_REGS; i++) {
+    fprintf(out, "%3s: %016lx\n", regNames[i],
+            read_register_y86(debug->y86, i));
+  }
+  const Byte cc = read_cc_y86(debug->y86);
+  fprintf(out, " pc: %016lx\n", read_pc_y86(debug->y86));
+  fprintf(out, "cc: Z=%d S=%d O=%d\n", (cc >> ZF_CC) & 1,
+          (cc >> SF_CC) & 1, (cc >> OF_CC) & 1);
+}
+
+static void
+print_words(const YDebug *debug, Address addr, long n, FILE *out)
+{
+  for (long i = 0; i < n; i++, addr += sizeof(Word)) {
+    Word word;
+    if (!read_word_ymem(debug->mem, addr, &word)) {
+      fprintf(out, "bad address %08lx\n", addr);
+      break;
+    }
+    fprintf(out, "W[%08lx]: %016lx\n", addr, word);
+  }
+}
+
+static void
+print_points(const YDebug *debug, FILE *out)
+{
+  for (int i = 0; i < debug->nBreaks; i++) {
+    print_break(&debug->breaks[i], out);
+  }
+  for (int i = 0; i < debug->nWatches; i++) {
+    const Watchpoint *wp = &debug->watches[i];
+    fprintf(out, "watchpoint at %08lx:%zu\n",
+            wp->addr, wp->nWords * sizeof(Word));
+  }
+}
+
+static void
+help(FILE *out)
+{
+  fprintf(out,
+          "  c            continue\n"
+          "  s [N]        step N instructions (default 1; also empty line)\n"
+          "  b ADDR[:REG OP VALUE]  set (conditional) breakpoint\n"
+          "  d ADDR       delete breakpoints at ADDR\n"
+          "  w ADDR[:LEN] watch LEN bytes (default 8) for changes\n"
+          "  i            list breakpoints and watchpoints\n"
+          "  r            print registers\n"
+          "  x ADDR [N]   print N words (default 1) at ADDR\n"
+          "  rs [N]       reverse-step N instructions (default 1)\n"
+          "  rc           reverse-continue to previous stop\n"
+          "  q            quit\n");
+}
+
+/** Read and execute commands from in until the user continues;
+ *  return false iff the user quits.
+ */
+static bool
+prompt(YDebug *debug, FILE *in, FILE *out)
+{
+  for (;;) {
+    char line[256], cmd[16] = "", arg1[128] = "", arg2[128] = "";
+    fprintf(out, "(ydb) ");
+    fflush(out);
+    if (!fgets(line, sizeof(line), in)) return false;
+    sscanf(line, "%15s %127s %127s", cmd, arg1, arg2);
+    if (strcmp(cmd, "rs") == 0 || strcmp(cmd, "rc") == 0) {
+      if (!debug->history) {
+        fprintf(out, "reverse execution not enabled\n");
+      }
+      else if (cmd[1] == 's') {
+        long n = (arg1[0] != '\0') ? strtol(arg1, NULL, 0) : 1;
+        reverse_step(debug, (n > 0) ? n : 1, out);
+      }
+      else {
+        reverse_continue(debug, out);
+      }
+      fprintf(out, "pc: %08lx\n", read_pc_y86(debug->y86));
+      continue;
+    }
+    switch (cmd[0]) {
+    case '\0':
+      debug->nSteps = 1;
+      return true;
+    case 'c':
+      return true;
+    case 's': {
+      long n = (arg1[0] != '\0') ? strtol(arg1, NULL, 0) : 1;
+      debug->nSteps = (n > 0) ? n : 1;
+      return true;
+    }
+    case 'b':
+      if (!add_break_ydebug(debug, arg1)) fprintf(out, "bad breakpoint\n");
+      break;
+    case 'd':
+      fprintf(out, "deleted %d breakpoint(s)\n",
+              delete_breaks(debug, strtoul(arg1, NULL, 0)));
+      break;
+    case 'w':
+      if (!add_watch_ydebug(debug, arg1)) fprintf(out, "bad watchpoint\n");
+      break;
+    case 'i':
+      print_points(debug, out);
+      break;
+    case 'r':
+      print_regs(debug, out);
+      break;
+    case 'x': {
+      long n = (arg2[0] != '\0') ? strtol(arg2, NULL, 0) : 1;
+      print_words(debug, strtoul(arg1, NULL, 0), n, out);
+      break;
+    }
+    case 'q':
+      return false;
+    default:
+      help(out);
+      break;
+    }
+  }
+}
+
+/** Must be called before each instruction is executed.  If there is a
+ *  breakpoint at the pc whose condition holds, a watched location was
+ *  changed by the previous instruction or a stop has been requested,
+ *  report why on out and read commands from in until the user
+ *  continues.  Return false iff the user asked to quit.
+ */
+bool
+check_ydebug(YDebug *debug, FILE *in, FILE *out)
+{
+  const Address pc = read_pc_y86(debug->y86);
+  bool isStop = debug->isStop;
+  if (debug->nSteps > 0 && --debug->nSteps == 0) isStop = true;
+  const Breakpoint *bp = has_break(debug, pc) ? triggered_break(debug, pc) : NULL;
+  bool isContinuing = true;
+  if (isStop || bp) {
+    debug->isStop = false;
+    debug->nSteps = 0;
+    report_watches(debug, out);
+    if (bp) print_break(bp, out);
+    fprintf(out, "pc: %08lx\n", pc);
+    isContinuing = prompt(debug, in, out);
+  }
+  if (isContinuing && debug->history) record_yhistory(debug->history);
+  return isContinuing;
+}
@@ -0,0 +1,56 @@
+#ifndef _YDEBUG_H
+#define _YDEBUG_H
+
+#include "y86.h"
+#include "ymem.h"
+
+#include <stdio.h>
+
+/** Breakpoints, conditional breakpoints and memory watchpoints for a
+ *  y86 running with memory mem.  Breakpoints are kept in a bitmap
+ *  indexed by pc and watchpoints in mem's per-page watch bitmap, so
+ *  checking them costs a bit test per instruction and per write to
+ *  a watched page.  A command prompt is only entered when one of
+ *  them triggers.
+ *
+ *  Breakpoint specs have the form ADDR[:REG OP VALUE] where OP is one
+ *  of == != < <= > >= (signed comparison), e.g. 0x77:%rax==5.
+ *  Watchpoint specs have the form ADDR[:LEN] and watch LEN bytes
+ *  (default 8) for changes.
+ */
+typedef struct YDebugStruct YDebug;
+
+/** Create a new debugger for y86 running with memory mem. */
+YDebug *new_ydebug(Y86 *y86, YMem *mem);
+
+/** Free all resources allocated by new_ydebug() in debug. */
+void free_ydebug(YDebug *debug);
+
+/** Add the breakpoint specified by spec.  Return false if spec is
+ *  invalid.
+ */
+bool add_break_ydebug(YDebug *debug, const char *spec);
+
+/** Add the watchpoint specified by spec.  Return false if spec is
+ *  invalid.
+ */
+bool add_watch_ydebug(YDebug *debug, const char *spec);
+
+/** Record execution history so that the prompt's rs (reverse-step)
+ *  and rc (reverse-continue) commands can go back up to
+ *  interval * maxSnapshots instructions; see yhistory.h.
+ */
+void enable_reverse_ydebug(YDebug *debug, long interval, int maxSnapshots);
+
+/** Make the next call to check_ydebug() stop. */
+void stop_ydebug(YDebug *debug);
+
+/** Must be called before each instruction is executed.  If there is a
+ *  breakpoint at the pc whose condition holds, a watched location was
+ *  changed by the previous instruction or a stop has been requested,
+ *  report why on out and read commands from in until the user
+ *  continues.  Return false iff the user asked to quit.
+ */
+bool check_ydebug(YDebug *debug, FILE *in, FILE *out);
+
+#endif //ifndef _YDEBUG_H
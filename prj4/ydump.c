@@ -0,0 +1,87 @@
+#include "ydump.h"
+
+#include "yregs.h"
+
+#include "errors.h"
+
+#include <stdlib.h>
+
+static const char *statusNames[] = { "AOK", "HLT", "ADR", "INS" };
+
+struct YDumpStruct {
+  Y86 *y86;
+  Word regs[REG_NONE];   //values at previous dump
+  Address pc;
+  Status status;
+  Byte cc;
+  unsigned marked;       //registers possibly written since previous dump
+};
+
+/** Create a new dumper for y86 whose current state is the baseline
+ *  for the first dump.  All registers start out marked.
+ */
+YDump *
+new_ydump(Y86 *y86)
+{
+  YDump *dump = calloc(1, sizeof(struct YDumpStruct));
+  if (!dump) fatal("out of memory\n");
+  dump->y86 = y86;
+  for (Register r = REG_RAX; r < REG_NONE; r++) {
+    dump->regs[r] = read_register_y86(y86, r);
+  }
+  dump->pc = read_pc_y86(y86);
+  dump->status = read_status_y86(y86);
+  dump->cc = read_cc_y86(y86);
+  dump->marked = ~0u;
+  return dump;
+}
+
+/** Free all resources allocated by new_ydump() in dump. */
+void
+free_ydump(YDump *dump)
+{
+  free(dump);
+}
+
+/** Mark the registers with their bit set in regMask (as returned by
+ *  step_ysim_mem()) as possibly written since the previous dump.
+ */
+void
+mark_ydump(YDump *dump, unsigned regMask)
+{
+  dump->marked |= regMask;
+}
+
+/** Print the marked registers which have changed since the previous
+ *  dump, followed by the pc, status and cc if they have changed.  If
+ *  isVerbose, print all of them.
+ */
+void
+dump_changes_ydump(YDump *dump, bool isVerbose, FILE *out)
+{
+  Y86 *y86 = dump->y86;
+  const unsigned marked = isVerbose ? ~0u : dump->marked;
+  for (Register r = REG_RAX; r < REG_NONE; r++) {
+    if (!((marked >> r) & 1)) continue;
+    const Word value = read_register_y86(y86, r);
+    if (isVerbose || value != dump->regs[r]) {
+      fprintf(out, "%3s: %016lx\n", regNames[r], value);
+    }
+    dump->regs[r] = value;
+  }
+  dump->marked = 0;
+  const Address pc = read_pc_y86(y86);
+  if (isVerbose || pc != dump->pc) fprintf(out, " pc: %016lx\n", pc);
+  dump->pc = pc;
+  const Status status = read_status_y86(y86);
+  if (isVerbose || status != dump->status) {
+    fprintf(out, "status: %s\n", statusNames[status]);
+  }
+  dump->status = status;
+  const Byte cc = read_cc_y86(y86);
+  if (isVerbose || cc != dump->cc) {
+    fprintf(out, "cc: Z=%d S=%d O=%d\n", (cc >> ZF_CC) & 1,
+            (cc >> SF_CC) & 1, (cc >> OF_CC) & 1);
+  }
+  dump->cc = cc;
+}
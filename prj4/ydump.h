@@ -0,0 +1,35 @@
+#ifndef _YDUMP_H
+#define _YDUMP_H
+
+#include "y86.h"
+
+#include <stdio.h>
+
+/** Change dumps of the registers, pc, status and cc of a y86 in the
+ *  same format as dump_changes_y86(), but without scanning y86's own
+ *  memory (memory changes are dumped by dump_changes_ymem()).  Only
+ *  registers marked as possibly written are compared with their
+ *  values at the previous dump.
+ */
+typedef struct YDumpStruct YDump;
+
+/** Create a new dumper for y86 whose current state is the baseline
+ *  for the first dump.  All registers start out marked.
+ */
+YDump *new_ydump(Y86 *y86);
+
+/** Free all resources allocated by new_ydump() in dump. */
+void free_ydump(YDump *dump);
+
+/** Mark the registers with their bit set in regMask (as returned by
+ *  step_ysim_mem()) as possibly written since the previous dump.
+ */
+void mark_ydump(YDump *dump, unsigned regMask);
+
+/** Print the marked registers which have changed since the previous
+ *  dump, followed by the pc, status and cc if they have changed.  If
+ *  isVerbose, print all of them.
+ */
+void dump_changes_ydump(YDump *dump, bool isVerbose, FILE *out);
+
+#endif //ifndef _YDUMP_H
@@ -0,0 +1,531 @@
+#include "yfuzz.h"
+
+#include "yinsn.h"
+#include "ylockstep.h"
+#include "yloop.h"
+#include "ysim.h"
+#include "yverify.h"
+
+#include "errors.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+  MAX_FUZZ_INSNS = 32,      /** max # of instructions in a program */
+  MAX_PROGRAM_LEN = (MAX_FUZZ_INSNS + 1) * MAX_INSN_LEN + 1,
+  MAX_FUZZ_STEPS = 1000,    /** a program is stopped after this many */
+  MAX_WHY = 128,            /** max length of a divergence description */
+};
+
+/** The engines checked against step_ysim() */
+typedef enum {
+  MEM_ENGINE, FUSED_ENGINE, VERIFIED_ENGINE, LOOP_ENGINE, LOCKSTEP_ENGINE,
+  N_ENGINES
+} Engine;
+
+static const char *engineNames[N_ENGINES] = {
+  [MEM_ENGINE] = "step_ysim_mem()",
+  [FUSED_ENGINE] = "step_fused_ysim_mem()",
+  [VERIFIED_ENGINE] = "step_verified_ysim_mem()",
+  [LOOP_ENGINE] = "run_yloop()",
+  [LOCKSTEP_ENGINE] = "run_ylockstep()",
+};
+
+/** The processor state at the end of a run */
+typedef struct {
+  long nSteps;
+  Word regs[REG_NONE];
+  Address pc;
+  Byte cc;
+  Status status;
+} State;
+
+/** The first diverging program found by any thread */
+typedef struct {
+  atomic_bool isDiverged;
+  pthread_mutex_t lock;
+  Byte program[MAX_PROGRAM_LEN];
+  size_t len;
+  long nPrograms;           //# of programs run by all threads so far
+} Shared;
+
+/** The simulators and buffers used by one thread */
+typedef struct {
+  Y86 *ref;                 //runs step_ysim() on its own memory
+  Y86 *alt;                 //runs the other engines on mem
+  YMem *mem;
+  Address memSize;
+  Byte initialCc;
+  Byte *zeros;              //[memSize]
+  Byte *refBytes;           //[memSize]: memory of ref after a run
+  Byte *altBytes;           //[memSize]: memory of alt after a run
+  uint64_t rng;
+  long nPrograms;           //# of programs to run
+  long nSteps;              //# of reference steps run
+  Shared *shared;
+} Worker;
+
+/**************************** Random Programs **************************/
+
+/** xorshift64* */
+static uint64_t
+next_random(uint64_t *rng)
+{
+  *rng ^= *rng >> 12;
+  *rng ^= *rng << 25;
+  *rng ^= *rng >> 27;
+  return *rng * 0x2545f4914f6cdd1dUL;
+}
+
+static uint64_t
+random_below(uint64_t *rng, uint64_t n)
+{
+  return next_random(rng) % n;
+}
+
+/** Return a random immediate: usually a small value or an address in
+ *  or just outside memory, sometimes any word.
+ */
+static Word
+random_imm(uint64_t *rng, Address memSize)
+{
+  switch (random_below(rng, 4)) {
+  case 0:
+    return (Word)random_below(rng, 33) - 16;
+  case 1:
+    return random_below(rng, memSize + 64);
+  case 2:
+    return memSize - 8 * random_below(rng, 8);
+  default:
+    return next_random(rng);
+  }
+}
+
+static Register
+random_reg(uint64_t *rng)
+{
+  return random_below(rng, 20) == 0 ? REG_NONE : random_below(rng, REG_NONE);
+}
+
+static void
+put_word(Byte bytes[], Word word)
+{
+  for (int i = 0; i < sizeof(Word); i++) bytes[i] = word >> (8 * i);
+}
+
+/** Generate a random program into program[] and return its length.
+ *  The program usually starts by pointing %rsp near the top of
+ *  memory and always ends with a halt; most jump and call targets are
+ *  the starts of its instructions.
+ */
+static size_t
+generate(uint64_t *rng, Address memSize, Byte program[])
+{
+  size_t starts[MAX_FUZZ_INSNS + 1];
+  size_t targets[MAX_FUZZ_INSNS];  //offsets of destinations to patch
+  int nTargets = 0;
+  size_t len = 0;
+  if (random_below(rng, 4) != 0) {
+    program[len++] = IRMOVQ_CODE << 4;
+    program[len++] = (REG_NONE << 4) | REG_RSP;
+    put_word(&program[len], memSize - 8 * random_below(rng, 8));
+    len += sizeof(Word);
+  }
+  const int nInsns = 1 + random_below(rng, MAX_FUZZ_INSNS);
+  for (int i = 0; i < nInsns; i++) {
+    starts[i] = len;
+    if (random_below(rng, 20) == 0) {   //garbage
+      program[len++] = next_random(rng);
+      continue;
+    }
+    const int base = random_below(rng, N_BASE_CODES);
+    const InsnFormat *format = &insnFormats[base];
+    const int fn = (random_below(rng, 20) == 0)
+      ? random_below(rng, 16) : random_below(rng, format->maxFn + 1);
+    program[len] = (base << 4) | fn;
+    int immOffset = 1;
+    if (format->regsUse != NO_REGS) {
+      Register rA = (format->regsUse == RB_REG) ? REG_NONE : random_reg(rng);
+      Register rB = (format->regsUse == RA_REG) ? REG_NONE : random_reg(rng);
+      if (random_below(rng, 20) == 0) rA = random_below(rng, 16);
+      if (random_below(rng, 20) == 0) rB = random_below(rng, 16);
+      program[len + 1] = (rA << 4) | rB;
+      immOffset = 2;
+    }
+    if (format->length > immOffset) {
+      put_word(&program[len + immOffset], random_imm(rng, memSize));
+      if ((base == Jxx_CODE || base == CALL_CODE) &&
+          random_below(rng, 8) != 0) {
+        targets[nTargets++] = len + immOffset;
+      }
+    }
+    len += format->length;
+  }
+  starts[nInsns] = len;
+  program[len++] = HALT_CODE << 4;
+  for (int i = 0; i < nTargets; i++) {
+    put_word(&program[targets[i]], starts[random_below(rng, nInsns + 1)]);
+  }
+  return len;
+}
+
+/****************************** Running ********************************/
+
+/** Reset y86 to the state of a fresh simulator. */
+static void
+reset(Y86 *y86, Byte cc)
+{
+  for (Register r = 0; r < REG_NONE; r++) write_register_y86(y86, r, 0);
+  write_pc_y86(y86, 0);
+  write_cc_y86(y86, cc);
+  write_status_y86(y86, STATUS_AOK);
+}
+
+static void
+get_state(Y86 *y86, long nSteps, State *state)
+{
+  state->nSteps = nSteps;
+  for (Register r = 0; r < REG_NONE; r++) {
+    state->regs[r] = read_register_y86(y86, r);
+  }
+  state->pc = read_pc_y86(y86);
+  state->cc = read_cc_y86(y86);
+  state->status = read_status_y86(y86);
+}
+
+/** Run program[len] with step_ysim() on the own memory of the
+ *  reference simulator, setting *state and worker->refBytes to its
+ *  final state and memory.  The memory is left all zero.
+ */
+static void
+run_reference(Worker *worker, const Byte program[], size_t len,
+              State *state)
+{
+  Y86 *y86 = worker->ref;
+  reset(y86, worker->initialCc);
+  for (size_t i = 0; i < len; i++) write_memory_byte_y86(y86, i, program[i]);
+  long n = 0;
+  while (n < MAX_FUZZ_STEPS && read_status_y86(y86) == STATUS_AOK) {
+    step_ysim(y86);
+    n++;
+  }
+  get_state(y86, n, state);
+  for (Address a = 0; a < worker->memSize; a++) {
+    const Byte b = read_memory_byte_y86(y86, a);
+    worker->refBytes[a] = b;
+    if (b != 0) write_memory_byte_y86(y86, a, 0);
+  }
+}
+
+/** Run the program loaded in worker->mem as a single lockstep lane,
+ *  setting *state and worker->altBytes to its final state and memory.
+ */
+static void
+run_lockstep(Worker *worker, State *state)
+{
+  YLockstep *lockstep = new_ylockstep(worker->mem, 0, 1);
+  const long n = run_ylockstep(lockstep, MAX_FUZZ_STEPS);
+  //the lane starts from the state of a new y86, not from reset()
+  read_lane_ylockstep(lockstep, 0, worker->alt);
+  get_state(worker->alt, n, state);
+  read_bytes_ymem(get_mem_ylockstep(lockstep, 0), 0, worker->altBytes,
+                  worker->memSize);
+  free_ylockstep(lockstep);
+}
+
+/** Run program[len] with engine on worker->mem, setting *state and
+ *  worker->altBytes to its final state and memory.
+ */
+static void
+run_engine(Worker *worker, Engine engine, const Byte program[], size_t len,
+           State *state)
+{
+  Y86 *y86 = worker->alt;
+  YMem *mem = worker->mem;
+  reset(y86, worker->initialCc);
+  load_bytes_ymem(mem, 0, worker->zeros, worker->memSize);
+  load_bytes_ymem(mem, 0, program, len);
+  if (engine == LOCKSTEP_ENGINE) {
+    run_lockstep(worker, state);
+    return;
+  }
+  YVerify *verify = (engine != MEM_ENGINE) ? new_yverify(mem, 0) : NULL;
+  YLoop *loop = (engine == LOOP_ENGINE) ? new_yloop() : NULL;
+  long n = 0;
+  while (n < MAX_FUZZ_STEPS && read_status_y86(y86) == STATUS_AOK) {
+    switch (engine) {
+    case MEM_ENGINE:
+      step_ysim_mem(y86, mem);
+      n++;
+      break;
+    case FUSED_ENGINE:
+      //a fused pair must not run past the step limit
+      if (n + 1 < MAX_FUZZ_STEPS) {
+        n += step_fused_ysim_mem(y86, mem, verify);
+      }
+      else {
+        step_ysim_mem(y86, mem);
+        n++;
+      }
+      break;
+    case VERIFIED_ENGINE:
+      step_verified_ysim_mem(y86, mem, verify);
+      n++;
+      break;
+    case LOOP_ENGINE: {
+      //as in the silent run of y86-sim, but iterations count as steps
+      const YLoopBody *body = check_yloop(loop, y86, mem);
+      if (body) {
+        const long maxIters = (MAX_FUZZ_STEPS - n) / body->nInsns;
+        n += run_yloop(body, y86, mem, maxIters) * body->nInsns;
+      }
+      if (n < MAX_FUZZ_STEPS) {
+        step_verified_ysim_mem(y86, mem, verify);
+        n++;
+      }
+      break;
+    }
+    default:
+      assert(false);
+    }
+  }
+  if (verify) free_yverify(verify);
+  if (loop) free_yloop(loop);
+  get_state(y86, n, state);
+  read_bytes_ymem(mem, 0, worker->altBytes, worker->memSize);
+}
+
+/** Describe the first difference between the reference run ending
+ *  in ref with memory worker->refBytes and the run ending in alt with
+ *  memory worker->altBytes in why[MAX_WHY].  Return false if there is
+ *  none.
+ */
+static bool
+diff_runs(const Worker *worker, const State *ref, const State *alt,
+          char why[])
+{
+  if (ref->nSteps != alt->nSteps) {
+    snprintf(why, MAX_WHY, "ran %ld steps, not %ld", alt->nSteps,
+             ref->nSteps);
+    return true;
+  }
+  for (Register r = 0; r < REG_NONE; r++) {
+    if (ref->regs[r] != alt->regs[r]) {
+      snprintf(why, MAX_WHY, "%%%s = %016lx, not %016lx", regNames[r],
+               alt->regs[r], ref->regs[r]);
+      return true;
+    }
+  }
+  if (ref->pc != alt->pc) {
+    snprintf(why, MAX_WHY, "pc = %lx, not %lx", alt->pc, ref->pc);
+    return true;
+  }
+  if (ref->cc != alt->cc) {
+    snprintf(why, MAX_WHY, "cc = %x, not %x", alt->cc, ref->cc);
+    return true;
+  }
+  if (ref->status != alt->status) {
+    snprintf(why, MAX_WHY, "status = %d, not %d", alt->status, ref->status);
+    return true;
+  }
+  for (Address a = 0; a < worker->memSize; a++) {
+    if (worker->refBytes[a] != worker->altBytes[a]) {
+      snprintf(why, MAX_WHY, "M[%lx] = %02x, not %02x", a,
+               worker->altBytes[a], worker->refBytes[a]);
+      return true;
+    }
+  }
+  return false;
+}
+
+/** Run program[len] on the reference and on every engine.  Return the
+ *  first engine which diverges from the reference, after describing
+ *  the divergence in why[MAX_WHY]; N_ENGINES if none does.
+ */
+static Engine
+check_program(Worker *worker, const Byte program[], size_t len, char why[])
+{
+  State ref;
+  run_reference(worker, program, len, &ref);
+  worker->nSteps += ref.nSteps;
+  for (Engine e = 0; e < N_ENGINES; e++) {
+    State alt;
+    run_engine(worker, e, program, len, &alt);
+    if (diff_runs(worker, &ref, &alt, why)) return e;
+  }
+  return N_ENGINES;
+}
+
+/***************************** Minimizing ******************************/
+
+/** Shrink program[*len], which diverges, by deleting chunks of bytes
+ *  of decreasing size and then zeroing single bytes, keeping each
+ *  change after which some engine still diverges.
+ */
+static void
+minimize(Worker *worker, Byte program[], size_t *len)
+{
+  char why[MAX_WHY];
+  Byte trial[MAX_PROGRAM_LEN];
+  for (size_t chunk = *len / 2; chunk > 0; chunk /= 2) {
+    size_t i = 0;
+    while (i + chunk <= *len && chunk < *len) {
+      const size_t n = *len - chunk;
+      memcpy(trial, program, i);
+      memcpy(&trial[i], &program[i + chunk], n - i);
+      if (check_program(worker, trial, n, why) != N_ENGINES) {
+        memcpy(program, trial, n);
+        *len = n;
+      }
+      else {
+        i += chunk;
+      }
+    }
+  }
+  for (size_t i = 0; i < *len; i++) {
+    const Byte b = program[i];
+    if (b == 0) continue;
+    program[i] = 0;
+    if (check_program(worker, program, *len, why) == N_ENGINES) {
+      program[i] = b;
+    }
+  }
+}
+
+/****************************** Workers ********************************/
+
+static void
+init_worker(Worker *worker, Shared *shared, unsigned long seed, int id)
+{
+  worker->ref = new_y86_default();
+  worker->alt = new_y86_default();
+  worker->memSize = get_memory_size_y86(worker->ref);
+  worker->mem = new_ymem(worker->memSize);
+  worker->initialCc = read_cc_y86(worker->ref);
+  worker->zeros = calloc(worker->memSize, 1);
+  worker->refBytes = malloc(worker->memSize);
+  worker->altBytes = malloc(worker->memSize);
+  if (!worker->mem || !worker->zeros || !worker->refBytes ||
+      !worker->altBytes) {
+    fatal("out of memory\n");
+  }
+  for (Address a = 0; a < worker->memSize; a++) {
+    write_memory_byte_y86(worker->ref, a, 0);
+  }
+  worker->rng = (seed + id + 1) * 0x9e3779b97f4a7c15UL;
+  if (worker->rng == 0) worker->rng = 1;
+  worker->nSteps = 0;
+  worker->shared = shared;
+}
+
+static void
+free_worker(Worker *worker)
+{
+  free_y86(worker->ref);
+  free_y86(worker->alt);
+  free_ymem(worker->mem);
+  free(worker->zeros);
+  free(worker->refBytes);
+  free(worker->altBytes);
+}
+
+static void *
+run_worker(void *arg)
+{
+  Worker *worker = arg;
+  Shared *shared = worker->shared;
+  Byte program[MAX_PROGRAM_LEN];
+  char why[MAX_WHY];
+  long i;
+  for (i = 0; i < worker->nPrograms; i++) {
+    if (atomic_load_explicit(&shared->isDiverged, memory_order_relaxed)) {
+      break;
+    }
+    const size_t len = generate(&worker->rng, worker->memSize, program);
+    if (check_program(worker, program, len, why) != N_ENGINES) {
+      pthread_mutex_lock(&shared->lock);
+      if (!atomic_load(&shared->isDiverged)) {
+        memcpy(shared->program, program, len);
+        shared->len = len;
+        atomic_store(&shared->isDiverged, true);
+      }
+      pthread_mutex_unlock(&shared->lock);
+      i++;
+      break;
+    }
+  }
+  pthread_mutex_lock(&shared->lock);
+  shared->nPrograms += i;
+  pthread_mutex_unlock(&shared->lock);
+  return NULL;
+}
+
+/** Write program[len] on out as the body of a .ys file. */
+static void
+write_program(const Byte program[], size_t len, FILE *out)
+{
+  fprintf(out, "\t.pos 0\n");
+  for (size_t i = 0; i < len; i += sizeof(Word)) {
+    Word word = 0;
+    for (size_t j = 0; j < sizeof(Word) && i + j < len; j++) {
+      word |= (Word)program[i + j] << (8 * j);
+    }
+    fprintf(out, "\t.quad 0x%016lx\n", word);
+  }
+}
+
+/** Run nPrograms random programs generated from seed on nThreads
+ *  threads.  If an engine diverges from the reference, write a
+ *  minimized reproducer on out as a .ys file whose comments describe
+ *  the divergence and return false.  Otherwise write a summary line
+ *  on out and return true.
+ */
+bool
+run_yfuzz(long nPrograms, int nThreads, unsigned long seed, FILE *out)
+{
+  Shared shared = { .len = 0, .nPrograms = 0 };
+  atomic_init(&shared.isDiverged, false);
+  pthread_mutex_init(&shared.lock, NULL);
+  Worker workers[nThreads];
+  pthread_t threads[nThreads];
+  for (int i = 0; i < nThreads; i++) {
+    init_worker(&workers[i], &shared, seed, i);
+    workers[i].nPrograms = nPrograms / nThreads + (i < nPrograms % nThreads);
+    //worker 0 runs on the calling thread
+    if (i > 0 &&
+        pthread_create(&threads[i], NULL, run_worker, &workers[i]) != 0) {
+      fatal("cannot create fuzzing thread %d\n", i);
+    }
+  }
+  run_worker(&workers[0]);
+  long nSteps = workers[0].nSteps;
+  for (int i = 1; i < nThreads; i++) {
+    pthread_join(threads[i], NULL);
+    nSteps += workers[i].nSteps;
+  }
+  const bool isDiverged = atomic_load(&shared.isDiverged);
+  if (!isDiverged) {
+    fprintf(out, "%ld programs (%ld instructions): all engines agree with "
+            "step_ysim()\n", shared.nPrograms, nSteps);
+  }
+  else {
+    const size_t origLen = shared.len;
+    minimize(&workers[0], shared.program, &shared.len);
+    char why[MAX_WHY];
+    const Engine e =
+      check_program(&workers[0], shared.program, shared.len, why);
+    fprintf(out, "# %s diverges from step_ysim(): %s\n", engineNames[e], why);
+    fprintf(out, "# found with seed %lu after %ld programs; minimized from "
+            "%zu to %zu bytes\n", seed, shared.nPrograms, origLen,
+            shared.len);
+    write_program(shared.program, shared.len, out);
+  }
+  for (int i = 0; i < nThreads; i++) free_worker(&workers[i]);
+  pthread_mutex_destroy(&shared.lock);
+  return !isDiverged;
+}
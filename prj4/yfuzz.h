@@ -0,0 +1,32 @@
+#ifndef _YFUZZ_H
+#define _YFUZZ_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/** Differential fuzzing of the execution engines.  Random
+ *  instruction streams, mostly valid instructions with a sprinkling
+ *  of bad opcodes, functions, registers and addresses, are loaded at
+ *  address 0 and run for a bounded # of steps by the reference
+ *  step_ysim() on y86's own memory and by each of step_ysim_mem(),
+ *  step_fused_ysim_mem() and step_verified_ysim_mem() on a YMem, by
+ *  run_yloop() for the hot loops found by check_yloop(), and by
+ *  run_ylockstep() as a single lane.
+ *  After the run, every engine must agree with the reference on the
+ *  # of steps taken, the registers, pc, cc, status and every byte of
+ *  memory.
+ *
+ *  Programs are run by nThreads host threads.  The first program on
+ *  which an engine diverges stops the search; it is then minimized by
+ *  deleting and zeroing bytes for as long as the divergence remains.
+ */
+
+/** Run nPrograms random programs generated from seed on nThreads
+ *  threads.  If an engine diverges from the reference, write a
+ *  minimized reproducer on out as a .ys file whose comments describe
+ *  the divergence and return false.  Otherwise write a summary line
+ *  on out and return true.
+ */
+bool run_yfuzz(long nPrograms, int nThreads, unsigned long seed, FILE *out);
+
+#endif //ifndef _YFUZZ_H
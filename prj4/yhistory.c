@@ -0,0 +1,231 @@
+#include "yhistory.h"
+
+#include "ysim.h"
+
+#include "errors.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  long step;             //state before this step was executed
+  Word regs[REG_NONE];
+  Address pc;
+  Byte cc;
+  Status status;
+  size_t undoIndex;      //absolute index of first later undo entry
+} Snapshot;
+
+typedef struct {
+  Address addr;
+  Word old;              //previous contents of size bytes at addr
+  size_t size;
+} Undo;
+
+struct YHistoryStruct {
+  Y86 *y86;
+  YMem *mem;
+  long interval;
+  long step;             //# of instructions recorded
+  Snapshot *snapshots;   //circular buffer of maxSnapshots
+  int maxSnapshots;
+  int firstSnapshot;
+  int nSnapshots;
+  Undo *undos;           //undos[i] has absolute index undoBase + i
+  size_t undoBase;
+  size_t nUndos;
+  size_t maxUndos;
+  bool isRestoring;      //do not log writes made by the history itself
+};
+
+/** YMemWatchFn: log the contents of memory about to be overwritten. */
+static void
+on_write(void *ctx, Address addr, size_t size)
+{
+  YHistory *history = ctx;
+  if (history->isRestoring) return;
+  if (history->nUndos == history->maxUndos) {
+    history->maxUndos = history->maxUndos ? 2 * history->maxUndos : 1024;
+    history->undos = realloc(history->undos, history->maxUndos * sizeof(Undo));
+    if (!history->undos) fatal("out of memory\n");
+  }
+  Undo *undo = &history->undos[history->nUndos++];
+  undo->addr = addr;
+  undo->size = size;
+  undo->old = 0;
+  if (size == sizeof(Word)) {
+    read_word_ymem(history->mem, addr, &undo->old);
+  }
+  else {
+    Byte byte = 0;
+    read_byte_ymem(history->mem, addr, &byte);
+    undo->old = byte;
+  }
+}
+
+/********************** Allocation / Deallocation **********************/
+
+/** Create a new history for y86 running with memory mem.  Only one
+ *  history may be attached to mem at a time.
+ */
+YHistory *
+new_yhistory(Y86 *y86, YMem *mem, long interval, int maxSnapshots)
+{
+  YHistory *history = calloc(1, sizeof(struct YHistoryStruct));
+  if (!history) fatal("out of memory\n");
+  history->y86 = y86;
+  history->mem = mem;
+  history->interval = (interval > 0) ? interval : 1;
+  history->maxSnapshots = (maxSnapshots > 1) ? maxSnapshots : 2;
+  history->snapshots = calloc(history->maxSnapshots, sizeof(Snapshot));
+  if (!history->snapshots) fatal("out of memory\n");
+  hook_writes_ymem(mem, on_write, history);
+  return history;
+}
+
+/** Free all resources allocated by new_yhistory() in history. */
+void
+free_yhistory(YHistory *history)
+{
+  hook_writes_ymem(history->mem, NULL, NULL);
+  free(history->undos);
+  free(history->snapshots);
+  free(history);
+}
+
+/****************************** Snapshots ******************************/
+
+static Snapshot *
+get_snapshot(YHistory *history, int i)
+{
+  return
+    &history->snapshots[(history->firstSnapshot + i) % history->maxSnapshots];
+}
+
+/** Drop the oldest snapshot and the undo entries only it needed. */
+static void
+drop_first_snapshot(YHistory *history)
+{
+  history->firstSnapshot =
+    (history->firstSnapshot + 1) % history->maxSnapshots;
+  history->nSnapshots--;
+  const size_t nDropped =
+    get_snapshot(history, 0)->undoIndex - history->undoBase;
+  memmove(history->undos, history->undos + nDropped,
+          (history->nUndos - nDropped) * sizeof(Undo));
+  history->nUndos -= nDropped;
+  history->undoBase += nDropped;
+}
+
+static void
+take_snapshot(YHistory *history)
+{
+  if (history->nSnapshots == history->maxSnapshots) {
+    drop_first_snapshot(history);
+  }
+  Snapshot *snapshot = get_snapshot(history, history->nSnapshots++);
+  Y86 *y86 = history->y86;
+  snapshot->step = history->step;
+  for (Register r = REG_RAX; r < REG_NONE; r++) {
+    snapshot->regs[r] = read_register_y86(y86, r);
+  }
+  snapshot->pc = read_pc_y86(y86);
+  snapshot->cc = read_cc_y86(y86);
+  snapshot->status = read_status_y86(y86);
+  snapshot->undoIndex = history->undoBase + history->nUndos;
+}
+
+/** Must be called before each instruction is executed. */
+void
+record_yhistory(YHistory *history)
+{
+  const bool isTaken = history->nSnapshots > 0 &&
+    get_snapshot(history, history->nSnapshots - 1)->step == history->step;
+  if (history->step % history->interval == 0 && !isTaken) {
+    take_snapshot(history);
+  }
+  history->step++;
+}
+
+/** Return the # of instructions recorded so far. */
+long
+get_step_yhistory(const YHistory *history)
+{
+  return history->step;
+}
+
+/** Return the earliest step which can still be gone back to. */
+long
+get_first_step_yhistory(const YHistory *history)
+{
+  if (history->nSnapshots == 0) return history->step;
+  return history->snapshots[history->firstSnapshot].step;
+}
+
+/******************************* Replay ********************************/
+
+/** Undo memory writes back to snapshot i, restore it and drop all
+ *  later snapshots.
+ */
+static void
+restore_snapshot(YHistory *history, int i)
+{
+  const Snapshot *snapshot = get_snapshot(history, i);
+  YMem *mem = history->mem;
+  history->isRestoring = true;
+  while (history->undoBase + history->nUndos > snapshot->undoIndex) {
+    const Undo *undo = &history->undos[--history->nUndos];
+    if (undo->size == sizeof(Word)) {
+      write_word_ymem(mem, undo->addr, undo->old);
+    }
+    else {
+      write_byte_ymem(mem, undo->addr, undo->old);
+    }
+  }
+  history->isRestoring = false;
+  Y86 *y86 = history->y86;
+  for (Register r = REG_RAX; r < REG_NONE; r++) {
+    write_register_y86(y86, r, snapshot->regs[r]);
+  }
+  write_pc_y86(y86, snapshot->pc);
+  write_cc_y86(y86, snapshot->cc);
+  write_status_y86(y86, snapshot->status);
+  history->step = snapshot->step;
+  history->nSnapshots = i + 1;
+}
+
+/** Replay forward from the current step to endStep, calling fn(ctx)
+ *  before each replayed instruction.  Return the last step at which
+ *  fn returned true; -1 if none.
+ */
+long
+find_yhistory(YHistory *history, long endStep,
+              YHistoryStopFn *fn, void *ctx)
+{
+  long found = -1;
+  while (history->step < endStep &&
+         read_status_y86(history->y86) == STATUS_AOK) {
+    if (fn && fn(ctx)) found = history->step;
+    record_yhistory(history);
+    step_ysim_mem(history->y86, history->mem);
+  }
+  return found;
+}
+
+/** Restore y86 and mem to their state before step was executed.
+ *  Return false (changing nothing) unless step is between
+ *  get_first_step_yhistory() and get_step_yhistory().
+ */
+bool
+goto_yhistory(YHistory *history, long step)
+{
+  if (step < get_first_step_yhistory(history) || step > history->step) {
+    return false;
+  }
+  if (step == history->step) return true;
+  int i = history->nSnapshots - 1;
+  while (get_snapshot(history, i)->step > step) i--;
+  restore_snapshot(history, i);
+  find_yhistory(history, step, NULL, NULL);
+  return true;
+}
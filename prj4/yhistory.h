@@ -0,0 +1,52 @@
+#ifndef _YHISTORY_H
+#define _YHISTORY_H
+
+#include "y86.h"
+#include "ymem.h"
+
+/** Execution history of a y86 running with memory mem, allowing it to
+ *  be moved back to any recent step.  Every interval steps a snapshot
+ *  of the registers, pc, cc and status is taken, and the old contents
+ *  of every memory write are kept in an undo log.  Going back to a
+ *  step undoes memory writes to the nearest earlier snapshot, restores
+ *  it and replays at most interval - 1 instructions.  Only the last
+ *  maxSnapshots snapshots (and the undo log since the oldest of them)
+ *  are kept, so memory use is bounded by interval * maxSnapshots
+ *  steps.
+ */
+typedef struct YHistoryStruct YHistory;
+
+/** Create a new history for y86 running with memory mem.  Only one
+ *  history may be attached to mem at a time.
+ */
+YHistory *new_yhistory(Y86 *y86, YMem *mem, long interval, int maxSnapshots);
+
+/** Free all resources allocated by new_yhistory() in history. */
+void free_yhistory(YHistory *history);
+
+/** Must be called before each instruction is executed. */
+void record_yhistory(YHistory *history);
+
+/** Return the # of instructions recorded so far. */
+long get_step_yhistory(const YHistory *history);
+
+/** Return the earliest step which can still be gone back to. */
+long get_first_step_yhistory(const YHistory *history);
+
+/** Restore y86 and mem to their state before step was executed.
+ *  Return false (changing nothing) unless step is between
+ *  get_first_step_yhistory() and get_step_yhistory().
+ */
+bool goto_yhistory(YHistory *history, long step);
+
+/** Predicate evaluated on a replayed state. */
+typedef bool YHistoryStopFn(void *ctx);
+
+/** Replay forward from the current step to endStep, calling fn(ctx)
+ *  before each replayed instruction.  Return the last step at which
+ *  fn returned true; -1 if none.
+ */
+long find_yhistory(YHistory *history, long endStep,
+                   YHistoryStopFn *fn, void *ctx);
+
+#endif //ifndef _YHISTORY_H
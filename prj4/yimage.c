@@ -0,0 +1,455 @@
+#define _DEFAULT_SOURCE   //for mmap() and fileno()
+
+#include "yimage.h"
+
+#include "yas.h"
+
+#include "errors.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum {
+  YIMAGE_VERSION = 1,
+  SEGMENT_GAP = 32,  /** zero runs shorter than this do not split segments */
+  ALIGN = 8,         /** alignment of all sections within an image file */
+};
+
+static const char MAGIC[8] = { 'Y', '8', '6', 'I', 'M', 'G', '\n', '\0' };
+
+/** On-disk layout: a Header followed by the segment and symbol
+ *  tables, segment contents, a string table of NUL-terminated symbol
+ *  names and the listing text.  All offsets are from the start of the
+ *  file; all sections are ALIGN-aligned.
+ */
+typedef struct {
+  char magic[sizeof(MAGIC)];
+  uint32_t version;
+  uint32_t nSegments;
+  uint32_t nSymbols;
+  uint32_t unused;
+  uint64_t entry;
+  uint64_t segmentsOffset;
+  uint64_t symbolsOffset;
+  uint64_t stringsOffset;
+  uint64_t stringsSize;
+  uint64_t listingOffset;
+  uint64_t listingSize;
+  uint64_t fileSize;
+} Header;
+
+typedef struct {
+  uint64_t addr;
+  uint64_t size;
+  uint64_t offset;
+} Segment;
+
+typedef struct {
+  uint64_t addr;
+  uint64_t nameOffset;
+} Symbol;
+
+struct YImageStruct {
+  const Byte *base;       //mmap'd file
+  size_t size;
+  const Header *header;
+  const Segment *segments;
+  const Symbol *symbols;
+  const char *strings;
+  const char *listing;
+};
+
+static uint64_t
+align_up(uint64_t n)
+{
+  return (n + ALIGN - 1) / ALIGN * ALIGN;
+}
+
+/**************************** Image Writing ****************************/
+
+/** Return the listing of fileNames[nFiles] in a malloc()'d buffer,
+ *  setting *size to its length.
+ */
+static char *
+capture_listing(int nFiles, const char *fileNames[], size_t *size)
+{
+  FILE *tmp = tmpfile();
+  if (!tmp) return NULL;
+  yas_to_listing(tmp, nFiles, fileNames);
+  long n = ftell(tmp);
+  char *listing = (n >= 0) ? malloc(n + 1) : NULL;
+  rewind(tmp);
+  if (listing && fread(listing, 1, n, tmp) != (size_t)n) {
+    free(listing); listing = NULL;
+  }
+  fclose(tmp);
+  if (listing) {
+    listing[n] = '\0';
+    *size = n;
+  }
+  return listing;
+}
+
+typedef struct {
+  Symbol *symbols;
+  int nSymbols;
+  char *strings;
+  size_t stringsSize;
+} SymbolTable;
+
+/** Add the labels defined in listing to table.  A label is recognized
+ *  on a listing line of the form "0xADDR: ... | label:".
+ */
+static void
+parse_symbols(const char *listing, SymbolTable *table)
+{
+  size_t nLines = 1;
+  for (const char *p = listing; *p != '\0'; p++) nLines += (*p == '\n');
+  table->symbols = malloc(nLines * sizeof(Symbol));
+  table->strings = malloc(strlen(listing) + 1);
+  if (!table->symbols || !table->strings) fatal("out of memory\n");
+  for (const char *line = listing; *line != '\0'; ) {
+    const char *end = strchr(line, '\n');
+    if (!end) end = line + strlen(line);
+    unsigned long addr;
+    const char *bar = memchr(line, '|', end - line);
+    if (bar && sscanf(line, " 0x%lx:", &addr) == 1) {
+      const char *p = bar + 1;
+      while (p < end && isspace(*p)) p++;
+      const char *name = p;
+      while (p < end && (isalnum(*p) || *p == '_' || *p == '.')) p++;
+      if (p > name && p < end && *p == ':' && !isdigit(*name)) {
+        Symbol *sym = &table->symbols[table->nSymbols++];
+        sym->addr = addr;
+        sym->nameOffset = table->stringsSize;
+        memcpy(table->strings + table->stringsSize, name, p - name);
+        table->stringsSize += p - name;
+        table->strings[table->stringsSize++] = '\0';
+      }
+    }
+    line = (*end == '\n') ? end + 1 : end;
+  }
+}
+
+/** Return the non-zero segments of memory[size], setting *nSegments.
+ *  The offset field of each segment is relative to the first segment.
+ */
+static Segment *
+find_segments(const Byte memory[], Address size, int *nSegments)
+{
+  Segment *segments = NULL;
+  int n = 0, max = 0;
+  Address i = 0;
+  while (i < size) {
+    while (i < size && memory[i] == 0) i++;
+    if (i == size) break;
+    Address lo = i, hi = i;
+    while (i < size && i - hi < SEGMENT_GAP) {
+      if (memory[i] != 0) hi = i;
+      i++;
+    }
+    if (n == max) {
+      max = max ? 2 * max : 4;
+      segments = realloc(segments, max * sizeof(Segment));
+      if (!segments) fatal("out of memory\n");
+    }
+    segments[n].addr = lo;
+    segments[n].size = hi + 1 - lo;
+    segments[n].offset = n ? align_up(segments[n - 1].offset +
+                                      segments[n - 1].size) : 0;
+    n++;
+    i = hi + 1;
+  }
+  *nSegments = n;
+  return segments;
+}
+
+static bool
+write_padded(FILE *f, const void *data, size_t size)
+{
+  static const Byte zeros[ALIGN];
+  return fwrite(data, 1, size, f) == size &&
+    fwrite(zeros, 1, align_up(size) - size, f) == align_up(size) - size;
+}
+
+/** Write an image of the program already loaded into y86 from
+ *  fileNames[nFiles] to path.  Return false after printing a message
+ *  on stderr on failure.
+ */
+bool
+write_y86_yimage(const char *path, Y86 *y86,
+                 int nFiles, const char *fileNames[])
+{
+  const Address memSize = get_memory_size_y86(y86);
+  Byte *memory = malloc(memSize);
+  size_t listingSize = 0;
+  char *listing = capture_listing(nFiles, fileNames, &listingSize);
+  if (!memory || !listing) fatal("out of memory\n");
+  for (Address a = 0; a < memSize; a++) {
+    memory[a] = read_memory_byte_y86(y86, a);
+  }
+  int nSegments;
+  Segment *segments = find_segments(memory, memSize, &nSegments);
+  SymbolTable table = { NULL, 0, NULL, 0 };
+  parse_symbols(listing, &table);
+
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = YIMAGE_VERSION;
+  header.nSegments = nSegments;
+  header.nSymbols = table.nSymbols;
+  header.entry = read_pc_y86(y86);
+  header.segmentsOffset = align_up(sizeof(Header));
+  header.symbolsOffset =
+    header.segmentsOffset + align_up(nSegments * sizeof(Segment));
+  uint64_t dataOffset =
+    header.symbolsOffset + align_up(table.nSymbols * sizeof(Symbol));
+  uint64_t dataSize = (nSegments == 0) ? 0 :
+    align_up(segments[nSegments - 1].offset + segments[nSegments - 1].size);
+  for (int i = 0; i < nSegments; i++) segments[i].offset += dataOffset;
+  header.stringsOffset = dataOffset + dataSize;
+  header.stringsSize = table.stringsSize;
+  header.listingOffset = header.stringsOffset + align_up(table.stringsSize);
+  header.listingSize = listingSize;
+  header.fileSize = header.listingOffset + align_up(listingSize);
+
+  FILE *f = fopen(path, "wb");
+  bool isOk = f != NULL &&
+    write_padded(f, &header, sizeof(header)) &&
+    write_padded(f, segments, nSegments * sizeof(Segment)) &&
+    write_padded(f, table.symbols, table.nSymbols * sizeof(Symbol));
+  for (int i = 0; isOk && i < nSegments; i++) {
+    isOk = write_padded(f, &memory[segments[i].addr], segments[i].size);
+  }
+  isOk = isOk &&
+    write_padded(f, table.strings, table.stringsSize) &&
+    write_padded(f, listing, listingSize);
+  if (f && fclose(f) != 0) isOk = false;
+  if (!isOk) fprintf(stderr, "cannot write image %s\n", path);
+  free(table.symbols); free(table.strings);
+  free(segments); free(listing); free(memory);
+  return isOk;
+}
+
+/** Assemble fileNames[nFiles] and write the resulting image to path.
+ *  Return false after printing a message on stderr on failure.
+ */
+bool
+write_yimage(const char *path, int nFiles, const char *fileNames[])
+{
+  Y86 *y86 = new_y86_default();
+  bool isOk = yas_to_y86(y86, nFiles, fileNames) &&
+    write_y86_yimage(path, y86, nFiles, fileNames);
+  free_y86(y86);
+  return isOk;
+}
+
+/**************************** Image Reading ****************************/
+
+/** Return true iff path names a readable image file. */
+bool
+is_yimage(const char *path)
+{
+  char magic[sizeof(MAGIC)];
+  FILE *f = fopen(path, "rb");
+  if (!f) return false;
+  bool isImage = fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+    memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+  fclose(f);
+  return isImage;
+}
+
+/** Return true iff [offset, offset + size) lies within a file of
+ *  fileSize bytes.
+ */
+static bool
+in_file(uint64_t offset, uint64_t size, uint64_t fileSize)
+{
+  return offset <= fileSize && size <= fileSize - offset;
+}
+
+static bool
+is_valid(const YImage *image)
+{
+  const Header *h = image->header;
+  const uint64_t n = image->size;
+  if (n < sizeof(Header) || memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      h->version != YIMAGE_VERSION || h->fileSize != n) {
+    return false;
+  }
+  if (!in_file(h->segmentsOffset, h->nSegments * sizeof(Segment), n) ||
+      !in_file(h->symbolsOffset, h->nSymbols * sizeof(Symbol), n) ||
+      !in_file(h->stringsOffset, h->stringsSize, n) ||
+      !in_file(h->listingOffset, h->listingSize, n) ||
+      h->segmentsOffset % ALIGN != 0 || h->symbolsOffset % ALIGN != 0) {
+    return false;
+  }
+  for (int i = 0; i < h->nSegments; i++) {
+    if (!in_file(image->segments[i].offset, image->segments[i].size, n)) {
+      return false;
+    }
+  }
+  if (h->nSymbols > 0 &&
+      (h->stringsSize == 0 || image->strings[h->stringsSize - 1] != '\0')) {
+    return false;
+  }
+  for (int i = 0; i < h->nSymbols; i++) {
+    if (image->symbols[i].nameOffset >= h->stringsSize) return false;
+  }
+  return true;
+}
+
+/** Map the image in path.  Return NULL after printing a message on
+ *  stderr if path cannot be read or is not a valid image.
+ */
+YImage *
+read_yimage(const char *path)
+{
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+    fprintf(stderr, "cannot read image %s\n", path);
+    if (fd >= 0) close(fd);
+    return NULL;
+  }
+  const Byte *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    fprintf(stderr, "cannot map image %s\n", path);
+    return NULL;
+  }
+  YImage *image = malloc(sizeof(struct YImageStruct));
+  if (!image) fatal("out of memory\n");
+  image->base = base;
+  image->size = st.st_size;
+  image->header = (const Header *)base;
+  if (image->size >= sizeof(Header)) {
+    const Header *h = image->header;
+    image->segments = (const Segment *)(base + h->segmentsOffset);
+    image->symbols = (const Symbol *)(base + h->symbolsOffset);
+    image->strings = (const char *)(base + h->stringsOffset);
+    image->listing = (const char *)(base + h->listingOffset);
+  }
+  if (image->size < sizeof(Header) || !is_valid(image)) {
+    fprintf(stderr, "%s is not a valid y86 image\n", path);
+    free_yimage(image);
+    return NULL;
+  }
+  return image;
+}
+
+/** Free all resources allocated by read_yimage() in image. */
+void
+free_yimage(YImage *image)
+{
+  munmap((void *)image->base, image->size);
+  free(image);
+}
+
+/** Return the pc at which execution of image starts. */
+Address
+get_entry_yimage(const YImage *image)
+{
+  return image->header->entry;
+}
+
+/** Return # of memory segments in image. */
+int
+get_n_segments_yimage(const YImage *image)
+{
+  return image->header->nSegments;
+}
+
+/** Return the contents of segment i of image, setting *addr to its
+ *  Y86 address and *size to its size in bytes.
+ */
+const Byte *
+get_segment_yimage(const YImage *image, int i, Address *addr, size_t *size)
+{
+  const Segment *segment = &image->segments[i];
+  *addr = segment->addr;
+  *size = segment->size;
+  return image->base + segment->offset;
+}
+
+/** Return # of symbols in image. */
+int
+get_n_symbols_yimage(const YImage *image)
+{
+  return image->header->nSymbols;
+}
+
+/** Return the name of symbol i of image, setting *addr to its value. */
+const char *
+get_symbol_yimage(const YImage *image, int i, Address *addr)
+{
+  *addr = image->symbols[i].addr;
+  return image->strings + image->symbols[i].nameOffset;
+}
+
+/** Set *addr to the value of symbol name in image; return false if
+ *  image has no such symbol.
+ */
+bool
+lookup_symbol_yimage(const YImage *image, const char *name, Address *addr)
+{
+  for (int i = 0; i < image->header->nSymbols; i++) {
+    if (strcmp(image->strings + image->symbols[i].nameOffset, name) == 0) {
+      *addr = image->symbols[i].addr;
+      return true;
+    }
+  }
+  return false;
+}
+
+/** Write the assembler listing stored in image on out. */
+void
+write_listing_yimage(const YImage *image, FILE *out)
+{
+  fwrite(image->listing, 1, image->header->listingSize, out);
+}
+
+/** Load image into y86: copy its segments into y86's memory and
+ *  set its pc to the image entry point.  Return false if a segment
+ *  does not fit in y86's memory.  Like a program loaded by
+ *  yas_to_y86(), the loaded image is not reported as a change by
+ *  dump_changes_y86().
+ */
+bool
+load_yimage_y86(const YImage *image, Y86 *y86)
+{
+  const Address memSize = get_memory_size_y86(y86);
+  for (int i = 0; i < get_n_segments_yimage(image); i++) {
+    Address addr;
+    size_t size;
+    const Byte *bytes = get_segment_yimage(image, i, &addr, &size);
+    if (addr > memSize || size > memSize - addr) return false;
+    size_t j = 0;
+    for (; j < size && (addr + j) % sizeof(Word) != 0; j++) {
+      write_memory_byte_y86(y86, addr + j, bytes[j]);
+    }
+    for (; j + sizeof(Word) <= size; j += sizeof(Word)) {
+      Word word;
+      memcpy(&word, bytes + j, sizeof(Word));
+      write_memory_word_y86(y86, addr + j, word);
+    }
+    for (; j < size; j++) {
+      write_memory_byte_y86(y86, addr + j, bytes[j]);
+    }
+  }
+  write_pc_y86(y86, get_entry_yimage(image));
+  //make the loaded image the baseline for dump_changes_y86()
+  FILE *devNull = fopen("/dev/null", "w");
+  if (devNull) {
+    dump_changes_y86(y86, false, devNull);
+    fclose(devNull);
+  }
+  return read_status_y86(y86) == STATUS_AOK;
+}
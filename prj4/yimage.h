@@ -0,0 +1,73 @@
+#ifndef _YIMAGE_H
+#define _YIMAGE_H
+
+#include "y86.h"
+
+#include <stddef.h>
+
+/** A precompiled program image: the non-zero memory segments left by
+ *  yas_to_y86(), the entry pc, a symbol table and the assembler
+ *  listing.  Images are mmap'd when read so that loading a program
+ *  costs a single copy of its segments rather than an assembly.
+ */
+typedef struct YImageStruct YImage;
+
+/** Assemble fileNames[nFiles] and write the resulting image to path.
+ *  Return false after printing a message on stderr on failure.
+ */
+bool write_yimage(const char *path, int nFiles, const char *fileNames[]);
+
+/** Write an image of the program already loaded into y86 from
+ *  fileNames[nFiles] to path.  Return false after printing a message
+ *  on stderr on failure.
+ */
+bool write_y86_yimage(const char *path, Y86 *y86,
+                      int nFiles, const char *fileNames[]);
+
+/** Return true iff path names a readable image file. */
+bool is_yimage(const char *path);
+
+/** Map the image in path.  Return NULL after printing a message on
+ *  stderr if path cannot be read or is not a valid image.
+ */
+YImage *read_yimage(const char *path);
+
+/** Free all resources allocated by read_yimage() in image. */
+void free_yimage(YImage *image);
+
+/** Return the pc at which execution of image starts. */
+Address get_entry_yimage(const YImage *image);
+
+/** Return # of memory segments in image. */
+int get_n_segments_yimage(const YImage *image);
+
+/** Return the contents of segment i of image, setting *addr to its
+ *  Y86 address and *size to its size in bytes.
+ */
+const Byte *get_segment_yimage(const YImage *image, int i,
+                               Address *addr, size_t *size);
+
+/** Return # of symbols in image. */
+int get_n_symbols_yimage(const YImage *image);
+
+/** Return the name of symbol i of image, setting *addr to its value. */
+const char *get_symbol_yimage(const YImage *image, int i, Address *addr);
+
+/** Set *addr to the value of symbol name in image; return false if
+ *  image has no such symbol.
+ */
+bool lookup_symbol_yimage(const YImage *image, const char *name,
+                          Address *addr);
+
+/** Write the assembler listing stored in image on out. */
+void write_listing_yimage(const YImage *image, FILE *out);
+
+/** Load image into y86: copy its segments into y86's memory and
+ *  set its pc to the image entry point.  Return false if a segment
+ *  does not fit in y86's memory.  Like a program loaded by
+ *  yas_to_y86(), the loaded image is not reported as a change by
+ *  dump_changes_y86().
+ */
+bool load_yimage_y86(const YImage *image, Y86 *y86);
+
+#endif //ifndef _YIMAGE_H
@@ -0,0 +1,145 @@
+#define _DEFAULT_SOURCE   //for mmap() and fstat()
+
+#include "yinput.h"
+
+#include "errors.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum { MAX_PATH = 4096 };
+
+/** Parse the integer at *p (before end) into *word and advance *p past
+ *  it.  Return false if there is no valid integer at *p.
+ */
+static bool
+parse_word(const char **p, const char *end, Word *word)
+{
+  const char *q = *p;
+  const bool isNeg = q < end && *q == '-';
+  if (q < end && (*q == '-' || *q == '+')) q++;
+  int base = 10;
+  if (end - q > 2 && q[0] == '0' && (q[1] == 'x' || q[1] == 'X')) {
+    base = 16;
+    q += 2;
+  }
+  else if (end - q > 1 && q[0] == '0') {
+    base = 8;
+  }
+  Word value = 0;
+  const char *digits = q;
+  for (; q < end && isxdigit(*q); q++) {
+    const int d = isdigit(*q) ? *q - '0' : tolower(*q) - 'a' + 10;
+    if (d >= base) break;
+    value = value * base + d;
+  }
+  if (q == digits || (q < end && !isspace(*q))) return false;
+  *word = isNeg ? -value : value;
+  *p = q;
+  return true;
+}
+
+/** Parse the text inputs in bytes[size] into a new array of words,
+ *  setting *nWords to their #.  Return NULL if the text is invalid.
+ */
+static Word *
+parse_words(const char *bytes, size_t size, long *nWords)
+{
+  size_t maxWords = 1024;
+  Word *words = malloc(maxWords * sizeof(Word));
+  if (!words) fatal("out of memory\n");
+  const char *p = bytes, *end = bytes + size;
+  long n = 0;
+  for (;;) {
+    while (p < end && isspace(*p)) p++;
+    if (p == end) break;
+    if (n == maxWords) {
+      maxWords *= 2;
+      if (!(words = realloc(words, maxWords * sizeof(Word)))) {
+        fatal("out of memory\n");
+      }
+    }
+    if (!parse_word(&p, end, &words[n++])) {
+      free(words);
+      return NULL;
+    }
+  }
+  *nWords = n;
+  return words;
+}
+
+/** Bulk program inputs: see yinput.h.  Set *addr to where they were
+ *  copied and return their #; return -1 after printing a message on
+ *  stderr on error.
+ */
+long
+load_yinput(YMem *mem, const char *spec, bool isText, Address *addr)
+{
+  char path[MAX_PATH];
+  const char *at = strrchr(spec, '@');
+  const size_t pathLen = at ? (size_t)(at - spec) : strlen(spec);
+  if (pathLen >= sizeof(path)) {
+    fprintf(stderr, "input file name too long: %s\n", spec);
+    return -1;
+  }
+  memcpy(path, spec, pathLen);
+  path[pathLen] = '\0';
+  const int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    perror(path);
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+  const size_t size = st.st_size;
+  const void *bytes = NULL;
+  if (size > 0) {
+    bytes = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (bytes == MAP_FAILED) {
+      perror(path);
+      close(fd);
+      return -1;
+    }
+  }
+  close(fd);
+  long nWords = size / sizeof(Word);
+  Word *words = NULL;
+  bool isOk = true;
+  if (isText) {
+    isOk = (words = parse_words(bytes, size, &nWords)) != NULL;
+    if (!isOk) fprintf(stderr, "%s: bad integer input\n", path);
+  }
+  else if (size % sizeof(Word) != 0) {
+    fprintf(stderr, "%s: size %zu is not a multiple of %zu\n",
+            path, size, sizeof(Word));
+    isOk = false;
+  }
+  const size_t nBytes = nWords * sizeof(Word);
+  const Address memSize = get_size_ymem(mem);
+  if (isOk && at) {
+    char *end;
+    *addr = strtoul(at + 1, &end, 0);
+    if (*end != '\0') {
+      fprintf(stderr, "bad input address in %s\n", spec);
+      isOk = false;
+    }
+  }
+  else if (isOk) {
+    *addr = (nBytes <= memSize) ? memSize - nBytes : 0;
+  }
+  if (isOk && !load_bytes_ymem(mem, *addr, words ? (void *)words : bytes,
+                               nBytes)) {
+    fprintf(stderr, "%s: %zu bytes do not fit in memory at %08lx\n",
+            path, nBytes, *addr);
+    isOk = false;
+  }
+  free(words);
+  if (bytes) munmap((void *)bytes, size);
+  return isOk ? nWords : -1;
+}
@@ -0,0 +1,21 @@
+#ifndef _YINPUT_H
+#define _YINPUT_H
+
+#include "y86.h"
+#include "ymem.h"
+
+/** Bulk program inputs: a file of words which is mmap'd and copied
+ *  into memory with a single copy rather than given as INT_INPUTS.
+ *  Like a loaded program, the inputs become part of the baseline
+ *  against which dump_changes_ymem() reports changes.
+ *
+ *  spec has the form FILE[@ADDR].  If isText, FILE contains integers
+ *  separated by whitespace (as accepted by strtol() with base 0),
+ *  else it contains raw little-endian 8-byte words.  The words are
+ *  copied to ADDR, or if no ADDR is given, to the top of mem as for
+ *  INT_INPUTS.  Set *addr to where they were copied and return their
+ *  #; return -1 after printing a message on stderr on error.
+ */
+long load_yinput(YMem *mem, const char *spec, bool isText, Address *addr);
+
+#endif //ifndef _YINPUT_H
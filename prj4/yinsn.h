@@ -0,0 +1,87 @@
+#ifndef _YINSN_H
+#define _YINSN_H
+
+#include "y86.h"
+#include "yregs.h"
+
+#include <stdbool.h>
+
+/** Encodings of the Y86 instructions (Figure 4.2 of Bryant's
+ *  CompSys3e, plus the atomics of yatomic.h), shared by the modules
+ *  which decode instructions themselves: the step (ysim.c), the load
+ *  time verifier, the lockstep engine, the loop kernel and the fuzzer.
+ */
+
+/** Base opcodes: the high nybble of the first byte */
+typedef enum {
+  HALT_CODE, NOP_CODE, CMOVxx_CODE, IRMOVQ_CODE, RMMOVQ_CODE, MRMOVQ_CODE,
+  OP1_CODE, Jxx_CODE, CALL_CODE, RET_CODE,
+  PUSHQ_CODE, POPQ_CODE, ATOMIC_CODE
+} BaseOpCode;
+
+enum { N_BASE_CODES = ATOMIC_CODE + 1 };
+
+/** Functions of OPq */
+enum { ADDQ_FN, SUBQ_FN, ANDQ_FN, XORQ_FN };
+
+enum { MAX_INSN_LEN = 10 };   /** max # of bytes in an instruction */
+
+/** How the register byte of an instruction is used */
+typedef enum {
+  NO_REGS,        /** no register byte */
+  BOTH_REGS,      /** rA and rB are both registers */
+  RB_REG,         /** rA is F, rB is a register */
+  RA_REG,         /** rA is a register, rB is F */
+} RegsUse;
+
+typedef struct {
+  int length;     /** # of bytes in the instruction */
+  int maxFn;      /** largest valid function */
+  RegsUse regsUse;
+} InsnFormat;
+
+/** Format of the instructions of each base opcode */
+static const InsnFormat insnFormats[N_BASE_CODES] = {
+  [HALT_CODE] =    { 1, 0, NO_REGS },
+  [NOP_CODE] =     { 1, 0, NO_REGS },
+  [CMOVxx_CODE] =  { 2, 6, BOTH_REGS },
+  [IRMOVQ_CODE] =  { 10, 0, RB_REG },
+  [RMMOVQ_CODE] =  { 10, 0, BOTH_REGS },
+  [MRMOVQ_CODE] =  { 10, 0, BOTH_REGS },
+  [OP1_CODE] =     { 2, 3, BOTH_REGS },
+  [Jxx_CODE] =     { 9, 6, NO_REGS },
+  [CALL_CODE] =    { 9, 0, NO_REGS },
+  [RET_CODE] =     { 1, 0, NO_REGS },
+  [PUSHQ_CODE] =   { 2, 0, RA_REG },
+  [POPQ_CODE] =    { 2, 0, RA_REG },
+  [ATOMIC_CODE] =  { 10, 1, BOTH_REGS },
+};
+
+/** Return true iff register byte regs is valid for use. */
+static inline bool
+is_valid_regs(RegsUse use, Byte regs)
+{
+  const Register rA = regs >> 4, rB = regs & 0xF;
+  switch (use) {
+  case NO_REGS:
+    return true;
+  case BOTH_REGS:
+    return rA < REG_NONE && rB < REG_NONE;
+  case RB_REG:
+    return rA == REG_NONE && rB < REG_NONE;
+  case RA_REG:
+    return rA < REG_NONE && rB == REG_NONE;
+  }
+  return false;
+}
+
+/** Return the little-endian word in code[]. */
+static inline Word
+get_imm(const Byte code[])
+{
+  Word word = 0;
+  for (int i = sizeof(Word) - 1; i >= 0; i--) word = (word << 8) | code[i];
+  return word;
+}
+
+#endif //ifndef _YINSN_H
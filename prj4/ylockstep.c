@@ -0,0 +1,517 @@
+#include "ylockstep.h"
+
+#include "ydump.h"
+#include "yinsn.h"
+#include "ysim.h"
+
+#include "errors.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint64_t LaneSet;   //bit l set iff lane l is in the set
+
+struct YLockstepStruct {
+  int nLanes;
+  Address memSize;
+  YMem *mems[MAX_LANES_YLOCKSTEP];
+  //structure-of-arrays state: element l of each array is for lane l
+  Word regs[REG_NONE][MAX_LANES_YLOCKSTEP];
+  Word pc[MAX_LANES_YLOCKSTEP];
+  Word cc[MAX_LANES_YLOCKSTEP];
+  Status status[MAX_LANES_YLOCKSTEP];
+  LaneSet groups[MAX_LANES_YLOCKSTEP];  //running lanes partitioned by pc
+  int nGroups;
+  Address codeLimit;     //all fetches so far were below this address
+  bool isCodeWritten;    //fetched code may differ between lanes
+  Y86 *scratch;          //for running one lane with step_ysim_mem()
+};
+
+enum { ALWAYS_COND, LE_COND, LT_COND, EQ_COND, NE_COND, GE_COND, GT_COND };
+
+static Byte
+get_nybble(Byte op, int pos) {
+  return (op >> (pos * 4)) & 0xF;
+}
+
+static bool
+is_reg(Byte reg)
+{
+  return reg < REG_NONE;
+}
+
+/********************** Allocation / Deallocation **********************/
+
+/** Create nLanes instances of the program loaded in image starting at
+ *  pc entry.  Each lane gets its own copy of image.
+ */
+YLockstep *
+new_ylockstep(const YMem *image, Address entry, int nLanes)
+{
+  if (nLanes < 1 || nLanes > MAX_LANES_YLOCKSTEP) {
+    fatal("bad # of lockstep lanes %d\n", nLanes);
+  }
+  YLockstep *lockstep = calloc(1, sizeof(struct YLockstepStruct));
+  if (!lockstep) fatal("out of memory\n");
+  lockstep->nLanes = nLanes;
+  lockstep->memSize = get_size_ymem(image);
+  for (int l = 0; l < nLanes; l++) {
+    if (!(lockstep->mems[l] = new_ymem(lockstep->memSize))) {
+      fatal("cannot reserve memory for lane %d\n", l);
+    }
+  }
+  //copy only the non-zero pages of image
+  Byte page[YMEM_PAGE_SIZE];
+  static const Byte zeros[YMEM_PAGE_SIZE];
+  for (Address base = 0; base < lockstep->memSize; base += YMEM_PAGE_SIZE) {
+    read_bytes_ymem(image, base, page, YMEM_PAGE_SIZE);
+    if (memcmp(page, zeros, YMEM_PAGE_SIZE) == 0) continue;
+    for (int l = 0; l < nLanes; l++) {
+      load_bytes_ymem(lockstep->mems[l], base, page, YMEM_PAGE_SIZE);
+    }
+  }
+  //every lane starts in the state of a new y86
+  Y86 *y86 = lockstep->scratch = new_y86_default();
+  for (int l = 0; l < nLanes; l++) {
+    for (Register r = REG_RAX; r < REG_NONE; r++) {
+      lockstep->regs[r][l] = read_register_y86(y86, r);
+    }
+    lockstep->pc[l] = entry;
+    lockstep->cc[l] = read_cc_y86(y86);
+    lockstep->status[l] = STATUS_AOK;
+  }
+  lockstep->groups[0] = (nLanes == 64) ? ~0UL : (1UL << nLanes) - 1;
+  lockstep->nGroups = 1;
+  return lockstep;
+}
+
+/** Free all resources allocated by new_ylockstep() in lockstep. */
+void
+free_ylockstep(YLockstep *lockstep)
+{
+  for (int l = 0; l < lockstep->nLanes; l++) free_ymem(lockstep->mems[l]);
+  free_y86(lockstep->scratch);
+  free(lockstep);
+}
+
+/** Copy params[nParams] to the top of lane's memory and set %rdi to
+ *  nParams and %rsi to their address, as for a single run.
+ */
+void
+set_params_ylockstep(YLockstep *lockstep, int lane,
+                     int nParams, const Word params[])
+{
+  if (nParams == 0) return;
+  const Address argv = lockstep->memSize - nParams * sizeof(Word);
+  for (int i = 0; i < nParams; i++) {
+    write_word_ymem(lockstep->mems[lane], argv + i * sizeof(Word), params[i]);
+  }
+  lockstep->regs[REG_RDI][lane] = nParams;
+  lockstep->regs[REG_RSI][lane] = argv;
+}
+
+/**************************** Single Lanes *****************************/
+
+static void
+load_lane(YLockstep *lockstep, int l, Y86 *y86)
+{
+  for (Register r = REG_RAX; r < REG_NONE; r++) {
+    write_register_y86(y86, r, lockstep->regs[r][l]);
+  }
+  write_pc_y86(y86, lockstep->pc[l]);
+  write_cc_y86(y86, lockstep->cc[l]);
+  write_status_y86(y86, lockstep->status[l]);
+}
+
+/** Execute the next instruction of lane l alone. */
+static void
+step_lane(YLockstep *lockstep, int l)
+{
+  Y86 *y86 = lockstep->scratch;
+  load_lane(lockstep, l, y86);
+  step_ysim_mem(y86, lockstep->mems[l]);
+  for (Register r = REG_RAX; r < REG_NONE; r++) {
+    lockstep->regs[r][l] = read_register_y86(y86, r);
+  }
+  lockstep->pc[l] = read_pc_y86(y86);
+  lockstep->cc[l] = read_cc_y86(y86);
+  lockstep->status[l] = read_status_y86(y86);
+}
+
+/**************************** Vector Ops *******************************/
+
+/* The loops below run over all lanes, with m[l] all ones for the lanes
+ * being stepped and zero for the others, so that they have no
+ * data-dependent branches and are vectorized.
+ */
+
+static inline Word
+blend(Word m, Word a, Word b)
+{
+  return (a & m) | (b & ~m);
+}
+
+static void
+get_masks(const YLockstep *lockstep, LaneSet lanes, Word m[])
+{
+  for (int l = 0; l < lockstep->nLanes; l++) m[l] = -((lanes >> l) & 1);
+}
+
+static void
+advance_pc(YLockstep *lockstep, const Word m[], Word len)
+{
+  for (int l = 0; l < lockstep->nLanes; l++) lockstep->pc[l] += len & m[l];
+}
+
+/** Set cond[l] to all ones iff the condition fn holds in lane l. */
+static void
+get_conds(const YLockstep *lockstep, Byte fn, Word cond[])
+{
+  const Word isAlways = fn == ALWAYS_COND, isLe = fn == LE_COND;
+  const Word isLt = fn == LT_COND, isEq = fn == EQ_COND;
+  const Word isNe = fn == NE_COND, isGe = fn == GE_COND;
+  const Word isGt = fn == GT_COND;
+  for (int l = 0; l < lockstep->nLanes; l++) {
+    const Word cc = lockstep->cc[l];
+    const Word zf = (cc >> ZF_CC) & 1;
+    const Word lt = ((cc >> SF_CC) ^ (cc >> OF_CC)) & 1;
+    cond[l] = -(isAlways | (isLe & (lt | zf)) | (isLt & lt) | (isEq & zf) |
+                (isNe & !zf) | (isGe & !lt) | (isGt & !lt & !zf));
+  }
+}
+
+/** OPq rA, rB with function fn in all lanes selected by m. */
+static void
+vector_op(YLockstep *lockstep, const Word m[], Byte fn, Byte rA, Byte rB)
+{
+  const Word isAdd = -(Word)(fn == ADDQ_FN), isSub = -(Word)(fn == SUBQ_FN);
+  const Word isAnd = -(Word)(fn == ANDQ_FN), isXor = -(Word)(fn == XORQ_FN);
+  Word *a = lockstep->regs[rA], *b = lockstep->regs[rB];
+  Word *cc = lockstep->cc;
+  for (int l = 0; l < lockstep->nLanes; l++) {
+    const Word x = a[l], y = b[l];
+    const Word r = (isAdd & (y + x)) | (isSub & (y - x)) |
+      (isAnd & (y & x)) | (isXor & (y ^ x));
+    //sign bit of of is set on signed overflow, as in ysim.c
+    const Word of = (isAdd & ~(x ^ y) & (x ^ r)) | (isSub & (y ^ x) & (y ^ r));
+    const Word c = ((Word)(r == 0) << ZF_CC) | ((r >> 63) << SF_CC) |
+      ((of >> 63) << OF_CC);
+    b[l] = blend(m[l], r, y);
+    cc[l] = blend(m[l], c, cc[l]);
+  }
+}
+
+/***************************** Group Step ******************************/
+
+/** Return the lanes l in lanes for which the word at addr[l] cannot be
+ *  accessed.
+ */
+static LaneSet
+get_bad_words(const YLockstep *lockstep, LaneSet lanes, const Word addr[])
+{
+  LaneSet bad = 0;
+  for (LaneSet s = lanes; s != 0; s &= s - 1) {
+    const int l = __builtin_ctzll(s);
+    if (addr[l] > lockstep->memSize - sizeof(Word)) bad |= 1UL << l;
+  }
+  return bad;
+}
+
+static void
+store_word(YLockstep *lockstep, int l, Address addr, Word word)
+{
+  write_word_ymem(lockstep->mems[l], addr, word);
+  if (addr < lockstep->codeLimit) lockstep->isCodeWritten = true;
+}
+
+static Word
+load_word(YLockstep *lockstep, int l, Address addr)
+{
+  Word word = 0;
+  read_word_ymem(lockstep->mems[l], addr, &word);
+  return word;
+}
+
+/** Execute the instruction at pc in every lane in lanes.  Lanes for
+ *  which the instruction is uncommon or would fault are stepped one
+ *  at a time.
+ */
+static void
+step_group(YLockstep *lockstep, LaneSet lanes, Address pc)
+{
+  const int leader = __builtin_ctzll(lanes);
+  Byte code[10] = { 0 };
+  int len = 0;
+  if (read_bytes_ymem(lockstep->mems[leader], pc, code, 1) &&
+      get_nybble(code[0], 1) < N_BASE_CODES) {
+    len = insnFormats[get_nybble(code[0], 1)].length;
+    if (!read_bytes_ymem(lockstep->mems[leader], pc, code, len)) len = 0;
+  }
+  LaneSet single = (len == 0) ? lanes : 0;
+  if (len > 0 && pc + len > lockstep->codeLimit) {
+    lockstep->codeLimit = pc + len;
+  }
+  if (len > 0 && lockstep->isCodeWritten) {
+    //lanes whose code differs from the leader's are stepped alone
+    for (LaneSet s = lanes & (lanes - 1); s != 0; s &= s - 1) {
+      const int l = __builtin_ctzll(s);
+      Byte laneCode[10];
+      read_bytes_ymem(lockstep->mems[l], pc, laneCode, len);
+      if (memcmp(code, laneCode, len) != 0) single |= 1UL << l;
+    }
+  }
+  LaneSet run = lanes & ~single;
+  const Byte fn = get_nybble(code[0], 0);
+  const Byte rA = get_nybble(code[1], 1), rB = get_nybble(code[1], 0);
+  Word *sp = lockstep->regs[REG_RSP];
+  Word m[MAX_LANES_YLOCKSTEP], addr[MAX_LANES_YLOCKSTEP];
+  switch (run ? get_nybble(code[0], 1) : N_BASE_CODES) {
+  case HALT_CODE:
+    for (LaneSet s = run; s != 0; s &= s - 1) {
+      lockstep->status[__builtin_ctzll(s)] = STATUS_HLT;
+    }
+    break;
+  case NOP_CODE:
+    get_masks(lockstep, run, m);
+    advance_pc(lockstep, m, len);
+    break;
+  case CMOVxx_CODE: {
+    //a bad condition stops the lane with STATUS_INS
+    if (fn > GT_COND || !(is_reg(rA) && is_reg(rB))) {
+      single |= run;
+      break;
+    }
+    Word cond[MAX_LANES_YLOCKSTEP];
+    get_masks(lockstep, run, m);
+    get_conds(lockstep, fn, cond);
+    Word *a = lockstep->regs[rA], *b = lockstep->regs[rB];
+    for (int l = 0; l < lockstep->nLanes; l++) {
+      b[l] = blend(m[l] & cond[l], a[l], b[l]);
+    }
+    advance_pc(lockstep, m, len);
+    break;
+  }
+  case IRMOVQ_CODE: {
+    if (!is_reg(rB)) {
+      single |= run;
+      break;
+    }
+    const Word imm = get_imm(&code[2]);
+    Word *b = lockstep->regs[rB];
+    get_masks(lockstep, run, m);
+    for (int l = 0; l < lockstep->nLanes; l++) b[l] = blend(m[l], imm, b[l]);
+    advance_pc(lockstep, m, len);
+    break;
+  }
+  case RMMOVQ_CODE:
+  case MRMOVQ_CODE: {
+    if (!(is_reg(rA) && is_reg(rB))) {
+      single |= run;
+      break;
+    }
+    const Word disp = get_imm(&code[2]);
+    for (int l = 0; l < lockstep->nLanes; l++) {
+      addr[l] = lockstep->regs[rB][l] + disp;
+    }
+    const LaneSet bad = get_bad_words(lockstep, run, addr);
+    single |= bad;
+    run &= ~bad;
+    for (LaneSet s = run; s != 0; s &= s - 1) {
+      const int l = __builtin_ctzll(s);
+      if (get_nybble(code[0], 1) == RMMOVQ_CODE) {
+        store_word(lockstep, l, addr[l], lockstep->regs[rA][l]);
+      }
+      else {
+        lockstep->regs[rA][l] = load_word(lockstep, l, addr[l]);
+      }
+    }
+    get_masks(lockstep, run, m);
+    advance_pc(lockstep, m, len);
+    break;
+  }
+  case OP1_CODE:
+    if (fn > XORQ_FN || !(is_reg(rA) && is_reg(rB))) {
+      single |= run;
+      break;
+    }
+    get_masks(lockstep, run, m);
+    vector_op(lockstep, m, fn, rA, rB);
+    advance_pc(lockstep, m, len);
+    break;
+  case Jxx_CODE: {
+    if (fn > GT_COND) {
+      single |= run;
+      break;
+    }
+    const Word dest = get_imm(&code[1]);
+    Word cond[MAX_LANES_YLOCKSTEP];
+    get_masks(lockstep, run, m);
+    get_conds(lockstep, fn, cond);
+    for (int l = 0; l < lockstep->nLanes; l++) {
+      const Word next = blend(cond[l], dest, lockstep->pc[l] + len);
+      lockstep->pc[l] = blend(m[l], next, lockstep->pc[l]);
+    }
+    break;
+  }
+  case CALL_CODE:
+  case PUSHQ_CODE: {
+    const bool isCall = get_nybble(code[0], 1) == CALL_CODE;
+    if (!isCall && !is_reg(rA)) {
+      single |= run;
+      break;
+    }
+    for (int l = 0; l < lockstep->nLanes; l++) addr[l] = sp[l] - sizeof(Word);
+    const LaneSet bad = get_bad_words(lockstep, run, addr);
+    single |= bad;
+    run &= ~bad;
+    for (LaneSet s = run; s != 0; s &= s - 1) {
+      const int l = __builtin_ctzll(s);
+      //pushq %rsp pushes the old %rsp
+      const Word value = isCall ? pc + len : lockstep->regs[rA][l];
+      sp[l] = addr[l];
+      store_word(lockstep, l, addr[l], value);
+    }
+    get_masks(lockstep, run, m);
+    if (isCall) {
+      const Word dest = get_imm(&code[1]);
+      for (int l = 0; l < lockstep->nLanes; l++) {
+        lockstep->pc[l] = blend(m[l], dest, lockstep->pc[l]);
+      }
+    }
+    else {
+      advance_pc(lockstep, m, len);
+    }
+    break;
+  }
+  case RET_CODE:
+  case POPQ_CODE: {
+    const bool isRet = get_nybble(code[0], 1) == RET_CODE;
+    if (!isRet && !is_reg(rA)) {
+      single |= run;
+      break;
+    }
+    const LaneSet bad = get_bad_words(lockstep, run, sp);
+    single |= bad;
+    run &= ~bad;
+    for (LaneSet s = run; s != 0; s &= s - 1) {
+      const int l = __builtin_ctzll(s);
+      const Word stack = sp[l];
+      const Word value = load_word(lockstep, l, stack);
+      if (isRet) {
+        sp[l] = stack + sizeof(Word);
+        lockstep->pc[l] = value;
+      }
+      else {
+        //popq %rsp leaves the popped value in %rsp
+        lockstep->regs[rA][l] = value;
+        if (rA != REG_RSP) sp[l] = stack + sizeof(Word);
+        lockstep->pc[l] += len;
+      }
+    }
+    break;
+  }
+  default:
+    single |= run;
+    break;
+  }
+  for (LaneSet s = single; s != 0; s &= s - 1) {
+    step_lane(lockstep, __builtin_ctzll(s));
+  }
+  if (single != 0 && len > 0) {
+    //a lane stepped alone may have written anywhere
+    const Byte op = get_nybble(code[0], 1);
+    if (op == RMMOVQ_CODE || op == CALL_CODE || op == PUSHQ_CODE ||
+        op == ATOMIC_CODE) {
+      lockstep->isCodeWritten = true;
+    }
+  }
+}
+
+/** Add the running lanes in lanes back to the groups, one per pc. */
+static void
+regroup(YLockstep *lockstep, LaneSet lanes)
+{
+  for (LaneSet s = lanes; s != 0; s &= s - 1) {
+    const int l = __builtin_ctzll(s);
+    if (lockstep->status[l] != STATUS_AOK) lanes &= ~(1UL << l);
+  }
+  while (lanes != 0) {
+    const Address pc = lockstep->pc[__builtin_ctzll(lanes)];
+    LaneSet group = 0;
+    for (LaneSet s = lanes; s != 0; s &= s - 1) {
+      const int l = __builtin_ctzll(s);
+      if (lockstep->pc[l] == pc) group |= 1UL << l;
+    }
+    lockstep->groups[lockstep->nGroups++] = group;
+    lanes &= ~group;
+  }
+}
+
+static Address
+get_group_pc(const YLockstep *lockstep, int g)
+{
+  return lockstep->pc[__builtin_ctzll(lockstep->groups[g])];
+}
+
+/** Run all lanes until each has stopped (status no longer
+ *  STATUS_AOK) or maxSteps group steps have been taken; a later call
+ *  continues where this one left off.  Return the # of group steps
+ *  taken.  With a single lane, a group step is a step of that lane.
+ */
+long
+run_ylockstep(YLockstep *lockstep, long maxSteps)
+{
+  long nSteps = 0;
+  while (lockstep->nGroups > 0 && nSteps < maxSteps) {
+    //step the group with the lowest pc, merging any others there, so
+    //that lanes which diverged at a branch meet again after it
+    int g = 0;
+    for (int i = 1; i < lockstep->nGroups; i++) {
+      if (get_group_pc(lockstep, i) < get_group_pc(lockstep, g)) g = i;
+    }
+    const Address pc = get_group_pc(lockstep, g);
+    LaneSet lanes = 0;
+    int n = 0;
+    for (int i = 0; i < lockstep->nGroups; i++) {
+      if (get_group_pc(lockstep, i) == pc) {
+        lanes |= lockstep->groups[i];
+      }
+      else {
+        lockstep->groups[n++] = lockstep->groups[i];
+      }
+    }
+    lockstep->nGroups = n;
+    step_group(lockstep, lanes, pc);
+    regroup(lockstep, lanes);
+    nSteps++;
+  }
+  return nSteps;
+}
+
+/** Copy the registers, pc, cc and status of lane into y86. */
+void
+read_lane_ylockstep(YLockstep *lockstep, int lane, Y86 *y86)
+{
+  load_lane(lockstep, lane, y86);
+}
+
+/** Return the memory of lane. */
+const YMem *
+get_mem_ylockstep(const YLockstep *lockstep, int lane)
+{
+  return lockstep->mems[lane];
+}
+
+/** Dump all the registers of lane followed by its memory changes in
+ *  the same format as a single run.
+ */
+void
+dump_ylockstep(YLockstep *lockstep, int lane, FILE *out)
+{
+  load_lane(lockstep, lane, lockstep->scratch);
+  YDump *dump = new_ydump(lockstep->scratch);
+  dump_changes_ydump(dump, true, out);
+  free_ydump(dump);
+  dump_changes_ymem(lockstep->mems[lane], out);
+}
@@ -0,0 +1,56 @@
+#ifndef _YLOCKSTEP_H
+#define _YLOCKSTEP_H
+
+#include "y86.h"
+#include "ymem.h"
+
+#include <stdio.h>
+
+/** Lockstep execution of up to MAX_LANES_YLOCKSTEP instances (lanes)
+ *  of one program, each with its own parameters and memory.  Lanes at
+ *  the same pc form a group which is stepped together: registers, pc
+ *  and cc are kept in structure-of-arrays form so that ALU ops,
+ *  condition codes, branches and moves are computed by loops over all
+ *  lanes which the compiler vectorizes.  Lanes which branch differently
+ *  are split into separate groups and merged again when they reach
+ *  the same pc.  Instructions which may fault or which are not common
+ *  are run lane by lane with step_ysim_mem(), so the final state of
+ *  every lane is exactly that of a separate run.
+ */
+typedef struct YLockstepStruct YLockstep;
+
+enum { MAX_LANES_YLOCKSTEP = 64 };
+
+/** Create nLanes instances of the program loaded in image starting at
+ *  pc entry.  Each lane gets its own copy of image.
+ */
+YLockstep *new_ylockstep(const YMem *image, Address entry, int nLanes);
+
+/** Free all resources allocated by new_ylockstep() in lockstep. */
+void free_ylockstep(YLockstep *lockstep);
+
+/** Copy params[nParams] to the top of lane's memory and set %rdi to
+ *  nParams and %rsi to their address, as for a single run.
+ */
+void set_params_ylockstep(YLockstep *lockstep, int lane,
+                          int nParams, const Word params[]);
+
+/** Run all lanes until each has stopped (status no longer
+ *  STATUS_AOK) or maxSteps group steps have been taken; a later call
+ *  continues where this one left off.  Return the # of group steps
+ *  taken.  With a single lane, a group step is a step of that lane.
+ */
+long run_ylockstep(YLockstep *lockstep, long maxSteps);
+
+/** Copy the registers, pc, cc and status of lane into y86. */
+void read_lane_ylockstep(YLockstep *lockstep, int lane, Y86 *y86);
+
+/** Return the memory of lane. */
+const YMem *get_mem_ylockstep(const YLockstep *lockstep, int lane);
+
+/** Dump all the registers of lane followed by its memory changes in
+ *  the same format as a single run.
+ */
+void dump_ylockstep(YLockstep *lockstep, int lane, FILE *out);
+
+#endif //ifndef _YLOCKSTEP_H
@@ -0,0 +1,315 @@
+#include "yloop.h"
+
+#include "ycc.h"
+#include "yinsn.h"
+
+#include "errors.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+  MAX_CODE = MAX_YLOOP_INSNS * MAX_INSN_LEN,
+  N_SLOTS = 64,         /** # of heads tracked, direct-mapped by pc */
+  HOT_COUNT = 16,       /** # of back jumps after which a loop is hot */
+};
+
+typedef enum {
+  COUNTING_SLOT,        /** counting back jumps to head */
+  COMPILED_SLOT,        /** body decoded */
+  REJECTED_SLOT,        /** not a loop which can be accelerated */
+} SlotState;
+
+typedef struct {
+  bool isUsed;
+  SlotState state;
+  int count;            //# of back jumps to head seen
+  size_t codeLength;
+  Byte code[MAX_CODE];  //code of body when it was decoded
+  YLoopBody body;       //body.head is the head of the slot
+} Slot;
+
+struct YLoopStruct {
+  Address lastPc;       //pc at the previous call of check_yloop()
+  Slot slots[N_SLOTS];
+};
+
+/********************** Allocation / Deallocation **********************/
+
+/** Return a new loop detector with no loops found. */
+YLoop *
+new_yloop(void)
+{
+  YLoop *loop = calloc(1, sizeof(YLoop));
+  if (!loop) fatal("out of memory\n");
+  return loop;
+}
+
+/** Free all resources allocated by new_yloop() in loop. */
+void
+free_yloop(YLoop *loop)
+{
+  free(loop);
+}
+
+/*************************** Memory Access *****************************/
+
+/** Copy the n bytes at addr in mem, or in the memory of y86 if mem is
+ *  NULL, into bytes[].  Return false (leaving the status of y86
+ *  unchanged) if they are not entirely within memory.
+ */
+static bool
+read_code(Y86 *y86, const YMem *mem, Address addr, Byte bytes[], size_t n)
+{
+  if (mem) return read_bytes_ymem(mem, addr, bytes, n);
+  const Address memSize = get_memory_size_y86(y86);
+  if (addr > memSize || n > memSize - addr) return false;
+  for (size_t i = 0; i < n; i++) bytes[i] = read_memory_byte_y86(y86, addr + i);
+  return true;
+}
+
+/** Set *word to the word at addr in mem, or in the memory of y86 if
+ *  mem is NULL.  Return false if the load would fault, leaving the
+ *  status of y86 unchanged.
+ */
+static inline bool
+load_word(Y86 *y86, const YMem *mem, Address addr, Word *word)
+{
+  if (mem) return read_word_ymem(mem, addr, word);
+  const Address memSize = get_memory_size_y86(y86);
+  if (addr > memSize || sizeof(Word) > memSize - addr) return false;
+  *word = read_memory_word_y86(y86, addr);
+  if (read_status_y86(y86) == STATUS_AOK) return true;
+  write_status_y86(y86, STATUS_AOK);
+  return false;
+}
+
+/****************************** Decoding *******************************/
+
+/** Return true iff instructions with base opcode base may be in a
+ *  loop body.
+ */
+static bool
+is_loop_code(int base)
+{
+  switch (base) {
+  case NOP_CODE:
+  case CMOVxx_CODE:
+  case IRMOVQ_CODE:
+  case MRMOVQ_CODE:
+  case OP1_CODE:
+  case Jxx_CODE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/** Decode the instruction at pc into *insn.  Return false if it is
+ *  not a valid instruction allowed in a loop body.
+ */
+static bool
+decode(Y86 *y86, const YMem *mem, Address pc, YVerifiedInsn *insn)
+{
+  Byte code[MAX_INSN_LEN];
+  if (!read_code(y86, mem, pc, code, 1)) return false;
+  const int base = code[0] >> 4, fn = code[0] & 0xF;
+  if (!is_loop_code(base)) return false;
+  const InsnFormat *format = &insnFormats[base];
+  if (fn > format->maxFn) return false;
+  if (!read_code(y86, mem, pc, code, format->length)) return false;
+  *insn = (YVerifiedInsn) {
+    .op = code[0], .length = format->length,
+    .regA = REG_NONE, .regB = REG_NONE,
+  };
+  int immOffset = 1;
+  if (format->regsUse != NO_REGS) {
+    if (!is_valid_regs(format->regsUse, code[1])) return false;
+    insn->regA = code[1] >> 4;
+    insn->regB = code[1] & 0xF;
+    immOffset = 2;
+  }
+  if (format->length > immOffset) insn->imm = get_imm(&code[immOffset]);
+  return true;
+}
+
+/** Return true iff the instruction at from, or the one after it if
+ *  from holds an OPq, is a conditional jXX to to.
+ */
+static bool
+is_back_jump(Y86 *y86, const YMem *mem, Address from, Address to)
+{
+  YVerifiedInsn insn;
+  if (!decode(y86, mem, from, &insn)) return false;
+  //a fused OPq+jXX step (see step_fused_ysim_mem()) starts at the OPq
+  if ((insn.op >> 4) == OP1_CODE &&
+      !decode(y86, mem, from + insn.length, &insn)) {
+    return false;
+  }
+  return (insn.op >> 4) == Jxx_CODE && (insn.op & 0xF) != ALWAYS_COND &&
+    insn.imm == to;
+}
+
+/** Decode the body of the loop at the head of slot.  Return false if
+ *  it is not a loop which can be accelerated.
+ */
+static bool
+compile(Slot *slot, Y86 *y86, const YMem *mem)
+{
+  YLoopBody *body = &slot->body;
+  Address pc = body->head;
+  body->writtenRegs = 0;
+  for (int n = 0; n < MAX_YLOOP_INSNS; n++) {
+    YVerifiedInsn *insn = &body->insns[n];
+    if (!decode(y86, mem, pc, insn)) return false;
+    pc += insn->length;
+    switch (insn->op >> 4) {
+    case CMOVxx_CODE: case IRMOVQ_CODE: case OP1_CODE:
+      body->writtenRegs |= 1u << insn->regB;
+      break;
+    case MRMOVQ_CODE:
+      body->writtenRegs |= 1u << insn->regA;
+      break;
+    case Jxx_CODE:
+      if ((insn->op & 0xF) == ALWAYS_COND || insn->imm != body->head ||
+          n == 0) {
+        return false;
+      }
+      body->nInsns = n + 1;
+      slot->codeLength = pc - body->head;
+      return read_code(y86, mem, body->head, slot->code, slot->codeLength);
+    }
+  }
+  return false;
+}
+
+/** Return true iff the code of the body of slot is unchanged. */
+static bool
+is_unchanged(const Slot *slot, Y86 *y86, const YMem *mem)
+{
+  Byte code[MAX_CODE];
+  return read_code(y86, mem, slot->body.head, code, slot->codeLength) &&
+    memcmp(code, slot->code, slot->codeLength) == 0;
+}
+
+/** Note the pc of y86, which must be called before each step (or
+ *  fused pair of steps), and return the body of the hot loop whose
+ *  head is at that pc; NULL if there is none.  Code is read from mem,
+ *  or from the memory of y86 if mem is NULL, without changing the
+ *  status of y86.
+ */
+const YLoopBody *
+check_yloop(YLoop *loop, Y86 *y86, const YMem *mem)
+{
+  const Address pc = read_pc_y86(y86), lastPc = loop->lastPc;
+  loop->lastPc = pc;
+  if (pc >= lastPc) return NULL;  //only backward transfers reach heads
+  Slot *slot = &loop->slots[pc % N_SLOTS];
+  const bool isKnown = slot->isUsed && slot->body.head == pc;
+  if (isKnown && slot->state == COMPILED_SLOT) {
+    if (is_unchanged(slot, y86, mem)) return &slot->body;
+    slot->state = COUNTING_SLOT;    //rewritten: count again
+    slot->count = 0;
+    return NULL;
+  }
+  if (isKnown && slot->state == REJECTED_SLOT) return NULL;
+  if (!is_back_jump(y86, mem, lastPc, pc)) return NULL;
+  if (!isKnown) {
+    slot->isUsed = true;
+    slot->state = COUNTING_SLOT;
+    slot->count = 0;
+    slot->body.head = pc;
+  }
+  if (++slot->count < HOT_COUNT) return NULL;
+  slot->state = compile(slot, y86, mem) ? COMPILED_SLOT : REJECTED_SLOT;
+  return (slot->state == COMPILED_SLOT) ? &slot->body : NULL;
+}
+
+/******************************* Kernel ********************************/
+
+/** Run insn, which is not the final jXX of a body, on regs[] and *cc.
+ *  Return false if its load would fault.
+ */
+static inline bool
+run_insn(const YVerifiedInsn *insn, Word regs[], Byte *cc, Y86 *y86,
+         const YMem *mem)
+{
+  const Register rA = insn->regA, rB = insn->regB;
+  switch (insn->op >> 4) {
+  case CMOVxx_CODE:
+    if (holds_cc(*cc, insn->op & 0xF)) regs[rB] = regs[rA];
+    break;
+  case IRMOVQ_CODE:
+    regs[rB] = insn->imm;
+    break;
+  case MRMOVQ_CODE:
+    return load_word(y86, mem, regs[rB] + insn->imm, &regs[rA]);
+  case OP1_CODE: {
+    const Word opA = regs[rA], opB = regs[rB];
+    Word result;
+    switch (insn->op & 0xF) {
+    case ADDQ_FN:
+      result = opA + opB;
+      *cc = add_arith_cc(opA, opB, result);
+      break;
+    case SUBQ_FN:
+      result = opB - opA;
+      *cc = sub_arith_cc(opB, opA, result);
+      break;
+    case ANDQ_FN:
+      result = opA & opB;
+      *cc = logic_op_cc(result);
+      break;
+    default:
+      result = opA ^ opB;
+      *cc = logic_op_cc(result);
+      break;
+    }
+    regs[rB] = result;
+    break;
+  }
+  }
+  return true;
+}
+
+/** Run up to maxIters whole iterations of body on y86, whose pc must
+ *  be the head of body, reading memory from mem or from y86 if mem
+ *  is NULL.  An iteration which would fault or leave the loop is not
+ *  run, so that it can be stepped normally; the pc of y86 is always
+ *  left at the head.  The state afterwards is that after stepping
+ *  each instruction of the iterations run.  Return their #.
+ */
+long
+run_yloop(const YLoopBody *body, Y86 *y86, const YMem *mem, long maxIters)
+{
+  if (read_pc_y86(y86) != body->head ||
+      read_status_y86(y86) != STATUS_AOK) {
+    return 0;
+  }
+  Word regs[N_REGISTERS], saved[N_REGISTERS];
+  for (int r = 0; r < N_REGISTERS; r++) regs[r] = read_register_y86(y86, r);
+  Byte cc = read_cc_y86(y86);
+  const int nBody = body->nInsns - 1;
+  const Condition loopCond = body->insns[nBody].op & 0xF;
+  long n;
+  for (n = 0; n < maxIters; n++) {
+    memcpy(saved, regs, sizeof(regs));
+    const Byte savedCc = cc;
+    bool isOk = true;
+    for (int i = 0; isOk && i < nBody; i++) {
+      isOk = run_insn(&body->insns[i], regs, &cc, y86, mem);
+    }
+    if (!isOk || !holds_cc(cc, loopCond)) {
+      memcpy(regs, saved, sizeof(regs));
+      cc = savedCc;
+      break;
+    }
+  }
+  if (n > 0) {
+    for (int r = 0; r < N_REGISTERS; r++) {
+      if (body->writtenRegs & (1u << r)) write_register_y86(y86, r, regs[r]);
+    }
+    write_cc_y86(y86, cc);
+  }
+  return n;
+}
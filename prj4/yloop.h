@@ -0,0 +1,59 @@
+#ifndef _YLOOP_H
+#define _YLOOP_H
+
+#include "y86.h"
+#include "ymem.h"
+#include "yverify.h"
+
+/** Run-time acceleration of simple counted loops.  A loop is a
+ *  straight-line body from its head up to a conditional jXX back to
+ *  the head, with no instructions other than nop, rrmovq/cmovXX,
+ *  irmovq, mrmovq and OPq.  Such a body writes only registers and
+ *  condition codes, so whole iterations can be run by a kernel on
+ *  copies of them, with loads as the only accesses to memory.
+ *
+ *  Heads are found by watching the pcs stepped: a loop becomes hot
+ *  after its jXX has been taken back to its head a number of times,
+ *  and is then decoded once.  The code of a decoded body is compared
+ *  with the memory it was decoded from at each entry, so that
+ *  self-modifying programs never run a stale body.
+ */
+typedef struct YLoopStruct YLoop;
+
+enum {
+  MAX_YLOOP_INSNS = 32,   /** max # of instructions in a loop body */
+};
+
+/** A decoded loop body. */
+typedef struct {
+  Address head;           /** pc of its first instruction */
+  int nInsns;             /** # of instructions, ending with the jXX */
+  unsigned writtenRegs;   /** mask with bit r set iff it writes r */
+  YVerifiedInsn insns[MAX_YLOOP_INSNS];
+} YLoopBody;
+
+/** Return a new loop detector with no loops found. */
+YLoop *new_yloop(void);
+
+/** Free all resources allocated by new_yloop() in loop. */
+void free_yloop(YLoop *loop);
+
+/** Note the pc of y86, which must be called before each step (or
+ *  fused pair of steps), and return the body of the hot loop whose
+ *  head is at that pc; NULL if there is none.  Code is read from mem,
+ *  or from the memory of y86 if mem is NULL, without changing the
+ *  status of y86.
+ */
+const YLoopBody *check_yloop(YLoop *loop, Y86 *y86, const YMem *mem);
+
+/** Run up to maxIters whole iterations of body on y86, whose pc must
+ *  be the head of body, reading memory from mem or from y86 if mem
+ *  is NULL.  An iteration which would fault or leave the loop is not
+ *  run, so that it can be stepped normally; the pc of y86 is always
+ *  left at the head.  The state afterwards is that after stepping
+ *  each instruction of the iterations run.  Return their #.
+ */
+long run_yloop(const YLoopBody *body, Y86 *y86, const YMem *mem,
+               long maxIters);
+
+#endif //ifndef _YLOOP_H
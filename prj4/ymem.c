@@ -0,0 +1,405 @@
+#define _DEFAULT_SOURCE   //for MAP_ANONYMOUS and MAP_NORESERVE
+
+#include "ymem.h"
+
+#include "errors.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+struct YMemStruct {
+  Byte *base;        //sparse host reservation of size bytes
+  Address size;
+  size_t nPages;
+  Byte **shadow;     //shadow[p]: page p at last dump; NULL if untouched
+  size_t *touched;   //indexes of pages with a non-NULL shadow
+  size_t nTouched;
+  size_t maxTouched;
+  uint64_t *dirtyBits;  //bit p set iff page p written since last dump
+  size_t *dirty;     //indexes of pages with their dirty bit set
+  size_t nDirty;
+  size_t maxDirty;
+  pthread_mutex_t lock;  //guards first touches by concurrent cores
+  uint64_t *watchBits;   //bit p set iff page p is watched; NULL if none
+  YMemWatchFn *watchFn;
+  void *watchCtx;
+  YMemWatchFn *writeFn;  //called before each write; NULL if none
+  void *writeCtx;
+};
+
+/********************** Allocation / Deallocation **********************/
+
+/** Create a new paged memory of size bytes (rounded up to a whole
+ *  page).  Return NULL if size is 0 or cannot be reserved.
+ */
+YMem *
+new_ymem(Address size)
+{
+  if (size == 0) return NULL;
+  const size_t nPages = (size + YMEM_PAGE_SIZE - 1) >> YMEM_PAGE_SHIFT;
+  size = (Address)nPages << YMEM_PAGE_SHIFT;
+  //MAP_NORESERVE: nothing is committed until a page is first written
+  Byte *base = mmap(NULL, size, PROT_READ|PROT_WRITE,
+                    MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED) return NULL;
+  YMem *mem = calloc(1, sizeof(struct YMemStruct));
+  //large calloc()'s are mmap'd lazily, so this is also sparse
+  Byte **shadow = calloc(nPages, sizeof(Byte *));
+  uint64_t *dirtyBits = calloc((nPages + 63) / 64, sizeof(uint64_t));
+  if (!mem || !shadow || !dirtyBits) {
+    free(mem); free(shadow); free(dirtyBits); munmap(base, size);
+    return NULL;
+  }
+  mem->base = base;
+  mem->size = size;
+  mem->nPages = nPages;
+  mem->shadow = shadow;
+  mem->dirtyBits = dirtyBits;
+  pthread_mutex_init(&mem->lock, NULL);
+  return mem;
+}
+
+/** Free all resources allocated by new_ymem() in mem. */
+void
+free_ymem(YMem *mem)
+{
+  for (size_t i = 0; i < mem->nTouched; i++) {
+    free(mem->shadow[mem->touched[i]]);
+  }
+  free(mem->touched);
+  free(mem->dirty);
+  free(mem->dirtyBits);
+  free(mem->shadow);
+  free(mem->watchBits);
+  munmap(mem->base, mem->size);
+  pthread_mutex_destroy(&mem->lock);
+  free(mem);
+}
+
+/** Return the (virtual) size in bytes of mem. */
+Address
+get_size_ymem(const YMem *mem)
+{
+  return mem->size;
+}
+
+/** Return # of pages which have been written since mem was loaded. */
+size_t
+get_n_touched_pages_ymem(const YMem *mem)
+{
+  return mem->nTouched;
+}
+
+/************************** Page Tracking ******************************/
+
+/** Save the current contents of page as its shadow.  Called with
+ *  mem->lock held.
+ */
+static void
+save_shadow(YMem *mem, size_t page)
+{
+  if (mem->nTouched == mem->maxTouched) {
+    mem->maxTouched = mem->maxTouched ? 2 * mem->maxTouched : 64;
+    mem->touched = realloc(mem->touched, mem->maxTouched * sizeof(size_t));
+    if (!mem->touched) fatal("cannot track %zu touched pages\n", mem->nTouched);
+  }
+  Byte *shadow = malloc(YMEM_PAGE_SIZE);
+  if (!shadow) fatal("cannot allocate shadow for page %zu\n", page);
+  memcpy(shadow, mem->base + ((Address)page << YMEM_PAGE_SHIFT),
+         YMEM_PAGE_SIZE);
+  mem->touched[mem->nTouched++] = page;
+  mem->shadow[page] = shadow;
+}
+
+static inline bool
+is_dirty(const YMem *mem, size_t page)
+{
+  const uint64_t bits =
+    __atomic_load_n(&mem->dirtyBits[page / 64], __ATOMIC_ACQUIRE);
+  return (bits >> (page % 64)) & 1;
+}
+
+/** Record that page is about to be written: the first time this
+ *  happens the page's current contents are saved as its shadow, and
+ *  the first time after each dump it is added to the dirty list so
+ *  that dump_changes_ymem() visits only written pages.
+ */
+static void
+touch_page(YMem *mem, size_t page)
+{
+  if (is_dirty(mem, page)) return;
+  pthread_mutex_lock(&mem->lock);
+  if (is_dirty(mem, page)) {
+    pthread_mutex_unlock(&mem->lock);
+    return;
+  }
+  if (mem->nDirty == mem->maxDirty) {
+    mem->maxDirty = mem->maxDirty ? 2 * mem->maxDirty : 64;
+    mem->dirty = realloc(mem->dirty, mem->maxDirty * sizeof(size_t));
+    if (!mem->dirty) fatal("cannot track %zu dirty pages\n", mem->nDirty);
+  }
+  mem->dirty[mem->nDirty++] = page;
+  if (!mem->shadow[page]) save_shadow(mem, page);
+  __atomic_or_fetch(&mem->dirtyBits[page / 64], 1UL << (page % 64),
+                    __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&mem->lock);
+}
+
+/** Copy bytes[size] into mem at addr as part of the baseline image
+ *  against which dump_changes_ymem() reports changes.  Return false
+ *  if the bytes do not fit within mem.
+ */
+bool
+load_bytes_ymem(YMem *mem, Address addr, const Byte bytes[], size_t size)
+{
+  if (addr > mem->size || size > mem->size - addr) return false;
+  memcpy(mem->base + addr, bytes, size);
+  return true;
+}
+
+/** Copy the contents of y86's own memory into mem.  The copied
+ *  image becomes the baseline against which dump_changes_ymem()
+ *  reports changes; pages which are all zero are not committed.
+ */
+void
+load_y86_ymem(YMem *mem, Y86 *y86)
+{
+  Address n = get_memory_size_y86(y86);
+  if (n > mem->size) n = mem->size;
+  Byte page[YMEM_PAGE_SIZE];
+  for (Address base = 0; base < n; base += YMEM_PAGE_SIZE) {
+    const Address len = (n - base < YMEM_PAGE_SIZE) ? n - base : YMEM_PAGE_SIZE;
+    bool isZero = true;
+    for (Address i = 0; i < len; i++) {
+      page[i] = read_memory_byte_y86(y86, base + i);
+      isZero = isZero && page[i] == 0;
+    }
+    if (!isZero) load_bytes_ymem(mem, base, page, len);
+  }
+}
+
+/**************************** Watchpoints ******************************/
+
+/** Call fn(ctx, addr, size) after every write of size bytes at addr
+ *  which touches a page overlapping [addr, addr + size).  All watches
+ *  on mem must use the same fn and ctx.
+ */
+void
+watch_ymem(YMem *mem, Address addr, size_t size, YMemWatchFn *fn, void *ctx)
+{
+  if (size == 0 || addr >= mem->size) return;
+  if (size > mem->size - addr) size = mem->size - addr;
+  if (!mem->watchBits) {
+    mem->watchBits = calloc((mem->nPages + 63) / 64, sizeof(uint64_t));
+    if (!mem->watchBits) fatal("out of memory\n");
+  }
+  const size_t last = (addr + size - 1) >> YMEM_PAGE_SHIFT;
+  for (size_t page = addr >> YMEM_PAGE_SHIFT; page <= last; page++) {
+    mem->watchBits[page / 64] |= 1UL << (page % 64);
+  }
+  mem->watchFn = fn;
+  mem->watchCtx = ctx;
+}
+
+/** Remove all watches from mem. */
+void
+clear_watches_ymem(YMem *mem)
+{
+  free(mem->watchBits);
+  mem->watchBits = NULL;
+}
+
+/** Call fn(ctx, addr, size) before every write of size bytes at addr
+ *  in mem, so that fn can read the bytes about to be overwritten.  A
+ *  NULL fn removes the hook.
+ */
+void
+hook_writes_ymem(YMem *mem, YMemWatchFn *fn, void *ctx)
+{
+  mem->writeFn = fn;
+  mem->writeCtx = ctx;
+}
+
+static inline bool
+is_watched(const YMem *mem, size_t page)
+{
+  return (mem->watchBits[page / 64] >> (page % 64)) & 1;
+}
+
+/** Notify mem's watch function of the write of size bytes at addr if
+ *  it touched a watched page.  Only called when mem has watches.
+ */
+static void
+check_watch(YMem *mem, Address addr, size_t size)
+{
+  if (is_watched(mem, addr >> YMEM_PAGE_SHIFT) ||
+      is_watched(mem, (addr + size - 1) >> YMEM_PAGE_SHIFT)) {
+    mem->watchFn(mem->watchCtx, addr, size);
+  }
+}
+
+/*************************** Memory Access *****************************/
+
+/** Set *byte to the byte at addr in mem.  Return false (leaving
+ *  *byte unchanged) if addr is out of bounds.
+ */
+bool
+read_byte_ymem(const YMem *mem, Address addr, Byte *byte)
+{
+  if (addr >= mem->size) return false;
+  *byte = mem->base[addr];
+  return true;
+}
+
+/** Set *word to the word at addr in mem.  Return false (leaving
+ *  *word unchanged) if the word is not entirely within mem.
+ */
+bool
+read_word_ymem(const YMem *mem, Address addr, Word *word)
+{
+  //mem->size is at least a page, so no underflow
+  if (addr > mem->size - sizeof(Word)) return false;
+  memcpy(word, mem->base + addr, sizeof(Word));
+  return true;
+}
+
+/** Copy the size bytes at addr in mem into bytes[].  Return false
+ *  (copying nothing) if they are not entirely within mem.
+ */
+bool
+read_bytes_ymem(const YMem *mem, Address addr, Byte bytes[], size_t size)
+{
+  if (addr > mem->size || size > mem->size - addr) return false;
+  memcpy(bytes, mem->base + addr, size);
+  return true;
+}
+
+/** Write byte to addr in mem.  Return false if addr is out of bounds. */
+bool
+write_byte_ymem(YMem *mem, Address addr, Byte byte)
+{
+  if (addr >= mem->size) return false;
+  if (mem->writeFn) mem->writeFn(mem->writeCtx, addr, sizeof(Byte));
+  touch_page(mem, addr >> YMEM_PAGE_SHIFT);
+  mem->base[addr] = byte;
+  if (mem->watchBits) check_watch(mem, addr, sizeof(Byte));
+  return true;
+}
+
+/** Write word to addr in mem.  Return false if the word is not
+ *  entirely within mem.
+ */
+bool
+write_word_ymem(YMem *mem, Address addr, Word word)
+{
+  if (addr > mem->size - sizeof(Word)) return false;
+  if (mem->writeFn) mem->writeFn(mem->writeCtx, addr, sizeof(Word));
+  const size_t page = addr >> YMEM_PAGE_SHIFT;
+  const size_t lastPage = (addr + sizeof(Word) - 1) >> YMEM_PAGE_SHIFT;
+  if (!is_dirty(mem, page) || lastPage != page) {
+    //slow path: first write to page or word straddles two pages
+    touch_page(mem, page);
+    touch_page(mem, lastPage);
+  }
+  memcpy(mem->base + addr, &word, sizeof(Word));
+  if (mem->watchBits) check_watch(mem, addr, sizeof(Word));
+  return true;
+}
+
+/** Write bytes[size] to addr in mem.  Return false (writing nothing)
+ *  if they are not entirely within mem.
+ */
+bool
+write_bytes_ymem(YMem *mem, Address addr, const Byte bytes[], size_t size)
+{
+  if (addr > mem->size || size > mem->size - addr) return false;
+  if (size == 0) return true;
+  if (mem->writeFn) mem->writeFn(mem->writeCtx, addr, size);
+  const size_t lastPage = (addr + size - 1) >> YMEM_PAGE_SHIFT;
+  for (size_t page = addr >> YMEM_PAGE_SHIFT; page <= lastPage; page++) {
+    touch_page(mem, page);
+  }
+  memcpy(mem->base + addr, bytes, size);
+  if (mem->watchBits) check_watch(mem, addr, size);
+  return true;
+}
+
+/** Atomically add addend to the word at addr in mem, setting *old to
+ *  its previous value.  Return false if addr is not word-aligned or
+ *  the word is not within mem.
+ */
+bool
+fetch_add_word_ymem(YMem *mem, Address addr, Word addend, Word *old)
+{
+  if (addr % sizeof(Word) != 0 || addr > mem->size - sizeof(Word)) {
+    return false;
+  }
+  if (mem->writeFn) mem->writeFn(mem->writeCtx, addr, sizeof(Word));
+  touch_page(mem, addr >> YMEM_PAGE_SHIFT);
+  *old = __atomic_fetch_add((Word *)(mem->base + addr), addend,
+                            __ATOMIC_SEQ_CST);
+  if (mem->watchBits) check_watch(mem, addr, sizeof(Word));
+  return true;
+}
+
+/** Atomically replace the word at addr in mem by desired if it is
+ *  equal to *expected, setting *isSwapped to true; otherwise set
+ *  *expected to the word and *isSwapped to false.  Return false if
+ *  addr is not word-aligned or the word is not within mem.
+ */
+bool
+compare_swap_word_ymem(YMem *mem, Address addr, Word *expected,
+                       Word desired, bool *isSwapped)
+{
+  if (addr % sizeof(Word) != 0 || addr > mem->size - sizeof(Word)) {
+    return false;
+  }
+  if (mem->writeFn) mem->writeFn(mem->writeCtx, addr, sizeof(Word));
+  touch_page(mem, addr >> YMEM_PAGE_SHIFT);
+  *isSwapped =
+    __atomic_compare_exchange_n((Word *)(mem->base + addr), expected,
+                                desired, false,
+                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  if (*isSwapped && mem->watchBits) check_watch(mem, addr, sizeof(Word));
+  return true;
+}
+
+/**************************** Change Dump ******************************/
+
+static int
+cmp_page_desc(const void *p1, const void *p2)
+{
+  const size_t a = *(const size_t *)p1, b = *(const size_t *)p2;
+  return (a < b) ? 1 : (a > b) ? -1 : 0;
+}
+
+/** Print W[addr]: value on out for every aligned word in mem which
+ *  has changed since the previous dump (or since load for the first
+ *  dump), in the same format as dump_changes_y86().  Only the pages
+ *  written since the previous dump are visited.
+ */
+void
+dump_changes_ymem(YMem *mem, FILE *out)
+{
+  qsort(mem->dirty, mem->nDirty, sizeof(size_t), cmp_page_desc);
+  for (size_t i = 0; i < mem->nDirty; i++) {
+    const size_t page = mem->dirty[i];
+    const Address pageBase = (Address)page << YMEM_PAGE_SHIFT;
+    Byte *shadow = mem->shadow[page];
+    const Byte *current = mem->base + pageBase;
+    for (int off = YMEM_PAGE_SIZE - sizeof(Word); off >= 0;
+         off -= sizeof(Word)) {
+      if (memcmp(current + off, shadow + off, sizeof(Word)) != 0) {
+        Word word;
+        memcpy(&word, current + off, sizeof(Word));
+        fprintf(out, "W[%08lx]: %016lx\n", pageBase + off, word);
+      }
+    }
+    memcpy(shadow, current, YMEM_PAGE_SIZE);
+    mem->dirtyBits[page / 64] &= ~(1UL << (page % 64));
+  }
+  mem->nDirty = 0;
+}
@@ -0,0 +1,126 @@
+#ifndef _YMEM_H
+#define _YMEM_H
+
+#include "y86.h"
+
+#include <stddef.h>
+
+/** Paged backing store for Y86 memory.  The whole virtual size is
+ *  reserved up-front as a sparse host mapping, and host pages are
+ *  only committed when a page is first written, so the simulator's
+ *  footprint follows the pages a program touches rather than its
+ *  nominal memory size.
+ *
+ *  A YMem may be shared by cores running on several host threads:
+ *  the read_*(), write_*() and atomic operations may be called
+ *  concurrently, and fetch_add_word_ymem() and compare_swap_word_ymem()
+ *  are atomic.  Loading and dumping must not overlap other accesses.
+ */
+typedef struct YMemStruct YMem;
+
+enum {
+  YMEM_PAGE_SHIFT = 12,                    /** log2 of page size */
+  YMEM_PAGE_SIZE = 1 << YMEM_PAGE_SHIFT,   /** 4 KiB pages */
+};
+
+/** Create a new paged memory of size bytes (rounded up to a whole
+ *  page).  Return NULL if size is 0 or cannot be reserved.
+ */
+YMem *new_ymem(Address size);
+
+/** Free all resources allocated by new_ymem() in mem. */
+void free_ymem(YMem *mem);
+
+/** Return the (virtual) size in bytes of mem. */
+Address get_size_ymem(const YMem *mem);
+
+/** Return # of pages which have been written since mem was loaded. */
+size_t get_n_touched_pages_ymem(const YMem *mem);
+
+/** Copy bytes[size] into mem at addr as part of the baseline image
+ *  against which dump_changes_ymem() reports changes.  Return false
+ *  if the bytes do not fit within mem.
+ */
+bool load_bytes_ymem(YMem *mem, Address addr, const Byte bytes[],
+                     size_t size);
+
+/** Copy the contents of y86's own memory into mem.  The copied
+ *  image becomes the baseline against which dump_changes_ymem()
+ *  reports changes; pages which are all zero are not committed.
+ */
+void load_y86_ymem(YMem *mem, Y86 *y86);
+
+/** Set *byte to the byte at addr in mem.  Return false (leaving
+ *  *byte unchanged) if addr is out of bounds.
+ */
+bool read_byte_ymem(const YMem *mem, Address addr, Byte *byte);
+
+/** Set *word to the word at addr in mem.  Return false (leaving
+ *  *word unchanged) if the word is not entirely within mem.
+ */
+bool read_word_ymem(const YMem *mem, Address addr, Word *word);
+
+/** Copy the size bytes at addr in mem into bytes[].  Return false
+ *  (copying nothing) if they are not entirely within mem.
+ */
+bool read_bytes_ymem(const YMem *mem, Address addr, Byte bytes[],
+                     size_t size);
+
+/** Write byte to addr in mem.  Return false if addr is out of bounds. */
+bool write_byte_ymem(YMem *mem, Address addr, Byte byte);
+
+/** Write word to addr in mem.  Return false if the word is not
+ *  entirely within mem.
+ */
+bool write_word_ymem(YMem *mem, Address addr, Word word);
+
+/** Write bytes[size] to addr in mem.  Return false (writing nothing)
+ *  if they are not entirely within mem.
+ */
+bool write_bytes_ymem(YMem *mem, Address addr, const Byte bytes[],
+                      size_t size);
+
+/** Atomically add addend to the word at addr in mem, setting *old to
+ *  its previous value.  Return false if addr is not word-aligned or
+ *  the word is not within mem.
+ */
+bool fetch_add_word_ymem(YMem *mem, Address addr, Word addend, Word *old);
+
+/** Atomically replace the word at addr in mem by desired if it is
+ *  equal to *expected, setting *isSwapped to true; otherwise set
+ *  *expected to the word and *isSwapped to false.  Return false if
+ *  addr is not word-aligned or the word is not within mem.
+ */
+bool compare_swap_word_ymem(YMem *mem, Address addr, Word *expected,
+                            Word desired, bool *isSwapped);
+
+/** Function called by a YMem after a write of size bytes at addr to a
+ *  watched page.
+ */
+typedef void YMemWatchFn(void *ctx, Address addr, size_t size);
+
+/** Call fn(ctx, addr, size) after every write of size bytes at addr
+ *  which touches a page overlapping [addr, addr + size).  All watches
+ *  on mem must use the same fn and ctx.  Writes to unwatched pages
+ *  pay only a NULL check.
+ */
+void watch_ymem(YMem *mem, Address addr, size_t size,
+                YMemWatchFn *fn, void *ctx);
+
+/** Remove all watches from mem. */
+void clear_watches_ymem(YMem *mem);
+
+/** Call fn(ctx, addr, size) before every write of size bytes at addr
+ *  in mem, so that fn can read the bytes about to be overwritten.  A
+ *  NULL fn removes the hook.
+ */
+void hook_writes_ymem(YMem *mem, YMemWatchFn *fn, void *ctx);
+
+/** Print W[addr]: value on out for every aligned word in mem which
+ *  has changed since the previous dump (or since load for the first
+ *  dump), in the same format as dump_changes_y86().  Only the pages
+ *  written since the previous dump are visited.
+ */
+void dump_changes_ymem(YMem *mem, FILE *out);
+
+#endif //ifndef _YMEM_H
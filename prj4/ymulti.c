@@ -0,0 +1,47 @@
+#include "ymulti.h"
+
+#include "ysim.h"
+
+#include "errors.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+typedef struct {
+  Y86 *y86;
+  YMem *mem;
+} Core;
+
+static void *
+run_core(void *arg)
+{
+  Core *core = arg;
+  while (read_status_y86(core->y86) == STATUS_AOK) {
+    step_ysim_mem(core->y86, core->mem);
+  }
+  return NULL;
+}
+
+/** Run each of cores[nCores] on its own host thread until it stops
+ *  (status no longer STATUS_AOK), with all of them sharing memory
+ *  mem.  Each core has its own registers, pc, cc and status.  Return
+ *  when every core has stopped.
+ */
+void
+run_ymulti(Y86 *cores[], int nCores, YMem *mem)
+{
+  Core args[nCores];
+  pthread_t threads[nCores];
+  for (int i = 0; i < nCores; i++) {
+    args[i].y86 = cores[i];
+    args[i].mem = mem;
+    //core 0 runs on the calling thread
+    if (i > 0 && pthread_create(&threads[i], NULL, run_core, &args[i]) != 0) {
+      fatal("cannot create thread for core %d\n", i);
+    }
+  }
+  run_core(&args[0]);
+  for (int i = 1; i < nCores; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
@@ -0,0 +1,14 @@
+#ifndef _YMULTI_H
+#define _YMULTI_H
+
+#include "y86.h"
+#include "ymem.h"
+
+/** Run each of cores[nCores] on its own host thread until it stops
+ *  (status no longer STATUS_AOK), with all of them sharing memory
+ *  mem.  Each core has its own registers, pc, cc and status.  Return
+ *  when every core has stopped.
+ */
+void run_ymulti(Y86 *cores[], int nCores, YMem *mem);
+
+#endif //ifndef _YMULTI_H
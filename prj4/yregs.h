@@ -0,0 +1,15 @@
+#ifndef _YREGS_H
+#define _YREGS_H
+
+#include "y86.h"
+
+/** Names of the Y86 registers without the %, indexed by Register.
+ *  Kept apart from yinsn.h so that stall-sim, whose library already
+ *  defines the opcodes, can share them.
+ */
+static const char *const regNames[N_REGISTERS] = {
+  "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+  "r8", "r9", "r10", "r11", "r12", "r13", "r14",
+};
+
+#endif //ifndef _YREGS_H
@@ -0,0 +1,574 @@
+#include "yresume.h"
+
+#include "ysim.h"
+#include "ytrace.h"
+
+#include "errors.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+  MAX_INSN_LEN = 10,    /** a fetch touches up to this many bytes */
+  WORDS_PER_PAGE = YMEM_PAGE_SIZE / sizeof(Word),
+  YRESUME_VERSION = 1,
+};
+
+static const char MAGIC[8] = { 'Y', '8', '6', 'C', 'K', 'P', '\n', '\0' };
+
+/** Processor state before a step, with the memory pages written since
+ *  the previous checkpoint (or since the start of the run).
+ */
+typedef struct {
+  long step;            //# of steps executed before the checkpoint
+  Word regs[REG_NONE];
+  Address pc;
+  Byte cc;
+  Status status;
+  size_t nPages;
+  uint64_t *pages;      //[nPages]: indexes of pages written
+  Byte *contents;       //[nPages * YMEM_PAGE_SIZE]: their contents
+} Checkpoint;
+
+struct YResumeStruct {
+  Y86 *y86;
+  YMem *mem;
+  long interval;
+  long step;            //# of steps recorded
+  long lastCheckpoint;  //step of latest checkpoint; 0 if none
+  YTrace *trace;        //accesses since latest checkpoint
+  size_t nPages;        //# of pages in mem
+  Word initialRegs[REG_NONE];
+  Address initialPc;
+  Byte **initial;       //initial[p]: page p at start; NULL if all zero
+  long **touches;       //touches[p][w]: 1 + step first touching word w
+                        //of page p, else 0; touches[p] NULL if none
+  uint64_t *writtenBits;  //bit p set iff page p written since checkpoint
+  uint64_t *written;    //indexes of pages with their written bit set
+  size_t nWritten, maxWritten;
+  Checkpoint *checkpoints;
+  size_t nCheckpoints, maxCheckpoints;
+};
+
+/** File layout: a Header, then nInitial (page index, page contents),
+ *  nCheckpoints (CheckpointHeader, nPages (page index, page contents))
+ *  and nTouched (page index, touches[WORDS_PER_PAGE]).
+ */
+typedef struct {
+  char magic[sizeof(MAGIC)];
+  uint64_t version;
+  uint64_t memSize;
+  Word initialRegs[REG_NONE];
+  uint64_t initialPc;
+  uint64_t nInitial;
+  uint64_t nCheckpoints;
+  uint64_t nTouched;
+} Header;
+
+typedef struct {
+  int64_t step;
+  Word regs[REG_NONE];
+  uint64_t pc;
+  uint64_t cc;
+  uint64_t status;
+  uint64_t nPages;
+} CheckpointHeader;
+
+/************************ Creation / Destruction ***********************/
+
+/** Return a copy of page of mem; NULL if it is all zero. */
+static Byte *
+copy_page(const YMem *mem, size_t page)
+{
+  static const Byte zeros[YMEM_PAGE_SIZE];
+  Byte bytes[YMEM_PAGE_SIZE];
+  read_bytes_ymem(mem, (Address)page << YMEM_PAGE_SHIFT, bytes,
+                  YMEM_PAGE_SIZE);
+  if (memcmp(bytes, zeros, YMEM_PAGE_SIZE) == 0) return NULL;
+  Byte *copy = malloc(YMEM_PAGE_SIZE);
+  if (!copy) fatal("out of memory\n");
+  memcpy(copy, bytes, YMEM_PAGE_SIZE);
+  return copy;
+}
+
+/** Start recording the run of y86 with memory mem, taking a
+ *  checkpoint every interval steps.  The contents of mem at this
+ *  point are the initial image of the run.
+ */
+YResume *
+new_yresume(Y86 *y86, YMem *mem, long interval)
+{
+  YResume *resume = calloc(1, sizeof(struct YResumeStruct));
+  if (!resume) fatal("out of memory\n");
+  resume->y86 = y86;
+  resume->mem = mem;
+  resume->interval = interval;
+  resume->nPages = get_size_ymem(mem) >> YMEM_PAGE_SHIFT;
+  resume->initial = calloc(resume->nPages, sizeof(Byte *));
+  resume->touches = calloc(resume->nPages, sizeof(long *));
+  resume->writtenBits = calloc((resume->nPages + 63) / 64, sizeof(uint64_t));
+  if (!resume->initial || !resume->touches || !resume->writtenBits) {
+    fatal("out of memory\n");
+  }
+  for (Register r = 0; r < REG_NONE; r++) {
+    resume->initialRegs[r] = read_register_y86(y86, r);
+  }
+  resume->initialPc = read_pc_y86(y86);
+  for (size_t p = 0; p < resume->nPages; p++) {
+    resume->initial[p] = copy_page(mem, p);
+  }
+  resume->trace = new_ytrace();
+  trace_ysim(resume->trace);
+  return resume;
+}
+
+static void
+free_checkpoint(Checkpoint *checkpoint)
+{
+  free(checkpoint->pages);
+  free(checkpoint->contents);
+}
+
+/** Free all resources allocated by new_yresume() in resume and stop
+ *  tracing the simulator.
+ */
+void
+free_yresume(YResume *resume)
+{
+  trace_ysim(NULL);
+  free_ytrace(resume->trace);
+  for (size_t p = 0; p < resume->nPages; p++) {
+    free(resume->initial[p]);
+    free(resume->touches[p]);
+  }
+  for (size_t i = 0; i < resume->nCheckpoints; i++) {
+    free_checkpoint(&resume->checkpoints[i]);
+  }
+  free(resume->initial);
+  free(resume->touches);
+  free(resume->writtenBits);
+  free(resume->written);
+  free(resume->checkpoints);
+  free(resume);
+}
+
+/****************************** Recording ******************************/
+
+/** Record that the bytes [lo, hi) were touched at step, unless they
+ *  were touched before.
+ */
+static void
+touch(YResume *resume, Address lo, Address hi, long step)
+{
+  const Address size = (Address)resume->nPages << YMEM_PAGE_SHIFT;
+  if (lo >= size) return;
+  if (hi > size) hi = size;
+  for (Address w = lo / sizeof(Word); w <= (hi - 1) / sizeof(Word); w++) {
+    const size_t page = w / WORDS_PER_PAGE;
+    if (!resume->touches[page]) {
+      resume->touches[page] = calloc(WORDS_PER_PAGE, sizeof(long));
+      if (!resume->touches[page]) fatal("out of memory\n");
+    }
+    long *t = &resume->touches[page][w % WORDS_PER_PAGE];
+    if (*t == 0) *t = step + 1;
+  }
+}
+
+/** Record that page was written since the latest checkpoint. */
+static void
+mark_written(YResume *resume, size_t page)
+{
+  if (page >= resume->nPages) return;
+  uint64_t *bits = &resume->writtenBits[page / 64];
+  if ((*bits >> (page % 64)) & 1) return;
+  *bits |= 1UL << (page % 64);
+  if (resume->nWritten == resume->maxWritten) {
+    resume->maxWritten = resume->maxWritten ? 2 * resume->maxWritten : 64;
+    resume->written =
+      realloc(resume->written, resume->maxWritten * sizeof(uint64_t));
+    if (!resume->written) fatal("out of memory\n");
+  }
+  resume->written[resume->nWritten++] = page;
+}
+
+/** Fold the accesses traced since the latest checkpoint into the
+ *  touches and written pages of resume, and clear the trace.
+ */
+static void
+fold_trace(YResume *resume)
+{
+  const size_t n = get_n_ytrace(resume->trace);
+  long step = resume->lastCheckpoint - 1;
+  for (size_t i = 0; i < n; i++) {
+    Address addr;
+    switch (get_ytrace(resume->trace, i, &addr)) {
+    case FETCH_YTRACE:
+      step++;
+      touch(resume, addr, addr + MAX_INSN_LEN, step);
+      break;
+    case READ_YTRACE:
+      touch(resume, addr, addr + sizeof(Word), step);
+      break;
+    case WRITE_YTRACE:
+      touch(resume, addr, addr + sizeof(Word), step);
+      mark_written(resume, addr >> YMEM_PAGE_SHIFT);
+      mark_written(resume, (addr + sizeof(Word) - 1) >> YMEM_PAGE_SHIFT);
+      break;
+    }
+  }
+  clear_ytrace(resume->trace);
+}
+
+static Checkpoint *
+add_checkpoint(YResume *resume)
+{
+  if (resume->nCheckpoints == resume->maxCheckpoints) {
+    resume->maxCheckpoints =
+      resume->maxCheckpoints ? 2 * resume->maxCheckpoints : 16;
+    resume->checkpoints = realloc(resume->checkpoints,
+                                  resume->maxCheckpoints * sizeof(Checkpoint));
+    if (!resume->checkpoints) fatal("out of memory\n");
+  }
+  return &resume->checkpoints[resume->nCheckpoints++];
+}
+
+/** Checkpoint the current state of the simulator. */
+static void
+take_checkpoint(YResume *resume)
+{
+  fold_trace(resume);
+  Checkpoint *checkpoint = add_checkpoint(resume);
+  checkpoint->step = resume->step;
+  for (Register r = 0; r < REG_NONE; r++) {
+    checkpoint->regs[r] = read_register_y86(resume->y86, r);
+  }
+  checkpoint->pc = read_pc_y86(resume->y86);
+  checkpoint->cc = read_cc_y86(resume->y86);
+  checkpoint->status = read_status_y86(resume->y86);
+  checkpoint->nPages = resume->nWritten;
+  checkpoint->pages = malloc(resume->nWritten * sizeof(uint64_t));
+  checkpoint->contents = malloc(resume->nWritten * YMEM_PAGE_SIZE);
+  if (resume->nWritten > 0 && (!checkpoint->pages || !checkpoint->contents)) {
+    fatal("out of memory\n");
+  }
+  for (size_t i = 0; i < resume->nWritten; i++) {
+    const uint64_t page = resume->written[i];
+    checkpoint->pages[i] = page;
+    read_bytes_ymem(resume->mem, page << YMEM_PAGE_SHIFT,
+                    &checkpoint->contents[i * YMEM_PAGE_SIZE], YMEM_PAGE_SIZE);
+    resume->writtenBits[page / 64] &= ~(1UL << (page % 64));
+  }
+  resume->nWritten = 0;
+  resume->lastCheckpoint = resume->step;
+}
+
+/** Record that the simulator is about to execute its next step,
+ *  taking a checkpoint if one is due.
+ */
+void
+record_yresume(YResume *resume)
+{
+  if (resume->step - resume->lastCheckpoint >= resume->interval) {
+    take_checkpoint(resume);
+  }
+  resume->step++;
+}
+
+/** Return the # of steps recorded by resume, including those skipped
+ *  by resume_yresume().
+ */
+long
+get_n_steps_yresume(const YResume *resume)
+{
+  return resume->step;
+}
+
+/******************************* Saving ********************************/
+
+static bool
+write_page(FILE *f, uint64_t page, const void *data, size_t size)
+{
+  return fwrite(&page, sizeof(page), 1, f) == 1 &&
+    fwrite(data, 1, size, f) == size;
+}
+
+/** Write the initial image, checkpoints and touches of resume to file
+ *  fileName.  Return false on error.
+ */
+bool
+save_yresume(YResume *resume, const char *fileName)
+{
+  fold_trace(resume);
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = YRESUME_VERSION;
+  header.memSize = get_size_ymem(resume->mem);
+  memcpy(header.initialRegs, resume->initialRegs, sizeof(header.initialRegs));
+  header.initialPc = resume->initialPc;
+  header.nCheckpoints = resume->nCheckpoints;
+  for (size_t p = 0; p < resume->nPages; p++) {
+    if (resume->initial[p]) header.nInitial++;
+    if (resume->touches[p]) header.nTouched++;
+  }
+  FILE *f = fopen(fileName, "wb");
+  bool isOk = f != NULL && fwrite(&header, sizeof(header), 1, f) == 1;
+  for (size_t p = 0; isOk && p < resume->nPages; p++) {
+    if (resume->initial[p]) {
+      isOk = write_page(f, p, resume->initial[p], YMEM_PAGE_SIZE);
+    }
+  }
+  for (size_t i = 0; isOk && i < resume->nCheckpoints; i++) {
+    const Checkpoint *checkpoint = &resume->checkpoints[i];
+    CheckpointHeader h = {
+      .step = checkpoint->step, .pc = checkpoint->pc,
+      .cc = checkpoint->cc, .status = checkpoint->status,
+      .nPages = checkpoint->nPages,
+    };
+    memcpy(h.regs, checkpoint->regs, sizeof(h.regs));
+    isOk = fwrite(&h, sizeof(h), 1, f) == 1;
+    for (size_t j = 0; isOk && j < checkpoint->nPages; j++) {
+      isOk = write_page(f, checkpoint->pages[j],
+                        &checkpoint->contents[j * YMEM_PAGE_SIZE],
+                        YMEM_PAGE_SIZE);
+    }
+  }
+  for (size_t p = 0; isOk && p < resume->nPages; p++) {
+    if (resume->touches[p]) {
+      isOk = write_page(f, p, resume->touches[p],
+                        WORDS_PER_PAGE * sizeof(long));
+    }
+  }
+  if (f && fclose(f) != 0) isOk = false;
+  if (!isOk) fprintf(stderr, "cannot write checkpoints %s\n", fileName);
+  return isOk;
+}
+
+/****************************** Resuming *******************************/
+
+/** The contents of a checkpoint file */
+typedef struct {
+  Word initialRegs[REG_NONE];
+  Address initialPc;
+  Byte **initial;       //[nPages] as in YResume
+  long **touches;       //[nPages] as in YResume
+  Checkpoint *checkpoints;
+  size_t nCheckpoints;
+} Saved;
+
+static void
+free_saved(Saved *saved, size_t nPages)
+{
+  for (size_t p = 0; p < nPages; p++) {
+    free(saved->initial[p]);
+    free(saved->touches[p]);
+  }
+  for (size_t i = 0; i < saved->nCheckpoints; i++) {
+    free_checkpoint(&saved->checkpoints[i]);
+  }
+  free(saved->initial);
+  free(saved->touches);
+  free(saved->checkpoints);
+}
+
+/** Read a page index < nPages from f into *page and then size bytes
+ *  into a new buffer returned in *data.  Return false on error.
+ */
+static bool
+read_page(FILE *f, size_t nPages, uint64_t *page, void **data, size_t size)
+{
+  if (fread(page, sizeof(*page), 1, f) != 1 || *page >= nPages) return false;
+  *data = malloc(size);
+  if (!*data) fatal("out of memory\n");
+  if (fread(*data, 1, size, f) == size) return true;
+  free(*data);
+  *data = NULL;
+  return false;
+}
+
+/** Read the checkpoint file f for a memory of nPages pages into
+ *  *saved.  Return false if f is not such a file.
+ */
+static bool
+read_saved(FILE *f, size_t nPages, Saved *saved)
+{
+  Header header;
+  if (fread(&header, sizeof(header), 1, f) != 1 ||
+      memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.version != YRESUME_VERSION ||
+      header.memSize != (uint64_t)nPages << YMEM_PAGE_SHIFT) {
+    return false;
+  }
+  saved->initial = calloc(nPages, sizeof(Byte *));
+  saved->touches = calloc(nPages, sizeof(long *));
+  saved->checkpoints = calloc(header.nCheckpoints, sizeof(Checkpoint));
+  if (!saved->initial || !saved->touches ||
+      (header.nCheckpoints > 0 && !saved->checkpoints)) {
+    fatal("out of memory\n");
+  }
+  saved->nCheckpoints = 0;
+  memcpy(saved->initialRegs, header.initialRegs, sizeof(header.initialRegs));
+  saved->initialPc = header.initialPc;
+  for (uint64_t i = 0; i < header.nInitial; i++) {
+    uint64_t page;
+    void *data;
+    if (!read_page(f, nPages, &page, &data, YMEM_PAGE_SIZE)) return false;
+    free(saved->initial[page]);
+    saved->initial[page] = data;
+  }
+  for (uint64_t i = 0; i < header.nCheckpoints; i++) {
+    CheckpointHeader h;
+    if (fread(&h, sizeof(h), 1, f) != 1 || h.nPages > nPages) return false;
+    Checkpoint *checkpoint = &saved->checkpoints[saved->nCheckpoints++];
+    *checkpoint = (Checkpoint) {
+      .step = h.step, .pc = h.pc, .cc = h.cc, .status = h.status,
+      .pages = malloc(h.nPages * sizeof(uint64_t)),
+      .contents = malloc(h.nPages * YMEM_PAGE_SIZE),
+    };
+    memcpy(checkpoint->regs, h.regs, sizeof(h.regs));
+    if (h.nPages > 0 && (!checkpoint->pages || !checkpoint->contents)) {
+      fatal("out of memory\n");
+    }
+    for (uint64_t j = 0; j < h.nPages; j++) {
+      void *data;
+      if (!read_page(f, nPages, &checkpoint->pages[j], &data,
+                     YMEM_PAGE_SIZE)) {
+        return false;
+      }
+      memcpy(&checkpoint->contents[j * YMEM_PAGE_SIZE], data, YMEM_PAGE_SIZE);
+      free(data);
+      checkpoint->nPages++;
+    }
+  }
+  for (uint64_t i = 0; i < header.nTouched; i++) {
+    uint64_t page;
+    void *data;
+    if (!read_page(f, nPages, &page, &data, WORDS_PER_PAGE * sizeof(long))) {
+      return false;
+    }
+    free(saved->touches[page]);
+    saved->touches[page] = data;
+  }
+  return true;
+}
+
+static Byte
+get_initial_byte(Byte *const initial[], Address addr)
+{
+  const Byte *page = initial[addr >> YMEM_PAGE_SHIFT];
+  return page ? page[addr & (YMEM_PAGE_SIZE - 1)] : 0;
+}
+
+/** Return the earliest step of the saved run which touched a byte
+ *  whose initial value differs in resume; LONG_MAX if none did.  If
+ *  the runs start with different registers, return 0.
+ */
+static long
+find_first_change(const YResume *resume, const Saved *saved)
+{
+  if (memcmp(resume->initialRegs, saved->initialRegs,
+             sizeof(saved->initialRegs)) != 0 ||
+      resume->initialPc != saved->initialPc) {
+    return 0;
+  }
+  long first = LONG_MAX;
+  for (size_t p = 0; p < resume->nPages; p++) {
+    if (!resume->initial[p] && !saved->initial[p]) continue;
+    const Address base = (Address)p << YMEM_PAGE_SHIFT;
+    for (Address a = base; a < base + YMEM_PAGE_SIZE; a++) {
+      if (get_initial_byte(resume->initial, a) ==
+          get_initial_byte(saved->initial, a)) {
+        continue;
+      }
+      const long *t = saved->touches[p];
+      const long touched = t ? t[(a - base) / sizeof(Word)] : 0;
+      if (touched > 0 && touched - 1 < first) first = touched - 1;
+    }
+  }
+  return first;
+}
+
+/** Replace the bytes of the saved page contents[] with index page
+ *  whose initial value differs in resume by their new initial value.
+ *  Such bytes were not touched before the checkpoint holding
+ *  contents[], so they still have their initial value there.
+ */
+static void
+patch_page(const YResume *resume, const Saved *saved, uint64_t page,
+           Byte contents[])
+{
+  const Byte *now = resume->initial[page], *then = saved->initial[page];
+  if (!now && !then) return;
+  for (size_t i = 0; i < YMEM_PAGE_SIZE; i++) {
+    const Byte b = now ? now[i] : 0;
+    if (b != (then ? then[i] : 0)) contents[i] = b;
+  }
+}
+
+/** Restore y86 and mem to the latest checkpoint in file fileName,
+ *  left by save_yresume() for an earlier run, which precedes the
+ *  first touch of any byte whose initial value differs between that
+ *  run and this one.  The checkpoints and touches of the earlier run
+ *  up to that point become part of this run.  Return the # of steps
+ *  skipped; 0 if fileName does not exist, does not match mem or no
+ *  checkpoint precedes a change.  Must be called before the first
+ *  step.
+ */
+long
+resume_yresume(YResume *resume, const char *fileName)
+{
+  FILE *f = fopen(fileName, "rb");
+  if (!f) return 0;
+  Saved saved = { .initial = NULL };
+  const bool isOk = read_saved(f, resume->nPages, &saved);
+  fclose(f);
+  if (!isOk) {
+    fprintf(stderr, "ignoring bad checkpoints %s\n", fileName);
+    if (saved.initial) free_saved(&saved, resume->nPages);
+    return 0;
+  }
+  const long first = find_first_change(resume, &saved);
+  size_t nKept = 0;
+  while (nKept < saved.nCheckpoints &&
+         saved.checkpoints[nKept].step <= first) {
+    nKept++;
+  }
+  for (size_t i = 0; i < nKept; i++) {
+    Checkpoint *checkpoint = &saved.checkpoints[i];
+    for (size_t j = 0; j < checkpoint->nPages; j++) {
+      Byte *contents = &checkpoint->contents[j * YMEM_PAGE_SIZE];
+      patch_page(resume, &saved, checkpoint->pages[j], contents);
+      write_bytes_ymem(resume->mem, checkpoint->pages[j] << YMEM_PAGE_SHIFT,
+                       contents, YMEM_PAGE_SIZE);
+    }
+    *add_checkpoint(resume) = *checkpoint;
+  }
+  if (nKept > 0) {
+    const Checkpoint *last = &saved.checkpoints[nKept - 1];
+    for (Register r = 0; r < REG_NONE; r++) {
+      write_register_y86(resume->y86, r, last->regs[r]);
+    }
+    write_pc_y86(resume->y86, last->pc);
+    write_cc_y86(resume->y86, last->cc);
+    write_status_y86(resume->y86, last->status);
+    resume->step = resume->lastCheckpoint = last->step;
+    for (size_t p = 0; p < resume->nPages; p++) {
+      long *t = saved.touches[p];
+      if (!t) continue;
+      for (size_t w = 0; w < WORDS_PER_PAGE; w++) {
+        if (t[w] - 1 >= last->step) t[w] = 0;
+      }
+      resume->touches[p] = t;
+      saved.touches[p] = NULL;
+    }
+  }
+  //the kept checkpoints now belong to resume
+  memmove(saved.checkpoints, &saved.checkpoints[nKept],
+          (saved.nCheckpoints - nKept) * sizeof(Checkpoint));
+  saved.nCheckpoints -= nKept;
+  free_saved(&saved, resume->nPages);
+  return resume->step;
+}
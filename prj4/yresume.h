@@ -0,0 +1,62 @@
+#ifndef _YRESUME_H
+#define _YRESUME_H
+
+#include "y86.h"
+#include "ymem.h"
+
+#include <stdbool.h>
+
+/** Incremental re-simulation.  While a program runs, a YResume takes
+ *  a checkpoint of the processor state every interval steps, along
+ *  with the memory pages written since the previous checkpoint, and
+ *  records the step at which each word of memory was first touched
+ *  by a fetch, read or write.  Saved to a file together with the
+ *  memory image at the start of execution, this lets a later run of
+ *  an edited program skip every step which could not have seen the
+ *  edit: the new initial image is compared with the saved one, and
+ *  execution resumes from the last checkpoint taken before any
+ *  changed byte was first touched.
+ *
+ *  A YResume records accesses via trace_ysim() and so cannot be used
+ *  together with another trace.
+ */
+typedef struct YResumeStruct YResume;
+
+/** Start recording the run of y86 with memory mem, taking a
+ *  checkpoint every interval steps.  The contents of mem at this
+ *  point are the initial image of the run.
+ */
+YResume *new_yresume(Y86 *y86, YMem *mem, long interval);
+
+/** Free all resources allocated by new_yresume() in resume and stop
+ *  tracing the simulator.
+ */
+void free_yresume(YResume *resume);
+
+/** Restore y86 and mem to the latest checkpoint in file fileName,
+ *  left by save_yresume() for an earlier run, which precedes the
+ *  first touch of any byte whose initial value differs between that
+ *  run and this one.  The checkpoints and touches of the earlier run
+ *  up to that point become part of this run.  Return the # of steps
+ *  skipped; 0 if fileName does not exist, does not match mem or no
+ *  checkpoint precedes a change.  Must be called before the first
+ *  step.
+ */
+long resume_yresume(YResume *resume, const char *fileName);
+
+/** Record that the simulator is about to execute its next step,
+ *  taking a checkpoint if one is due.
+ */
+void record_yresume(YResume *resume);
+
+/** Return the # of steps recorded by resume, including those skipped
+ *  by resume_yresume().
+ */
+long get_n_steps_yresume(const YResume *resume);
+
+/** Write the initial image, checkpoints and touches of resume to file
+ *  fileName.  Return false on error.
+ */
+bool save_yresume(YResume *resume, const char *fileName);
+
+#endif //ifndef _YRESUME_H
@@ -1,5 +1,9 @@
 #include "ysim.h"
 
+#include "yatomic.h"
+#include "ycc.h"
+#include "yinsn.h"
+
 #include "errors.h"
 
 /************************** Utility Routines ****************************/
@@ -12,114 +16,57 @@ get_nybble(Byte op, int pos) {
   return (op >> (pos * 4)) & 0xF;
 }
 
-/************************** Condition Codes ****************************/
+/** Mask of registers written by the current step on this thread. */
+static _Thread_local unsigned changedRegs;
+
+static inline void
+set_register(Y86 *y86, Register reg, Word value)
+{
+  write_register_y86(y86, reg, value);
+  changedRegs |= 1u << reg;
+}
 
-/** Conditions used in instructions */
-typedef enum {
-  ALWAYS_COND, LE_COND, LT_COND, EQ_COND, NE_COND, GE_COND, GT_COND
-} Condition;
+/** Trace of the accesses made by steps on this thread; NULL if none. */
+static _Thread_local YTrace *trace;
 
-/** accessing condition code flags */
-static inline bool get_cc_flag(Byte cc, unsigned flagBitIndex) {
-  return !!(cc & (1 << flagBitIndex));
+static inline void
+trace_access(YTraceKind kind, Address addr)
+{
+  if (trace) add_ytrace(trace, kind, addr);
 }
-static inline bool get_zf(Byte cc) { return get_cc_flag(cc, ZF_CC); }
-static inline bool get_sf(Byte cc) { return get_cc_flag(cc, SF_CC); }
-static inline bool get_of(Byte cc) { return get_cc_flag(cc, OF_CC); }
+
+/************************** Condition Codes ****************************/
 
 /** Return true iff the condition specified in the least-significant
- *  nybble of op holds in y86.  Encoding of Figure 3.15 of Bryant's
- *  CompSys3e.
+ *  nybble of op holds in y86.
  */
 bool
 check_cc(const Y86 *y86, Byte op)
 {
-  bool ret = false;
   Condition condition = get_nybble(op, 0);
-  Byte cc = read_cc_y86(y86);
-  switch (condition) {
-  case ALWAYS_COND:
-    ret = true;
-    break;
-  case LE_COND:
-    ret = (get_sf(cc) ^ get_of(cc)) | get_zf(cc);
-    break;
-  case LT_COND:
-    ret = (get_sf(cc) ^ get_of(cc));
-    break;
-  case EQ_COND:
-    ret = get_zf(cc);
-    break;
-  case NE_COND:
-    ret = !get_zf(cc);
-    break;
-  case GE_COND:
-    ret = !(get_sf(cc) ^ get_of(cc)); 
-    break;
-  case GT_COND:
-    ret = (!(get_sf(cc) ^ get_of(cc)) & !get_zf(cc)); 
-    break;
-  default: {
+  if (condition > GT_COND) {
     Address pc = read_pc_y86(y86);
     fatal("%08lx: bad condition code %d\n", pc, condition);
-    break;
-    }
   }
-  return ret;
+  return holds_cc(read_cc_y86(y86), condition);
 }
 
-/** return true iff word has its sign bit set */
-static inline bool
-isLt0(Word word) {
-  return (word & (1UL << (sizeof(Word)*CHAR_BIT - 1))) != 0;
-}
-
-/** Set condition codes for addition operation with operands opA, opB
- *  and result with result == opA + opB.
- */
 static void
 set_add_arith_cc(Y86 *y86, Word opA, Word opB, Word result)
 {
-	Byte cc = 0;
-	if(result == 0) cc |= 4; //set ZF if result is 0
-	if(isLt0(result)) cc |= 2; //set SF if result is negative
-	if(isLt0(opA) && isLt0(opB)){ //if opA and opB are both negative...
-		if(!isLt0(result)) cc |= 1; //set OF if result is positive
-	}
-	if(!isLt0(opA) && !isLt0(opB)){ //if opA and opB are both positive...
-		if(isLt0(result)) cc |= 1; //set OF if result is negative
-	}
-	//printf("CC is %d\n", cc);
-	write_cc_y86(y86, cc);
+  write_cc_y86(y86, add_arith_cc(opA, opB, result));
 }
 
-/** Set condition codes for subtraction operation with operands opA, opB
- *  and result with result == opA - opB.
- */
 static void
 set_sub_arith_cc(Y86 *y86, Word opA, Word opB, Word result)
 {
-  Byte cc = 0;
-  if(result == 0) cc |= 4; //set ZF if result is 0
-  if(isLt0(result)) cc |= 2; //set SF if result is negative
-  if(!isLt0(opA) && isLt0(opB)){ //if opA is positive and opB is negative...
-	  if(isLt0(result)) cc |= 1; //set OF is result is negative
-  }
-  if(isLt0(opA) && !isLt0(opB)){ //if opA is negative and opB is positive...
-	  if(!isLt0(result)) cc |= 1; //set OF if result is positive
-  }
-  //printf("CC is %d\n", cc);
-  write_cc_y86(y86, cc);
+  write_cc_y86(y86, sub_arith_cc(opA, opB, result));
 }
 
 static void
 set_logic_op_cc(Y86 *y86, Word result)
 {
-  Byte cc = 0;
-  if(result == 0) cc |= 4; //set ZF if result is 0
-  if(isLt0(result)) cc |= 2; //set SF if result is negative
-  //printf("CC is %d\n", cc);
-  write_cc_y86(y86, cc);
+  write_cc_y86(y86, logic_op_cc(result));
 }
 
 /**************************** Operations *******************************/
@@ -135,53 +82,80 @@ op1(Y86 *y86, Byte op, Register regA, Register regB)
 	  case ADDL_FN:{
 		  Word result = opA + opB;
 		  set_add_arith_cc(y86, opA, opB, result);
-		  write_register_y86(y86, regB, result);
+		  set_register(y86, regB, result);
 		  break;
 	  }
 	  case SUBL_FN:{
 	          Word result = opB - opA;
 		  //printf("Result is %lx\n", result);
 		  set_sub_arith_cc(y86, opB, opA, result);
-		  write_register_y86(y86, regB, result);
+		  set_register(y86, regB, result);
 		  break;
 	  }
 	  case ANDL_FN:{
 		  Word result = opA & opB;
 		  set_logic_op_cc(y86, result);
-		  write_register_y86(y86, regB, result);
+		  set_register(y86, regB, result);
 		  break;
           }
           case XORL_FN:{
 		  Word result = opA ^ opB;
 		  set_logic_op_cc(y86, result);
-		  write_register_y86(y86, regB, result);
+		  set_register(y86, regB, result);
 		  break;
 	  }
 	  default:
-	  {
-		  Address pc = read_pc_y86(y86);
-		  fatal("%081lx: bad operation code %d\n", pc, op);
+		  write_status_y86(y86, STATUS_INS);
 		  break;
-	  }
   }
 }
 
-/*********************** Single Instruction Step ***********************/
+/*************************** Memory Access *****************************/
+
+/** Memory accessors used by step_ysim_mem(): they go to mem when it
+ *  is non-NULL, else to y86's own memory.  Like the y86 accessors,
+ *  they set the status of y86 to STATUS_ADR on a bad address.
+ */
+static Byte
+read_byte(Y86 *y86, YMem *mem, Address addr)
+{
+  if (!mem) return read_memory_byte_y86(y86, addr);
+  Byte byte = 0;
+  if (!read_byte_ymem(mem, addr, &byte)) write_status_y86(y86, STATUS_ADR);
+  return byte;
+}
 
-typedef enum {
-  HALT_CODE, NOP_CODE, CMOVxx_CODE, IRMOVQ_CODE, RMMOVQ_CODE, MRMOVQ_CODE,
-  OP1_CODE, Jxx_CODE, CALL_CODE, RET_CODE,
-  PUSHQ_CODE, POPQ_CODE } BaseOpCode;
+static Word
+read_word(Y86 *y86, YMem *mem, Address addr)
+{
+  if (!mem) return read_memory_word_y86(y86, addr);
+  Word word = 0;
+  if (!read_word_ymem(mem, addr, &word)) write_status_y86(y86, STATUS_ADR);
+  return word;
+}
 
-/** Execute the next instruction of y86. Must change status of
- *  y86 to STATUS_HLT on halt, STATUS_ADR or STATUS_INS on
- *  bad address or instruction.
+static void
+write_word(Y86 *y86, YMem *mem, Address addr, Word word)
+{
+  if (!mem) {
+    write_memory_word_y86(y86, addr, word);
+  }
+  else if (!write_word_ymem(mem, addr, word)) {
+    write_status_y86(y86, STATUS_ADR);
+  }
+}
+
+/*********************** Single Instruction Step ***********************/
+
+/** Execute the next instruction of y86 with all memory accesses
+ *  going to mem, or to y86's own memory if mem is NULL.
  */
-void
-step_ysim(Y86 *y86)
+static void
+execute(Y86 *y86, YMem *mem)
 {
   Address pc = read_pc_y86(y86);
-  Byte opcode = read_memory_byte_y86(y86, pc);
+  trace_access(FETCH_YTRACE, pc);
+  Byte opcode = read_byte(y86, mem, pc);
   if(read_status_y86(y86) != STATUS_AOK) return;
   opcode = get_nybble(opcode, 1);
   switch(opcode){
@@ -194,16 +168,20 @@ step_ysim(Y86 *y86)
 		  break;
           case 2: //cmov and rrmov
 	  {
-		  Byte cond = read_memory_byte_y86(y86, pc); //get condition code
+		  Byte cond = read_byte(y86, mem, pc); //get condition code
 		  if(read_status_y86(y86) != STATUS_AOK) return;
 		  cond = get_nybble(cond, 0);
+		  if(cond > GT_COND){
+			  write_status_y86(y86, STATUS_INS);
+			  return;
+		  }
 		  if(check_cc(y86, cond)){ //excute move if condition is met
-			  Byte regs = read_memory_byte_y86(y86, pc+1);
+			  Byte regs = read_byte(y86, mem, pc+1);
 			  if(read_status_y86(y86) != STATUS_AOK) return;
 			  Byte src = get_nybble(regs, 1); //get source register
 			  Byte dest = get_nybble(regs, 0); //get destination register
 			  Word val = read_register_y86(y86, src); //get value from source register
-			  write_register_y86(y86, dest, val); //write src register value to dest register
+			  set_register(y86, dest, val); //write src register value to dest register
 		  }
 		  pc = pc+1+sizeof(Byte); //increment pc
 		  write_pc_y86(y86, pc);
@@ -211,27 +189,28 @@ step_ysim(Y86 *y86)
 	  }
 	  case 3: //irmovq
 	  {
-		  Byte reg = read_memory_byte_y86(y86, (pc+1)); //get register
+		  Byte reg = read_byte(y86, mem, (pc+1)); //get register
 		  if(read_status_y86(y86) != STATUS_AOK) return;
 		  reg = get_nybble(reg, 0); //get destination register
-		  Word imm = read_memory_word_y86(y86, pc+1+sizeof(Byte)); //get source immediate
+		  Word imm = read_word(y86, mem, pc+1+sizeof(Byte)); //get source immediate
 		  if(read_status_y86(y86) != STATUS_AOK) return;
-		  write_register_y86(y86, reg, imm); //write immediate ot destination register
+		  set_register(y86, reg, imm); //write immediate ot destination register
 		  pc = pc + 1 + sizeof(Byte) + sizeof(Word); //increment pc
 		  write_pc_y86(y86, pc);
 		  break;
 	  }
 	  case 4: //rmmovq
 	  {
-		  Byte regs = read_memory_byte_y86(y86, (pc+1)); //get registers
+		  Byte regs = read_byte(y86, mem, (pc+1)); //get registers
 		  if(read_status_y86(y86) != STATUS_AOK) return;
 		  Byte src = get_nybble(regs, 1); //get source register
 		  Byte dest = get_nybble(regs, 0); //get destination register
-		  Word disp = read_memory_word_y86(y86, (pc+1+sizeof(Byte))); //get displacement
+		  Word disp = read_word(y86, mem, (pc+1+sizeof(Byte))); //get displacement
 		  if(read_status_y86(y86) != STATUS_AOK) return;
 		  Word val = read_register_y86(y86, src); //get value from source register
 		  Word d = read_register_y86(y86, dest); //get value from destination register
-		  write_memory_word_y86(y86, d+disp, val); //write value to memory address d+disp
+		  trace_access(WRITE_YTRACE, d+disp);
+		  write_word(y86, mem, d+disp, val); //write value to memory address d+disp
 		  if(read_status_y86(y86) != STATUS_AOK) return;
 		  pc = pc + 1 + sizeof(Byte) + sizeof(Word); //increment pc
 		  write_pc_y86(y86, pc);
@@ -239,42 +218,48 @@ step_ysim(Y86 *y86)
 	  }
 	  case 5: //mrmovq
 	  {
-		  Byte regs = read_memory_byte_y86(y86, (pc+1)); //get registers
+		  Byte regs = read_byte(y86, mem, (pc+1)); //get registers
 		  if(read_status_y86(y86) != STATUS_AOK) return;
 		  Byte src = get_nybble(regs, 0); //get source register
 		  Byte dest =  get_nybble(regs, 1); //get destination register
-		  Word disp = read_memory_word_y86(y86, (pc+1+sizeof(Byte))); //get displacement
+		  Word disp = read_word(y86, mem, (pc+1+sizeof(Byte))); //get displacement
 		  if(read_status_y86(y86) != STATUS_AOK) return;
 		  Word s = read_register_y86(y86, src); //get value from source register
-		  Word val = read_memory_word_y86(y86, s+disp); //get value from memory
+		  trace_access(READ_YTRACE, s+disp);
+		  Word val = read_word(y86, mem, s+disp); //get value from memory
 		  if(read_status_y86(y86) != STATUS_AOK) return;
-		  write_register_y86(y86, dest, val); //write value to dest register
+		  set_register(y86, dest, val); //write value to dest register
 		  pc = pc+1+sizeof(Byte)+sizeof(Word); //increment pc
 		  write_pc_y86(y86, pc);
 		  break;
 	  }
 	  case 6: //op
 	  {
-		  Byte op = read_memory_byte_y86(y86, pc); //get operation code
+		  Byte op = read_byte(y86, mem, pc); //get operation code
 		  if(read_status_y86(y86) != STATUS_AOK) return;
 		  op = get_nybble(op, 0);
 		  //printf("Opcode is %d\n", op);
-		  Byte regs = read_memory_byte_y86(y86, pc+1); //get registers
+		  Byte regs = read_byte(y86, mem, pc+1); //get registers
 		  if(read_status_y86(y86) != STATUS_AOK) return;
 		  Byte regA = get_nybble(regs, 1); //get register A
 		  Byte regB = get_nybble(regs, 0); //get register B
 		  op1(y86, op, regA, regB); //do operation
+		  if(read_status_y86(y86) != STATUS_AOK) return;
 		  pc = pc+1+sizeof(Byte); //increment pc
 		  write_pc_y86(y86, pc);
 		  break;
 	  }
 	  case 7: //jmp
 	  {
-		  Byte cond = read_memory_byte_y86(y86, pc); //get condition code
+		  Byte cond = read_byte(y86, mem, pc); //get condition code
 		  if(read_status_y86(y86) != STATUS_AOK) return;
 		  cond = get_nybble(cond, 0);
+		  if(cond > GT_COND){
+			  write_status_y86(y86, STATUS_INS);
+			  return;
+		  }
 		  if(check_cc(y86, cond)){
-			  Word dest = read_memory_word_y86(y86, pc+1);
+			  Word dest = read_word(y86, mem, pc+1);
 			  if(read_status_y86(y86) != STATUS_AOK) return;
 			  write_pc_y86(y86, dest);
 		  } else{
@@ -285,13 +270,14 @@ step_ysim(Y86 *y86)
 	  }
 	  case 8: //call
 	  {
-	  	Word dest = read_memory_word_y86(y86, pc+1); //get destination address
+	  	Word dest = read_word(y86, mem, pc+1); //get destination address
 		if(read_status_y86(y86) != STATUS_AOK) return;
 	  	Address ret_addr = pc+1+sizeof(Word); //get return address
 		Word stack = read_register_y86(y86, 4); //get stack pointer
 		stack = stack - sizeof(Address); //decrement stack pointer
-		write_register_y86(y86, 4, stack); 
-		write_memory_word_y86(y86, stack, ret_addr); //push return address to stack
+		set_register(y86, 4, stack); 
+		trace_access(WRITE_YTRACE, stack);
+		write_word(y86, mem, stack, ret_addr); //push return address to stack
 		if(read_status_y86(y86) != STATUS_AOK) return;
 		write_pc_y86(y86, dest); //jump to destination address
 		break;
@@ -299,23 +285,25 @@ step_ysim(Y86 *y86)
 	  case 9: //ret
 	  {
 		Word stack = read_register_y86(y86, 4); //get stack pointer
-		Word dest = read_memory_word_y86(y86, stack); //pop address from stack
+		trace_access(READ_YTRACE, stack);
+		Word dest = read_word(y86, mem, stack); //pop address from stack
 		if(read_status_y86(y86) != STATUS_AOK) return;
 		stack = stack + sizeof(Address); //increment stack pointer
-		write_register_y86(y86, 4, stack);
+		set_register(y86, 4, stack);
 		write_pc_y86(y86, dest);
 		break;
 	  }
 	  case 10: //push
 	  {
-		  Byte reg = read_memory_byte_y86(y86, pc+1);
+		  Byte reg = read_byte(y86, mem, pc+1);
 		  if(read_status_y86(y86) != STATUS_AOK) return;
 		  reg = get_nybble(reg, 1); //get source register
 		  Word value = read_register_y86(y86, reg); //get value of register
 		  Word stack = read_register_y86(y86, 4); //get stack pointer
 		  stack = stack - sizeof(Word); //decrement stack pointer
-		  write_register_y86(y86, 4, stack);
-		  write_memory_word_y86(y86, stack, value); //push value to stack
+		  set_register(y86, 4, stack);
+		  trace_access(WRITE_YTRACE, stack);
+		  write_word(y86, mem, stack, value); //push value to stack
 		  if(read_status_y86(y86) != STATUS_AOK) return;
 		  pc = pc+1+sizeof(Byte); //pc
 		  write_pc_y86(y86, pc);
@@ -323,22 +311,391 @@ step_ysim(Y86 *y86)
 	  }
 	  case 11: //pop
 	  {
-		  Byte reg = read_memory_byte_y86(y86, pc+1);
+		  Byte reg = read_byte(y86, mem, pc+1);
 		  if(read_status_y86(y86) != STATUS_AOK) return;
 		  reg = get_nybble(reg, 1); //get destination register
 		  Word stack = read_register_y86(y86, 4); //get stack pointer
-		  Word value = read_memory_word_y86(y86, stack); //pop address from stack
+		  trace_access(READ_YTRACE, stack);
+		  Word value = read_word(y86, mem, stack); //pop address from stack
 		  if(read_status_y86(y86) != STATUS_AOK) return;
-		  write_register_y86(y86, reg, value);
+		  set_register(y86, reg, value);
 		  if(reg != 4){
 		  	stack = stack+sizeof(Word); //increment stack pointer
-		  	write_register_y86(y86, 4, stack);
+		  	set_register(y86, 4, stack);
 		  }
 		  pc = pc+1+sizeof(Byte); //increment pc
 		  write_pc_y86(y86, pc);
 		  break;
 	  }
+	  case 12: //xaddq and cmpxchgq
+	  {
+		  Byte fn = get_nybble(read_byte(y86, mem, pc), 0);
+		  Byte regs = read_byte(y86, mem, pc+1); //get registers
+		  if(read_status_y86(y86) != STATUS_AOK) return;
+		  Byte regA = get_nybble(regs, 1);
+		  Byte regB = get_nybble(regs, 0);
+		  Word disp = read_word(y86, mem, pc+1+sizeof(Byte)); //get displacement
+		  if(read_status_y86(y86) != STATUS_AOK) return;
+		  Word b = read_register_y86(y86, regB);
+		  if(read_status_y86(y86) != STATUS_AOK) return;
+		  trace_access(READ_YTRACE, b+disp);
+		  trace_access(WRITE_YTRACE, b+disp);
+		  changedRegs |= exec_yatomic(y86, mem, fn, regA, b+disp);
+		  if(read_status_y86(y86) != STATUS_AOK) return;
+		  pc = pc+1+sizeof(Byte)+sizeof(Word); //increment pc
+		  write_pc_y86(y86, pc);
+		  break;
+	  }
 	  default:
 		  write_status_y86(y86, STATUS_INS);
   }
 }
+
+/** Like step_ysim(), but all memory accesses made by the instruction
+ *  (including its fetch) go to mem rather than to y86's own memory.
+ *  If mem is NULL, this is identical to step_ysim().  Return a mask
+ *  with bit r set iff register r was written by the instruction.
+ */
+unsigned
+step_ysim_mem(Y86 *y86, YMem *mem)
+{
+  changedRegs = 0;
+  execute(y86, mem);
+  return changedRegs;
+}
+
+/*********************** Verified Instructions *************************/
+
+/** Return false after setting the status of y86 to STATUS_ADR if isOk
+ *  is false.
+ */
+static inline bool
+check_data(Y86 *y86, bool isOk)
+{
+  if (!isOk) write_status_y86(y86, STATUS_ADR);
+  return isOk;
+}
+
+/** Execute insn, the verified instruction at pc of y86, with its data
+ *  accesses going to mem.  Only the data accesses are checked.
+ */
+static void
+execute_verified(Y86 *y86, YMem *mem, Address pc, const YVerifiedInsn *insn)
+{
+  trace_access(FETCH_YTRACE, pc);
+  const Byte fn = get_nybble(insn->op, 0);
+  const Register regA = insn->regA, regB = insn->regB;
+  Address next = pc + insn->length;
+  switch ((BaseOpCode)get_nybble(insn->op, 1)) {
+  case HALT_CODE:
+    write_status_y86(y86, STATUS_HLT);
+    return;
+  case NOP_CODE:
+    break;
+  case CMOVxx_CODE:
+    if (check_cc(y86, insn->op)) {
+      set_register(y86, regB, read_register_y86(y86, regA));
+    }
+    break;
+  case IRMOVQ_CODE:
+    set_register(y86, regB, insn->imm);
+    break;
+  case RMMOVQ_CODE: {
+    const Address addr = read_register_y86(y86, regB) + insn->imm;
+    trace_access(WRITE_YTRACE, addr);
+    const Word value = read_register_y86(y86, regA);
+    if (!check_data(y86, write_word_ymem(mem, addr, value))) {
+      return;
+    }
+    break;
+  }
+  case MRMOVQ_CODE: {
+    const Address addr = read_register_y86(y86, regB) + insn->imm;
+    trace_access(READ_YTRACE, addr);
+    Word value;
+    if (!check_data(y86, read_word_ymem(mem, addr, &value))) {
+      return;
+    }
+    set_register(y86, regA, value);
+    break;
+  }
+  case OP1_CODE:
+    op1(y86, fn, regA, regB);
+    break;
+  case Jxx_CODE:
+    if (check_cc(y86, insn->op)) next = insn->imm;
+    break;
+  case CALL_CODE: {
+    const Word stack = read_register_y86(y86, REG_RSP) - sizeof(Word);
+    set_register(y86, REG_RSP, stack);
+    trace_access(WRITE_YTRACE, stack);
+    if (!check_data(y86, write_word_ymem(mem, stack, next))) {
+      return;
+    }
+    next = insn->imm;
+    break;
+  }
+  case RET_CODE: {
+    const Word stack = read_register_y86(y86, REG_RSP);
+    trace_access(READ_YTRACE, stack);
+    if (!check_data(y86, read_word_ymem(mem, stack, &next))) {
+      return;
+    }
+    set_register(y86, REG_RSP, stack + sizeof(Word));
+    break;
+  }
+  case PUSHQ_CODE: {
+    const Word value = read_register_y86(y86, regA);
+    const Word stack = read_register_y86(y86, REG_RSP) - sizeof(Word);
+    set_register(y86, REG_RSP, stack);
+    trace_access(WRITE_YTRACE, stack);
+    if (!check_data(y86, write_word_ymem(mem, stack, value))) {
+      return;
+    }
+    break;
+  }
+  case POPQ_CODE: {
+    const Word stack = read_register_y86(y86, REG_RSP);
+    trace_access(READ_YTRACE, stack);
+    Word value;
+    if (!check_data(y86, read_word_ymem(mem, stack, &value))) {
+      return;
+    }
+    set_register(y86, regA, value);
+    if (regA != REG_RSP) set_register(y86, REG_RSP, stack + sizeof(Word));
+    break;
+  }
+  case ATOMIC_CODE: {
+    const Address addr = read_register_y86(y86, regB) + insn->imm;
+    trace_access(READ_YTRACE, addr);
+    trace_access(WRITE_YTRACE, addr);
+    changedRegs |= exec_yatomic(y86, mem, fn, regA, addr);
+    if (read_status_y86(y86) != STATUS_AOK) return;
+    break;
+  }
+  }
+  write_pc_y86(y86, next);
+}
+
+/** Like step_ysim_mem(), but if the instruction at the pc of y86 was
+ *  verified by verify, execute it without checking its fetch, opcode
+ *  or registers; only its data accesses are checked.  Falls back to
+ *  step_ysim_mem() for unverified instructions or a NULL mem.
+ */
+unsigned
+step_verified_ysim_mem(Y86 *y86, YMem *mem, const YVerify *verify)
+{
+  const Address pc = read_pc_y86(y86);
+  const YVerifiedInsn *insn = mem ? get_insn_yverify(verify, pc) : NULL;
+  if (!insn) return step_ysim_mem(y86, mem);
+  changedRegs = 0;
+  execute_verified(y86, mem, pc, insn);
+  return changedRegs;
+}
+
+/*********************** Fused Instruction Pairs ***********************/
+
+/** Return true iff verified instructions first and second, the one
+ *  following it, form one of the idioms OPq+jXX, irmovq+OPq,
+ *  mrmovq+OPq, pushq+pushq or popq+popq.
+ */
+static bool
+is_fused_pair(const YVerifiedInsn *first, const YVerifiedInsn *second)
+{
+  const BaseOpCode op1 = get_nybble(first->op, 1);
+  const BaseOpCode op2 = get_nybble(second->op, 1);
+  switch (op1) {
+  case OP1_CODE:
+    return op2 == Jxx_CODE;     //loop tail: subq %rdx, %rcx; jne loop
+  case IRMOVQ_CODE:             //constant operand: irmovq $8, %r8; addq ...
+  case MRMOVQ_CODE:             //accumulate: mrmovq (%rdi), %r10; addq ...
+    return op2 == OP1_CODE;
+  case PUSHQ_CODE:
+  case POPQ_CODE:
+    return op2 == op1;
+  default:
+    return false;
+  }
+}
+
+/** Return the result of OPq function fn, which must be valid, on
+ *  operands opA (from rA) and opB (from rB), setting *cc to its
+ *  condition codes.
+ */
+static Word
+eval_op1(Byte fn, Word opA, Word opB, Byte *cc)
+{
+  Word result;
+  switch (fn) {
+  case ADDQ_FN:
+    result = opA + opB;
+    *cc = add_arith_cc(opA, opB, result);
+    break;
+  case SUBQ_FN:
+    result = opB - opA;
+    *cc = sub_arith_cc(opB, opA, result);
+    break;
+  case ANDQ_FN:
+    result = opA & opB;
+    *cc = logic_op_cc(result);
+    break;
+  default:
+    result = opA ^ opB;
+    *cc = logic_op_cc(result);
+    break;
+  }
+  return result;
+}
+
+/** Execute first, the verified instruction at pc of y86, and second,
+ *  the one following it, which form a fused pair, with their data
+ *  accesses going to mem.  The pair is run by one handler: the pc is
+ *  written once, an OPq takes the register written by the first
+ *  instruction of its pair without reading it back, the jXX of an
+ *  OPq+jXX tests the codes just computed and the two stack words of
+ *  a pushq or popq pair are accessed with a single bounds check.
+ *  Return false, changing nothing, if the pair must instead be
+ *  stepped: its accesses fault, the first pushq stores over the
+ *  second or the first popq pops %rsp.
+ */
+static bool
+execute_fused(Y86 *y86, YMem *mem, Address pc, const YVerifiedInsn *first,
+              const YVerifiedInsn *second)
+{
+  const Address pc2 = pc + first->length;
+  Address next = pc2 + second->length;
+  const BaseOpCode base = get_nybble(first->op, 1);
+  switch (base) {
+  case OP1_CODE: {
+    Byte cc;
+    const Word result =
+      eval_op1(get_nybble(first->op, 0), read_register_y86(y86, first->regA),
+               read_register_y86(y86, first->regB), &cc);
+    trace_access(FETCH_YTRACE, pc);
+    trace_access(FETCH_YTRACE, pc2);
+    set_register(y86, first->regB, result);
+    write_cc_y86(y86, cc);
+    if (holds_cc(cc, get_nybble(second->op, 0))) next = second->imm;
+    break;
+  }
+  case IRMOVQ_CODE:
+  case MRMOVQ_CODE: {
+    Word value = first->imm;
+    Register dest = first->regB;
+    if (base == MRMOVQ_CODE) {
+      const Address addr = read_register_y86(y86, first->regB) + first->imm;
+      if (!read_word_ymem(mem, addr, &value)) return false;
+      trace_access(FETCH_YTRACE, pc);
+      trace_access(READ_YTRACE, addr);
+      dest = first->regA;
+    }
+    else {
+      trace_access(FETCH_YTRACE, pc);
+    }
+    trace_access(FETCH_YTRACE, pc2);
+    set_register(y86, dest, value);
+    const Word opA = (second->regA == dest)
+      ? value : read_register_y86(y86, second->regA);
+    const Word opB = (second->regB == dest)
+      ? value : read_register_y86(y86, second->regB);
+    Byte cc;
+    set_register(y86, second->regB,
+                 eval_op1(get_nybble(second->op, 0), opA, opB, &cc));
+    write_cc_y86(y86, cc);
+    break;
+  }
+  case PUSHQ_CODE: {
+    const Word stack = read_register_y86(y86, REG_RSP);
+    //the first push must not overwrite the second, already fetched
+    if (stack - sizeof(Word) < next && pc2 < stack) return false;
+    //a pushq %rsp pushes %rsp before its own decrement
+    const Word value1 = read_register_y86(y86, first->regA);
+    const Word value2 = (second->regA == REG_RSP)
+      ? stack - sizeof(Word) : read_register_y86(y86, second->regA);
+    const Word words[] = { value2, value1 };   //lowest address first
+    if (!write_bytes_ymem(mem, stack - sizeof(words), (const Byte *)words,
+                          sizeof(words))) {
+      return false;
+    }
+    trace_access(FETCH_YTRACE, pc);
+    trace_access(WRITE_YTRACE, stack - sizeof(Word));
+    trace_access(FETCH_YTRACE, pc2);
+    trace_access(WRITE_YTRACE, stack - sizeof(words));
+    set_register(y86, REG_RSP, stack - sizeof(words));
+    break;
+  }
+  case POPQ_CODE: {
+    //the second pop would read from the value popped by the first
+    if (first->regA == REG_RSP) return false;
+    const Word stack = read_register_y86(y86, REG_RSP);
+    Word words[2];
+    if (!read_bytes_ymem(mem, stack, (Byte *)words, sizeof(words))) {
+      return false;
+    }
+    trace_access(FETCH_YTRACE, pc);
+    trace_access(READ_YTRACE, stack);
+    trace_access(FETCH_YTRACE, pc2);
+    trace_access(READ_YTRACE, stack + sizeof(Word));
+    set_register(y86, first->regA, words[0]);
+    set_register(y86, second->regA, words[1]);
+    if (second->regA != REG_RSP) {
+      set_register(y86, REG_RSP, stack + sizeof(words));
+    }
+    break;
+  }
+  default:
+    return false;
+  }
+  write_pc_y86(y86, next);
+  return true;
+}
+
+/** Like step_verified_ysim_mem(), but if the next two instructions
+ *  are verified and form one of the common idioms OPq+jXX,
+ *  irmovq+OPq, mrmovq+OPq, pushq+pushq or popq+popq, execute both
+ *  with a single handler for the pair.  The state afterwards is the
+ *  same as after two calls to step_ysim_mem(); a pair which faults is
+ *  stepped one instruction at a time, so that the second is not
+ *  executed if the first faults.  Return the # of instructions
+ *  executed (1 or 2).
+ */
+int
+step_fused_ysim_mem(Y86 *y86, YMem *mem, const YVerify *verify)
+{
+  const Address pc = read_pc_y86(y86);
+  const YVerifiedInsn *insn = mem ? get_insn_yverify(verify, pc) : NULL;
+  if (!insn) {
+    step_ysim_mem(y86, mem);
+    return 1;
+  }
+  changedRegs = 0;
+  const YVerifiedInsn *second = get_insn_yverify(verify, pc + insn->length);
+  if (second && is_fused_pair(insn, second) &&
+      execute_fused(y86, mem, pc, insn, second)) {
+    return 2;
+  }
+  execute_verified(y86, mem, pc, insn);
+  return 1;
+}
+
+
+
+/** Execute the next instruction of y86. Must change status of
+ *  y86 to STATUS_HLT on halt, STATUS_ADR or STATUS_INS on
+ *  bad address or instruction.
+ */
+void
+step_ysim(Y86 *y86)
+{
+  step_ysim_mem(y86, NULL);
+}
+
+/** Record the instruction fetches and data accesses of all later
+ *  steps on this thread in newTrace; stop recording if newTrace is
+ *  NULL.
+ */
+void
+trace_ysim(YTrace *newTrace)
+{
+  trace = newTrace;
+}
@@ -2,6 +2,9 @@
 #define _YSIM_H
 
 #include "y86.h"
+#include "ymem.h"
+#include "ytrace.h"
+#include "yverify.h"
 
 /** Execute the next instruction of y86. Must change status of
  *  y86 to STATUS_HLT on halt, STATUS_ADR or STATUS_INS on
@@ -9,4 +12,34 @@
  */
 void step_ysim(Y86 *y86);
 
+/** Like step_ysim(), but all memory accesses made by the instruction
+ *  (including its fetch) go to mem rather than to y86's own memory.
+ *  If mem is NULL, this is identical to step_ysim().  Return a mask
+ *  with bit r set iff register r was written by the instruction.
+ */
+unsigned step_ysim_mem(Y86 *y86, YMem *mem);
+
+/** Like step_ysim_mem(), but an instruction verified by verify (see
+ *  yverify.h) is executed without fetch, opcode or register checks;
+ *  only its data accesses are checked.  Other instructions, or all
+ *  instructions if mem is NULL, are executed by step_ysim_mem().
+ */
+unsigned step_verified_ysim_mem(Y86 *y86, YMem *mem, const YVerify *verify);
+
+/** Like step_verified_ysim_mem(), but if the next two instructions
+ *  are verified and form one of the common idioms OPq+jXX,
+ *  irmovq+OPq, mrmovq+OPq, pushq+pushq or popq+popq, execute both
+ *  with a single handler for the pair.  The state afterwards is the
+ *  same as after two calls to step_ysim_mem(); a pair which faults is
+ *  stepped one instruction at a time, so that the second is not
+ *  executed if the first faults.  Return the # of instructions
+ *  executed (1 or 2).
+ */
+int step_fused_ysim_mem(Y86 *y86, YMem *mem, const YVerify *verify);
+
+/** Record the instruction fetches and data accesses of all later
+ *  steps on this thread in trace; stop recording if trace is NULL.
+ */
+void trace_ysim(YTrace *trace);
+
 #endif //ifndef _YSIM_H
@@ -0,0 +1,399 @@
+#include "ytrace.h"
+
+#include "errors.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+  KIND_BITS = 2,         /** low bits of a record holding its kind */
+  MAX_DISTANCE_LOG = 48, /** reuse distances are < 2**MAX_DISTANCE_LOG */
+  MAX_WINDOWS = 20,      /** max # of working-set windows reported */
+  MAX_STRIDES = 4,       /** # of distinct strides counted per pc */
+  MAX_STRIDE_PCS = 10,   /** # of pcs whose strides are reported */
+};
+
+struct YTraceStruct {
+  uint64_t *records;    //(addr << KIND_BITS) | kind
+  size_t n, max;
+};
+
+static YTraceKind
+get_kind(uint64_t record)
+{
+  return record & ((1 << KIND_BITS) - 1);
+}
+
+static Address
+get_addr(uint64_t record)
+{
+  return record >> KIND_BITS;
+}
+
+/********************** Allocation / Deallocation **********************/
+
+/** Return a new empty trace. */
+YTrace *
+new_ytrace(void)
+{
+  YTrace *trace = calloc(1, sizeof(struct YTraceStruct));
+  if (!trace) fatal("out of memory\n");
+  return trace;
+}
+
+/** Free all resources allocated by new_ytrace() in trace. */
+void
+free_ytrace(YTrace *trace)
+{
+  free(trace->records);
+  free(trace);
+}
+
+/***************************** Recording *******************************/
+
+/** Append an access of kind to addr to trace. */
+void
+add_ytrace(YTrace *trace, YTraceKind kind, Address addr)
+{
+  if (trace->n == trace->max) {
+    trace->max = trace->max ? 2 * trace->max : 4096;
+    trace->records = realloc(trace->records, trace->max * sizeof(uint64_t));
+    if (!trace->records) fatal("out of memory\n");
+  }
+  trace->records[trace->n++] = ((uint64_t)addr << KIND_BITS) | kind;
+}
+
+/** Return the # of accesses in trace. */
+size_t
+get_n_ytrace(const YTrace *trace)
+{
+  return trace->n;
+}
+
+/** Return the kind of the i'th access in trace, setting *addr to its
+ *  address.
+ */
+YTraceKind
+get_ytrace(const YTrace *trace, size_t i, Address *addr)
+{
+  assert(i < trace->n);
+  *addr = get_addr(trace->records[i]);
+  return get_kind(trace->records[i]);
+}
+
+/** Remove all accesses from trace, keeping its buffer. */
+void
+clear_ytrace(YTrace *trace)
+{
+  trace->n = 0;
+}
+
+/***************************** Address Map *****************************/
+
+/** Open-addressed hash map from addresses to longs. */
+typedef struct {
+  Address *keys;        //key + 1; 0 for an empty slot
+  long *values;
+  size_t size;          //a power of 2
+  size_t n;
+} AddrMap;
+
+static void
+init_addr_map(AddrMap *map, size_t size)
+{
+  map->size = size;
+  map->n = 0;
+  map->keys = calloc(size, sizeof(Address));
+  map->values = calloc(size, sizeof(long));
+  if (!map->keys || !map->values) fatal("out of memory\n");
+}
+
+static void
+free_addr_map(AddrMap *map)
+{
+  free(map->keys);
+  free(map->values);
+}
+
+static size_t
+hash_addr(Address addr)
+{
+  return (addr * 0x9e3779b97f4a7c15UL) >> 17;
+}
+
+/** Return the slot for key in map, inserting it with value 0 if it is
+ *  not present.  The slot is only valid until the next insertion.
+ */
+static long *
+get_addr_map(AddrMap *map, Address key)
+{
+  if (2 * (map->n + 1) > map->size) {
+    AddrMap old = *map;
+    init_addr_map(map, 2 * old.size);
+    for (size_t i = 0; i < old.size; i++) {
+      if (old.keys[i]) *get_addr_map(map, old.keys[i] - 1) = old.values[i];
+    }
+    free_addr_map(&old);
+  }
+  size_t i = hash_addr(key) & (map->size - 1);
+  while (map->keys[i] && map->keys[i] != key + 1) {
+    i = (i + 1) & (map->size - 1);
+  }
+  if (!map->keys[i]) {
+    map->keys[i] = key + 1;
+    map->n++;
+  }
+  return &map->values[i];
+}
+
+/************************** Reuse Distance *****************************/
+
+/** Fenwick tree over times 1..n counting the lines whose most recent
+ *  access is at each time.
+ */
+static void
+add_fenwick(long tree[], size_t n, size_t i, long delta)
+{
+  for (; i <= n; i += i & -i) tree[i] += delta;
+}
+
+static long
+sum_fenwick(const long tree[], size_t i)
+{
+  long sum = 0;
+  for (; i > 0; i -= i & -i) sum += tree[i];
+  return sum;
+}
+
+/** Return the bucket of reuse distance d: 0 for 0, else k for
+ *  2**(k-1) <= d < 2**k.
+ */
+static int
+distance_bucket(long d)
+{
+  int k = 0;
+  while (d > 0) { d >>= 1; k++; }
+  return k;
+}
+
+/** Set hist[] to the histogram of the reuse distances of the fetches
+ *  (if isFetch) or data accesses in records[n], and *nCold to the #
+ *  of first accesses to a line.  Return the # of distinct lines.
+ */
+static size_t
+reuse_distances(const uint64_t records[], size_t n, bool isFetch,
+                int lineShift, long hist[MAX_DISTANCE_LOG], long *nCold)
+{
+  size_t m = 0;
+  for (size_t i = 0; i < n; i++) {
+    m += (get_kind(records[i]) == FETCH_YTRACE) == isFetch;
+  }
+  long *tree = calloc(m + 1, sizeof(long));
+  if (!tree) fatal("out of memory\n");
+  AddrMap lastTimes;    //line -> time of its most recent access
+  init_addr_map(&lastTimes, 1024);
+  memset(hist, 0, MAX_DISTANCE_LOG * sizeof(long));
+  *nCold = 0;
+  size_t t = 0;
+  for (size_t i = 0; i < n; i++) {
+    if ((get_kind(records[i]) == FETCH_YTRACE) != isFetch) continue;
+    t++;
+    long *last = get_addr_map(&lastTimes, get_addr(records[i]) >> lineShift);
+    if (*last == 0) {
+      (*nCold)++;
+    }
+    else {
+      const long d = sum_fenwick(tree, t - 1) - sum_fenwick(tree, *last);
+      hist[distance_bucket(d)]++;
+      add_fenwick(tree, m, *last, -1);
+    }
+    add_fenwick(tree, m, t, 1);
+    *last = t;
+  }
+  const size_t nLines = lastTimes.n;
+  free_addr_map(&lastTimes);
+  free(tree);
+  return nLines;
+}
+
+static void
+write_reuse_histogram(const char *title, const long hist[], long nCold,
+                      int lineSize, FILE *out)
+{
+  long n = nCold;
+  int maxBucket = 0;
+  for (int k = 0; k < MAX_DISTANCE_LOG; k++) {
+    n += hist[k];
+    if (hist[k] > 0) maxBucket = k;
+  }
+  fprintf(out, "\n%s reuse distance (%ld accesses):\n", title, n);
+  if (n == 0) return;
+  fprintf(out, "  %12s %12s %10s %12s\n",
+          "distance <", "cache bytes", "count", "LRU hit %");
+  long nHits = 0;
+  for (int k = 0; k <= maxBucket; k++) {
+    nHits += hist[k];
+    const long lines = 1L << k;
+    fprintf(out, "  %12ld %12ld %10ld %11.2f%%\n",
+            lines, lines * lineSize, hist[k], 100.0 * nHits / n);
+  }
+  fprintf(out, "  %12s %12s %10ld\n", "cold", "", nCold);
+}
+
+/*************************** Working Set *******************************/
+
+static void
+write_working_sets(const uint64_t records[], size_t n, size_t nInsns,
+                   int lineShift, int lineSize, FILE *out)
+{
+  const size_t window = (nInsns + MAX_WINDOWS - 1) / MAX_WINDOWS;
+  fprintf(out, "\nworking set per %zu instructions (lines of %d bytes):\n",
+          window, lineSize);
+  if (window == 0) return;
+  fprintf(out, "  %12s %10s %10s\n", "from insn", "data", "code");
+  AddrMap lastWindows[2];  //line -> window of its last access + 1,
+                           //[0] for data, [1] for code
+  init_addr_map(&lastWindows[0], 1024);
+  init_addr_map(&lastWindows[1], 1024);
+  long nInWindow[2] = { 0, 0 };
+  long w = 0;
+  size_t insn = 0;
+  for (size_t i = 0; i <= n; i++) {
+    const bool isFetch = i < n && get_kind(records[i]) == FETCH_YTRACE;
+    if (i == n || (isFetch && insn > 0 && insn % window == 0)) {
+      fprintf(out, "  %12ld %10ld %10ld\n", w * (long)window,
+              nInWindow[0], nInWindow[1]);
+      nInWindow[0] = nInWindow[1] = 0;
+      w++;
+    }
+    if (i == n) break;
+    insn += isFetch;
+    long *last =
+      get_addr_map(&lastWindows[isFetch], get_addr(records[i]) >> lineShift);
+    if (*last != w + 1) {
+      *last = w + 1;
+      nInWindow[isFetch]++;
+    }
+  }
+  free_addr_map(&lastWindows[0]);
+  free_addr_map(&lastWindows[1]);
+}
+
+/****************************** Strides ********************************/
+
+/** Strides between consecutive data accesses by one instruction. */
+typedef struct {
+  Address pc;
+  Address lastAddr;
+  long n;                       //# of accesses
+  long strides[MAX_STRIDES];
+  long counts[MAX_STRIDES];     //# of times strides[i] was seen
+  long nOther;                  //# of other strides
+} PcStrides;
+
+static void
+add_stride(PcStrides *pcStrides, Address addr)
+{
+  if (pcStrides->n++ > 0) {
+    const long stride = (long)(addr - pcStrides->lastAddr);
+    int i = 0;
+    while (i < MAX_STRIDES && pcStrides->counts[i] > 0 &&
+           pcStrides->strides[i] != stride) {
+      i++;
+    }
+    if (i == MAX_STRIDES) {
+      pcStrides->nOther++;
+    }
+    else {
+      pcStrides->strides[i] = stride;
+      pcStrides->counts[i]++;
+    }
+  }
+  pcStrides->lastAddr = addr;
+}
+
+static int
+compare_pc_strides(const void *p1, const void *p2)
+{
+  const PcStrides *s1 = p1, *s2 = p2;
+  if (s1->n != s2->n) return (s1->n < s2->n) - (s1->n > s2->n);
+  return (s1->pc > s2->pc) - (s1->pc < s2->pc);
+}
+
+static void
+write_strides(const uint64_t records[], size_t n, FILE *out)
+{
+  AddrMap indexes;      //pc -> index in pcs[] + 1
+  init_addr_map(&indexes, 256);
+  PcStrides *pcs = NULL;
+  size_t nPcs = 0, maxPcs = 0;
+  Address pc = 0;
+  for (size_t i = 0; i < n; i++) {
+    const Address addr = get_addr(records[i]);
+    if (get_kind(records[i]) == FETCH_YTRACE) {
+      pc = addr;
+      continue;
+    }
+    long *index = get_addr_map(&indexes, pc);
+    if (*index == 0) {
+      if (nPcs == maxPcs) {
+        maxPcs = maxPcs ? 2 * maxPcs : 64;
+        pcs = realloc(pcs, maxPcs * sizeof(PcStrides));
+        if (!pcs) fatal("out of memory\n");
+      }
+      memset(&pcs[nPcs], 0, sizeof(PcStrides));
+      pcs[nPcs].pc = pc;
+      *index = ++nPcs;
+    }
+    add_stride(&pcs[*index - 1], addr);
+  }
+  qsort(pcs, nPcs, sizeof(PcStrides), compare_pc_strides);
+  fprintf(out, "\nstrides of the top data-accessing instructions:\n");
+  for (size_t i = 0; i < nPcs && i < MAX_STRIDE_PCS; i++) {
+    const PcStrides *s = &pcs[i];
+    fprintf(out, "  pc %04lx: %ld accesses;", s->pc, s->n);
+    if (s->n < 2) {
+      fprintf(out, " no strides\n");
+      continue;
+    }
+    for (int j = 0; j < MAX_STRIDES && s->counts[j] > 0; j++) {
+      fprintf(out, " %+ld: %.1f%%", s->strides[j],
+              100.0 * s->counts[j] / (s->n - 1));
+    }
+    if (s->nOther > 0) {
+      fprintf(out, " other: %.1f%%", 100.0 * s->nOther / (s->n - 1));
+    }
+    fprintf(out, "\n");
+  }
+  free(pcs);
+  free_addr_map(&indexes);
+}
+
+/***************************** Analysis ********************************/
+
+void
+analyze_ytrace(const YTrace *trace, int lineSize, FILE *out)
+{
+  assert(lineSize > 0 && (lineSize & (lineSize - 1)) == 0);
+  int lineShift = 0;
+  while ((1 << lineShift) < lineSize) lineShift++;
+  long nKinds[3] = { 0, 0, 0 };
+  for (size_t i = 0; i < trace->n; i++) nKinds[get_kind(trace->records[i])]++;
+  long dataHist[MAX_DISTANCE_LOG], fetchHist[MAX_DISTANCE_LOG];
+  long nDataCold, nFetchCold;
+  const size_t nDataLines = reuse_distances(trace->records, trace->n, false,
+                                            lineShift, dataHist, &nDataCold);
+  const size_t nCodeLines = reuse_distances(trace->records, trace->n, true,
+                                            lineShift, fetchHist, &nFetchCold);
+  fprintf(out, "memory accesses: %ld fetches, %ld reads, %ld writes\n",
+          nKinds[FETCH_YTRACE], nKinds[READ_YTRACE], nKinds[WRITE_YTRACE]);
+  fprintf(out, "footprint (lines of %d bytes): %zu data, %zu code\n",
+          lineSize, nDataLines, nCodeLines);
+  write_reuse_histogram("data", dataHist, nDataCold, lineSize, out);
+  write_reuse_histogram("fetch", fetchHist, nFetchCold, lineSize, out);
+  write_working_sets(trace->records, trace->n, nKinds[FETCH_YTRACE],
+                     lineShift, lineSize, out);
+  write_strides(trace->records, trace->n, out);
+}
@@ -0,0 +1,59 @@
+#ifndef _YTRACE_H
+#define _YTRACE_H
+
+#include "y86.h"
+
+#include <stdio.h>
+
+/** A trace of the memory accesses of a run: one instruction fetch per
+ *  instruction followed by the data accesses it makes.  Each access
+ *  takes a single word in a growable buffer so that recording is
+ *  cheap; all analysis is done after the run.
+ */
+typedef struct YTraceStruct YTrace;
+
+typedef enum {
+  FETCH_YTRACE,   /** fetch of the instruction at addr */
+  READ_YTRACE,    /** data read of the word at addr */
+  WRITE_YTRACE,   /** data write of the word at addr */
+} YTraceKind;
+
+/** Return a new empty trace. */
+YTrace *new_ytrace(void);
+
+/** Free all resources allocated by new_ytrace() in trace. */
+void free_ytrace(YTrace *trace);
+
+/** Append an access of kind to addr to trace. */
+void add_ytrace(YTrace *trace, YTraceKind kind, Address addr);
+
+/** Return the # of accesses in trace. */
+size_t get_n_ytrace(const YTrace *trace);
+
+/** Return the kind of the i'th access in trace, setting *addr to its
+ *  address.
+ */
+YTraceKind get_ytrace(const YTrace *trace, size_t i, Address *addr);
+
+/** Remove all accesses from trace, keeping its buffer. */
+void clear_ytrace(YTrace *trace);
+
+/** Write an analysis of trace on out, with memory divided into lines
+ *  of lineSize bytes (a power of 2):
+ *
+ *    counts of fetches, reads and writes and the # of distinct lines;
+ *
+ *    for data and for fetches, a histogram of reuse distances (the #
+ *    of distinct other lines accessed between two accesses to a
+ *    line) in powers of 2, with the hit rate of a fully associative
+ *    LRU cache holding that many lines;
+ *
+ *    the working set (# of distinct data and code lines) in each of
+ *    up to 20 consecutive windows of instructions;
+ *
+ *    for the instructions making the most data accesses, their most
+ *    common strides between consecutive accesses.
+ */
+void analyze_ytrace(const YTrace *trace, int lineSize, FILE *out);
+
+#endif //ifndef _YTRACE_H
@@ -0,0 +1,315 @@
+#include "yverify.h"
+
+#include "yinsn.h"
+
+#include "errors.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/** Verified instructions are kept in tables for pages of this many
+ *  bytes, only for the pages which hold them, so that a program
+ *  spread over a large memory needs no table spanning it.
+ */
+enum { PAGE_SHIFT = 10, PAGE_SIZE = 1 << PAGE_SHIFT };
+
+/** The verified instructions in one page */
+typedef struct {
+  Address base;                   //address of the page
+  YVerifiedInsn insns[PAGE_SIZE]; //verified insn starting at each
+                                  //byte, else with length 0
+  Byte isCovered[PAGE_SIZE];      //true iff byte is in a verified insn
+} VerifyPage;
+
+struct YVerifyStruct {
+  YMem *mem;
+  bool isValid;         //false once verified code has been overwritten
+  Address lo, hi;       //verified instructions lie within [lo, hi)
+  VerifyPage **pages;   //[nPages] in order of base
+  size_t nPages;
+  size_t nVerified;
+};
+
+/****************************** Decoding *******************************/
+
+/** Decode the instruction at pc in mem into *insn.  Return false if
+ *  there is no valid instruction at pc.
+ */
+static bool
+decode(const YMem *mem, Address pc, YVerifiedInsn *insn)
+{
+  Byte code[MAX_INSN_LEN];
+  if (!read_byte_ymem(mem, pc, &code[0])) return false;
+  const int base = code[0] >> 4, fn = code[0] & 0xF;
+  if (base >= N_BASE_CODES) return false;
+  const InsnFormat *format = &insnFormats[base];
+  if (fn > format->maxFn) return false;
+  if (!read_bytes_ymem(mem, pc, code, format->length)) return false;
+  *insn = (YVerifiedInsn) {
+    .op = code[0], .length = format->length,
+    .regA = REG_NONE, .regB = REG_NONE,
+  };
+  int immOffset = 1;
+  if (format->regsUse != NO_REGS) {
+    if (!is_valid_regs(format->regsUse, code[1])) return false;
+    insn->regA = code[1] >> 4;
+    insn->regB = code[1] & 0xF;
+    immOffset = 2;
+  }
+  if (format->length > immOffset) insn->imm = get_imm(&code[immOffset]);
+  return true;
+}
+
+/************************* Control-Flow Walk ***************************/
+
+/** Open-addressed set of the pcs found by the walk, with the
+ *  instruction at each (with length 0 if invalid).
+ */
+typedef struct {
+  Address *keys;        //pc + 1; 0 for an empty slot
+  YVerifiedInsn *insns;
+  size_t size;          //a power of 2
+  size_t n;
+} PcSet;
+
+static void
+init_pc_set(PcSet *set, size_t size)
+{
+  set->size = size;
+  set->n = 0;
+  set->keys = calloc(size, sizeof(Address));
+  set->insns = calloc(size, sizeof(YVerifiedInsn));
+  if (!set->keys || !set->insns) fatal("out of memory\n");
+}
+
+static void
+free_pc_set(PcSet *set)
+{
+  free(set->keys);
+  free(set->insns);
+}
+
+/** Add pc to set; return its slot, or -1 if it was already present. */
+static long
+add_pc_set(PcSet *set, Address pc)
+{
+  if (2 * (set->n + 1) > set->size) {
+    PcSet old = *set;
+    init_pc_set(set, 2 * old.size);
+    for (size_t i = 0; i < old.size; i++) {
+      if (old.keys[i]) {
+        set->insns[add_pc_set(set, old.keys[i] - 1)] = old.insns[i];
+      }
+    }
+    free_pc_set(&old);
+  }
+  size_t i = ((pc * 0x9e3779b97f4a7c15UL) >> 17) & (set->size - 1);
+  while (set->keys[i] && set->keys[i] != pc + 1) {
+    i = (i + 1) & (set->size - 1);
+  }
+  if (set->keys[i]) return -1;
+  set->keys[i] = pc + 1;
+  set->n++;
+  return i;
+}
+
+/** Walk the control flow of the program in mem from entry, recording
+ *  every pc reached in set.
+ */
+static void
+walk(const YMem *mem, Address entry, PcSet *set)
+{
+  size_t nWork = 0, maxWork = 64;
+  Address *work = malloc(maxWork * sizeof(Address));
+  if (!work) fatal("out of memory\n");
+  work[nWork++] = entry;
+  while (nWork > 0) {
+    const Address pc = work[--nWork];
+    const long slot = add_pc_set(set, pc);
+    if (slot < 0) continue;
+    YVerifiedInsn insn;
+    if (!decode(mem, pc, &insn)) continue;
+    set->insns[slot] = insn;
+    Address next[2];
+    int nNext = 0;
+    switch (insn.op >> 4) {
+    case HALT_CODE: case RET_CODE:
+      break;
+    case Jxx_CODE:
+      next[nNext++] = insn.imm;
+      if ((insn.op & 0xF) != 0) next[nNext++] = pc + insn.length;
+      break;
+    case CALL_CODE:
+      next[nNext++] = insn.imm;
+      next[nNext++] = pc + insn.length;
+      break;
+    default:
+      next[nNext++] = pc + insn.length;
+      break;
+    }
+    for (int i = 0; i < nNext; i++) {
+      if (nWork == maxWork) {
+        maxWork *= 2;
+        work = realloc(work, maxWork * sizeof(Address));
+        if (!work) fatal("out of memory\n");
+      }
+      work[nWork++] = next[i];
+    }
+  }
+  free(work);
+}
+
+/****************************** Pages **********************************/
+
+/** Return the page of verify holding addr; NULL if none. */
+static VerifyPage *
+find_page(const YVerify *verify, Address addr)
+{
+  const Address base = addr & ~(Address)(PAGE_SIZE - 1);
+  size_t lo = 0, hi = verify->nPages;
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if (verify->pages[mid]->base < base) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return (lo < verify->nPages && verify->pages[lo]->base == base)
+    ? verify->pages[lo] : NULL;
+}
+
+static int
+compare_addresses(const void *p1, const void *p2)
+{
+  const Address a1 = *(const Address *)p1, a2 = *(const Address *)p2;
+  return (a1 > a2) - (a1 < a2);
+}
+
+/** Allocate the pages of verify for the bytes of the instructions in
+ *  set.
+ */
+static void
+alloc_pages(YVerify *verify, const PcSet *set)
+{
+  Address *bases = malloc(2 * set->n * sizeof(Address));
+  if (!bases) fatal("out of memory\n");
+  size_t n = 0;
+  for (size_t i = 0; i < set->size; i++) {
+    if (!set->keys[i] || set->insns[i].length == 0) continue;
+    const Address pc = set->keys[i] - 1;
+    bases[n++] = pc & ~(Address)(PAGE_SIZE - 1);
+    bases[n++] = (pc + set->insns[i].length - 1) & ~(Address)(PAGE_SIZE - 1);
+  }
+  qsort(bases, n, sizeof(Address), compare_addresses);
+  verify->pages = malloc(n * sizeof(VerifyPage *));
+  if (!verify->pages) fatal("out of memory\n");
+  for (size_t i = 0; i < n; i++) {
+    if (i > 0 && bases[i] == bases[i - 1]) continue;
+    VerifyPage *page = calloc(1, sizeof(VerifyPage));
+    if (!page) fatal("out of memory\n");
+    page->base = bases[i];
+    verify->pages[verify->nPages++] = page;
+  }
+  free(bases);
+}
+
+/************************ Creation / Destruction ***********************/
+
+/** Invalidate verify if a write of size bytes at addr overlaps a
+ *  verified instruction.
+ */
+static void
+on_write(void *ctx, Address addr, size_t size)
+{
+  YVerify *verify = ctx;
+  if (!verify->isValid || addr >= verify->hi || addr + size <= verify->lo) {
+    return;
+  }
+  const Address lo = (addr > verify->lo) ? addr : verify->lo;
+  const Address hi = (addr + size < verify->hi) ? addr + size : verify->hi;
+  for (Address a = lo; a < hi; a++) {
+    const VerifyPage *page = find_page(verify, a);
+    if (page && page->isCovered[a - page->base]) {
+      verify->isValid = false;
+      return;
+    }
+  }
+}
+
+/** Verify the program loaded in mem starting at pc entry.  The
+ *  verification hooks the writes of mem (see hook_writes_ymem()) until
+ *  it is freed.
+ */
+YVerify *
+new_yverify(YMem *mem, Address entry)
+{
+  YVerify *verify = calloc(1, sizeof(struct YVerifyStruct));
+  if (!verify) fatal("out of memory\n");
+  verify->mem = mem;
+  PcSet set;
+  init_pc_set(&set, 1024);
+  walk(mem, entry, &set);
+  Address lo = ~(Address)0, hi = 0;
+  for (size_t i = 0; i < set.size; i++) {
+    if (!set.keys[i] || set.insns[i].length == 0) continue;
+    const Address pc = set.keys[i] - 1;
+    if (pc < lo) lo = pc;
+    if (pc + set.insns[i].length > hi) hi = pc + set.insns[i].length;
+    verify->nVerified++;
+  }
+  if (verify->nVerified > 0) {
+    verify->lo = lo;
+    verify->hi = hi;
+    alloc_pages(verify, &set);
+    for (size_t i = 0; i < set.size; i++) {
+      if (!set.keys[i] || set.insns[i].length == 0) continue;
+      const Address pc = set.keys[i] - 1;
+      VerifyPage *page = find_page(verify, pc);
+      page->insns[pc - page->base] = set.insns[i];
+      for (Address a = pc; a < pc + set.insns[i].length; a++) {
+        page = find_page(verify, a);
+        page->isCovered[a - page->base] = true;
+      }
+    }
+  }
+  free_pc_set(&set);
+  verify->isValid = verify->nVerified > 0;
+  hook_writes_ymem(mem, on_write, verify);
+  return verify;
+}
+
+/** Free all resources allocated by new_yverify() in verify and remove
+ *  its hook from the writes of its memory.
+ */
+void
+free_yverify(YVerify *verify)
+{
+  hook_writes_ymem(verify->mem, NULL, NULL);
+  for (size_t i = 0; i < verify->nPages; i++) free(verify->pages[i]);
+  free(verify->pages);
+  free(verify);
+}
+
+/****************************** Queries ********************************/
+
+/** Return the decoded verified instruction at pc; NULL if the
+ *  instruction at pc is not verified.
+ */
+const YVerifiedInsn *
+get_insn_yverify(const YVerify *verify, Address pc)
+{
+  if (!verify->isValid || pc < verify->lo || pc >= verify->hi) return NULL;
+  const VerifyPage *page = find_page(verify, pc);
+  if (!page) return NULL;
+  const YVerifiedInsn *insn = &page->insns[pc - page->base];
+  return (insn->length > 0) ? insn : NULL;
+}
+
+/** Return the # of instructions verified when verify was created. */
+size_t
+get_n_verified_yverify(const YVerify *verify)
+{
+  return verify->nVerified;
+}
@@ -0,0 +1,50 @@
+#ifndef _YVERIFY_H
+#define _YVERIFY_H
+
+#include "y86.h"
+#include "ymem.h"
+
+/** Load-time verification of a program.  Control flow is recovered
+ *  from the entry pc by following fallthroughs, jump and call
+ *  targets and the return addresses of calls.  Every instruction
+ *  found which has a valid opcode and function, valid registers and
+ *  lies entirely within memory is verified: it can be executed
+ *  without any fetch, opcode or register checks.  Only its data
+ *  accesses can fault.  A ret may go anywhere, so each pc must still
+ *  be looked up with get_insn_yverify().
+ *
+ *  A write to memory holding a verified instruction invalidates the
+ *  whole verification, so that self-modifying programs fall back to
+ *  checked execution.
+ */
+typedef struct YVerifyStruct YVerify;
+
+/** Verify the program loaded in mem starting at pc entry.  The
+ *  verification hooks the writes of mem (see hook_writes_ymem()) until
+ *  it is freed.
+ */
+YVerify *new_yverify(YMem *mem, Address entry);
+
+/** Free all resources allocated by new_yverify() in verify and remove
+ *  its hook from the writes of its memory.
+ */
+void free_yverify(YVerify *verify);
+
+/** A verified instruction, decoded at load time */
+typedef struct {
+  Byte op;          /** opcode byte: base opcode and function */
+  Byte length;      /** # of bytes in the instruction */
+  Register regA;    /** rA; REG_NONE if unused */
+  Register regB;    /** rB; REG_NONE if unused */
+  Word imm;         /** immediate, displacement or destination; else 0 */
+} YVerifiedInsn;
+
+/** Return the decoded verified instruction at pc; NULL if the
+ *  instruction at pc is not verified.
+ */
+const YVerifiedInsn *get_insn_yverify(const YVerify *verify, Address pc);
+
+/** Return the # of instructions verified when verify was created. */
+size_t get_n_verified_yverify(const YVerify *verify);
+
+#endif //ifndef _YVERIFY_H
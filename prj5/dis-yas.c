@@ -0,0 +1,233 @@
+#include "dis-yas.h"
+
+#include <assert.h>
+#include <string.h>
+
+const char *conds[] = { "", "le", "l", "e", "ne", "ge", "g", };
+static void
+cond_label(Byte opByte, const char *baseLabel, char *buf)
+{
+  const Byte fn = get_nybble(opByte, 0);
+  assert(fn < sizeof(conds)/sizeof(conds[0]));
+  if (fn == 0) {
+    const char *op = (strcmp(baseLabel, "j") == 0) ? "jmp" : "rrmovq";
+    strcat(buf, op);
+  }
+  else {
+    strcat(buf, baseLabel);
+    strcat(buf, conds[fn]);
+  }
+}
+
+static const char *ops[] = { "addq", "subq", "andq", "xorq", };
+static void
+op1_label(Byte opByte, const char *baseLabel, char *buf)
+{
+  const Byte fn = get_nybble(opByte, 0);
+  assert(fn < sizeof(ops)/sizeof(ops[0]));
+  strcat(buf, ops[fn]);
+}
+
+static void
+base_label(Byte opByte, const char *baseLabel, char *buf)
+{
+  strcat(buf, baseLabel);
+}
+
+
+static OpInfo opInfos[] = {
+  { .op = HALT_CODE,
+    .label = "halt",
+    .labelFn = base_label,
+    .arg1 = NO_ARG,
+    .arg2 = NO_ARG,
+  },
+  { .op = NOP_CODE,
+    .label = "nop",
+    .labelFn = base_label,
+    .arg1 = NO_ARG,
+    .arg2 = NO_ARG,
+  },
+  { .op = CMOVxx_CODE,
+    .label = "cmov",
+    .labelFn = cond_label,
+    .arg1 = REGA_ARG,
+    .arg2 = REGB_ARG,
+  },
+  { .op = IRMOVQ_CODE,
+    .label = "irmovq",
+    .labelFn = base_label,
+    .arg1 = IMMED_ARG,
+    .arg2 = REGB_ARG,
+  },
+  { .op = RMMOVQ_CODE,
+    .label = "rmmovq",
+    .labelFn = base_label,
+    .arg1 = REGA_ARG,
+    .arg2 = REGB_DISP_ARG,
+  },
+  { .op = MRMOVQ_CODE,
+    .label = "mrmovq",
+    .labelFn = base_label,
+    .arg1 = REGB_DISP_ARG,
+    .arg2 = REGA_ARG,
+  },
+  { .op = OP1_CODE,
+    .label = "",
+    .labelFn = op1_label,
+    .arg1 = REGA_ARG,
+    .arg2 = REGB_ARG,
+  },
+  { .op = Jxx_CODE,
+    .label = "j",
+    .labelFn = cond_label,
+    .arg1 = ADDR_ARG,
+    .arg2 = NO_ARG,
+  },
+  { .op = CALL_CODE,
+    .label = "call",
+    .labelFn = base_label,
+    .arg1 = ADDR_ARG,
+    .arg2 = NO_ARG,
+  },
+  { .op = RET_CODE,
+    .label = "ret",
+    .labelFn = base_label,
+    .arg1 = NO_ARG,
+    .arg2 = NO_ARG,
+  },
+  { .op = PUSHQ_CODE,
+    .label = "pushq",
+    .labelFn = base_label,
+    .arg1 = REGA_ARG,
+    .arg2 = NO_ARG,
+  },
+  { .op = POPQ_CODE,
+    .label = "popq",
+    .labelFn = base_label,
+    .arg1 = REGA_ARG,
+    .arg2 = NO_ARG,
+  },
+};
+
+const char *regs[] = {
+  "%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
+  "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14",
+};
+
+static void
+append_reg(const Byte code[], int nybblePos, char buf[])
+{
+  const Byte regN = get_nybble(code[1], nybblePos);
+  assert(regN < sizeof(regs)/sizeof(regs[0]));
+  strcat(buf, regs[regN]);
+}
+
+static void
+append_op_word(const Byte code[], Word pcDisp, char buf[])
+{
+  Word word = 0;
+  for (int i = sizeof(Word) - 1; i >= 0; i--) {
+    word = (word << 8) | code[pcDisp + i];
+  }
+  char *p = buf + strlen(buf);
+  sprintf(p, "$0x%lx", word);
+}
+static void
+append_arg(const Byte code[], ArgType arg, char buf[])
+{
+  switch (arg) {
+    case NO_ARG:
+      break;
+    case REGA_ARG:
+      append_reg(code, 1, buf);
+      break;
+    case REGB_ARG:
+      append_reg(code, 0, buf);
+      break;
+    case IMMED_ARG:
+      append_op_word(code, 2, buf);
+      break;
+    case REGB_DISP_ARG:
+      append_op_word(code, 2, buf);
+      strcat(buf, "(");
+      append_reg(code, 0, buf);
+      strcat(buf, ")");
+      break;
+    case ADDR_ARG:
+      append_op_word(code, 1, buf);
+      break;
+    default:
+      assert(0);
+  }
+}
+
+/** Return the info for instructions whose first byte is op; NULL if
+ *  the base op of op is not valid.
+ */
+const OpInfo *
+get_op_info(Byte op)
+{
+  const Byte baseOp = get_nybble(op, 1);
+  return (baseOp < sizeof(opInfos)/sizeof(opInfos[0])) ? &opInfos[baseOp]
+                                                       : NULL;
+}
+
+static bool
+is_word_arg(ArgType arg)
+{
+  return arg == IMMED_ARG || arg == REGB_DISP_ARG || arg == ADDR_ARG;
+}
+
+static bool
+is_reg_arg(ArgType arg)
+{
+  return arg == REGA_ARG || arg == REGB_ARG || arg == REGB_DISP_ARG;
+}
+
+/** Return the length in bytes of instructions described by opInfo. */
+int
+get_op_length(const OpInfo *opInfo)
+{
+  const bool hasRegs = is_reg_arg(opInfo->arg1) || is_reg_arg(opInfo->arg2);
+  const bool hasWord = is_word_arg(opInfo->arg1) || is_word_arg(opInfo->arg2);
+  return 1 + (hasRegs ? sizeof(Byte) : 0) + (hasWord ? sizeof(Word) : 0);
+}
+
+/** Disassemble the instruction at the pc of y86 into buf and return
+ *  buf.  Assumes that buf is large enough: no overflow checking.
+ */
+const char *
+dis_yas(Y86 *y86, char buf[])
+{
+  const Word pc = read_pc_y86(y86);
+  Byte code[MAX_INSN_BYTES];
+  code[0] = read_memory_byte_y86(y86, pc);
+  assert(read_status_y86(y86) == STATUS_AOK);
+  const OpInfo *opInfo = get_op_info(code[0]);
+  assert(opInfo);
+  for (int i = 1; i < get_op_length(opInfo); i++) {
+    code[i] = read_memory_byte_y86(y86, pc + i);
+    assert(read_status_y86(y86) == STATUS_AOK);
+  }
+  return dis_yas_code(code, buf);
+}
+
+/** Disassemble the instruction whose bytes are code[] into buf and
+ *  return buf.  Assumes that buf is large enough: no overflow checking.
+ */
+const char *
+dis_yas_code(const Byte code[], char buf[])
+{
+  const OpInfo *opInfo = get_op_info(code[0]);
+  assert(opInfo);
+  buf[0] = '\0';
+  opInfo->labelFn(code[0], opInfo->label, buf);
+  strcat(buf, "\t");
+  append_arg(code, opInfo->arg1, buf);
+  if (opInfo->arg2 != NO_ARG) {
+    strcat(buf, ", ");
+    append_arg(code, opInfo->arg2, buf);
+  }
+  return buf;
+}
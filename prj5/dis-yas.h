@@ -0,0 +1,51 @@
+#ifndef _DIS_YAS_H
+#define _DIS_YAS_H
+
+#include "y86.h"
+#include "y86-util.h"
+
+/** Disassembler for Y86 instructions, driven by a table with one
+ *  OpInfo per base op giving its label and the types of its args.
+ */
+
+enum { MAX_INSN_BYTES = 10 };  /** max length of an instruction */
+
+typedef enum {
+  NO_ARG,
+  REGA_ARG,
+  REGB_ARG,
+  IMMED_ARG,
+  REGB_DISP_ARG,
+  ADDR_ARG
+} ArgType;
+
+typedef void OpLabelFn(Byte opByte, const char *baseLabel, char *buf);
+
+typedef struct {
+  BaseOpCode op;
+  const char *label;
+  OpLabelFn *labelFn;
+  ArgType arg1;
+  ArgType arg2;
+} OpInfo;
+
+/** Return the info for instructions whose first byte is op; NULL if
+ *  the base op of op is not valid.
+ */
+const OpInfo *get_op_info(Byte op);
+
+/** Return the length in bytes of instructions described by opInfo. */
+int get_op_length(const OpInfo *opInfo);
+
+/** Disassemble the instruction at the pc of y86 into buf and return
+ *  buf.  Assumes that buf is large enough: no overflow checking.
+ */
+const char *dis_yas(Y86 *y86, char buf[]);
+
+/** Disassemble the instruction whose bytes are code[] into buf and
+ *  return buf.  code[] must hold all bytes of the instruction; buf is
+ *  assumed large enough.
+ */
+const char *dis_yas_code(const Byte code[], char buf[]);
+
+#endif //ifndef _DIS_YAS_H
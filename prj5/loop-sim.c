@@ -0,0 +1,92 @@
+#include "loop-sim.h"
+
+#include "mem-access.h"
+#include "yloop.h"
+#include "ysim.h"
+
+#include <string.h>
+
+enum {
+  MAX_LOOP_ITERS = 1 << 20,   /** max # of iterations per kernel run */
+};
+
+/** The mark of a StallSim at an arrival at the head of a loop. */
+typedef struct {
+  const YLoopBody *body;      //NULL if there is no mark
+  Address head;
+  long nInsns;                //# of instructions issued at the mark
+  StallSimMark stallSimMark;
+} LoopMark;
+
+/** Return true iff loops are accelerated under config. */
+bool
+is_accelerated_loop_sim(const StallSimConfig *config)
+{
+  return config->storeBufferSize == 0 && config->tlbEntries == 0;
+}
+
+/** Called when the instruction at the pc of y86, the head of body,
+ *  is about to be clocked, with *nInsns instructions issued so far.
+ *  If the last iteration of body returned stallSim to the state of
+ *  *mark, run as many iterations as possible with the kernel and
+ *  advance stallSim and *nInsns over them.  Then mark the state.
+ */
+static void
+arrive_at_head(Y86 *y86, StallSim *stallSim, const YLoopBody *body,
+               LoopMark *mark, long *nInsns)
+{
+  if (mark->body == body && mark->head == body->head &&
+      *nInsns - mark->nInsns == body->nInsns &&
+      is_at_mark_stall_sim(stallSim, &mark->stallSimMark)) {
+    const long nIters = run_yloop(body, y86, NULL, MAX_LOOP_ITERS);
+    repeat_stall_sim(stallSim, &mark->stallSimMark, nIters);
+    *nInsns += nIters * body->nInsns;
+  }
+  const bool isMarked = mark_stall_sim(stallSim, &mark->stallSimMark);
+  mark->body = isMarked ? body : NULL;
+  mark->head = body->head;
+  mark->nInsns = *nInsns;
+}
+
+/** Run y86, which must hold a loaded program, until it stops, timing
+ *  it with stallSim, which must have no subscribers.  If onStore is
+ *  not NULL, call onStore(ctx, addr) before each step which stores
+ *  (loop bodies never store).  Set *stats to the totals of stallSim
+ *  after the run.
+ */
+void
+run_loop_sim(Y86 *y86, StallSim *stallSim, LoopSimStoreFn *onStore,
+             void *ctx, StagedSimStats *stats)
+{
+  YLoop *loop = new_yloop();
+  LoopMark mark = { .body = NULL };
+  long nInsns = 0;
+  bool isArrival = true;    //next clock is the first for its pc
+  while (read_status_y86(y86) == STATUS_AOK) {
+    if (isArrival) {
+      const YLoopBody *body = check_yloop(loop, y86, NULL);
+      if (body) arrive_at_head(y86, stallSim, body, &mark, &nInsns);
+      isArrival = false;
+    }
+    if (clock_stall_sim(stallSim)) {
+      Address addr;
+      bool isWrite;
+      if (onStore && next_data_access(y86, &addr, &isWrite) && isWrite) {
+        onStore(ctx, addr);
+      }
+      step_ysim(y86);
+      nInsns++;
+      isArrival = true;
+    }
+  }
+  free_yloop(loop);
+  memset(stats, 0, sizeof(*stats));
+  stats->nCycles = get_n_clocks_stall_sim(stallSim);
+  stats->nInsns = nInsns;
+  for (int i = 0; i < N_STALL_REASONS; i++) {
+    stats->nStalls[i] = get_n_stalls_stall_sim(stallSim, i);
+  }
+  stats->nForwards = get_n_forwards_stall_sim(stallSim);
+  stats->nTlbLookups = get_n_tlb_lookups_stall_sim(stallSim);
+  stats->nTlbMisses = get_n_tlb_misses_stall_sim(stallSim);
+}
@@ -0,0 +1,40 @@
+#ifndef _LOOP_SIM_H
+#define _LOOP_SIM_H
+
+#include "staged-sim.h"
+#include "stall-sim.h"
+
+/** Timing of a single Y86 with loop acceleration: the StallSim is
+ *  clocked and the Y86 stepped in one loop, but hot loops (see
+ *  yloop.h in prj4) are fast-forwarded.  Once an iteration of a loop
+ *  has left the StallSim in the state it was in at the start of the
+ *  iteration, every later iteration takes the same clocks.  Whole
+ *  iterations are then run by the loop kernel and the StallSim is
+ *  advanced by the clocks of the first iteration times their #,
+ *  rather than clock by clock.
+ *
+ *  Whether an iteration takes the same clocks cannot be known when
+ *  they depend on the addresses it accesses, so loops are only
+ *  accelerated under configurations without a store buffer or TLB.
+ *  Under others, the run is simply clocked.  Totals are identical to
+ *  clocking the StallSim and stepping the Y86 in one loop.
+ */
+
+/** Return true iff loops are accelerated under config. */
+bool is_accelerated_loop_sim(const StallSimConfig *config);
+
+/** Function called with the address of the word which the next step
+ *  of a run may store to.
+ */
+typedef void LoopSimStoreFn(void *ctx, Address addr);
+
+/** Run y86, which must hold a loaded program, until it stops, timing
+ *  it with stallSim, which must have no subscribers.  If onStore is
+ *  not NULL, call onStore(ctx, addr) before each step which stores
+ *  (loop bodies never store).  Set *stats to the totals of stallSim
+ *  after the run.
+ */
+void run_loop_sim(Y86 *y86, StallSim *stallSim, LoopSimStoreFn *onStore,
+                  void *ctx, StagedSimStats *stats);
+
+#endif //ifndef _LOOP_SIM_H
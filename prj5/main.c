@@ -1,3 +1,5 @@
+#define _DEFAULT_SOURCE   //for realpath() and open_memstream()
+
 #include "y86.h"
 #include "yas.h"
 
@@ -5,11 +7,24 @@
 
 #include "ysim.h"
 #include "stall-sim.h"
+#include "mem-access.h"
+#include "dis-yas.h"
+#include "y86-to-c.h"
+#include "sweep.h"
+#include "staged-sim.h"
+#include "pipe-trace.h"
+#include "loop-sim.h"
+#include "yimage.h"
+#include "ycache.h"
+#include "ydump.h"
+#include "mc-sim.h"
+#include "sim-daemon.h"
 
 #include "errors.h"
 
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,15 +38,39 @@ typedef struct {
   int verbosity;
   bool isStep;
   bool isList;
+  bool isTimingOnly;      //print only totals rather than a trace
+  const char *imageName;  //write program image here instead of running
+  const char *cName;      //write C translation here instead of running
+  bool isNoCache;         //always assemble sources
+  int nCores;             //# of cores for multicore timing
+  int quantum;            //multicore synchronization quantum in cycles
+  StallSimConfig config;  //pipeline parameters
+  int nSweepAxes;         //# of -S pipeline parameter sweep axes
+  const char **sweepAxes;
+  int nThreads;           //# of sweep or daemon threads; 0 for # of processors
+  const char *daemonName; //serve runs on this socket
+  const char *clientName; //run on the daemon at this socket
+  const char *pipeTraceName; //export pipeline trace here
 } Args;
 
 enum { SILENT_VERBOSE, VERBOSE, VERY_VERBOSE };
 
+enum { MAX_CORES = 256 };
+
+enum {
+  MAX_THREADS = 1024,   /** max # of sweep threads */
+  MAX_PARAM_NAME = 32,  /** max length of a -p parameter name */
+};
+
 /**************************** Y86 Parameter Setup ***********************/
 
 
+/** Set up y86 with the parameters at the top of its memory, %rdi =
+ *  argc and %rsi = argv.  Log their addresses on out unless it is
+ *  NULL.
+ */
 static void
-setup_params(const Args *args, Y86 *y86)
+setup_params(const Args *args, Y86 *y86, FILE *out)
 {
   Word argc = args->numParams;
   if (argc > 0) {
@@ -39,7 +78,7 @@ setup_params(const Args *args, Y86 *y86)
     Address argv = top - argc * sizeof(Word);
     for (int i = 0; i < argc; i++) {
       const Address argvi = argv + i * sizeof(Word);
-      printf("argvi = %08lx\n", argvi);
+      if (out) fprintf(out, "argvi = %08lx\n", argvi);
       write_memory_word_y86(y86, argvi, args->params[i]);
       assert(read_status_y86(y86) == STATUS_AOK);
     }
@@ -48,237 +87,206 @@ setup_params(const Args *args, Y86 *y86)
   }
 }
 
-/************************** Disassembler ********************************/
-
-typedef enum {
-  NO_ARG,
-  REGA_ARG,
-  REGB_ARG,
-  IMMED_ARG,
-  REGB_DISP_ARG,
-  ADDR_ARG
-} ArgType;
-
-typedef void OpLabelFn(Byte opByte, const char *baseLabel, char *buf);
-
-const char *conds[] = { "", "le", "l", "e", "ne", "ge", "g", };
+/** Set up cores[args->nCores], each of which must already hold the
+ *  program, with the parameters at the top of each core's memory,
+ *  %rdi = core ID, %rsi = argv, %rdx = argc and %rcx = # of cores.
+ */
 static void
-cond_label(Byte opByte, const char *baseLabel, char *buf)
+setup_core_params(const Args *args, Y86 *cores[])
 {
-  const Byte fn = get_nybble(opByte, 0);
-  assert(fn < sizeof(conds)/sizeof(conds[0]));
-  if (fn == 0) {
-    const char *op = (strcmp(baseLabel, "j") == 0) ? "jmp" : "rrmovq";
-    strcat(buf, op);
-  }
-  else {
-    strcat(buf, baseLabel);
-    strcat(buf, conds[fn]);
+  Word argc = args->numParams;
+  for (int i = 0; i < args->nCores; i++) {
+    Address argv = get_memory_size_y86(cores[i]) - argc * sizeof(Word);
+    for (int j = 0; j < argc; j++) {
+      const Address argvj = argv + j * sizeof(Word);
+      if (i == 0) printf("argvi = %08lx\n", argvj);
+      write_memory_word_y86(cores[i], argvj, args->params[j]);
+      assert(read_status_y86(cores[i]) == STATUS_AOK);
+    }
+    write_register_y86(cores[i], REG_RDI, i);
+    write_register_y86(cores[i], REG_RSI, argv);
+    write_register_y86(cores[i], REG_RDX, argc);
+    write_register_y86(cores[i], REG_RCX, args->nCores);
   }
 }
 
-static const char *ops[] = { "addq", "subq", "andq", "xorq", };
+/*************************** Main Simulation ****************************/
+
+typedef struct {
+  Y86 *y86;
+  FILE *out;
+  PipeTrace *pipeTrace;   //NULL if no pipeline export
+} TraceCtx;
+
+/** The aligned words of a Y86 which the store of a step may change,
+ *  highest first as dump_changes_y86() prints them, with their values
+ *  before the step.
+ */
+typedef struct {
+  int nWords;           //0 if the step does not store
+  Address addrs[2];
+  Word olds[2];
+} StoreWatch;
+
+/** Set *watch to the words which the next instruction of y86 may
+ *  store to.  y86 is not changed.
+ */
 static void
-op1_label(Byte opByte, const char *baseLabel, char *buf)
+watch_store(Y86 *y86, StoreWatch *watch)
 {
-  const Byte fn = get_nybble(opByte, 0);
-  assert(fn < sizeof(ops)/sizeof(ops[0]));
-  strcat(buf, ops[fn]);
+  watch->nWords = 0;
+  Address addr;
+  bool isWrite = false;
+  if (!next_data_access(y86, &addr, &isWrite) || !isWrite) return;
+  const Address size = get_memory_size_y86(y86);
+  const Address lo = addr & ~(Address)(sizeof(Word) - 1);
+  const Address words[] = { lo + sizeof(Word), lo };
+  for (int i = (addr == lo); i < 2; i++) {
+    if (size >= sizeof(Word) && words[i] <= size - sizeof(Word)) {
+      watch->addrs[watch->nWords] = words[i];
+      watch->olds[watch->nWords++] = read_memory_word_y86(y86, words[i]);
+    }
+  }
 }
 
+/** The words which setup_params() writes with their values before
+ *  it, to be dumped with the first clock of a -V run.
+ */
+typedef struct {
+  int nWords;           //0 once dumped
+  Address argv;         //address of the lowest word
+  Word *olds;           //[nWords], lowest word first
+} ParamsWatch;
+
+/** Set *params to the words which setup_params() will write for args
+ *  in y86.  y86 is not changed.
+ */
 static void
-base_label(Byte opByte, const char *baseLabel, char *buf)
+watch_params(const Args *args, Y86 *y86, ParamsWatch *params)
 {
-  strcat(buf, baseLabel);
+  params->nWords = args->numParams;
+  params->argv = get_memory_size_y86(y86) - args->numParams * sizeof(Word);
+  params->olds = malloc(args->numParams * sizeof(Word) + 1);
+  if (!params->olds) fatal("out of memory\n");
+  for (int i = 0; i < params->nWords; i++) {
+    const Address argvi = params->argv + i * sizeof(Word);
+    params->olds[i] = read_memory_word_y86(y86, argvi);
+  }
 }
 
-typedef struct {
-  BaseOpCode op;
-  const char *label;
-  OpLabelFn *labelFn;
-  ArgType arg1;
-  ArgType arg2;
-} OpInfo;
-
-
-
-static OpInfo opInfos[] = {
-  { .op = HALT_CODE,
-    .label = "halt",
-    .labelFn = base_label,
-    .arg1 = NO_ARG,
-    .arg2 = NO_ARG,
-  },
-  { .op = NOP_CODE,
-    .label = "nop",
-    .labelFn = base_label,
-    .arg1 = NO_ARG,
-    .arg2 = NO_ARG,
-  },
-  { .op = CMOVxx_CODE,
-    .label = "cmov",
-    .labelFn = cond_label,
-    .arg1 = REGA_ARG,
-    .arg2 = REGB_ARG,
-  },
-  { .op = IRMOVQ_CODE,
-    .label = "irmovq",
-    .labelFn = base_label,
-    .arg1 = IMMED_ARG,
-    .arg2 = REGB_ARG,
-  },
-  { .op = RMMOVQ_CODE,
-    .label = "rmmovq",
-    .labelFn = base_label,
-    .arg1 = REGA_ARG,
-    .arg2 = REGB_DISP_ARG,
-  },
-  { .op = MRMOVQ_CODE,
-    .label = "mrmovq",
-    .labelFn = base_label,
-    .arg1 = REGB_DISP_ARG,
-    .arg2 = REGA_ARG,
-  },
-  { .op = OP1_CODE,
-    .label = "",
-    .labelFn = op1_label,
-    .arg1 = REGA_ARG,
-    .arg2 = REGB_ARG,
-  },
-  { .op = Jxx_CODE,
-    .label = "j",
-    .labelFn = cond_label,
-    .arg1 = ADDR_ARG,
-    .arg2 = NO_ARG,
-  },
-  { .op = CALL_CODE,
-    .label = "call",
-    .labelFn = base_label,
-    .arg1 = ADDR_ARG,
-    .arg2 = NO_ARG,
-  },
-  { .op = RET_CODE,
-    .label = "ret",
-    .labelFn = base_label,
-    .arg1 = NO_ARG,
-    .arg2 = NO_ARG,
-  },
-  { .op = PUSHQ_CODE,
-    .label = "pushq",
-    .labelFn = base_label,
-    .arg1 = REGA_ARG,
-    .arg2 = NO_ARG,
-  },
-  { .op = POPQ_CODE,
-    .label = "popq",
-    .labelFn = base_label,
-    .arg1 = REGA_ARG,
-    .arg2 = NO_ARG,
-  },
-};
-
-const char *regs[] = {
-  "%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
-  "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14",
-};
-
 static void
-append_reg(Y86 *y86, int nybblePos, char buf[])
+dump_word(Y86 *y86, Address addr, Word old, FILE *out)
 {
-  Address pc = read_pc_y86(y86);
-  const Byte regByte = read_memory_byte_y86(y86, pc + 1);
-  assert(read_status_y86(y86) == STATUS_AOK);
-  const Byte regN = get_nybble(regByte, nybblePos);
-  assert(regN < sizeof(regs)/sizeof(regs[0]));
-  strcat(buf, regs[regN]);
+  const Word word = read_memory_word_y86(y86, addr);
+  if (word != old) fprintf(out, "W[%08lx]: %016lx\n", addr, word);
 }
 
+/** Print W[addr]: value on out for each word of params and of watch
+ *  changed since watch_params() and watch_store(), highest first as
+ *  dump_changes_y86() prints them.  Then forget the words of params.
+ */
 static void
-append_op_word(Y86 *y86, Word pcDisp, char buf[])
+dump_store(Y86 *y86, ParamsWatch *params, const StoreWatch *watch,
+           FILE *out)
 {
-  Address pc = read_pc_y86(y86);
-  const Word word = read_memory_word_y86(y86, pc + pcDisp);
-  assert(read_status_y86(y86) == STATUS_AOK);
-  char *p = buf + strlen(buf);
-  sprintf(p, "$0x%lx", word);
+  int i = params->nWords - 1, j = 0;
+  while (i >= 0 || j < watch->nWords) {
+    const Address param = params->argv + i * sizeof(Word);
+    if (j == watch->nWords || (i >= 0 && param > watch->addrs[j])) {
+      dump_word(y86, param, params->olds[i--], out);
+    }
+    else if (i >= 0 && param == watch->addrs[j]) {
+      //the value before the parameters were written
+      dump_word(y86, param, params->olds[i--], out);
+      j++;
+    }
+    else {
+      dump_word(y86, watch->addrs[j], watch->olds[j], out);
+      j++;
+    }
+  }
+  params->nWords = 0;
 }
+
+/** StallSim subscriber which prints each clock as the instruction
+ *  issued or as a bubble and adds it to the pipeline export.
+ */
 static void
-append_arg(Y86 *y86, ArgType arg, char buf[])
+trace_clock(void *ctx, const StallSimEvent *event)
 {
-  switch (arg) {
-    case NO_ARG:
-      break;
-    case REGA_ARG:
-      append_reg(y86, 1, buf);
-      break;
-    case REGB_ARG:
-      append_reg(y86, 0, buf);
-      break;
-    case IMMED_ARG:
-      append_op_word(y86, 2, buf);
-      break;
-    case REGB_DISP_ARG:
-      append_op_word(y86, 2, buf);
-      strcat(buf, "(");
-      append_reg(y86, 0, buf);
-      strcat(buf, ")");
-      break;
-    case ADDR_ARG:
-      append_op_word(y86, 1, buf);
-      break;
-    default:
-      assert(0);
+  enum { DIS_YAS_BUF_SIZE = 80 };
+  const TraceCtx *trace = ctx;
+  char buf[DIS_YAS_BUF_SIZE];
+  const char *text = event->isIssue ? dis_yas(trace->y86, buf) : "";
+  fprintf(trace->out, "%4ld:\t%04lx\t%s\n", event->cycle, event->pc,
+          event->isIssue ? text : "bubble");
+  if (trace->pipeTrace) {
+    add_clock_pipe_trace(trace->pipeTrace, event->cycle, event->pc,
+                         event->reason, text);
   }
 }
 
-//assume that buf is large enough: no overflow checking
-static const char *
-dis_yas(Y86 *y86, char buf[])
+/** Run y86 with the functional engine, the timing model and the
+ *  trace formatter on separate host threads or, when only totals are
+ *  wanted under a configuration which allows it, on one thread with
+ *  hot loops accelerated.
+ */
+static void
+simulate_staged(const Args *args, Y86 *y86, PipeTrace *pipeTrace, FILE *out)
 {
-  const Word pc = read_pc_y86(y86);
-  const Byte op = read_memory_byte_y86(y86, pc);
-  assert(read_status_y86(y86) == STATUS_AOK);
-  const Byte baseOp = get_nybble(op, 1);
-  assert(baseOp < sizeof(opInfos)/sizeof(opInfos[0]));
-  const OpInfo *opInfo = &opInfos[baseOp];
-  buf[0] = '\0';
-  opInfo->labelFn(op, opInfo->label, buf);
-  strcat(buf, "\t");
-  append_arg(y86, opInfo->arg1, buf);
-  if (opInfo->arg2 != NO_ARG) {
-    strcat(buf, ", ");
-    append_arg(y86, opInfo->arg2, buf);
-  }
-  return buf;
+  setup_params(args, y86, stdout);
+  StagedSimStats stats;
+  if (args->isTimingOnly && !pipeTrace &&
+      is_accelerated_loop_sim(&args->config)) {
+    StallSim *stallSim = new_stall_sim(y86, &args->config);
+    run_loop_sim(y86, stallSim, NULL, NULL, &stats);
+    free_stall_sim(stallSim);
+  }
+  else {
+    run_staged_sim(y86, &args->config, args->isTimingOnly ? NULL : out,
+                   pipeTrace, &stats);
+  }
+  if (args->isTimingOnly) {
+    print_stats_staged_sim(&stats, &args->config, out);
+  }
+  if (args->verbosity != SILENT_VERBOSE) dump_changes_y86(y86, true, out);
 }
-/*************************** Main Simulation ****************************/
 
+/** Run y86 clock by clock, stepping it whenever an instruction
+ *  issues, as needed for a state dump between clocks.
+ */
 static void
-simulate(const Args *args, Y86 *y86, FILE *out)
+simulate_lockstep(const Args *args, Y86 *y86, PipeTrace *pipeTrace,
+                  FILE *out)
 {
-  enum { DIS_YAS_BUF_SIZE = 80 };
-  StallSim *stallSim = new_stall_sim(y86);
-  setup_params(args, y86);
+  StallSim *stallSim = new_stall_sim(y86, &args->config);
+  TraceCtx trace = { .y86 = y86, .out = out, .pipeTrace = pipeTrace };
+  subscribe_stall_sim(stallSim, trace_clock, &trace);
   bool isRunning = true;
   bool isVeryVerbose = (args->verbosity == VERY_VERBOSE);
-  int clockN = 0;
+  //-V dumps only the words each step stores to rather than scanning
+  //all of memory after every clock, and first those of the parameters
+  YDump *dump = isVeryVerbose ? new_ydump(y86) : NULL;
+  ParamsWatch params = { .nWords = 0, .olds = NULL };
+  if (dump) watch_params(args, y86, &params);
+  setup_params(args, y86, stdout);
   //fprintf(out, "%10s \t%6s\t  %s\n", "CLOCK #", "PC", "OP");
   while (isRunning) {
-    fprintf(out, "%4d:\t%04lx\t", clockN++, read_pc_y86(y86));
     Address pc = read_pc_y86(y86);
+    StoreWatch watch = { .nWords = 0 };
     if (clock_stall_sim(stallSim)) {
-      char buf[DIS_YAS_BUF_SIZE];
-      fprintf(out, "%s\n", dis_yas(y86, buf));
+      if (dump) {
+        watch_store(y86, &watch);
+        mark_ydump(dump, ~0u);
+      }
       step_ysim(y86);
     }
-    else {
-      fprintf(out, "bubble\n");
-    }
     isRunning = read_status_y86(y86) == STATUS_AOK;
     if (isRunning) {
       if (isVeryVerbose) {
         fprintf(out, "pc: %0*lx\n", (int)sizeof(Address)*2, pc);
-        dump_changes_y86(y86, false, out);
+        dump_changes_ydump(dump, false, out);
+        dump_store(y86, &params, &watch, out);
         fprintf(out, "\n");
       }
       if (args->isStep) {
@@ -287,10 +295,232 @@ simulate(const Args *args, Y86 *y86, FILE *out)
       }
     }
   }
-  if (args->verbosity != SILENT_VERBOSE) dump_changes_y86(y86, true, out);
+  //the stopping step stores nothing, so memory is unchanged since the
+  //last dump of a -V run but for parameters not dumped yet
+  if (dump) {
+    const StoreWatch none = { .nWords = 0 };
+    dump_changes_ydump(dump, true, out);
+    dump_store(y86, &params, &none, out);
+    free_ydump(dump);
+    free(params.olds);
+  }
+  else if (args->verbosity != SILENT_VERBOSE) {
+    dump_changes_y86(y86, true, out);
+  }
   free_stall_sim(stallSim);
 }
 
+/** Run y86 as specified by args, exporting its pipeline to the file
+ *  args->pipeTraceName if it is set.  Return false on error.
+ */
+static bool
+simulate(const Args *args, Y86 *y86, FILE *out)
+{
+  FILE *pipeOut = NULL;
+  PipeTrace *pipeTrace = NULL;
+  if (args->pipeTraceName) {
+    pipeOut = fopen(args->pipeTraceName, "w");
+    if (!pipeOut) {
+      fprintf(stderr, "cannot write %s\n", args->pipeTraceName);
+      return false;
+    }
+    const char *ext = strrchr(args->pipeTraceName, '.');
+    pipeTrace = new_pipe_trace(pipeOut, (ext && strcmp(ext, ".json") == 0)
+                               ? CHROME_PIPE_TRACE : KONATA_PIPE_TRACE);
+  }
+  //only a state dump between clocks needs the stages in lockstep
+  if (args->isTimingOnly ||
+      (args->verbosity != VERY_VERBOSE && !args->isStep)) {
+    simulate_staged(args, y86, pipeTrace, out);
+  }
+  else {
+    simulate_lockstep(args, y86, pipeTrace, out);
+  }
+  bool isOk = true;
+  if (pipeTrace) {
+    free_pipe_trace(pipeTrace);
+    isOk = fclose(pipeOut) == 0;
+    if (!isOk) fprintf(stderr, "error writing %s\n", args->pipeTraceName);
+  }
+  return isOk;
+}
+
+
+/************************** Program Loading ****************************/
+
+static bool
+is_image_args(const Args *args)
+{
+  return args->numFileNames == 1 && is_yimage(args->fileNames[0]);
+}
+
+/** Load the program specified by args into y86: either a single
+ *  precompiled image or assembler sources.  The image of the sources
+ *  is taken from cache if it is non-NULL, else they are assembled
+ *  into y86.  If end is not NULL, set it to the end of the memory
+ *  the load may have written: the end of the highest segment of the
+ *  image, or the memory size for sources assembled into y86.  Return
+ *  false on error.
+ */
+static bool
+load_program(const Args *args, Y86 *y86, YCache *cache, Address *end)
+{
+  YImage *ownImage = NULL;
+  const YImage *image = NULL;
+  if (is_image_args(args)) {
+    image = ownImage = read_yimage(args->fileNames[0]);
+  }
+  else if (cache) {
+    image = get_ycache(cache, args->numFileNames, args->fileNames);
+  }
+  else {
+    if (end) *end = get_memory_size_y86(y86);
+    return yas_to_y86(y86, args->numFileNames, args->fileNames);
+  }
+  if (!image) return false;
+  bool isOk = load_yimage_y86(image, y86);
+  if (!isOk) {
+    fprintf(stderr, "%s: image does not fit in memory\n", args->fileNames[0]);
+  }
+  if (end) *end = 0;
+  for (int i = 0; end && i < get_n_segments_yimage(image); i++) {
+    Address addr;
+    size_t size;
+    get_segment_yimage(image, i, &addr, &size);
+    if (addr + size > *end) *end = addr + size;
+  }
+  if (ownImage) free_yimage(ownImage);
+  return isOk;
+}
+
+/** Write the C translation of the program loaded in y86 to the file
+ *  args->cName.  Return false on error.
+ */
+static bool
+translate_to_c(const Args *args, Y86 *y86)
+{
+  FILE *out = fopen(args->cName, "w");
+  if (!out) {
+    fprintf(stderr, "cannot write %s\n", args->cName);
+    return false;
+  }
+  bool isOk = y86_to_c(y86, args->fileNames[0], out);
+  isOk = (fclose(out) == 0) && isOk;
+  if (!isOk) fprintf(stderr, "error writing %s\n", args->cName);
+  return isOk;
+}
+
+typedef struct {
+  const Args *args;
+  YCache *cache;
+} SweepCtx;
+
+/** Load the program in file # program of ((SweepCtx *)ctx)->args
+ *  into y86 and set up its parameters.
+ */
+static bool
+load_sweep_program(void *ctx, int program, Y86 *y86)
+{
+  const SweepCtx *sweepCtx = ctx;
+  Args args = *sweepCtx->args;
+  args.numFileNames = 1;
+  args.fileNames = &sweepCtx->args->fileNames[program];
+  if (!load_program(&args, y86, sweepCtx->cache, NULL)) return false;
+  setup_params(&args, y86, NULL);
+  return true;
+}
+
+/** Run each program in args separately under every pipeline
+ *  configuration of the args sweep and write a CSV of the results on
+ *  out.  Return false on error.
+ */
+static bool
+simulate_sweep(const Args *args, YCache *cache, FILE *out)
+{
+  SweepCtx ctx = { .args = args, .cache = cache };
+  return run_sweep(&args->config, args->nSweepAxes, args->sweepAxes,
+                   args->numFileNames, args->fileNames,
+                   load_sweep_program, &ctx, args->nThreads, out);
+}
+
+/** Load the program in fileNames[nFiles] into y86 with parameters
+ *  params[nParams] for the daemon, taking the image of sources from
+ *  cache if it is non-NULL, and set *end to the end of the memory
+ *  written by the load of the program.
+ */
+static bool
+load_daemon_program(void *cache, int nFiles, const char *fileNames[],
+                    int nParams, const Word params[], Y86 *y86,
+                    Address *end, FILE *out)
+{
+  const Args args = {
+    .numFileNames = nFiles, .fileNames = fileNames,
+    .numParams = nParams, .params = (Word *)params,
+  };
+  if (!load_program(&args, y86, cache, end)) return false;
+  setup_params(&args, y86, out);
+  return true;
+}
+
+/** Run the program in args on the daemon at args->clientName with
+ *  the pipeline parameters of args, writing its totals and, if
+ *  verbose, its final state on out.  Return false on error.
+ */
+static bool
+simulate_on_daemon(const Args *args, FILE *out)
+{
+  char *request;
+  size_t size;
+  FILE *req = open_memstream(&request, &size);
+  if (!req) fatal("out of memory\n");
+  if (args->verbosity != SILENT_VERBOSE) fprintf(req, "-v");
+  for (int i = 0; i < N_STALL_SIM_PARAMS; i++) {
+    fprintf(req, " -p %s=%d", get_param_name_stall_sim(i),
+            get_param_stall_sim(&args->config, i));
+  }
+  bool isOk = true;
+  for (int i = 0; i < args->numFileNames; i++) {
+    char *path = realpath(args->fileNames[i], NULL);
+    if (!path || strpbrk(path, " \t\r\n")) {
+      fprintf(stderr, "cannot send file name %s\n", args->fileNames[i]);
+      isOk = false;
+    }
+    else {
+      fprintf(req, " %s", path);
+    }
+    free(path);
+  }
+  for (int i = 0; i < args->numParams; i++) {
+    fprintf(req, " %ld", (long)args->params[i]);
+  }
+  fclose(req);
+  isOk = isOk && request_sim_daemon(args->clientName, request, out);
+  free(request);
+  return isOk;
+}
+
+/** Run cores[args->nCores] under the multicore timing model until all
+ *  have stopped, then print timing statistics and, if verbose, the
+ *  final state of each core.
+ */
+static void
+simulate_multicore(const Args *args, Y86 *cores[], FILE *out)
+{
+  setup_core_params(args, cores);
+  McSimConfig config = DEFAULT_MC_SIM_CONFIG;
+  if (args->quantum > 0) config.quantum = args->quantum;
+  config.pipeline = &args->config;
+  McSim *mcSim = new_mc_sim(cores, args->nCores, &config);
+  run_mc_sim(mcSim);
+  print_stats_mc_sim(mcSim, out);
+  if (args->verbosity != SILENT_VERBOSE) {
+    for (int i = 0; i < args->nCores; i++) {
+      fprintf(out, "core %d:\n", i);
+      dump_changes_y86(cores[i], true, out);
+    }
+  }
+  free_mc_sim(mcSim);
+}
 
 /************************* Parse Command Line **************************/
 
@@ -298,13 +528,59 @@ static void
 usage(const char *prog)
 {
   fprintf(stderr,
-          "usage: %s [-s] [-v] [-V] YAS_FILE_NAMES... INT_INPUTS...\n", prog);
+          "usage: %s [-s] [-t] [-v] [-V] [-n] [-c N [-q Q]] [-o IMAGE] [-C OUT.c]\n"
+          "          [-p NAME=N]... [-S NAME=VALUES... [-j N]] [-d SOCKET]\n"
+          "          [-x TRACE] YAS_FILE_NAMES... INT_INPUTS...\n"
+          "       %s [-n] [-p NAME=N]... [-j N] -D SOCKET\n", prog, prog);
   fprintf(stderr,
+          "          -C:  translate program to a C program OUT.c which\n"
+          "               takes INT_INPUTS and prints the final state of a\n"
+          "               -v run when compiled, then exit\n"
+          "          -c:  time N cores with private MESI-coherent L1s; core\n"
+          "               i starts with %%rdi = i, %%rsi = argv, %%rdx = argc\n"
+          "               and %%rcx = N (-s, -V ignored)\n"
+          "          -q:  with -c, synchronize cores every Q cycles\n"
+          "          -d:  run the program on the daemon at SOCKET and\n"
+          "               print its totals as with -t (-s, -V ignored)\n"
+          "          -D:  serve runs as a daemon on Unix domain socket\n"
+          "               SOCKET with warm machines and cached programs,\n"
+          "               using -p values as defaults, until a client\n"
+          "               sends the request \"quit\"\n"
+          "          -j:  with -S or -D, use N threads (default: # of\n"
+          "               processors)\n"
           "          -l:  produce assembler listing only\n"
+          "          -n:  do not cache assembled programs (the cache is in\n"
+          "               $Y86_CACHE_DIR, else $HOME/.cache/y86)\n"
+          "          -o:  write precompiled program image to IMAGE and exit;\n"
+          "               an IMAGE may be given in place of YAS_FILE_NAMES\n"
+          "          -p:  set pipeline parameter NAME to N; NAME is startup,\n"
+          "               jump, ret or data (bubbles on startup, after a\n"
+          "               cond jump, after a ret and max for data hazards),\n"
+          "               stores (store buffer entries; 0 to ignore memory\n"
+          "               dependences), commit (clocks until a store\n"
+          "               commits), forward (1 to forward buffered stores\n"
+          "               to loads, 0 to stall loads until commit), tlb\n"
+          "               (TLB entries, a multiple of ways; 0 to ignore\n"
+          "               address translation), ways (TLB associativity;\n"
+          "               0 for full), page (log2 of the page size) or\n"
+          "               walk (clocks per page table level of a walk on\n"
+          "               a TLB miss)\n"
           "          -s:  single-step program\n"
+          "          -t:  print only the totals of cycles, instructions and\n"
+          "               CPI rather than a trace of each clock (-s, -V\n"
+          "               ignored)\n"
+          "          -S:  sweep pipeline parameter NAME over VALUES, a\n"
+          "               comma-separated list of N or LO-HI; run each of\n"
+          "               YAS_FILE_NAMES as a separate program under every\n"
+          "               combination of the -S values and write a CSV of\n"
+          "               cycles and CPI\n"
           "          -v:  verbose: dump state at completion\n"
           "          -V:  very verbose: dump changes after each "
-          "instruction\n");
+          "instruction\n"
+          "          -x:  export the pipeline timing of each instruction\n"
+          "               to TRACE for a viewer: Chrome trace-event JSON\n"
+          "               if TRACE ends in .json, else a Konata log\n"
+          "               (single core runs only)\n");
   exit(1);
 }
 
@@ -325,6 +601,78 @@ first_pass_args(int argc, const char *argv[], Args *args)
     else if (strcmp(argv[i], "-l") == 0) {
       args->isList = true;
     }
+    else if (strcmp(argv[i], "-t") == 0) {
+      args->isTimingOnly = true;
+    }
+    else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "-q") == 0 ||
+             strcmp(argv[i], "-j") == 0) {
+      const char opt = argv[i][1];
+      char *p = "";
+      long n = (i + 1 < argc) ? strtol(argv[++i], &p, 0) : 0;
+      if (*p != '\0' || n < 1 || (opt == 'c' && n > MAX_CORES) ||
+          (opt == 'j' && n > MAX_THREADS)) {
+        fprintf(stderr, "bad or missing value for %s\n", argv[i - 1]);
+        usage(argv[0]);
+      }
+      if (opt == 'c') args->nCores = n;
+      else if (opt == 'q') args->quantum = n;
+      else args->nThreads = n;
+    }
+    else if (strcmp(argv[i], "-p") == 0) {
+      const char *eq = (i + 1 < argc) ? strchr(argv[++i], '=') : NULL;
+      char name[MAX_PARAM_NAME];
+      char *p = "";
+      long n = -1;
+      if (eq && eq - argv[i] < sizeof(name)) {
+        memcpy(name, argv[i], eq - argv[i]);
+        name[eq - argv[i]] = '\0';
+        n = strtol(eq + 1, &p, 10);
+      }
+      if (!eq || eq[1] == '\0' || *p != '\0' || n < 0 || n > INT_MAX ||
+          !set_param_stall_sim(&args->config, name, n)) {
+        fprintf(stderr, "bad or missing value for -p\n");
+        usage(argv[0]);
+      }
+    }
+    else if (strcmp(argv[i], "-S") == 0) {
+      if (i + 1 == argc) {
+        fprintf(stderr, "missing sweep axis for -S\n");
+        usage(argv[0]);
+      }
+      args->nSweepAxes++; i++;
+    }
+    else if (strcmp(argv[i], "-n") == 0) {
+      args->isNoCache = true;
+    }
+    else if (strcmp(argv[i], "-o") == 0) {
+      if (i + 1 == argc) {
+        fprintf(stderr, "missing image file name for -o\n");
+        usage(argv[0]);
+      }
+      args->imageName = argv[++i];
+    }
+    else if (strcmp(argv[i], "-C") == 0) {
+      if (i + 1 == argc) {
+        fprintf(stderr, "missing C file name for -C\n");
+        usage(argv[0]);
+      }
+      args->cName = argv[++i];
+    }
+    else if (strcmp(argv[i], "-D") == 0 || strcmp(argv[i], "-d") == 0) {
+      if (i + 1 == argc) {
+        fprintf(stderr, "missing socket name for %s\n", argv[i]);
+        usage(argv[0]);
+      }
+      if (argv[i][1] == 'D') args->daemonName = argv[++i];
+      else args->clientName = argv[++i];
+    }
+    else if (strcmp(argv[i], "-x") == 0) {
+      if (i + 1 == argc) {
+        fprintf(stderr, "missing trace file name for -x\n");
+        usage(argv[0]);
+      }
+      args->pipeTraceName = argv[++i];
+    }
     else if (argv[i][0] == '-' && !isdigit(argv[i][1])) {
       fprintf(stderr, "unknown option '%s'\n", argv[i]);
       usage(argv[0]);
@@ -337,19 +685,38 @@ first_pass_args(int argc, const char *argv[], Args *args)
       args->numFileNames++;
     }
   }
-  if (args->numFileNames == 0) {
+  if (args->numFileNames == 0 && !args->daemonName) {
     fprintf(stderr, "no files specified\n");
     usage(argv[0]);
   }
+  if (args->pipeTraceName && args->nCores > 1) {
+    fprintf(stderr, "-x cannot be used with -c\n");
+    usage(argv[0]);
+  }
+  //a sweep checks each of its configurations instead
+  if (args->nSweepAxes == 0 && !is_valid_config_stall_sim(&args->config)) {
+    fprintf(stderr, "-p tlb is not a multiple of -p ways\n");
+    usage(argv[0]);
+  }
 }
 
 static void
 second_pass_args(int argc, const char *argv[], Args *args)
 {
-  args->numFileNames = args->numParams = 0;
+  args->numFileNames = args->numParams = args->nSweepAxes = 0;
   for (int i = 1; i < argc; i++) {
     const char *arg = argv[i];
     if (arg[0] == '-' && !isdigit(arg[1])) {
+      if (strcmp(arg, "-S") == 0) {
+        args->sweepAxes[args->nSweepAxes++] = argv[++i];
+      }
+      else if (strcmp(arg, "-o") == 0 || strcmp(arg, "-c") == 0 ||
+               strcmp(arg, "-q") == 0 || strcmp(arg, "-C") == 0 ||
+               strcmp(arg, "-j") == 0 || strcmp(arg, "-p") == 0 ||
+               strcmp(arg, "-D") == 0 || strcmp(arg, "-d") == 0 ||
+               strcmp(arg, "-x") == 0) {
+        i++;  //skip value
+      }
       continue;
     }
     else if (isdigit(arg[0]) || (arg[0] == '-' && isdigit(arg[1]))) {
@@ -374,19 +741,69 @@ main(int argc, const char *argv[])
   }
   Args args;
   memset(&args, 0, sizeof(args));
+  args.nCores = 1;
+  args.config = DEFAULT_STALL_SIM_CONFIG;
   first_pass_args(argc, argv, &args);
   const char *fileNames[args.numFileNames];
   Word params[args.numParams];
+  const char *sweepAxes[args.nSweepAxes + 1];
   args.fileNames = fileNames; args.params = params;
+  args.sweepAxes = sweepAxes;
   second_pass_args(argc, argv, &args);
-  if (args.isList) {
+  int exitCode = 0;
+  if (args.imageName) {
+    return write_yimage(args.imageName, args.numFileNames, args.fileNames)
+      ? 0 : 1;
+  }
+  if (args.daemonName) {
+    YCache *cache = args.isNoCache ? NULL : new_ycache(NULL);
+    if (!run_sim_daemon(args.daemonName, &args.config, args.nThreads,
+                        load_daemon_program, cache)) {
+      exitCode = 1;
+    }
+    if (cache) free_ycache(cache);
+  }
+  else if (args.clientName) {
+    if (!simulate_on_daemon(&args, stdout)) exitCode = 1;
+  }
+  else if (args.isList && is_image_args(&args)) {
+    YImage *image = read_yimage(args.fileNames[0]);
+    if (image) {
+      write_listing_yimage(image, stdout);
+      free_yimage(image);
+    }
+  }
+  else if (args.isList) {
     yas_to_listing(stdout, args.numFileNames, args.fileNames);
   }
+  else if (args.nSweepAxes > 0) {
+    YCache *cache = args.isNoCache ? NULL : new_ycache(NULL);
+    if (!simulate_sweep(&args, cache, stdout)) exitCode = 1;
+    if (cache) free_ycache(cache);
+  }
   else {
     Y86 *y86 = new_y86_default();
-    if (yas_to_y86(y86, args.numFileNames, args.fileNames)) {
-      simulate(&args, y86, stdout);
+    YCache *cache = args.isNoCache ? NULL : new_ycache(NULL);
+    const bool isLoaded = load_program(&args, y86, cache, NULL);
+    if (isLoaded && args.cName) {
+      if (!translate_to_c(&args, y86)) exitCode = 1;
+    }
+    else if (isLoaded && args.nCores > 1) {
+      Y86 *cores[args.nCores];
+      cores[0] = y86;
+      bool isOk = true;
+      for (int i = 1; i < args.nCores; i++) {
+        cores[i] = new_y86_default();
+        isOk = isOk && load_program(&args, cores[i], cache, NULL);
+      }
+      if (isOk) simulate_multicore(&args, cores, stdout);
+      for (int i = 1; i < args.nCores; i++) free_y86(cores[i]);
+    }
+    else if (isLoaded) {
+      if (!simulate(&args, y86, stdout)) exitCode = 1;
     }
+    if (cache) free_ycache(cache);
     free_y86(y86);
   }
+  return exitCode;
 }
@@ -0,0 +1,513 @@
+#define _DEFAULT_SOURCE   //for pthread_barrier_t
+
+#include "mc-sim.h"
+
+#include "mem-access.h"
+#include "stall-sim.h"
+#include "yatomic.h"
+#include "ysim.h"
+
+#include "errors.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+const McSimConfig DEFAULT_MC_SIM_CONFIG = {
+  .quantum = 1000,
+  .nSets = 64,
+  .nWays = 4,
+  .lineSize = 64,
+  .memLatency = 20,
+  .c2cLatency = 10,
+  .upgradeLatency = 5,
+  .busCycles = 2,
+  .pipeline = NULL,
+};
+
+typedef enum { INVALID, SHARED, EXCLUSIVE, MODIFIED } MesiState;
+
+typedef enum {
+  BUS_RD,     /** read miss */
+  BUS_RDX,    /** write miss: read for ownership */
+  BUS_UPGR,   /** write hit on a shared line */
+  BUS_WB,     /** writeback of an evicted modified line */
+} BusOp;
+
+typedef struct {
+  Address tag;        //line address
+  MesiState state;
+  uint64_t lastUse;   //for LRU replacement
+} Line;
+
+typedef struct {
+  uint64_t cycle;
+  int core;
+  size_t seq;         //order within core, for a stable sort
+  BusOp op;
+  Address line;
+} BusRequest;
+
+typedef struct {
+  uint64_t cycle;
+  int core;
+  size_t seq;
+  Address addr;
+  Word word;
+} Store;
+
+typedef struct {
+  McSim *mcSim;
+  int id;
+  Y86 *y86;
+  StallSim *stallSim;
+  Line *lines;        //nSets x nWays
+  uint64_t clock;
+  uint64_t nInsns;
+  int penalty;        //pending memory stall cycles
+  bool isDone;
+  bool isAtomicPending;  //an atomic waits for the end of the quantum
+  uint64_t atomicCycle;  //cycle at which it issued
+  Address atomicAddr;    //word it accesses
+  BusRequest *requests;  //this quantum's bus transactions
+  size_t nRequests, maxRequests;
+  Store *stores;         //this quantum's stores
+  size_t nStores, maxStores;
+  uint64_t nHits, nMisses, nUpgrades, nWritebacks, nInvalidated;
+  uint64_t nMemStalls, nAtomicWaits;
+} Core;
+
+struct McSimStruct {
+  McSimConfig config;
+  int lineShift;
+  int nCores;
+  Core *cores;
+  pthread_barrier_t start;   //all threads wait here before a quantum
+  pthread_barrier_t end;     //... and here after it
+  bool isFinished;
+  uint64_t busFree;          //first cycle at which the bus is free
+  uint64_t nBusTxns, nInvalidations, nC2C;
+};
+
+/** Ensure that *items, an array of *max items of size bytes, has
+ *  room for n + 1 items.
+ */
+static void
+ensure_room(void **items, size_t *max, size_t n, size_t size)
+{
+  if (n < *max) return;
+  *max = *max ? 2 * *max : 64;
+  if (!(*items = realloc(*items, *max * size))) fatal("out of memory\n");
+}
+
+/********************** Allocation / Deallocation **********************/
+
+/** Create a new multicore simulator for cores[nCores], which must
+ *  already be loaded and set up.  If config is NULL, use
+ *  DEFAULT_MC_SIM_CONFIG.
+ */
+McSim *
+new_mc_sim(Y86 *cores[], int nCores, const McSimConfig *config)
+{
+  McSim *mcSim = calloc(1, sizeof(struct McSimStruct));
+  if (!mcSim) fatal("out of memory\n");
+  mcSim->config = config ? *config : DEFAULT_MC_SIM_CONFIG;
+  while ((1 << mcSim->lineShift) < mcSim->config.lineSize) mcSim->lineShift++;
+  mcSim->nCores = nCores;
+  mcSim->cores = calloc(nCores, sizeof(Core));
+  if (!mcSim->cores) fatal("out of memory\n");
+  const int nLines = mcSim->config.nSets * mcSim->config.nWays;
+  for (int i = 0; i < nCores; i++) {
+    Core *core = &mcSim->cores[i];
+    core->mcSim = mcSim;
+    core->id = i;
+    core->y86 = cores[i];
+    core->stallSim = new_stall_sim(cores[i], mcSim->config.pipeline);
+    core->lines = calloc(nLines, sizeof(Line));
+    if (!core->lines) fatal("out of memory\n");
+    core->isDone = read_status_y86(cores[i]) != STATUS_AOK;
+  }
+  return mcSim;
+}
+
+/** Free all resources allocated by new_mc_sim() in mcSim; the cores
+ *  themselves are not freed.
+ */
+void
+free_mc_sim(McSim *mcSim)
+{
+  for (int i = 0; i < mcSim->nCores; i++) {
+    Core *core = &mcSim->cores[i];
+    free_stall_sim(core->stallSim);
+    free(core->lines);
+    free(core->requests);
+    free(core->stores);
+  }
+  free(mcSim->cores);
+  free(mcSim);
+}
+
+/****************************** L1 Cache *******************************/
+
+/** Return the valid line of core's L1 holding line address line;
+ *  NULL if there is none.
+ */
+static Line *
+find_line(Core *core, Address line)
+{
+  const McSimConfig *config = &core->mcSim->config;
+  Line *ways = &core->lines[(line % config->nSets) * config->nWays];
+  for (int i = 0; i < config->nWays; i++) {
+    if (ways[i].state != INVALID && ways[i].tag == line) return &ways[i];
+  }
+  return NULL;
+}
+
+/** Return the way of core's L1 to be filled with line: an invalid
+ *  way if there is one, else the least-recently used way.
+ */
+static Line *
+victim_line(Core *core, Address line)
+{
+  const McSimConfig *config = &core->mcSim->config;
+  Line *ways = &core->lines[(line % config->nSets) * config->nWays];
+  Line *victim = &ways[0];
+  for (int i = 0; i < config->nWays; i++) {
+    if (ways[i].state == INVALID) return &ways[i];
+    if (ways[i].lastUse < victim->lastUse) victim = &ways[i];
+  }
+  return victim;
+}
+
+static void
+add_request(Core *core, BusOp op, Address line)
+{
+  ensure_room((void **)&core->requests, &core->maxRequests,
+              core->nRequests, sizeof(BusRequest));
+  BusRequest *request = &core->requests[core->nRequests];
+  request->cycle = core->clock;
+  request->core = core->id;
+  request->seq = core->nRequests++;
+  request->op = op;
+  request->line = line;
+}
+
+/** Access addr in core's L1 using only core's own view of the line
+ *  states.  Misses and upgrades are charged their nominal latency
+ *  and logged for the bus; their effect on other L1s is applied at
+ *  the end of the quantum.
+ */
+static void
+access_l1(Core *core, Address addr, bool isWrite)
+{
+  const McSimConfig *config = &core->mcSim->config;
+  const Address lineAddr = addr >> core->mcSim->lineShift;
+  Line *line = find_line(core, lineAddr);
+  if (line) {
+    core->nHits++;
+    if (isWrite && line->state == SHARED) {
+      core->nUpgrades++;
+      core->penalty += config->upgradeLatency;
+      add_request(core, BUS_UPGR, lineAddr);
+    }
+    if (isWrite) line->state = MODIFIED;
+  }
+  else {
+    core->nMisses++;
+    line = victim_line(core, lineAddr);
+    if (line->state == MODIFIED) {
+      core->nWritebacks++;
+      add_request(core, BUS_WB, line->tag);
+    }
+    line->tag = lineAddr;
+    //a read fill is provisionally SHARED; promoted to EXCLUSIVE at the
+    //end of the quantum if no other L1 holds the line
+    line->state = isWrite ? MODIFIED : SHARED;
+    core->penalty += config->memLatency;
+    add_request(core, isWrite ? BUS_RDX : BUS_RD, lineAddr);
+  }
+  line->lastUse = core->clock;
+}
+
+/*************************** Core Execution ****************************/
+
+static void
+add_store(Core *core, Address addr, Word word)
+{
+  ensure_room((void **)&core->stores, &core->maxStores,
+              core->nStores, sizeof(Store));
+  Store *store = &core->stores[core->nStores];
+  store->cycle = core->clock;
+  store->core = core->id;
+  store->seq = core->nStores++;
+  store->addr = addr;
+  store->word = word;
+}
+
+/** Return true iff the next instruction of y86 is xaddq or cmpxchgq.
+ *  y86 is not changed.
+ */
+static bool
+is_atomic_next(Y86 *y86)
+{
+  const Status status = read_status_y86(y86);
+  const Byte op = read_memory_byte_y86(y86, read_pc_y86(y86));
+  if (read_status_y86(y86) != status) {
+    write_status_y86(y86, status);
+    return false;
+  }
+  return get_nybble(op, 1) == YATOMIC_CODE;
+}
+
+/** Simulate one clock cycle of core. */
+static void
+clock_core(Core *core)
+{
+  Y86 *y86 = core->y86;
+  if (core->penalty > 0) {
+    core->penalty--;
+    core->nMemStalls++;
+  }
+  else if (clock_stall_sim(core->stallSim)) {
+    Address addr = 0;
+    bool isWrite = false;
+    bool isAccess = next_data_access(y86, &addr, &isWrite);
+    if (isAccess) access_l1(core, addr, isWrite);
+    if (is_atomic_next(y86)) {
+      //executed by resolve_quantum() once all cores' stores are applied
+      core->isAtomicPending = true;
+      core->atomicCycle = core->clock;
+      core->atomicAddr = addr;
+    }
+    else {
+      step_ysim(y86);
+      core->nInsns++;
+      if (isAccess && isWrite && read_status_y86(y86) == STATUS_AOK) {
+        add_store(core, addr, read_memory_word_y86(y86, addr));
+      }
+    }
+  }
+  core->clock++;
+  core->isDone = read_status_y86(y86) != STATUS_AOK;
+}
+
+static void *
+run_core(void *arg)
+{
+  Core *core = arg;
+  McSim *mcSim = core->mcSim;
+  for (;;) {
+    pthread_barrier_wait(&mcSim->start);
+    if (mcSim->isFinished) break;
+    const uint64_t end = core->clock + mcSim->config.quantum;
+    while (!core->isDone && !core->isAtomicPending && core->clock < end) {
+      clock_core(core);
+    }
+    if (core->isAtomicPending && core->clock < end) {
+      core->nAtomicWaits += end - core->clock;
+      core->clock = end;
+    }
+    pthread_barrier_wait(&mcSim->end);
+  }
+  return NULL;
+}
+
+/************************* Quantum Resolution **************************/
+
+static int
+cmp_requests(const void *p1, const void *p2)
+{
+  const BusRequest *a = p1, *b = p2;
+  if (a->cycle != b->cycle) return (a->cycle < b->cycle) ? -1 : 1;
+  if (a->core != b->core) return a->core - b->core;
+  return (a->seq < b->seq) ? -1 : (a->seq > b->seq);
+}
+
+static int
+cmp_stores(const void *p1, const void *p2)
+{
+  const Store *a = p1, *b = p2;
+  if (a->cycle != b->cycle) return (a->cycle < b->cycle) ? -1 : 1;
+  if (a->core != b->core) return a->core - b->core;
+  return (a->seq < b->seq) ? -1 : (a->seq > b->seq);
+}
+
+static int
+cmp_atomics(const void *p1, const void *p2)
+{
+  const Core *a = *(Core *const *)p1, *b = *(Core *const *)p2;
+  if (a->atomicCycle != b->atomicCycle) {
+    return (a->atomicCycle < b->atomicCycle) ? -1 : 1;
+  }
+  return a->id - b->id;
+}
+
+/** Apply request to the L1s of all cores other than the requester,
+ *  returning the extra stall cycles it costs the requester.
+ */
+static int
+snoop(McSim *mcSim, const BusRequest *request)
+{
+  const McSimConfig *config = &mcSim->config;
+  int extra = 0;
+  bool isShared = false;
+  for (int i = 0; i < mcSim->nCores; i++) {
+    if (i == request->core) continue;
+    Core *other = &mcSim->cores[i];
+    Line *line = find_line(other, request->line);
+    if (!line) continue;
+    switch (request->op) {
+    case BUS_RD:
+      if (line->state == MODIFIED) {
+        other->nWritebacks++;
+        mcSim->nC2C++;
+        extra += config->c2cLatency;
+      }
+      line->state = SHARED;
+      isShared = true;
+      break;
+    case BUS_RDX:
+    case BUS_UPGR:
+      if (line->state == MODIFIED) {
+        other->nWritebacks++;
+        mcSim->nC2C++;
+        extra += config->c2cLatency;
+      }
+      line->state = INVALID;
+      other->nInvalidated++;
+      mcSim->nInvalidations++;
+      break;
+    case BUS_WB:
+      break;
+    }
+  }
+  Line *own = find_line(&mcSim->cores[request->core], request->line);
+  if (request->op == BUS_RD && !isShared && own && own->state == SHARED) {
+    own->state = EXCLUSIVE;
+  }
+  return extra;
+}
+
+/** Apply the bus transactions and stores of the quantum just run by
+ *  all cores, in (cycle, core) order, then execute the atomics which
+ *  waited for the end of the quantum in the same order.
+ */
+static void
+resolve_quantum(McSim *mcSim)
+{
+  size_t nRequests = 0, nStores = 0;
+  for (int i = 0; i < mcSim->nCores; i++) {
+    nRequests += mcSim->cores[i].nRequests;
+    nStores += mcSim->cores[i].nStores;
+  }
+  BusRequest *requests = malloc((nRequests + 1) * sizeof(BusRequest));
+  Store *stores = malloc((nStores + 1) * sizeof(Store));
+  if (!requests || !stores) fatal("out of memory\n");
+  nRequests = nStores = 0;
+  for (int i = 0; i < mcSim->nCores; i++) {
+    Core *core = &mcSim->cores[i];
+    memcpy(&requests[nRequests], core->requests,
+           core->nRequests * sizeof(BusRequest));
+    memcpy(&stores[nStores], core->stores, core->nStores * sizeof(Store));
+    nRequests += core->nRequests;
+    nStores += core->nStores;
+    core->nRequests = core->nStores = 0;
+  }
+  qsort(requests, nRequests, sizeof(BusRequest), cmp_requests);
+  for (size_t i = 0; i < nRequests; i++) {
+    const BusRequest *request = &requests[i];
+    const uint64_t start =
+      (request->cycle > mcSim->busFree) ? request->cycle : mcSim->busFree;
+    mcSim->busFree = start + mcSim->config.busCycles;
+    mcSim->nBusTxns++;
+    const int extra = snoop(mcSim, request) + (int)(start - request->cycle);
+    mcSim->cores[request->core].penalty += extra;
+  }
+  //make every core's memory reflect all stores, last store wins
+  qsort(stores, nStores, sizeof(Store), cmp_stores);
+  for (size_t i = 0; i < nStores; i++) {
+    for (int j = 0; j < mcSim->nCores; j++) {
+      write_memory_word_y86(mcSim->cores[j].y86, stores[i].addr,
+                            stores[i].word);
+    }
+  }
+  free(requests);
+  free(stores);
+  //each atomic sees the stores of the quantum and of earlier atomics
+  Core *atomics[mcSim->nCores];
+  int nAtomics = 0;
+  for (int i = 0; i < mcSim->nCores; i++) {
+    Core *core = &mcSim->cores[i];
+    if (core->isAtomicPending) atomics[nAtomics++] = core;
+  }
+  qsort(atomics, nAtomics, sizeof(Core *), cmp_atomics);
+  for (int i = 0; i < nAtomics; i++) {
+    Core *core = atomics[i];
+    step_yatomic(core->y86);
+    core->nInsns++;
+    core->isAtomicPending = false;
+    core->isDone = read_status_y86(core->y86) != STATUS_AOK;
+    if (core->isDone) continue;
+    const Word word = read_memory_word_y86(core->y86, core->atomicAddr);
+    for (int j = 0; j < mcSim->nCores; j++) {
+      if (j != core->id) {
+        write_memory_word_y86(mcSim->cores[j].y86, core->atomicAddr, word);
+      }
+    }
+  }
+}
+
+/** Run all cores of mcSim until every one has stopped. */
+void
+run_mc_sim(McSim *mcSim)
+{
+  const int nCores = mcSim->nCores;
+  pthread_t threads[nCores];
+  pthread_barrier_init(&mcSim->start, NULL, nCores + 1);
+  pthread_barrier_init(&mcSim->end, NULL, nCores + 1);
+  for (int i = 0; i < nCores; i++) {
+    if (pthread_create(&threads[i], NULL, run_core, &mcSim->cores[i]) != 0) {
+      fatal("cannot create thread for core %d\n", i);
+    }
+  }
+  for (;;) {
+    bool isDone = true;
+    for (int i = 0; i < nCores; i++) isDone = isDone && mcSim->cores[i].isDone;
+    mcSim->isFinished = isDone;
+    pthread_barrier_wait(&mcSim->start);
+    if (isDone) break;
+    pthread_barrier_wait(&mcSim->end);
+    resolve_quantum(mcSim);
+  }
+  for (int i = 0; i < nCores; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  pthread_barrier_destroy(&mcSim->start);
+  pthread_barrier_destroy(&mcSim->end);
+}
+
+/***************************** Statistics ******************************/
+
+/** Print per-core CPI and cache statistics and bus coherence traffic
+ *  of mcSim on out.
+ */
+void
+print_stats_mc_sim(const McSim *mcSim, FILE *out)
+{
+  for (int i = 0; i < mcSim->nCores; i++) {
+    const Core *core = &mcSim->cores[i];
+    fprintf(out, "core %d: %lu cycles, %lu instructions, CPI %.2f\n",
+            i, core->clock, core->nInsns,
+            core->nInsns ? (double)core->clock / core->nInsns : 0.0);
+    fprintf(out, "        L1: %lu hits, %lu misses, %lu upgrades, "
+            "%lu writebacks, %lu invalidated\n",
+            core->nHits, core->nMisses, core->nUpgrades,
+            core->nWritebacks, core->nInvalidated);
+    fprintf(out, "        %lu memory stall cycles, %lu atomic wait cycles\n",
+            core->nMemStalls, core->nAtomicWaits);
+  }
+  fprintf(out, "bus: %lu transactions, %lu invalidations, "
+          "%lu cache-to-cache transfers\n",
+          mcSim->nBusTxns, mcSim->nInvalidations, mcSim->nC2C);
+}
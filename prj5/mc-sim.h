@@ -0,0 +1,65 @@
+#ifndef _MC_SIM_H
+#define _MC_SIM_H
+
+#include "stall-sim.h"
+#include "y86x.h"
+
+#include <stdio.h>
+
+/** Multicore timing simulator.  Each core is a Y86 with its own
+ *  StallSim pipeline model and a private L1 data cache; the L1s are
+ *  kept coherent with the MESI protocol over a shared bus.
+ *
+ *  Cores run in parallel on host threads and synchronize every
+ *  quantum cycles.  Within a quantum a core only sees its own cache
+ *  and memory, so its stores become visible to the other cores only
+ *  at the next quantum barrier, where the bus transactions and stores
+ *  of all cores are applied in (cycle, core) order.
+ *
+ *  An xaddq or cmpxchgq (see yatomic.h) waits for the barrier and is
+ *  executed there, after the stores of the quantum and in (cycle,
+ *  core) order, so it is atomic across cores; its core stalls for the
+ *  rest of the quantum.  Results are therefore identical from run to
+ *  run, whatever the host scheduling.
+ */
+typedef struct McSimStruct McSim;
+
+typedef struct {
+  int quantum;        /** # of cycles cores run between synchronizations */
+  int nSets;          /** # of sets in each L1 */
+  int nWays;          /** associativity of each L1 */
+  int lineSize;       /** L1 line size in bytes: a power of 2 */
+  int memLatency;     /** stall cycles to fill a line from memory */
+  int c2cLatency;     /** extra stall cycles when a modified line is
+                       *  written back by another L1 to supply it */
+  int upgradeLatency; /** stall cycles to upgrade a shared line */
+  int busCycles;      /** cycles the bus is busy per transaction */
+  const StallSimConfig *pipeline;  /** pipeline of each core; NULL for
+                                    *  DEFAULT_STALL_SIM_CONFIG */
+} McSimConfig;
+
+/** Default configuration: 1000-cycle quantum, 4-way 16 KiB L1s with
+ *  64-byte lines, default pipelines.
+ */
+extern const McSimConfig DEFAULT_MC_SIM_CONFIG;
+
+/** Create a new multicore simulator for cores[nCores], which must
+ *  already be loaded and set up.  If config is NULL, use
+ *  DEFAULT_MC_SIM_CONFIG.
+ */
+McSim *new_mc_sim(Y86 *cores[], int nCores, const McSimConfig *config);
+
+/** Free all resources allocated by new_mc_sim() in mcSim; the cores
+ *  themselves are not freed.
+ */
+void free_mc_sim(McSim *mcSim);
+
+/** Run all cores of mcSim until every one has stopped. */
+void run_mc_sim(McSim *mcSim);
+
+/** Print per-core CPI and cache statistics and bus coherence traffic
+ *  of mcSim on out.
+ */
+void print_stats_mc_sim(const McSim *mcSim, FILE *out);
+
+#endif //ifndef _MC_SIM_H
@@ -0,0 +1,72 @@
+#include "mem-access.h"
+
+#include "yatomic.h"
+
+#include <limits.h>
+
+enum {
+  DATA_INSN_BYTES = 10, /** length of an instruction with a displacement */
+};
+
+/** If the next instruction of y86 (the one at its pc) accesses data
+ *  memory, set *addr to the address of the word it accesses and
+ *  *isWrite to true iff it stores to that word (as xaddq and
+ *  cmpxchgq always do, see yatomic.h), and return true.
+ *  Return false for instructions which do not access data memory.
+ *  y86 is not changed.
+ */
+bool
+next_data_access(Y86 *y86, Address *addr, bool *isWrite)
+{
+  //only fetch the bytes which lie in memory, so that decoding a
+  //faulting instruction does not change y86
+  const Address pc = read_pc_y86(y86);
+  const Address size = get_memory_size_y86(y86);
+  Byte code[DATA_INSN_BYTES];
+  int nCode = 0;
+  while (nCode < DATA_INSN_BYTES && pc < size && nCode < size - pc) {
+    code[nCode] = read_memory_byte_y86(y86, pc + nCode);
+    nCode++;
+  }
+  return code_data_access(y86, code, nCode, addr, isWrite);
+}
+
+/** Like next_data_access(), but for the instruction at the pc of y86
+ *  whose first nCode bytes are in code[]; only the registers of y86
+ *  are read.  Return false if code[] is too short for the fields
+ *  which its access depends on.
+ */
+bool
+code_data_access(Y86 *y86, const Byte code[], int nCode,
+                 Address *addr, bool *isWrite)
+{
+  if (nCode < 1) return false;
+  const Byte op = code[0];
+  const Word rsp = read_register_y86(y86, REG_RSP);
+  switch (get_nybble(op, 1)) {
+  case RMMOVQ_CODE:
+  case MRMOVQ_CODE:
+  case YATOMIC_CODE: {
+    if (nCode < DATA_INSN_BYTES) return false;
+    Word disp = 0;
+    for (int i = sizeof(Word) - 1; i >= 0; i--) {
+      disp = (disp << CHAR_BIT) | code[2 + i];
+    }
+    *addr = read_register_y86(y86, get_nybble(code[1], 0)) + disp;
+    *isWrite = get_nybble(op, 1) != MRMOVQ_CODE;
+    return true;
+  }
+  case CALL_CODE:
+  case PUSHQ_CODE:
+    *addr = rsp - sizeof(Word);
+    *isWrite = true;
+    return true;
+  case RET_CODE:
+  case POPQ_CODE:
+    *addr = rsp;
+    *isWrite = false;
+    return true;
+  default:
+    return false;
+  }
+}
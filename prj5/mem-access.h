@@ -0,0 +1,23 @@
+#ifndef _MEM_ACCESS_H
+#define _MEM_ACCESS_H
+
+#include "y86x.h"
+
+/** If the next instruction of y86 (the one at its pc) accesses data
+ *  memory, set *addr to the address of the word it accesses and
+ *  *isWrite to true iff it stores to that word (as xaddq and
+ *  cmpxchgq always do, see yatomic.h), and return true.
+ *  Return false for instructions which do not access data memory.
+ *  y86 is not changed.
+ */
+bool next_data_access(Y86 *y86, Address *addr, bool *isWrite);
+
+/** Like next_data_access(), but for the instruction at the pc of y86
+ *  whose first nCode bytes are in code[]; only the registers of y86
+ *  are read.  Return false if code[] is too short for the fields
+ *  which its access depends on.
+ */
+bool code_data_access(Y86 *y86, const Byte code[], int nCode,
+                      Address *addr, bool *isWrite);
+
+#endif //ifndef _MEM_ACCESS_H
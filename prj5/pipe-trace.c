@@ -0,0 +1,260 @@
+#include "pipe-trace.h"
+
+#include "errors.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+  N_LATER_STAGES = 3,   /** # of stages after issue */
+  MAX_TEXT = 80,        /** max length of the text of an instruction */
+  WAIT_LANE = 0,        /** Chrome thread of stall stages; stage I and
+                         *  the later stages follow on their own */
+};
+
+static const char *laterStages[N_LATER_STAGES] = { "E", "M", "W" };
+
+/** An issued instruction which has not yet left stage W. */
+typedef struct {
+  long id;
+  long issueCycle;
+  Address pc;
+  char text[MAX_TEXT];
+} InFlight;
+
+struct PipeTraceStruct {
+  FILE *out;
+  PipeTraceFormat format;
+  long nextId;          //id of the next instruction
+  long nRetired;
+  long cycle;           //# of the last clock added; -1 before the first
+  long konataCycle;     //cycle of the last Konata command written
+  bool isEmpty;         //no Chrome event written yet
+  bool isWaiting;       //an instruction is waiting to issue
+  long waitId;          //id, pc and current stage of that instruction
+  Address waitPc;
+  StallReason waitReason;
+  long waitStart;       //cycle at which its current stage started
+  InFlight inFlight[N_LATER_STAGES + 1];  //circular, in issue order
+  int head;             //index of the oldest instruction in flight
+  int nInFlight;
+};
+
+/******************************* Output ********************************/
+
+/** Write the Konata command which advances the cycle of trace to
+ *  cycle, if it is not there already.
+ */
+static void
+konata_at(PipeTrace *trace, long cycle)
+{
+  if (cycle != trace->konataCycle) {
+    fprintf(trace->out, "C\t%ld\n", cycle - trace->konataCycle);
+    trace->konataCycle = cycle;
+  }
+}
+
+/** Write text on out as the contents of a JSON string. */
+static void
+write_json_text(FILE *out, const char *text)
+{
+  for (const char *p = text; *p != '\0'; p++) {
+    if (*p == '"' || *p == '\\') fputc('\\', out);
+    if ((unsigned char)*p >= ' ') fputc(*p, out);
+  }
+}
+
+/** Start a Chrome event of trace with name on thread lane covering
+ *  cycles [start, end), leaving its args object open.
+ */
+static void
+begin_chrome_event(PipeTrace *trace, const char *name, int lane, long start,
+                   long end)
+{
+  fprintf(trace->out, "%s\n{\"name\":\"", trace->isEmpty ? "" : ",");
+  trace->isEmpty = false;
+  write_json_text(trace->out, name);
+  fprintf(trace->out, "\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+          "\"ts\":%ld,\"dur\":%ld,\"args\":{", lane, start, end - start);
+}
+
+/** Record that instruction id enters stage at cycle. */
+static void
+begin_stage(PipeTrace *trace, long id, const char *stage, long cycle)
+{
+  if (trace->format == KONATA_PIPE_TRACE) {
+    konata_at(trace, cycle);
+    fprintf(trace->out, "S\t%ld\t0\t%s\n", id, stage);
+  }
+}
+
+/** Record that the instruction waiting in trace leaves the stall stage
+ *  it started at trace->waitStart at cycle.
+ */
+static void
+end_wait_stage(PipeTrace *trace, long cycle)
+{
+  const char *stage = get_reason_name_stall_sim(trace->waitReason);
+  if (trace->format == KONATA_PIPE_TRACE) {
+    konata_at(trace, cycle);
+    fprintf(trace->out, "E\t%ld\t0\t%s\n", trace->waitId, stage);
+  }
+  else {
+    begin_chrome_event(trace, stage, WAIT_LANE, trace->waitStart, cycle);
+    fprintf(trace->out, "\"id\":%ld,\"pc\":\"0x%04lx\"}}", trace->waitId,
+            trace->waitPc);
+  }
+}
+
+/** Record that insn leaves stage # stage (0 for I) at cycle. */
+static void
+end_issued_stage(PipeTrace *trace, const InFlight *insn, int stage,
+                 long cycle)
+{
+  const char *name = (stage == 0) ? "I" : laterStages[stage - 1];
+  if (trace->format == KONATA_PIPE_TRACE) {
+    konata_at(trace, cycle);
+    fprintf(trace->out, "E\t%ld\t0\t%s\n", insn->id, name);
+  }
+  else {
+    begin_chrome_event(trace, insn->text, WAIT_LANE + 1 + stage, cycle - 1,
+                       cycle);
+    fprintf(trace->out, "\"id\":%ld,\"pc\":\"0x%04lx\"}}", insn->id,
+            insn->pc);
+  }
+}
+
+/********************** Allocation / Deallocation **********************/
+
+/** Return a new pipeline trace writing format on out. */
+PipeTrace *
+new_pipe_trace(FILE *out, PipeTraceFormat format)
+{
+  PipeTrace *trace = calloc(1, sizeof(PipeTrace));
+  if (!trace) fatal("out of memory\n");
+  trace->out = out;
+  trace->format = format;
+  trace->cycle = -1;
+  trace->isEmpty = true;
+  if (format == KONATA_PIPE_TRACE) {
+    fprintf(out, "Kanata\t0004\nC=\t0\n");
+  }
+  else {
+    static const char *lanes[] = { "stall", "I", "E", "M", "W" };
+    fprintf(out, "{\"traceEvents\":[");
+    for (int i = 0; i < sizeof(lanes)/sizeof(lanes[0]); i++) {
+      fprintf(out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+              "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+              trace->isEmpty ? "" : ",", WAIT_LANE + i, lanes[i]);
+      trace->isEmpty = false;
+    }
+  }
+  return trace;
+}
+
+/** Move the instructions in flight in trace to the stages they occupy
+ *  at cycle, retiring those which leave stage W.
+ */
+static void
+advance(PipeTrace *trace, long cycle)
+{
+  const int size = N_LATER_STAGES + 1;
+  for (int i = 0; i < trace->nInFlight; i++) {
+    const InFlight *insn = &trace->inFlight[(trace->head + i) % size];
+    const int stage = cycle - insn->issueCycle;  //# of stages passed
+    end_issued_stage(trace, insn, stage - 1, cycle);
+    if (stage <= N_LATER_STAGES) {
+      begin_stage(trace, insn->id, laterStages[stage - 1], cycle);
+    }
+    else if (trace->format == KONATA_PIPE_TRACE) {
+      fprintf(trace->out, "R\t%ld\t%ld\t0\n", insn->id, trace->nRetired);
+    }
+  }
+  //only the oldest can leave W
+  if (trace->nInFlight > 0 &&
+      cycle - trace->inFlight[trace->head].issueCycle > N_LATER_STAGES) {
+    trace->head = (trace->head + 1) % size;
+    trace->nInFlight--;
+    trace->nRetired++;
+  }
+}
+
+/** Complete trace by running the instructions still in the pipeline
+ *  through their remaining stages, write any trailer required by its
+ *  format and free all resources allocated by new_pipe_trace() in
+ *  trace.  Its output file is not closed.
+ */
+void
+free_pipe_trace(PipeTrace *trace)
+{
+  long cycle = trace->cycle + 1;
+  if (trace->isWaiting) {
+    //an instruction which never issued, as on a fault, is flushed
+    end_wait_stage(trace, cycle);
+    if (trace->format == KONATA_PIPE_TRACE) {
+      fprintf(trace->out, "L\t%ld\t0\t%04lx: \nR\t%ld\t%ld\t1\n",
+              trace->waitId, trace->waitPc, trace->waitId, trace->waitId);
+    }
+  }
+  for (; trace->nInFlight > 0; cycle++) advance(trace, cycle);
+  if (trace->format == CHROME_PIPE_TRACE) {
+    fprintf(trace->out, "\n]}\n");
+  }
+  free(trace);
+}
+
+/******************************* Clocks ********************************/
+
+/** Add the clock # cycle to trace, at which the instruction at pc
+ *  issued if reason is NO_STALL, else stalled for reason.
+ */
+void
+add_clock_pipe_trace(PipeTrace *trace, long cycle, Address pc,
+                     StallReason reason, const char *text)
+{
+  advance(trace, cycle);
+  trace->cycle = cycle;
+  if (!trace->isWaiting) {
+    trace->isWaiting = true;
+    trace->waitId = trace->nextId++;
+    trace->waitPc = pc;
+    trace->waitReason = reason;
+    trace->waitStart = cycle;
+    if (trace->format == KONATA_PIPE_TRACE) {
+      konata_at(trace, cycle);
+      fprintf(trace->out, "I\t%ld\t%ld\t0\n", trace->waitId, trace->waitId);
+    }
+    if (reason != NO_STALL) {
+      begin_stage(trace, trace->waitId, get_reason_name_stall_sim(reason),
+                  cycle);
+    }
+  }
+  else if (reason != trace->waitReason) {
+    end_wait_stage(trace, cycle);
+    trace->waitReason = reason;
+    trace->waitStart = cycle;
+    if (reason != NO_STALL) {
+      begin_stage(trace, trace->waitId, get_reason_name_stall_sim(reason),
+                  cycle);
+    }
+  }
+  if (reason == NO_STALL) {
+    InFlight *insn = &trace->inFlight[(trace->head + trace->nInFlight) %
+                                      (N_LATER_STAGES + 1)];
+    insn->id = trace->waitId;
+    insn->issueCycle = cycle;
+    insn->pc = pc;
+    //tabs separate the fields of Konata commands
+    snprintf(insn->text, sizeof(insn->text), "%s", text);
+    for (char *p = strchr(insn->text, '\t'); p; p = strchr(p, '\t')) *p = ' ';
+    size_t len = strlen(insn->text);
+    while (len > 0 && insn->text[len - 1] == ' ') insn->text[--len] = '\0';
+    trace->nInFlight++;
+    trace->isWaiting = false;
+    if (trace->format == KONATA_PIPE_TRACE) {
+      fprintf(trace->out, "L\t%ld\t0\t%04lx: %s\n", insn->id, pc,
+              insn->text);
+    }
+    begin_stage(trace, insn->id, "I", cycle);
+  }
+}
@@ -0,0 +1,43 @@
+#ifndef _PIPE_TRACE_H
+#define _PIPE_TRACE_H
+
+#include "stall-sim.h"
+
+#include <stdio.h>
+
+/** Export of the clocks of a StallSim for pipeline viewers.  Each
+ *  instruction is shown from the first clock at which it waits to
+ *  issue: its stalls as stages named by their reason (data, jump,
+ *  ...), then the clock at which it issues as stage I, followed by one
+ *  clock in each of stages E, M and W.  The StallSim times issue only,
+ *  so the later stages are notional.  Output is streamed as clocks are
+ *  added, with only the instructions still in the pipeline held in
+ *  memory, so that runs of any length can be exported.
+ */
+typedef struct PipeTraceStruct PipeTrace;
+
+typedef enum {
+  KONATA_PIPE_TRACE,    /** Kanata 0004 log for the Konata viewer */
+  CHROME_PIPE_TRACE,    /** Chrome trace-event JSON, one thread per
+                         *  stage, for chrome://tracing or Perfetto */
+} PipeTraceFormat;
+
+/** Return a new pipeline trace writing format on out. */
+PipeTrace *new_pipe_trace(FILE *out, PipeTraceFormat format);
+
+/** Complete trace by running the instructions still in the pipeline
+ *  through their remaining stages, write any trailer required by its
+ *  format and free all resources allocated by new_pipe_trace() in
+ *  trace.  Its output file is not closed.
+ */
+void free_pipe_trace(PipeTrace *trace);
+
+/** Add the clock # cycle to trace, at which the instruction at pc
+ *  issued if reason is NO_STALL, else stalled for reason.  text is
+ *  the assembler text of the instruction; it is only used when the
+ *  instruction issues.  Clocks must be added in order, starting at 0.
+ */
+void add_clock_pipe_trace(PipeTrace *trace, long cycle, Address pc,
+                          StallReason reason, const char *text);
+
+#endif //ifndef _PIPE_TRACE_H
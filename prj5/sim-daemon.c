@@ -0,0 +1,354 @@
+#define _DEFAULT_SOURCE   //for sysconf() and sockets
+
+#include "sim-daemon.h"
+
+#include "loop-sim.h"
+#include "staged-sim.h"
+
+#include "errors.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+enum {
+  MAX_REQUEST = 8192,       /** max length of a request line */
+  MAX_REQUEST_WORDS = 512,  /** max # of words in a request */
+  MAX_PARAM_NAME = 32,      /** max length of a -p parameter name */
+  LISTEN_BACKLOG = 64,
+  DIRTY_PAGE_SHIFT = 12,    /** log2 of the size of a page reset as one */
+};
+
+typedef struct {
+  const StallSimConfig *base;
+  SimDaemonLoadFn *load;
+  void *ctx;
+  int listenFd;
+  atomic_bool isStopping;
+  pthread_mutex_t lock;     //protects calls to load
+} SimDaemon;
+
+/** A request parsed into the arguments of a run. */
+typedef struct {
+  bool isVerbose;
+  StallSimConfig config;
+  int nFiles;
+  const char *fileNames[MAX_REQUEST_WORDS];
+  int nParams;
+  Word params[MAX_REQUEST_WORDS];
+} Request;
+
+/** A worker's warm machine, reset between runs. */
+typedef struct {
+  Y86 *y86;
+  Address memSize;          //memory size of y86
+  Byte *isDirty;            //[# of pages] true for pages written since reset
+  Byte initialCc;           //cc of a new Y86
+  StallSim *stallSim;
+  FILE *devNull;
+} Machine;
+
+/*************************** Request Parsing ***************************/
+
+/** Set the pipeline parameter given by spec, of the form NAME=N, in
+ *  config.  Return false if spec is bad.
+ */
+static bool
+parse_param(const char *spec, StallSimConfig *config)
+{
+  const char *eq = strchr(spec, '=');
+  char name[MAX_PARAM_NAME];
+  if (!eq || eq - spec >= sizeof(name) || eq[1] == '\0') return false;
+  memcpy(name, spec, eq - spec);
+  name[eq - spec] = '\0';
+  char *p;
+  long n = strtol(eq + 1, &p, 10);
+  return *p == '\0' && n >= 0 && n <= INT_MAX &&
+    set_param_stall_sim(config, name, n);
+}
+
+/** Parse line, which is modified, into *request, whose config must
+ *  already hold the base configuration.  Return NULL on success,
+ *  else a message describing the error.
+ */
+static const char *
+parse_request(char *line, Request *request)
+{
+  int nWords = 0;
+  char *save;
+  for (char *word = strtok_r(line, " \t\r\n", &save); word;
+       word = strtok_r(NULL, " \t\r\n", &save)) {
+    if (++nWords > MAX_REQUEST_WORDS) return "too many words in request";
+    if (strcmp(word, "-v") == 0) {
+      request->isVerbose = true;
+    }
+    else if (strcmp(word, "-p") == 0) {
+      word = strtok_r(NULL, " \t\r\n", &save);
+      if (!word || !parse_param(word, &request->config)) {
+        return "bad or missing value for -p";
+      }
+    }
+    else if (isdigit(word[0]) || (word[0] == '-' && isdigit(word[1]))) {
+      char *p;
+      request->params[request->nParams++] = strtol(word, &p, 0);
+      if (*p != '\0') return "bad parameter";
+    }
+    else if (word[0] == '-') {
+      return "unknown option";
+    }
+    else {
+      request->fileNames[request->nFiles++] = word;
+    }
+  }
+  if (!is_valid_config_stall_sim(&request->config)) {
+    return "-p tlb is not a multiple of -p ways";
+  }
+  return (request->nFiles == 0) ? "no files specified" : NULL;
+}
+
+/** Read a single line from fd into line[MAX_REQUEST], without its
+ *  newline.  Return false if the connection closed or the line is
+ *  too long.
+ */
+static bool
+read_request_line(int fd, char line[])
+{
+  size_t n = 0;
+  while (n < MAX_REQUEST - 1) {
+    ssize_t nRead = read(fd, &line[n], MAX_REQUEST - 1 - n);
+    if (nRead < 0 && errno == EINTR) continue;
+    if (nRead <= 0) break;
+    char *nl = memchr(&line[n], '\n', nRead);
+    if (nl) {
+      *nl = '\0';
+      return true;
+    }
+    n += nRead;
+  }
+  line[n] = '\0';
+  return n > 0 && n < MAX_REQUEST - 1;
+}
+
+/****************************** Running ********************************/
+
+/** Mark the pages of machine overlapping [lo, hi) as written. */
+static void
+mark_dirty(Machine *machine, Address lo, Address hi)
+{
+  if (hi > machine->memSize) hi = machine->memSize;
+  if (lo >= hi) return;
+  for (Address page = lo >> DIRTY_PAGE_SHIFT; page << DIRTY_PAGE_SHIFT < hi;
+       page++) {
+    machine->isDirty[page] = true;
+  }
+}
+
+/** LoopSimStoreFn marking the page(s) of the word at addr of the
+ *  Machine ctx as written.
+ */
+static void
+mark_store(void *ctx, Address addr)
+{
+  mark_dirty(ctx, addr, addr + sizeof(Word));
+}
+
+/** Return the Y86 of machine to the state of a new Y86 with zeroed
+ *  memory, zeroing only the pages written since the last reset.  If
+ *  isBaseline, also make that state the baseline for
+ *  dump_changes_y86(), which visits all of memory.
+ */
+static void
+reset_machine(Machine *machine, bool isBaseline)
+{
+  Y86 *y86 = machine->y86;
+  const Address memSize = machine->memSize;
+  for (Address page = 0; page << DIRTY_PAGE_SHIFT < memSize; page++) {
+    if (!machine->isDirty[page]) continue;
+    const Address lo = page << DIRTY_PAGE_SHIFT;
+    const Address hi = lo + (1 << DIRTY_PAGE_SHIFT);
+    for (Address a = lo; a < hi && a + sizeof(Word) <= memSize;
+         a += sizeof(Word)) {
+      write_memory_word_y86(y86, a, 0);
+    }
+    machine->isDirty[page] = false;
+  }
+  for (int r = 0; r < N_REGISTERS; r++) write_register_y86(y86, r, 0);
+  write_pc_y86(y86, 0);
+  write_cc_y86(y86, machine->initialCc);
+  write_status_y86(y86, STATUS_AOK);
+  if (isBaseline) dump_changes_y86(y86, false, machine->devNull);
+}
+
+/** Load and run request on machine, writing the response on out. */
+static void
+run_request(SimDaemon *daemon, Machine *machine, Request *request,
+            FILE *out)
+{
+  Y86 *y86 = machine->y86;
+  reset_machine(machine, request->isVerbose);
+  Address end = machine->memSize;   //in case load fails before setting it
+  pthread_mutex_lock(&daemon->lock);
+  const bool isLoaded =
+    daemon->load(daemon->ctx, request->nFiles, request->fileNames,
+                 request->nParams, request->params, y86, &end, out);
+  pthread_mutex_unlock(&daemon->lock);
+  mark_dirty(machine, 0, end);
+  mark_dirty(machine, machine->memSize - request->nParams * sizeof(Word),
+             machine->memSize);
+  if (!isLoaded) {
+    fprintf(out, "error: cannot load program\n");
+    return;
+  }
+  StallSim *stallSim = machine->stallSim;
+  reset_stall_sim(stallSim, &request->config);
+  StagedSimStats stats;
+  run_loop_sim(y86, stallSim, mark_store, machine, &stats);
+  print_stats_staged_sim(&stats, &request->config, out);
+  if (request->isVerbose) dump_changes_y86(y86, true, out);
+}
+
+/** Serve the connection on fd, closing it when done. */
+static void
+serve(SimDaemon *daemon, Machine *machine, int fd)
+{
+  char line[MAX_REQUEST];
+  const bool isLine = read_request_line(fd, line);
+  FILE *out = fdopen(fd, "w");
+  if (!out) {
+    close(fd);
+    return;
+  }
+  Request *request = calloc(1, sizeof(Request));
+  if (!request) fatal("out of memory\n");
+  request->config = *daemon->base;
+  const char *err = isLine ? NULL : "bad request line";
+  if (isLine && strcmp(line, "quit") == 0) {
+    atomic_store(&daemon->isStopping, true);
+    shutdown(daemon->listenFd, SHUT_RDWR);  //wake threads in accept()
+  }
+  else if (!err && !(err = parse_request(line, request))) {
+    run_request(daemon, machine, request, out);
+  }
+  if (err) fprintf(out, "error: %s\n", err);
+  free(request);
+  fclose(out);
+}
+
+static void *
+run_thread(void *arg)
+{
+  SimDaemon *daemon = arg;
+  Machine machine = { .y86 = new_y86_default() };
+  machine.memSize = get_memory_size_y86(machine.y86);
+  const Address nPages =
+    (machine.memSize + (1 << DIRTY_PAGE_SHIFT) - 1) >> DIRTY_PAGE_SHIFT;
+  machine.isDirty = calloc(nPages, sizeof(Byte));
+  if (!machine.isDirty) fatal("out of memory\n");
+  machine.initialCc = read_cc_y86(machine.y86);
+  machine.stallSim = new_stall_sim(machine.y86, daemon->base);
+  machine.devNull = fopen("/dev/null", "w");
+  if (!machine.devNull) fatal("cannot open /dev/null\n");
+  while (!atomic_load(&daemon->isStopping)) {
+    int fd = accept(daemon->listenFd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      break;
+    }
+    serve(daemon, &machine, fd);
+  }
+  fclose(machine.devNull);
+  free_stall_sim(machine.stallSim);
+  free(machine.isDirty);
+  free_y86(machine.y86);
+  return NULL;
+}
+
+/** Fill *addr with the address of the socket at socketPath.  Return
+ *  false if the path is too long.
+ */
+static bool
+make_address(const char *socketPath, struct sockaddr_un *addr)
+{
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (strlen(socketPath) >= sizeof(addr->sun_path)) {
+    fprintf(stderr, "socket path %s is too long\n", socketPath);
+    return false;
+  }
+  strcpy(addr->sun_path, socketPath);
+  return true;
+}
+
+bool
+run_sim_daemon(const char *socketPath, const StallSimConfig *base,
+               int nThreads, SimDaemonLoadFn *load, void *ctx)
+{
+  struct sockaddr_un addr;
+  if (!make_address(socketPath, &addr)) return false;
+  SimDaemon daemon = { .base = base, .load = load, .ctx = ctx };
+  daemon.listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (daemon.listenFd < 0) {
+    perror("socket");
+    return false;
+  }
+  unlink(socketPath);
+  if (bind(daemon.listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(daemon.listenFd, LISTEN_BACKLOG) != 0) {
+    perror(socketPath);
+    close(daemon.listenFd);
+    return false;
+  }
+  signal(SIGPIPE, SIG_IGN);  //a client may leave before its response
+  atomic_init(&daemon.isStopping, false);
+  pthread_mutex_init(&daemon.lock, NULL);
+  if (nThreads <= 0) nThreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nThreads < 1) nThreads = 1;
+  pthread_t threads[nThreads];
+  for (int i = 0; i < nThreads; i++) {
+    if (pthread_create(&threads[i], NULL, run_thread, &daemon) != 0) {
+      fatal("cannot create daemon thread\n");
+    }
+  }
+  for (int i = 0; i < nThreads; i++) pthread_join(threads[i], NULL);
+  pthread_mutex_destroy(&daemon.lock);
+  close(daemon.listenFd);
+  unlink(socketPath);
+  return true;
+}
+
+/******************************* Client ********************************/
+
+bool
+request_sim_daemon(const char *socketPath, const char *request, FILE *out)
+{
+  struct sockaddr_un addr;
+  if (!make_address(socketPath, &addr)) return false;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    perror(socketPath);
+    if (fd >= 0) close(fd);
+    return false;
+  }
+  FILE *conn = fdopen(fd, "r+");
+  if (!conn) fatal("out of memory\n");
+  fprintf(conn, "%s\n", request);
+  fflush(conn);
+  shutdown(fd, SHUT_WR);
+  char buf[BUFSIZ];
+  bool isFirst = true, isError = false;
+  while (fgets(buf, sizeof(buf), conn)) {
+    if (isFirst && strncmp(buf, "error:", 6) == 0) isError = true;
+    isFirst = false;
+    fputs(buf, isError ? stderr : out);
+  }
+  fclose(conn);
+  return !isError;
+}
@@ -0,0 +1,66 @@
+#ifndef _SIM_DAEMON_H
+#define _SIM_DAEMON_H
+
+#include "stall-sim.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/** Persistent simulation server.  A daemon listens on a Unix domain
+ *  socket and serves timing runs to clients, sparing each run the
+ *  cost of process startup, machine allocation and assembly.  Each of
+ *  its worker threads owns a warm Y86 and StallSim which are reset
+ *  rather than reallocated between runs, zeroing only the pages of
+ *  memory the last run wrote, and programs are loaded through the
+ *  caller, which can keep assembled images cached for the life of
+ *  the daemon.
+ *
+ *  A client connects, sends a single request line of space-separated
+ *  words and reads the response until the daemon closes the
+ *  connection.  The words of a request are:
+ *
+ *    -v          dump the final state after the totals
+ *    -p NAME=N   set pipeline parameter NAME to N for this run
+ *    INT_INPUT   a program parameter (a word starting with a digit,
+ *                or with - followed by a digit)
+ *    FILE_NAME   a program source or image, relative to the daemon's
+ *                working directory
+ *
+ *  The response is the output of a -t run of the program: the
+ *  totals of the run followed, with -v, by the final state.  A
+ *  response for a request which cannot be run is a single line
+ *  starting with "error:".  A request of just "quit" stops the
+ *  daemon once runs in progress are done.
+ */
+
+/** Load the program in fileNames[nFiles] into y86, a reset Y86, and
+ *  set up params[nParams] as its parameters in the top words of its
+ *  memory, logging their addresses on out.  Set *end to the end of
+ *  the memory written by the load of the program, which is taken to
+ *  start at address 0.  Return false after printing a message on
+ *  stderr on error.  Calls are serialized, so the function need not
+ *  be thread-safe.
+ */
+typedef bool SimDaemonLoadFn(void *ctx, int nFiles, const char *fileNames[],
+                             int nParams, const Word params[], Y86 *y86,
+                             Address *end, FILE *out);
+
+/** Serve requests on a Unix domain socket at socketPath, replacing
+ *  any file there, until a quit request, using nThreads worker
+ *  threads (the # of online processors if nThreads <= 0).  Runs use
+ *  the pipeline parameters in base unless overridden by a request.
+ *  Return false after printing a message on stderr if the socket
+ *  cannot be set up.
+ */
+bool run_sim_daemon(const char *socketPath, const StallSimConfig *base,
+                    int nThreads, SimDaemonLoadFn *load, void *ctx);
+
+/** Send request, a line of words as described above without a
+ *  terminating newline, to the daemon at socketPath and copy its
+ *  response to out.  Return false after printing a message on stderr
+ *  if the daemon cannot be reached, or if the response is an error.
+ */
+bool request_sim_daemon(const char *socketPath, const char *request,
+                        FILE *out);
+
+#endif //ifndef _SIM_DAEMON_H
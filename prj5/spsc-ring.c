@@ -0,0 +1,100 @@
+#define _DEFAULT_SOURCE   //for sched_yield()
+
+#include "spsc-ring.h"
+
+#include "errors.h"
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+  CACHE_LINE_SIZE = 64,
+  SPINS_BEFORE_YIELD = 64,  /** # of spins on a full or empty ring
+                             *  before giving up the processor */
+};
+
+struct SpscRingStruct {
+  char *elts;               //[mask + 1] elements of eltSize bytes
+  size_t eltSize;
+  size_t mask;
+  //written by the consumer
+  _Alignas(CACHE_LINE_SIZE) atomic_size_t head;  //# of elements popped
+  size_t tailCache;         //consumer's last view of tail
+  //written by the producer
+  _Alignas(CACHE_LINE_SIZE) atomic_size_t tail;  //# of elements pushed
+  size_t headCache;         //producer's last view of head
+};
+
+/** Return a new empty ring holding up to nElts (rounded up to a power
+ *  of 2) elements of eltSize bytes.
+ */
+SpscRing *
+new_spsc_ring(size_t eltSize, size_t nElts)
+{
+  size_t size = 1;
+  while (size < nElts) size *= 2;
+  SpscRing *ring = aligned_alloc(CACHE_LINE_SIZE, sizeof(SpscRing));
+  if (!ring) fatal("out of memory\n");
+  ring->elts = malloc(size * eltSize);
+  if (!ring->elts) fatal("out of memory\n");
+  ring->eltSize = eltSize;
+  ring->mask = size - 1;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  ring->tailCache = ring->headCache = 0;
+  return ring;
+}
+
+/** Free all resources allocated by new_spsc_ring() in ring. */
+void
+free_spsc_ring(SpscRing *ring)
+{
+  free(ring->elts);
+  free(ring);
+}
+
+/** Spin, then yield the processor: for waits on the other side. */
+static void
+backoff(int *nSpins)
+{
+  if (++*nSpins >= SPINS_BEFORE_YIELD) {
+    sched_yield();
+    *nSpins = 0;
+  }
+}
+
+/** Copy the element at elt onto the tail of ring, waiting while ring
+ *  is full.  Only to be called by the producer.
+ */
+void
+push_spsc_ring(SpscRing *ring, const void *elt)
+{
+  const size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  int nSpins = 0;
+  while (tail - ring->headCache > ring->mask) {
+    ring->headCache = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail - ring->headCache > ring->mask) backoff(&nSpins);
+  }
+  memcpy(ring->elts + (tail & ring->mask) * ring->eltSize, elt,
+         ring->eltSize);
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+/** Copy the element at the head of ring into elt and remove it,
+ *  waiting while ring is empty.  Only to be called by the consumer.
+ */
+void
+pop_spsc_ring(SpscRing *ring, void *elt)
+{
+  const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  int nSpins = 0;
+  while (head == ring->tailCache) {
+    ring->tailCache = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head == ring->tailCache) backoff(&nSpins);
+  }
+  memcpy(elt, ring->elts + (head & ring->mask) * ring->eltSize,
+         ring->eltSize);
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
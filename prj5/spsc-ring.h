@@ -0,0 +1,34 @@
+#ifndef _SPSC_RING_H
+#define _SPSC_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Lock-free bounded ring of fixed-size elements for passing data
+ *  from exactly one producer thread to exactly one consumer thread.
+ *  Each side only writes its own index and re-reads the other side's
+ *  index only when the ring looks full (or empty), so in the steady
+ *  state the two threads share no written cache lines but the
+ *  elements themselves.
+ */
+typedef struct SpscRingStruct SpscRing;
+
+/** Return a new empty ring holding up to nElts (rounded up to a power
+ *  of 2) elements of eltSize bytes.
+ */
+SpscRing *new_spsc_ring(size_t eltSize, size_t nElts);
+
+/** Free all resources allocated by new_spsc_ring() in ring. */
+void free_spsc_ring(SpscRing *ring);
+
+/** Copy the element at elt onto the tail of ring, waiting while ring
+ *  is full.  Only to be called by the producer.
+ */
+void push_spsc_ring(SpscRing *ring, const void *elt);
+
+/** Copy the element at the head of ring into elt and remove it,
+ *  waiting while ring is empty.  Only to be called by the consumer.
+ */
+void pop_spsc_ring(SpscRing *ring, void *elt);
+
+#endif //ifndef _SPSC_RING_H
@@ -0,0 +1,402 @@
+#include "staged-sim.h"
+
+#include "dis-yas.h"
+#include "spsc-ring.h"
+#include "ysim.h"
+#include "ycc.h"
+
+#include "errors.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+
+enum {
+  N_RING_ELTS = 4096,   /** capacity of each ring */
+  DIS_YAS_BUF_SIZE = 80,
+};
+
+/** Record of an instruction executed by the functional engine. */
+typedef struct {
+  StallSimInsn insn;
+  Byte code[MAX_INSN_BYTES]; //bytes of insn; only filled in when tracing
+  bool isFault;         //insn could not be read: clocked once, not run
+  bool isLast;          //y86 stopped with this insn
+} InsnRecord;
+
+/** Record of a clock for the formatter. */
+typedef struct {
+  long cycle;
+  Address pc;
+  bool isIssue;
+  StallReason reason;   //NO_STALL iff isIssue
+  bool isEnd;           //no more clocks
+  Byte code[MAX_INSN_BYTES]; //bytes of the instruction issued
+} ClockRecord;
+
+typedef struct {
+  Y86 *y86;
+  StallSim *stallSim;
+  const StallSimConfig *config;
+  int startupBubbles;
+  SpscRing *insns;      //engine -> timing
+  SpscRing *clocks;     //timing -> formatter; NULL if no trace
+  const InsnRecord *current;  //record being clocked by timing
+  StagedSimStats stats;
+  FILE *out;            //NULL if no trace
+  PipeTrace *pipeTrace; //NULL if no pipeline export
+} StagedSim;
+
+/************************** Functional Engine **************************/
+
+/** Copy the bytes of the instruction at pc of y86 into code[],
+ *  without touching the status of y86.  Bytes past the end of memory
+ *  are left 0.
+ */
+static void
+fetch_code(Y86 *y86, Address pc, Byte code[MAX_INSN_BYTES])
+{
+  const Address size = get_memory_size_y86(y86);
+  for (int i = 0; i < MAX_INSN_BYTES && pc + i < size; i++) {
+    code[i] = read_memory_byte_y86(y86, pc + i);
+  }
+}
+
+/** Return the length of the instruction in code[] if it is one which
+ *  execute_code() runs, else 0: halt, the atomics and invalid
+ *  instructions are left to step_ysim().
+ */
+static int
+code_length(const Byte code[MAX_INSN_BYTES])
+{
+  const Byte fn = get_nybble(code[0], 0);
+  const Byte regA = get_nybble(code[1], 1), regB = get_nybble(code[1], 0);
+  const bool isRegs = regA < REG_NONE && regB < REG_NONE;
+  switch (get_nybble(code[0], 1)) {
+  case NOP_CODE:
+    return fn == 0 ? 1 : 0;
+  case CMOVxx_CODE:
+    return fn <= GT_COND && isRegs ? 2 : 0;
+  case IRMOVQ_CODE:
+    return fn == 0 && regA == REG_NONE && regB < REG_NONE ? 10 : 0;
+  case RMMOVQ_CODE:
+  case MRMOVQ_CODE:
+    return fn == 0 && isRegs ? 10 : 0;
+  case OP1_CODE:
+    return fn <= 3 && isRegs ? 2 : 0;
+  case Jxx_CODE:
+    return fn <= GT_COND ? 9 : 0;
+  case CALL_CODE:
+    return fn == 0 ? 9 : 0;
+  case RET_CODE:
+    return fn == 0 ? 1 : 0;
+  case PUSHQ_CODE:
+  case POPQ_CODE:
+    return fn == 0 && regA < REG_NONE && regB == REG_NONE ? 2 : 0;
+  default:
+    return 0;
+  }
+}
+
+/** Return the little-endian word in code[] at offset. */
+static Word
+code_word(const Byte code[MAX_INSN_BYTES], int offset)
+{
+  Word word = 0;
+  for (int i = sizeof(Word) - 1; i >= 0; i--) {
+    word = (word << CHAR_BIT) | code[offset + i];
+  }
+  return word;
+}
+
+/** Return true iff the word at addr lies within the memory of y86. */
+static bool
+is_word_in_memory(const Y86 *y86, Address addr)
+{
+  const Address size = get_memory_size_y86(y86);
+  return size >= sizeof(Word) && addr <= size - sizeof(Word);
+}
+
+/** Execute the instruction of length bytes in code[], fetched from
+ *  the pc of y86, where length is its code_length().  Return false
+ *  without changing y86 if its data access would fault.
+ */
+static bool
+execute_code(Y86 *y86, const Byte code[MAX_INSN_BYTES], int length)
+{
+  const Byte fn = get_nybble(code[0], 0);
+  const Register regA = get_nybble(code[1], 1), regB = get_nybble(code[1], 0);
+  const Word rsp = read_register_y86(y86, REG_RSP);
+  Address next = read_pc_y86(y86) + length;
+  switch (get_nybble(code[0], 1)) {
+  case CMOVxx_CODE:
+    if (holds_cc(read_cc_y86(y86), fn)) {
+      write_register_y86(y86, regB, read_register_y86(y86, regA));
+    }
+    break;
+  case IRMOVQ_CODE:
+    write_register_y86(y86, regB, code_word(code, 2));
+    break;
+  case RMMOVQ_CODE: {
+    const Address addr = read_register_y86(y86, regB) + code_word(code, 2);
+    if (!is_word_in_memory(y86, addr)) return false;
+    write_memory_word_y86(y86, addr, read_register_y86(y86, regA));
+    break;
+  }
+  case MRMOVQ_CODE: {
+    const Address addr = read_register_y86(y86, regB) + code_word(code, 2);
+    if (!is_word_in_memory(y86, addr)) return false;
+    write_register_y86(y86, regA, read_memory_word_y86(y86, addr));
+    break;
+  }
+  case OP1_CODE: {
+    const Word opA = read_register_y86(y86, regA);
+    const Word opB = read_register_y86(y86, regB);
+    Word result;
+    Byte cc;
+    switch (fn) {
+    case 0: //addq
+      result = opA + opB;
+      cc = add_arith_cc(opA, opB, result);
+      break;
+    case 1: //subq
+      result = opB - opA;
+      cc = sub_arith_cc(opB, opA, result);
+      break;
+    case 2: //andq
+      result = opA & opB;
+      cc = logic_op_cc(result);
+      break;
+    default: //xorq
+      result = opA ^ opB;
+      cc = logic_op_cc(result);
+      break;
+    }
+    write_cc_y86(y86, cc);
+    write_register_y86(y86, regB, result);
+    break;
+  }
+  case Jxx_CODE:
+    if (holds_cc(read_cc_y86(y86), fn)) next = code_word(code, 1);
+    break;
+  case CALL_CODE:
+    if (!is_word_in_memory(y86, rsp - sizeof(Word))) return false;
+    write_register_y86(y86, REG_RSP, rsp - sizeof(Word));
+    write_memory_word_y86(y86, rsp - sizeof(Word), next);
+    next = code_word(code, 1);
+    break;
+  case RET_CODE:
+    if (!is_word_in_memory(y86, rsp)) return false;
+    next = read_memory_word_y86(y86, rsp);
+    write_register_y86(y86, REG_RSP, rsp + sizeof(Word));
+    break;
+  case PUSHQ_CODE: {
+    if (!is_word_in_memory(y86, rsp - sizeof(Word))) return false;
+    const Word value = read_register_y86(y86, regA);
+    write_register_y86(y86, REG_RSP, rsp - sizeof(Word));
+    write_memory_word_y86(y86, rsp - sizeof(Word), value);
+    break;
+  }
+  case POPQ_CODE:
+    if (!is_word_in_memory(y86, rsp)) return false;
+    write_register_y86(y86, regA, read_memory_word_y86(y86, rsp));
+    if (regA != REG_RSP) write_register_y86(y86, REG_RSP, rsp + sizeof(Word));
+    break;
+  default: //nop
+    break;
+  }
+  write_pc_y86(y86, next);
+  return true;
+}
+
+/** Decode the instruction at the pc of y86 into *record and execute
+ *  it.  An instruction which execute_code() runs is fetched once and
+ *  decoded from its bytes for both the timing model and its execution;
+ *  any other is decoded by decode_stall_sim() and, unless it cannot be
+ *  read, executed by step_ysim().
+ */
+static void
+step_engine(StagedSim *sim, InsnRecord *record)
+{
+  Y86 *y86 = sim->y86;
+  const Address pc = read_pc_y86(y86);
+  const Address size = get_memory_size_y86(y86);
+  if (pc < size && size - pc >= MAX_INSN_BYTES) {
+    fetch_code(y86, pc, record->code);
+    const int length = code_length(record->code);
+    if (length > 0) {
+      decode_code_stall_sim(y86, sim->config, record->code, &record->insn);
+      if (execute_code(y86, record->code, length)) return;
+    }
+  }
+  memset(record, 0, sizeof(*record));
+  decode_stall_sim(y86, sim->config, &record->insn);
+  record->isFault = read_status_y86(y86) != STATUS_AOK;
+  if (record->isFault) return;
+  if (sim->clocks) fetch_code(y86, pc, record->code);
+  step_ysim(y86);
+}
+
+/** Execute y86 until it stops, pushing a record of each instruction
+ *  onto the insns ring of sim.
+ */
+static void
+run_engine(StagedSim *sim)
+{
+  Y86 *y86 = sim->y86;
+  InsnRecord record;
+  do {
+    memset(&record, 0, sizeof(record));
+    step_engine(sim, &record);
+    record.isLast = read_status_y86(y86) != STATUS_AOK;
+    push_spsc_ring(sim->insns, &record);
+  } while (!record.isLast);
+}
+
+/*************************** Timing Model ******************************/
+
+/** StallSim subscriber which forwards each clock to the formatter. */
+static void
+forward_clock(void *ctx, const StallSimEvent *event)
+{
+  StagedSim *sim = ctx;
+  ClockRecord record = {
+    .cycle = event->cycle,
+    .pc = event->pc,
+    .isIssue = event->isIssue,
+    .reason = event->reason,
+  };
+  if (event->isIssue) memcpy(record.code, sim->current->code, MAX_INSN_BYTES);
+  push_spsc_ring(sim->clocks, &record);
+}
+
+/** Clock each instruction popped from the insns ring until it issues,
+ *  until the last.
+ */
+static void *
+run_timing(void *arg)
+{
+  StagedSim *sim = arg;
+  InsnRecord record;
+  sim->current = &record;
+  do {
+    pop_spsc_ring(sim->insns, &record);
+    bool isIssue;
+    do {
+      isIssue = clock_insn_stall_sim(sim->stallSim, &record.insn);
+      //like clock_stall_sim(), a fault ends the run on its first look
+    } while (!isIssue && !(record.isFault &&
+                           get_n_clocks_stall_sim(sim->stallSim) >
+                           sim->startupBubbles));
+    if (isIssue) sim->stats.nInsns++;
+  } while (!record.isLast);
+  sim->stats.nCycles = get_n_clocks_stall_sim(sim->stallSim);
+  for (int i = 0; i < N_STALL_REASONS; i++) {
+    sim->stats.nStalls[i] = get_n_stalls_stall_sim(sim->stallSim, i);
+  }
+  sim->stats.nForwards = get_n_forwards_stall_sim(sim->stallSim);
+  sim->stats.nTlbLookups = get_n_tlb_lookups_stall_sim(sim->stallSim);
+  sim->stats.nTlbMisses = get_n_tlb_misses_stall_sim(sim->stallSim);
+  if (sim->clocks) {
+    const ClockRecord end = { .isEnd = true };
+    push_spsc_ring(sim->clocks, &end);
+  }
+  return NULL;
+}
+
+/****************************** Formatter ******************************/
+
+/** Write a trace line for each record popped from the clocks ring
+ *  and add it to the pipeline export.
+ */
+static void *
+run_formatter(void *arg)
+{
+  StagedSim *sim = arg;
+  while (true) {
+    ClockRecord record;
+    pop_spsc_ring(sim->clocks, &record);
+    if (record.isEnd) break;
+    char buf[DIS_YAS_BUF_SIZE];
+    const char *text = record.isIssue ? dis_yas_code(record.code, buf) : "";
+    if (sim->out) {
+      fprintf(sim->out, "%4ld:\t%04lx\t%s\n", record.cycle, record.pc,
+              record.isIssue ? text : "bubble");
+    }
+    if (sim->pipeTrace) {
+      add_clock_pipe_trace(sim->pipeTrace, record.cycle, record.pc,
+                           record.reason, text);
+    }
+  }
+  return NULL;
+}
+
+/******************************* Running *******************************/
+
+/** Run y86 until it stops, timing it with a StallSim configured by
+ *  config, writing a trace of each clock on out unless it is NULL and
+ *  adding each clock to pipeTrace unless it is NULL.
+ */
+void
+run_staged_sim(Y86 *y86, const StallSimConfig *config, FILE *out,
+               PipeTrace *pipeTrace, StagedSimStats *stats)
+{
+  if (!config) config = &DEFAULT_STALL_SIM_CONFIG;
+  const bool isFormatting = out || pipeTrace;
+  StagedSim sim = {
+    .y86 = y86,
+    .stallSim = new_stall_sim(y86, config),
+    .config = config,
+    .startupBubbles = config->startupBubbles,
+    .insns = new_spsc_ring(sizeof(InsnRecord), N_RING_ELTS),
+    .clocks = isFormatting
+      ? new_spsc_ring(sizeof(ClockRecord), N_RING_ELTS) : NULL,
+    .out = out,
+    .pipeTrace = pipeTrace,
+  };
+  if (isFormatting) subscribe_stall_sim(sim.stallSim, forward_clock, &sim);
+  pthread_t timing, formatter;
+  if (pthread_create(&timing, NULL, run_timing, &sim) != 0 ||
+      (isFormatting &&
+       pthread_create(&formatter, NULL, run_formatter, &sim) != 0)) {
+    fatal("cannot create simulation thread\n");
+  }
+  run_engine(&sim);
+  pthread_join(timing, NULL);
+  if (isFormatting) pthread_join(formatter, NULL);
+  *stats = sim.stats;
+  if (sim.clocks) free_spsc_ring(sim.clocks);
+  free_spsc_ring(sim.insns);
+  free_stall_sim(sim.stallSim);
+}
+
+/** Write the totals in stats of a run under config on out: cycles,
+ *  instructions and CPI, bubbles per reason, if config has a store
+ *  buffer, the # of forwarded loads and, if it has a TLB, the # of
+ *  TLB lookups and misses.
+ */
+void
+print_stats_staged_sim(const StagedSimStats *stats,
+                       const StallSimConfig *config, FILE *out)
+{
+  fprintf(out, "%ld cycles, %ld instructions, CPI %.2f\n", stats->nCycles,
+          stats->nInsns,
+          stats->nInsns > 0 ? (double)stats->nCycles / stats->nInsns : 0.0);
+  fprintf(out, "bubbles:");
+  const char *sep = " ";
+  for (int i = NO_STALL + 1; i < N_STALL_REASONS; i++) {
+    if (i == TLB_STALL && config->tlbEntries == 0) continue;
+    fprintf(out, "%s%ld %s", sep, stats->nStalls[i],
+            get_reason_name_stall_sim(i));
+    sep = ", ";
+  }
+  fprintf(out, "\n");
+  if (config->storeBufferSize > 0) {
+    fprintf(out, "%ld loads forwarded from the store buffer\n",
+            stats->nForwards);
+  }
+  if (config->tlbEntries > 0) {
+    fprintf(out, "%ld TLB lookups, %ld misses\n", stats->nTlbLookups,
+            stats->nTlbMisses);
+  }
+}
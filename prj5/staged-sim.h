@@ -0,0 +1,47 @@
+#ifndef _STAGED_SIM_H
+#define _STAGED_SIM_H
+
+#include "pipe-trace.h"
+#include "stall-sim.h"
+
+#include <stdio.h>
+
+/** Pipelined host design for timing a single Y86: the functional
+ *  engine runs ahead on the calling thread, fetching and decoding each
+ *  instruction once, both for the timing model and to execute it
+ *  (halt, the atomics and faulting instructions are left to
+ *  step_ysim()), and passes a record of each executed instruction
+ *  through a lock-free ring to a StallSim on a second thread.  When a trace or pipeline export is wanted, the
+ *  record also carries the instruction bytes, and the StallSim passes
+ *  a record of each clock through a second ring to a formatter on a
+ *  third thread, which disassembles the bytes.  Results are identical
+ *  to clocking a StallSim and stepping the Y86 in one loop.
+ */
+
+typedef struct {
+  long nCycles;         /** # of clocks */
+  long nInsns;          /** # of instructions issued */
+  long nStalls[N_STALL_REASONS];  /** # of clocks stalled per reason */
+  long nForwards;       /** # of loads forwarded from buffered stores */
+  long nTlbLookups;     /** # of TLB lookups */
+  long nTlbMisses;      /** # of TLB lookups which missed */
+} StagedSimStats;
+
+/** Run y86, which must hold a loaded program, until it stops, timing
+ *  it with a StallSim configured by config (default if NULL).  If out
+ *  is not NULL, write a line on out for each clock giving its #, the
+ *  pc and the instruction issued or bubble.  If pipeTrace is not NULL,
+ *  add each clock to it.  Set *stats to the totals of the run.
+ */
+void run_staged_sim(Y86 *y86, const StallSimConfig *config, FILE *out,
+                    PipeTrace *pipeTrace, StagedSimStats *stats);
+
+/** Write the totals in stats of a run under config on out: cycles,
+ *  instructions and CPI, bubbles per reason, if config has a store
+ *  buffer, the # of forwarded loads and, if it has a TLB, the # of
+ *  TLB lookups and misses.
+ */
+void print_stats_staged_sim(const StagedSimStats *stats,
+                            const StallSimConfig *config, FILE *out);
+
+#endif //ifndef _STAGED_SIM_H
@@ -1,56 +1,212 @@
 #include "stall-sim.h"
 
+#include "dis-yas.h"
+#include "mem-access.h"
+#include "tlb.h"
+
 #include "y86-util.h"
 
 #include "errors.h"
 #include "memalloc.h"
 
 #include <assert.h>
+#include <stddef.h>
+#include <string.h>
 
 enum {
-  MAX_DATA_BUBBLES = 3,  /** max # of bubbles due to data hazards */
-  JUMP_BUBBLES = 2,      /** # of bubbles for cond jump op */
-  RET_BUBBLES = 3,       /** # of bubbles for return op */
-  MAX_REG_WRITE = 2      /** max # of registers written per clock cycle */
+  MAX_SUBSCRIBERS = 8,   /** max # of event subscribers */
+  MAX_PARAM = MAX_STALL_SIM_BUBBLES,  /** max value of most parameters */
+};
+
+const StallSimConfig DEFAULT_STALL_SIM_CONFIG = {
+  .startupBubbles = 4,
+  .jumpBubbles = 2,
+  .retBubbles = 3,
+  .maxDataBubbles = 3,
+  .storeBufferSize = 0,
+  .commitClocks = 3,
+  .isForwarding = 1,
+  .tlbEntries = 0,
+  .tlbWays = 4,
+  .pageBits = 12,
+  .walkClocks = 8,
 };
 
+static const struct {
+  const char *name;
+  size_t offset;
+  int min, max;         //range of values
+} params[N_STALL_SIM_PARAMS] = {
+  { "startup", offsetof(StallSimConfig, startupBubbles), 0, MAX_PARAM },
+  { "jump", offsetof(StallSimConfig, jumpBubbles), 0, MAX_PARAM },
+  { "ret", offsetof(StallSimConfig, retBubbles), 0, MAX_PARAM },
+  { "data", offsetof(StallSimConfig, maxDataBubbles), 0, MAX_PARAM },
+  { "stores", offsetof(StallSimConfig, storeBufferSize), 0, MAX_PARAM },
+  { "commit", offsetof(StallSimConfig, commitClocks), 0, MAX_PARAM },
+  { "forward", offsetof(StallSimConfig, isForwarding), 0, 1 },
+  { "tlb", offsetof(StallSimConfig, tlbEntries), 0, MAX_PARAM },
+  { "ways", offsetof(StallSimConfig, tlbWays), 0, MAX_PARAM },
+  { "page", offsetof(StallSimConfig, pageBits), MIN_PAGE_BITS, MAX_PAGE_BITS },
+  { "walk", offsetof(StallSimConfig, walkClocks), 0, MAX_PARAM },
+};
+
+static const char *reasonNames[N_STALL_REASONS] = {
+  "issue", "startup", "jump", "ret", "data", "memory", "store-buffer",
+  "tlb",
+};
+
+/** A store waiting in the store buffer */
+typedef struct {
+  Address addr;         //address of the word stored
+  long commitClock;     //clock at which it commits
+} BufferedStore;
+
 struct StallSimStruct {
   Y86 *y86;
-  int clock;
+  Address memSize;  //memory size of y86
+  StallSimConfig config;
+  long clock;
   //int read[6];
-  int write[6];
+  int *write;     //registers written in each of the last
+                  //config.maxDataBubbles clocks
   int regClock;
   int stallTimer; //indicates how many stalls in a row
   bool stalling; //indicates if y86 was stalled last clock cycle
+  BufferedStore *stores; //[config.storeBufferSize] circular, in issue order
+  int storeHead;         //index of oldest buffered store
+  int nStores;           //# of buffered stores
+  long nStalls[N_STALL_REASONS];
+  long nForwards;
+  Tlb *tlb;              //NULL if translation is not timed
+  int walkTimer;         //clocks left in the current page table walk
+  int nSubscribers;
+  struct {
+    StallSimEventFn *fn;
+    void *ctx;
+  } subscribers[MAX_SUBSCRIBERS];
 };
 
 
 /********************** Allocation / Deallocation **********************/
 
-/** Create a new pipeline stall simulator for y86. */
+/** Create a new pipeline stall simulator for y86.  If config is
+ *  NULL, use DEFAULT_STALL_SIM_CONFIG.
+ */
 StallSim *
-new_stall_sim(Y86 *y86)
+new_stall_sim(Y86 *y86, const StallSimConfig *config)
 {
   StallSim *sim = malloc(sizeof(struct StallSimStruct));
+  if (!sim) fatal("out of memory\n");
   sim->y86 = y86;
+  sim->memSize = get_memory_size_y86(y86);
+  sim->write = NULL;
+  sim->stores = NULL;
+  sim->tlb = NULL;
+  reset_stall_sim(sim, config);
+  return sim;
+}
+
+/** Return stallSim to the state of a new StallSim for its Y86 with
+ *  configuration config (default if NULL), without subscribers.  Its
+ *  buffers are reused when they are large enough.
+ */
+void
+reset_stall_sim(StallSim *sim, const StallSimConfig *config)
+{
+  if (!config) config = &DEFAULT_STALL_SIM_CONFIG;
+  const int nWrite = config->maxDataBubbles * MAX_REG_WRITE;
+  int *write = realloc(sim->write, (nWrite + 1) * sizeof(int));
+  BufferedStore *stores = realloc(sim->stores,
+    (config->storeBufferSize + 1) * sizeof(BufferedStore));
+  if (!write || !stores) fatal("out of memory\n");
+  sim->config = *config;
+  sim->write = write;
   sim->clock = 0;
   sim->stallTimer=0;
   sim->stalling=false;
   sim->regClock = 0;
-  for(int i = 0; i < 6; i++){
+  sim->stores = stores;
+  sim->storeHead = sim->nStores = 0;
+  memset(sim->nStalls, 0, sizeof(sim->nStalls));
+  sim->nForwards = 0;
+  if (sim->tlb) free_tlb(sim->tlb);
+  sim->tlb = (config->tlbEntries > 0)
+    ? new_tlb(config->tlbEntries, config->tlbWays, config->pageBits,
+              sim->memSize)
+    : NULL;
+  sim->walkTimer = 0;
+  sim->nSubscribers = 0;
+  for(int i = 0; i < nWrite; i++){
 	  //sim->read[i]=-1;
 	  sim->write[i]=-1;
   }
-  return sim;
 }
 
 /** Free all resources allocated by new_pipe_sim() in stallSim. */
 void
 free_stall_sim(StallSim *stallSim)
 {
+  free(stallSim->write);
+  free(stallSim->stores);
+  if (stallSim->tlb) free_tlb(stallSim->tlb);
   free(stallSim);
 }
 
+/************************** Configuration ******************************/
+
+/** Return the name of parameter i of StallSimConfig. */
+const char *
+get_param_name_stall_sim(int i)
+{
+  assert(0 <= i && i < N_STALL_SIM_PARAMS);
+  return params[i].name;
+}
+
+/** Return the value of parameter i of config. */
+int
+get_param_stall_sim(const StallSimConfig *config, int i)
+{
+  assert(0 <= i && i < N_STALL_SIM_PARAMS);
+  return *(const int *)((const char *)config + params[i].offset);
+}
+
+/** Set the parameter of config named name to value.  Return false
+ *  if there is no such parameter or value is out of range.
+ */
+bool
+set_param_stall_sim(StallSimConfig *config, const char *name, int value)
+{
+  for (int i = 0; i < N_STALL_SIM_PARAMS; i++) {
+    if (strcmp(name, params[i].name) == 0) {
+      if (value < params[i].min || value > params[i].max) return false;
+      *(int *)((char *)config + params[i].offset) = value;
+      return true;
+    }
+  }
+  return false;
+}
+
+/** Return true iff the parameters of config combine: its TLB, if any,
+ *  is fully associative (tlbWays 0 or at least tlbEntries) or its
+ *  entries are a whole # of sets of tlbWays, so that new_tlb() uses
+ *  all of them.
+ */
+bool
+is_valid_config_stall_sim(const StallSimConfig *config)
+{
+  const int nEntries = config->tlbEntries, nWays = config->tlbWays;
+  return nEntries == 0 || nWays == 0 || nWays >= nEntries ||
+    nEntries % nWays == 0;
+}
+
+/** Return a short name for reason. */
+const char *
+get_reason_name_stall_sim(StallReason reason)
+{
+  assert(0 <= reason && reason < N_STALL_REASONS);
+  return reasonNames[reason];
+}
+
 /*void
 insert_read(int reg1, int reg2, StallSim *stallSim){
 	int regClock = stallSim->regClock;
@@ -75,21 +231,9 @@ insert_read(int reg1, int reg2, StallSim *stallSim){
 void
 insert_written(int reg1, int reg2, StallSim *stallSim){
 	int regClock = stallSim->regClock;
-	switch(regClock){
-		case 0:
-			stallSim->write[0] = reg1;
-			stallSim->write[1] = reg2;
-			break;
-		case 1:
-			stallSim->write[2] = reg1;
-			stallSim->write[3] = reg2;
-			break;
-		case 2:
-			stallSim->write[4] = reg1;
-			stallSim->write[5] = reg2;
-			break;
-		default:
-			break;
+	if(regClock < stallSim->config.maxDataBubbles){
+		stallSim->write[regClock*MAX_REG_WRITE] = reg1;
+		stallSim->write[regClock*MAX_REG_WRITE + 1] = reg2;
 	}
 	/*printf("write is: ");
 	for(int i = 0; i<6; i++){
@@ -98,28 +242,43 @@ insert_written(int reg1, int reg2, StallSim *stallSim){
 	printf("\n");*/
 }
 
-void
-check_reg(Byte opcode, StallSim *stallSim){
-	Address pc = read_pc_y86(stallSim->y86);
+/** Advance to the next slot of the circular write[] window. */
+static void
+next_reg_clock(StallSim *stallSim){
+	if(stallSim->regClock < stallSim->config.maxDataBubbles - 1){
+		stallSim->regClock++;
+	} else {
+		stallSim->regClock=0;
+	}
+}
+
+/** Return true iff an instruction with base op opcode has a register
+ *  byte.
+ */
+static bool
+has_regs_byte(Byte opcode){
+	return (opcode >= 2 && opcode <= 6) || opcode == 10 || opcode == 11;
+}
+
+/** Set regs[] to the registers written by an instruction with base
+ *  op opcode and register byte regsByte (-1 for none).
+ */
+static void
+get_written_regs(Byte opcode, Byte regsByte, int regs[MAX_REG_WRITE]){
 	int reg1 = -1;
 	int reg2 = -1;
 	switch(opcode){ //check register being written
 		case 2: //rrmov and cmov
-			reg1 = read_memory_byte_y86(stallSim->y86, pc+1);
-			if(read_status_y86(stallSim->y86) != STATUS_AOK) return;
-			reg1 = (reg1 & 0xF);
+			reg1 = (regsByte & 0xF);
 			break;
 		case 3: //irmov
-			reg1 = read_memory_byte_y86(stallSim->y86, pc+1);
-			reg1 = (reg1 & 0xF);
+			reg1 = (regsByte & 0xF);
 			break;
 		case 5: //mrmov
-			reg1 = read_memory_byte_y86(stallSim->y86, pc+1);
-			reg1 = ((reg1 >> 4) & 0xF);
+			reg1 = ((regsByte >> 4) & 0xF);
 			break;
 		case 6: //op
-			reg1 = read_memory_byte_y86(stallSim->y86, pc+1);
-			reg1 = (reg1 & 0xF);
+			reg1 = (regsByte & 0xF);
 			break;
 		case 8: //call
 			reg1 = 4;
@@ -131,19 +290,20 @@ check_reg(Byte opcode, StallSim *stallSim){
 			reg1 = 4;
 			break;
 		case 11: //pop
-			reg1 = read_memory_byte_y86(stallSim->y86, pc+1);
-			reg1 = ((reg1 >> 4) & 0xF);
+			reg1 = ((regsByte >> 4) & 0xF);
 			reg2 = 4;
 			break;
 		default:
 			break;
 	}
-	insert_written(reg1, reg2, stallSim);
-	if(stallSim->regClock != 2){
-		stallSim->regClock++;
-	} else {
-		stallSim->regClock=0;
-	}
+	regs[0] = reg1;
+	regs[1] = reg2;
+}
+
+void
+check_reg(const int regs[MAX_REG_WRITE], StallSim *stallSim){
+	insert_written(regs[0], regs[1], stallSim);
+	next_reg_clock(stallSim);
 }
 
 Byte
@@ -155,30 +315,26 @@ read_opcode(Y86 *y86){
 	return opcode;
 }
 
-//return true if data hazard detected, return false if no data hazards
-bool
-check_data_hazard(Byte opcode, StallSim *stallSim){
+/** Set regs[] to the registers read by an instruction with base op
+ *  opcode and register byte regsByte (-1 for none).
+ */
+static void
+get_read_regs(Byte opcode, Byte regsByte, int regs[MAX_REG_READ]){
 	int reg1 = -1; //registers read by current instruction
 	int reg2 = -1;
-	Address pc = read_pc_y86(stallSim->y86);
 	switch(opcode){
 		case 2: //rrmov and cmov
-			reg1 = read_memory_byte_y86(stallSim->y86, pc+1);
-			reg1 = ((reg1 >> 4) & 0xF);
+			reg1 = ((regsByte >> 4) & 0xF);
 			break;
 		case 4: //rmmov
-			reg1 = read_memory_byte_y86(stallSim->y86, pc+1);
-			reg1 = ((reg1 >> 4) & 0xF);
+			reg1 = ((regsByte >> 4) & 0xF);
 			break;
 		case 5: //mrmov
-			reg1 = read_memory_byte_y86(stallSim->y86, pc+1);
-			reg1 = (reg1 & 0xF);
+			reg1 = (regsByte & 0xF);
 			break;
 		case 6: //op
-			reg1 = read_memory_byte_y86(stallSim->y86, pc+1);
-			reg2 = reg1;
-			reg1 = ((reg1 >> 4) & 0xF);
-			reg2 = (reg2 & 0xF);
+			reg1 = ((regsByte >> 4) & 0xF);
+			reg2 = (regsByte & 0xF);
 			break;
 		case 8: //call
 			reg1 = 4;
@@ -186,8 +342,7 @@ check_data_hazard(Byte opcode, StallSim *stallSim){
 		/*case 9: //ret
 			break;*/
 		case 10: //push
-			reg1 = read_memory_byte_y86(stallSim->y86, pc+1);
-			reg1 = ((reg1 >> 4) & 0xF);
+			reg1 = ((regsByte >> 4) & 0xF);
 			reg2 = 4;
 			break;
 		case 11: //pop
@@ -196,7 +351,16 @@ check_data_hazard(Byte opcode, StallSim *stallSim){
 		default:
 			break;
 	}
-	for(int i=0; i<6; i++){
+	regs[0] = reg1;
+	regs[1] = reg2;
+}
+
+//return true if data hazard detected, return false if no data hazards
+bool
+check_data_hazard(const int regs[MAX_REG_READ], StallSim *stallSim){
+	const int reg1 = regs[0], reg2 = regs[1];
+	const int nWrite = stallSim->config.maxDataBubbles * MAX_REG_WRITE;
+	for(int i=0; i<nWrite; i++){
 		int written = stallSim->write[i];
 		//printf("written is %d\n", written);
 		if(written != -1){
@@ -209,39 +373,227 @@ check_data_hazard(Byte opcode, StallSim *stallSim){
 	}
 	return false;
 }
+/************************* Memory Dependences **************************/
+
+/** Commit the buffered stores of stallSim whose time has come. */
+static void
+commit_stores(StallSim *stallSim)
+{
+  while (stallSim->nStores > 0 &&
+         stallSim->stores[stallSim->storeHead].commitClock <= stallSim->clock) {
+    stallSim->storeHead =
+      (stallSim->storeHead + 1) % stallSim->config.storeBufferSize;
+    stallSim->nStores--;
+  }
+}
+
+/** Return true iff a buffered store of stallSim overlaps the word at
+ *  addr.
+ */
+static bool
+is_buffered(const StallSim *stallSim, Address addr)
+{
+  const int size = stallSim->config.storeBufferSize;
+  for (int i = 0; i < stallSim->nStores; i++) {
+    const Address store = stallSim->stores[(stallSim->storeHead + i) % size].addr;
+    if (store < addr + sizeof(Word) && addr < store + sizeof(Word)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/** Return the reason insn must stall on memory in stallSim if it were
+ *  to issue now; NO_STALL if it can issue.  A load which can issue
+ *  only by forwarding is counted as a forward.
+ */
+static StallReason
+check_memory_hazard(const StallSimInsn *insn, StallSim *stallSim)
+{
+  if (!insn->isMemAccess) return NO_STALL;
+  if (insn->isStore) {
+    return (stallSim->nStores == stallSim->config.storeBufferSize)
+      ? STORE_BUFFER_STALL : NO_STALL;
+  }
+  if (!is_buffered(stallSim, insn->memAddr)) return NO_STALL;
+  if (!stallSim->config.isForwarding) return MEMORY_STALL;
+  stallSim->nForwards++;
+  return NO_STALL;
+}
+
+/** Buffer the store of insn, which issues in the current clock. */
+static void
+buffer_store(const StallSimInsn *insn, StallSim *stallSim)
+{
+  const int size = stallSim->config.storeBufferSize;
+  assert(stallSim->nStores < size);
+  BufferedStore *store =
+    &stallSim->stores[(stallSim->storeHead + stallSim->nStores) % size];
+  store->addr = insn->memAddr;
+  store->commitClock = stallSim->clock + 1 + stallSim->config.commitClocks;
+  stallSim->nStores++;
+}
+
+/************************* Address Translation *************************/
+
+/** Return TLB_STALL if insn must wait in stallSim for a page table
+ *  walk before it issues; NO_STALL if it can issue.  A walk covers
+ *  the misses of both the fetch and the data address, and the
+ *  instruction issues at its end without another lookup.
+ */
+static StallReason
+check_translation(const StallSimInsn *insn, StallSim *stallSim)
+{
+  if (stallSim->walkTimer > 0) {
+    return (--stallSim->walkTimer > 0) ? TLB_STALL : NO_STALL;
+  }
+  int nMisses = !lookup_tlb(stallSim->tlb, insn->pc);
+  if (insn->isMemAccess) nMisses += !lookup_tlb(stallSim->tlb, insn->memAddr);
+  stallSim->walkTimer = nMisses * get_n_levels_tlb(stallSim->tlb) *
+    stallSim->config.walkClocks;
+  return (stallSim->walkTimer > 0) ? TLB_STALL : NO_STALL;
+}
+
+/**************************** Events *********************************/
+
+/** Call fn(ctx, event) with the event of each later clock of
+ *  stallSim.  Return false if stallSim already has the maximum # of
+ *  subscribers.
+ */
+bool
+subscribe_stall_sim(StallSim *stallSim, StallSimEventFn *fn, void *ctx)
+{
+  if (stallSim->nSubscribers == MAX_SUBSCRIBERS) return false;
+  stallSim->subscribers[stallSim->nSubscribers].fn = fn;
+  stallSim->subscribers[stallSim->nSubscribers].ctx = ctx;
+  stallSim->nSubscribers++;
+  return true;
+}
+
+/** Deliver the event for the clock just applied to stallSim, in which
+ *  insn issued or was stalled for reason.
+ */
+static void
+publish_event(StallSim *stallSim, const StallSimInsn *insn, bool isIssue,
+              StallReason reason)
+{
+  StallSimEvent event = {
+    .cycle = stallSim->clock,
+    .pc = insn->pc,
+    .isIssue = isIssue,
+    .reason = reason,
+    .regsRead = { -1, -1 },
+    .regsWritten = { -1, -1 },
+  };
+  //do not read a register byte which lies past the end of memory
+  if (reason != STARTUP_STALL && event.pc + 1 < stallSim->memSize) {
+    memcpy(event.regsRead, insn->regsRead, sizeof(event.regsRead));
+    memcpy(event.regsWritten, insn->regsWritten, sizeof(event.regsWritten));
+  }
+  for (int i = 0; i < stallSim->nSubscribers; i++) {
+    stallSim->subscribers[i].fn(stallSim->subscribers[i].ctx, &event);
+  }
+}
+
+/** Decode the instruction at the pc of y86 into *insn for a StallSim
+ *  configured by config, setting the status of y86 to STATUS_ADR if
+ *  it cannot be read.  Its data access is only decoded if config
+ *  times memory dependences or address translation.
+ */
+void
+decode_stall_sim(Y86 *y86, const StallSimConfig *config, StallSimInsn *insn)
+{
+  insn->pc = read_pc_y86(y86);
+  insn->opcode = read_opcode(y86);
+  const Byte regsByte = has_regs_byte(insn->opcode)
+    ? read_memory_byte_y86(y86, insn->pc + 1) : 0;
+  get_read_regs(insn->opcode, regsByte, insn->regsRead);
+  get_written_regs(insn->opcode, regsByte, insn->regsWritten);
+  //a cmov whose register byte cannot be read writes no register
+  if (insn->opcode == 2 && read_status_y86(y86) != STATUS_AOK) {
+    insn->regsWritten[0] = -1;
+  }
+  insn->isMemAccess = (config->storeBufferSize > 0 || config->tlbEntries > 0)
+    && next_data_access(y86, &insn->memAddr, &insn->isStore);
+}
+
+/** Like decode_stall_sim(), but decode the instruction from code[],
+ *  which holds all of its bytes as fetched from the pc of y86; only
+ *  the pc and registers of y86 are read.
+ */
+void
+decode_code_stall_sim(Y86 *y86, const StallSimConfig *config,
+                      const Byte code[], StallSimInsn *insn)
+{
+  insn->pc = read_pc_y86(y86);
+  insn->opcode = (code[0] >> 4) & 0xF;
+  const Byte regsByte = has_regs_byte(insn->opcode) ? code[1] : 0;
+  get_read_regs(insn->opcode, regsByte, insn->regsRead);
+  get_written_regs(insn->opcode, regsByte, insn->regsWritten);
+  insn->isMemAccess = (config->storeBufferSize > 0 || config->tlbEntries > 0)
+    && code_data_access(y86, code, MAX_INSN_BYTES, &insn->memAddr,
+                        &insn->isStore);
+}
+
 /** Apply next pipeline clock to stallSim.  Return true if
  *  processor can proceed, false if pipeline is stalled.
  *
  * The pipeline will stall under the following circumstances:
  *
- * Exactly 4 clock cycles on startup to allow the pipeline to fill up.
+ * Exactly startupBubbles clock cycles on startup to allow the pipeline
+ * to fill up.
+ *
+ * Exactly jumpBubbles clock cyclies after execution of a conditional
+ * jump.
  *
- * Exactly 2 clock cyclies after execution of a conditional jump.
+ * Exactly retBubbles clock cycles after execution of a return.
  *
- * Exactly 3 clock cycles after execution of a return.
+ * Upto maxDataBubbles clock cycles when attempting to read a register
+ * which was written by any of upto maxDataBubbles preceeding
+ * instructions.
  *
- * Upto 3 clock cycles when attempting to read a register which was
- * written by any of upto 3 preceeding instructions.
+ * The numbers are those of the config given to new_stall_sim().
  */
 bool
 clock_stall_sim(StallSim *stallSim)
 {
-  //Byte opcode = read_opcode(stallSim->y86);
-  //printf("opcode is %d\n", opcode);
-  //check_reg(opcode, stallSim); //checks which registers are being written by current instruction
+  StallSimInsn insn = {
+    .pc = read_pc_y86(stallSim->y86),
+    .opcode = -1,
+    .regsRead = { -1, -1 },
+    .regsWritten = { -1, -1 },
+    .isMemAccess = false,
+  };
+  //the instruction is not looked at on startup
+  if (stallSim->clock >= stallSim->config.startupBubbles) {
+    decode_stall_sim(stallSim->y86, &stallSim->config, &insn);
+  }
+  return clock_insn_stall_sim(stallSim, &insn);
+}
+
+/** Apply next pipeline clock to stallSim for insn.  Return true if
+ *  insn issues, false if the pipeline is stalled.
+ */
+bool
+clock_insn_stall_sim(StallSim *stallSim, const StallSimInsn *insn)
+{
+  static const int noRegs[MAX_REG_WRITE] = { -1, -1 };
   Byte opcode = -1;
+  const int *regsRead = noRegs, *regsWritten = noRegs;
   bool stall = true; //signals stall if needed
-  int clock = stallSim->clock;
-  if(clock < 4){ //stall on startup
+  const StallSimConfig *config = &stallSim->config;
+  long clock = stallSim->clock;
+  if(clock < config->startupBubbles){ //stall on startup
 	  stall = false;
   } else {
-	  opcode = read_opcode(stallSim->y86);
-	  //printf("opcode is %d\n", opcode);
-	 // check_reg(opcode, stallSim);
+	  opcode = insn->opcode;
+	  regsRead = insn->regsRead;
+	  regsWritten = insn->regsWritten;
   }
-  if(opcode == Jxx_CODE){ //stall after conditional jump
+  const bool isHazard = check_data_hazard(regsRead, stallSim);
+  if(opcode == Jxx_CODE && config->jumpBubbles > 0){ //stall after conditional jump
 	  if(stallSim->stalling == false){ 
-		  stallSim->stallTimer = 2;
+		  stallSim->stallTimer = config->jumpBubbles;
 		  stallSim->stalling = true;
 		  stall = false;
 	  } else {
@@ -255,9 +607,9 @@ clock_stall_sim(StallSim *stallSim)
 		  }
 	  }
   }
-  else if(opcode == RET_CODE){ //stall after return
+  else if(opcode == RET_CODE && config->retBubbles > 0){ //stall after return
 	  if(stallSim->stalling == false){
-		  stallSim->stallTimer = 3;
+		  stallSim->stallTimer = config->retBubbles;
 		  stallSim->stalling = true;
 		  stall = false;
 	  } else {
@@ -271,24 +623,168 @@ clock_stall_sim(StallSim *stallSim)
 		  }
 	  }
   }
-  else if(check_data_hazard(opcode, stallSim)){
+  else if(isHazard){
   	stall = false;
   }
+  StallReason memoryReason = NO_STALL;
+  if(clock >= config->startupBubbles){
+	  if(config->storeBufferSize > 0){
+		  commit_stores(stallSim);
+	  }
+	  if(stall && stallSim->tlb){
+		  memoryReason = check_translation(insn, stallSim);
+	  }
+	  if(stall && memoryReason == NO_STALL && config->storeBufferSize > 0){
+		  memoryReason = check_memory_hazard(insn, stallSim);
+	  }
+	  if(memoryReason != NO_STALL){
+		  stall = false;
+		  if((opcode == RET_CODE && config->retBubbles > 0) ||
+		     (opcode == Jxx_CODE && config->jumpBubbles > 0)){
+			  //issue as soon as the access can
+			  stallSim->stalling = true;
+			  stallSim->stallTimer = 1;
+		  }
+	  } else if(stall && config->storeBufferSize > 0 &&
+	            insn->isMemAccess && insn->isStore){
+		  buffer_store(insn, stallSim);
+	  }
+  }
 
-  if(clock >= 4){
-	  if(!check_data_hazard(opcode, stallSim)){
-	  	check_reg(opcode, stallSim);
+  if(clock >= config->startupBubbles){
+	  if(!isHazard && memoryReason == NO_STALL){
+	  	check_reg(regsWritten, stallSim);
 	  } else{
 		  insert_written(-1, -1, stallSim);
-		  if(stallSim->regClock != 2){
-			  stallSim->regClock++;
-		  } else{
-			  stallSim->regClock=0;
-		  }
+		  next_reg_clock(stallSim);
 	  }
   }
+  StallReason reason = NO_STALL;
+  if(clock < config->startupBubbles){
+	  reason = STARTUP_STALL;
+  } else if(memoryReason != NO_STALL){
+	  reason = memoryReason;
+  } else if(!stall){
+	  reason = (opcode == Jxx_CODE) ? JUMP_STALL
+		  : (opcode == RET_CODE) ? RET_STALL : DATA_STALL;
+  }
+  stallSim->nStalls[reason]++;
+  if(stallSim->nSubscribers > 0){ //no cost without subscribers
+	  publish_event(stallSim, insn, stall, reason);
+  }
   clock++; //increment clock
   stallSim->clock = clock;
   //printf("stalling is %d\n", stallSim->stalling);
   return stall;
 }
+
+/** Return the # of clocks applied to stallSim. */
+long
+get_n_clocks_stall_sim(const StallSim *stallSim)
+{
+  return stallSim->clock;
+}
+
+/** Return the # of clocks of stallSim which stalled for reason. */
+long
+get_n_stalls_stall_sim(const StallSim *stallSim, StallReason reason)
+{
+  assert(0 <= reason && reason < N_STALL_REASONS);
+  return stallSim->nStalls[reason];
+}
+
+/** Return the # of loads forwarded from buffered stores in stallSim. */
+long
+get_n_forwards_stall_sim(const StallSim *stallSim)
+{
+  return stallSim->nForwards;
+}
+
+/** Return the # of TLB lookups in stallSim. */
+long
+get_n_tlb_lookups_stall_sim(const StallSim *stallSim)
+{
+  return stallSim->tlb ? get_n_lookups_tlb(stallSim->tlb) : 0;
+}
+
+/** Return the # of TLB lookups in stallSim which missed. */
+long
+get_n_tlb_misses_stall_sim(const StallSim *stallSim)
+{
+  return stallSim->tlb ? get_n_misses_tlb(stallSim->tlb) : 0;
+}
+
+/**************************** Repetition *******************************/
+
+/** Copy the write[] window of stallSim into window[], oldest slot
+ *  (the next to be written) first.
+ */
+static void
+get_window(const StallSim *stallSim, int window[])
+{
+  const int nSlots = stallSim->config.maxDataBubbles;
+  for (int i = 0; i < nSlots; i++) {
+    const int slot = (stallSim->regClock + i) % nSlots;
+    memcpy(&window[i * MAX_REG_WRITE], &stallSim->write[slot * MAX_REG_WRITE],
+           MAX_REG_WRITE * sizeof(int));
+  }
+}
+
+/** Record in *mark the state of stallSim before its next clock.
+ *  Return false if later clocks depend on more than that state, so
+ *  that stallSim cannot be repeated from the mark: during startup,
+ *  with a store buffer or TLB, or with subscribers.
+ */
+bool
+mark_stall_sim(const StallSim *stallSim, StallSimMark *mark)
+{
+  if (stallSim->clock < stallSim->config.startupBubbles ||
+      stallSim->config.storeBufferSize > 0 || stallSim->tlb ||
+      stallSim->nSubscribers > 0) {
+    return false;
+  }
+  mark->clock = stallSim->clock;
+  memcpy(mark->nStalls, stallSim->nStalls, sizeof(mark->nStalls));
+  mark->stallTimer = stallSim->stallTimer;
+  mark->stalling = stallSim->stalling;
+  get_window(stallSim, mark->window);
+  return true;
+}
+
+/** Return true iff stallSim is in the state recorded by *mark, apart
+ *  from its clock and totals.
+ */
+bool
+is_at_mark_stall_sim(const StallSim *stallSim, const StallSimMark *mark)
+{
+  int window[MAX_STALL_SIM_BUBBLES * MAX_REG_WRITE];
+  get_window(stallSim, window);
+  return stallSim->stallTimer == mark->stallTimer &&
+    stallSim->stalling == mark->stalling &&
+    memcmp(window, mark->window,
+           stallSim->config.maxDataBubbles * MAX_REG_WRITE * sizeof(int)) == 0;
+}
+
+/** Advance stallSim, which must be at *mark (see is_at_mark_stall_sim()),
+ *  as if the clocks applied since the mark were applied n more times
+ *  to the same instructions.
+ */
+void
+repeat_stall_sim(StallSim *stallSim, const StallSimMark *mark, long n)
+{
+  const long nClocks = n * (stallSim->clock - mark->clock);
+  for (int i = 0; i < N_STALL_REASONS; i++) {
+    stallSim->nStalls[i] += n * (stallSim->nStalls[i] - mark->nStalls[i]);
+  }
+  stallSim->clock += nClocks;
+  //each clock after startup advances the window by one slot
+  const int nSlots = stallSim->config.maxDataBubbles;
+  if (nSlots > 0) {
+    stallSim->regClock = (stallSim->regClock + nClocks) % nSlots;
+    for (int i = 0; i < nSlots; i++) {
+      const int slot = (stallSim->regClock + i) % nSlots;
+      memcpy(&stallSim->write[slot * MAX_REG_WRITE],
+             &mark->window[i * MAX_REG_WRITE], MAX_REG_WRITE * sizeof(int));
+    }
+  }
+}
@@ -7,12 +7,130 @@
  */
 typedef struct StallSimStruct StallSim;
 
-/** Create a new pipeline stall simulator for y86. */
-StallSim *new_stall_sim(Y86 *y86);
+/** Pipeline timing parameters. */
+typedef struct {
+  int startupBubbles;  /** # of bubbles on startup to fill the pipeline */
+  int jumpBubbles;     /** # of bubbles for cond jump op */
+  int retBubbles;      /** # of bubbles for return op */
+  int maxDataBubbles;  /** max # of bubbles due to data hazards: writes
+                        *  by this many preceding clocks are tracked */
+  int storeBufferSize; /** # of stores buffered until they commit; 0
+                        *  if memory dependences are not tracked */
+  int commitClocks;    /** # of clocks a store is buffered */
+  int isForwarding;    /** non-zero if loads of a buffered store take
+                        *  its value; else they wait for its commit */
+  int tlbEntries;      /** # of TLB entries; 0 if address translation
+                        *  is not timed */
+  int tlbWays;         /** TLB associativity; 0 for fully associative */
+  int pageBits;        /** log2 of the page size in bytes */
+  int walkClocks;      /** # of clocks per page table level of a walk
+                        *  after a TLB miss */
+} StallSimConfig;
+
+/** Default configuration: 4 startup bubbles, 2 jump bubbles, 3 ret
+ *  bubbles and up to 3 data hazard bubbles.  Memory dependences are
+ *  not tracked, but setting storeBufferSize tracks them with 3-clock
+ *  commits and forwarding.  Address translation is not timed, but
+ *  setting tlbEntries times it with a 4-way TLB, 4 KB pages and walks
+ *  of 8 clocks per level.
+ */
+extern const StallSimConfig DEFAULT_STALL_SIM_CONFIG;
+
+enum {
+  N_STALL_SIM_PARAMS = 11,     /** # of parameters in StallSimConfig */
+  MAX_STALL_SIM_BUBBLES = 64,  /** max value of any parameter */
+  MIN_PAGE_BITS = 6,           /** range of pageBits */
+  MAX_PAGE_BITS = 24,
+};
+
+/** Return the name of parameter i of StallSimConfig: one of startup,
+ *  jump, ret, data, stores, commit, forward, tlb, ways, page or walk.
+ */
+const char *get_param_name_stall_sim(int i);
+
+/** Return the value of parameter i of config. */
+int get_param_stall_sim(const StallSimConfig *config, int i);
+
+/** Set the parameter of config named name to value.  Return false
+ *  if there is no such parameter or value is out of range.
+ */
+bool set_param_stall_sim(StallSimConfig *config, const char *name, int value);
+
+/** Return true iff the parameters of config combine: its TLB, if any,
+ *  is fully associative (tlbWays 0 or at least tlbEntries) or its
+ *  entries are a whole # of sets of tlbWays.  Check this once all the
+ *  parameters are set, as their order does not matter.
+ */
+bool is_valid_config_stall_sim(const StallSimConfig *config);
+
+enum {
+  MAX_REG_READ = 2,      /** max # of registers read per instruction */
+  MAX_REG_WRITE = 2,     /** max # of registers written per clock cycle */
+};
+
+/** Why a clock did not issue an instruction. */
+typedef enum {
+  NO_STALL,        /** the clock issued an instruction */
+  STARTUP_STALL,   /** pipeline filling on startup */
+  JUMP_STALL,      /** bubble for a cond jump */
+  RET_STALL,       /** bubble for a return */
+  DATA_STALL,      /** register read waits for an earlier write */
+  MEMORY_STALL,    /** load waits for the commit of a buffered store
+                    *  to the same word */
+  STORE_BUFFER_STALL, /** store waits for a free store buffer entry */
+  TLB_STALL,       /** page table walk after a TLB miss on the fetch
+                    *  or data address */
+  N_STALL_REASONS
+} StallReason;
+
+/** Return a short name for reason: issue, startup, jump, ret, data,
+ *  memory, store-buffer or tlb.
+ */
+const char *get_reason_name_stall_sim(StallReason reason);
+
+/** Record of one clock of a StallSim. */
+typedef struct {
+  long cycle;             /** clock #, starting at 0 */
+  Address pc;             /** pc of the instruction issued or waiting */
+  bool isIssue;           /** true iff the instruction issued */
+  StallReason reason;     /** NO_STALL iff isIssue */
+  int regsRead[MAX_REG_READ];     /** registers read by the instruction;
+                                   *  -1 for none or on startup */
+  int regsWritten[MAX_REG_WRITE]; /** registers it writes; -1 for none
+                                   *  or on startup */
+} StallSimEvent;
+
+/** An instruction as seen by a StallSim, decoded once by
+ *  decode_stall_sim() so that it can be clocked by
+ *  clock_insn_stall_sim() away from the Y86 which holds it.
+ */
+typedef struct {
+  Address pc;                     /** pc of the instruction */
+  Byte opcode;                    /** its base op */
+  int regsRead[MAX_REG_READ];     /** registers it reads; -1 for none */
+  int regsWritten[MAX_REG_WRITE]; /** registers it writes; -1 for none */
+  bool isMemAccess;               /** true iff it accesses data memory */
+  bool isStore;                   /** true iff that access is a store */
+  Address memAddr;                /** address of the word accessed */
+} StallSimInsn;
+
+/** Function called with the event of each clock of a StallSim. */
+typedef void StallSimEventFn(void *ctx, const StallSimEvent *event);
+
+/** Create a new pipeline stall simulator for y86.  If config is
+ *  NULL, use DEFAULT_STALL_SIM_CONFIG.
+ */
+StallSim *new_stall_sim(Y86 *y86, const StallSimConfig *config);
 
 /** Free all resources allocated by new_pipe_sim() in stallSim. */
 void free_stall_sim(StallSim *stallSim);
 
+/** Return stallSim to the state of a new StallSim for its Y86 with
+ *  configuration config (default if NULL), without subscribers.  Its
+ *  buffers are reused when they are large enough.
+ */
+void reset_stall_sim(StallSim *stallSim, const StallSimConfig *config);
+
 /** Apply next pipeline clock to stallSim.  Return true if
  *  processor can proceed, false if pipeline is stalled.
  *  Any Y86 state contained in stallSim must not be changed
@@ -20,16 +138,115 @@ void free_stall_sim(StallSim *stallSim);
  *
  * The pipeline will stall under the following circumstances:
  *
- * Exactly 4 clock cycles on startup to allow the pipeline to fill up.
+ * Exactly startupBubbles clock cycles on startup to allow the pipeline
+ * to fill up.
+ *
+ * Exactly jumpBubbles clock cyclies after execution of a conditional
+ * jump.
+ *
+ * Exactly retBubbles clock cycles after execution of a return.
  *
- * Exactly 2 clock cyclies after execution of a conditional jump.
+ * Upto maxDataBubbles clock cycles when attempting to read a register
+ * which was written by any of upto maxDataBubbles preceeding
+ * instructions.  This applies to conditional moves irrespective of
+ * the value of the condition.
  *
- * Exactly 3 clock cycles after execution of a return.
+ * If storeBufferSize > 0, stores (rmmovq, pushq, call) wait in a
+ * store buffer for commitClocks clocks after they issue.  A store
+ * stalls while the buffer is full.  Without forwarding, a load
+ * (mrmovq, popq, ret) stalls while a buffered store overlaps the word
+ * it reads.
  *
- * Upto 3 clock cycles when attempting to read a register which was
- * written by any of upto 3 preceeding instructions.  This applies
- * to conditional moves irrespective of the value of the condition.
+ * If tlbEntries > 0, the fetch address and any data address of an
+ * instruction are looked up in a TLB before it issues.  Each miss
+ * stalls for a page table walk of walkClocks clocks per level.
  */
 bool clock_stall_sim(StallSim *stallSim);
 
+/** Decode the instruction at the pc of y86 into *insn for a StallSim
+ *  configured by config; its data access is only decoded if config
+ *  times memory dependences or address translation.  Like
+ *  clock_stall_sim(), this sets the status of y86 to STATUS_ADR if the
+ *  instruction cannot be read; a run stops with the clock of such an
+ *  instruction.
+ */
+void decode_stall_sim(Y86 *y86, const StallSimConfig *config,
+                      StallSimInsn *insn);
+
+/** Like decode_stall_sim(), but decode the instruction from code[],
+ *  which holds all of its bytes as fetched from the pc of y86; only
+ *  the pc and registers of y86 are read.
+ */
+void decode_code_stall_sim(Y86 *y86, const StallSimConfig *config,
+                           const Byte code[], StallSimInsn *insn);
+
+/** Like clock_stall_sim(), but apply the clock to insn, an
+ *  instruction decoded by decode_stall_sim() from the state of the
+ *  Y86 of stallSim as it would be at this clock, rather than to the
+ *  Y86 itself, which is not accessed.  During startup, insn only
+ *  supplies the pc of the events.
+ */
+bool clock_insn_stall_sim(StallSim *stallSim, const StallSimInsn *insn);
+
+/** Return the # of clocks applied to stallSim. */
+long get_n_clocks_stall_sim(const StallSim *stallSim);
+
+/** Return the # of clocks of stallSim which stalled for reason; for
+ *  NO_STALL, the # which issued an instruction.
+ */
+long get_n_stalls_stall_sim(const StallSim *stallSim, StallReason reason);
+
+/** Return the # of loads which took their value from a buffered store
+ *  in stallSim.
+ */
+long get_n_forwards_stall_sim(const StallSim *stallSim);
+
+/** Return the # of TLB lookups in stallSim; 0 if address translation
+ *  is not timed.
+ */
+long get_n_tlb_lookups_stall_sim(const StallSim *stallSim);
+
+/** Return the # of TLB lookups in stallSim which missed. */
+long get_n_tlb_misses_stall_sim(const StallSim *stallSim);
+
+/** State of a StallSim between clocks, recorded by mark_stall_sim()
+ *  so that a run of clocks which returns it to the same state can be
+ *  repeated without applying them.
+ */
+typedef struct {
+  long clock;                     /** # of clocks applied */
+  long nStalls[N_STALL_REASONS];  /** totals of those clocks */
+  int stallTimer;                 /** bubbles left before a jump or ret */
+  bool stalling;                  /** in those bubbles */
+  /** registers written by the preceding clocks, oldest first */
+  int window[MAX_STALL_SIM_BUBBLES * MAX_REG_WRITE];
+} StallSimMark;
+
+/** Record in *mark the state of stallSim before its next clock.
+ *  Return false if later clocks depend on more than that state, so
+ *  that stallSim cannot be repeated from the mark: during startup,
+ *  with a store buffer or TLB, or with subscribers.
+ */
+bool mark_stall_sim(const StallSim *stallSim, StallSimMark *mark);
+
+/** Return true iff stallSim is in the state recorded by *mark, apart
+ *  from its clock and totals.  Instructions which take the same
+ *  clocks from that state will then take the same clocks again.
+ */
+bool is_at_mark_stall_sim(const StallSim *stallSim, const StallSimMark *mark);
+
+/** Advance stallSim, which must be at *mark (see is_at_mark_stall_sim()),
+ *  as if the clocks applied since the mark were applied n more times
+ *  to the same instructions.  Its clock and totals grow by n times
+ *  their growth since the mark; its state is unchanged.
+ */
+void repeat_stall_sim(StallSim *stallSim, const StallSimMark *mark, long n);
+
+/** Call fn(ctx, event) from within each later clock_stall_sim() on
+ *  stallSim, before it returns and so before the issued instruction
+ *  is executed.  Return false if stallSim already has the maximum #
+ *  of subscribers.  Without subscribers, no events are built.
+ */
+bool subscribe_stall_sim(StallSim *stallSim, StallSimEventFn *fn, void *ctx);
+
 #endif //ifndef _STALL_SIM_H
@@ -0,0 +1,230 @@
+#define _DEFAULT_SOURCE   //for sysconf()
+
+#include "sweep.h"
+
+#include "loop-sim.h"
+
+#include "errors.h"
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum {
+  MAX_SWEEP_CONFIGS = 1 << 20,  /** max # of configurations in a grid */
+  MAX_AXIS_NAME = 32,
+};
+
+typedef struct {
+  bool isLoaded;
+  long cycles;
+  long nInsns;
+  Status status;
+} Result;
+
+typedef struct {
+  const StallSimConfig *configs;
+  int nConfigs;
+  int nPrograms;
+  SweepLoadFn *load;
+  void *ctx;
+  Result *results;          //[nConfigs * nPrograms]
+  int nextJob;              //next job to be taken by a thread
+  pthread_mutex_t lock;     //protects nextJob and calls to load
+} Sweep;
+
+/**************************** Grid Setup *******************************/
+
+/** Parse the comma-separated list of values or ranges in spec into
+ *  values[], which has room for MAX_STALL_SIM_BUBBLES + 1 values.
+ *  Return the # of values, or -1 on error.
+ */
+static int
+parse_values(const char *spec, int values[])
+{
+  int n = 0;
+  const char *p = spec;
+  do {
+    char *end;
+    if (!isdigit(*p)) return -1;
+    long lo = strtol(p, &end, 10), hi = lo;
+    if (*end == '-') {
+      p = end + 1;
+      if (!isdigit(*p)) return -1;
+      hi = strtol(p, &end, 10);
+    }
+    if (lo > hi || hi > MAX_STALL_SIM_BUBBLES) return -1;
+    for (long v = lo; v <= hi; v++) {
+      if (n > MAX_STALL_SIM_BUBBLES) return -1;
+      values[n++] = v;
+    }
+    p = end;
+  } while (*p++ == ',');
+  return (p[-1] == '\0') ? n : -1;
+}
+
+/** Return the configurations in the grid given by axes[nAxes] over
+ *  base, setting *nConfigs to their #.  Return NULL after printing a
+ *  message on stderr if an axis or a configuration is bad.
+ */
+static StallSimConfig *
+make_grid(const StallSimConfig *base, int nAxes, const char *axes[],
+          int *nConfigs)
+{
+  StallSimConfig *configs = malloc(sizeof(StallSimConfig));
+  if (!configs) fatal("out of memory\n");
+  configs[0] = *base;
+  int n = 1;
+  for (int i = 0; i < nAxes; i++) {
+    const char *eq = strchr(axes[i], '=');
+    const size_t nameLen = eq ? eq - axes[i] : 0;
+    int values[MAX_STALL_SIM_BUBBLES + 1];
+    const int nValues = eq ? parse_values(eq + 1, values) : -1;
+    char name[MAX_AXIS_NAME];
+    bool isOk = 0 < nameLen && nameLen < sizeof(name) && nValues > 0 &&
+      (long)n * nValues <= MAX_SWEEP_CONFIGS;
+    if (isOk) {
+      memcpy(name, axes[i], nameLen);
+      name[nameLen] = '\0';
+      StallSimConfig config = *base;
+      for (int k = 0; isOk && k < nValues; k++) {
+        isOk = set_param_stall_sim(&config, name, values[k]);
+      }
+    }
+    if (!isOk) {
+      fprintf(stderr, "bad sweep axis '%s'\n", axes[i]);
+      free(configs);
+      return NULL;
+    }
+    StallSimConfig *grid = malloc(n * nValues * sizeof(StallSimConfig));
+    if (!grid) fatal("out of memory\n");
+    for (int j = 0; j < n; j++) {
+      for (int k = 0; k < nValues; k++) {
+        grid[j * nValues + k] = configs[j];
+        set_param_stall_sim(&grid[j * nValues + k], name, values[k]);
+      }
+    }
+    free(configs);
+    configs = grid;
+    n *= nValues;
+  }
+  //values valid alone may not combine with other axes or -p values
+  for (int j = 0; j < n; j++) {
+    if (!is_valid_config_stall_sim(&configs[j])) {
+      fprintf(stderr, "sweep gives tlb=%d, not a multiple of ways=%d\n",
+              configs[j].tlbEntries, configs[j].tlbWays);
+      free(configs);
+      return NULL;
+    }
+  }
+  *nConfigs = n;
+  return configs;
+}
+
+/****************************** Running ********************************/
+
+/** Run job # job: program job % nPrograms under configuration job /
+ *  nPrograms.
+ */
+static void
+run_job(Sweep *sweep, int job)
+{
+  Result *result = &sweep->results[job];
+  Y86 *y86 = new_y86_default();
+  pthread_mutex_lock(&sweep->lock);
+  result->isLoaded = sweep->load(sweep->ctx, job % sweep->nPrograms, y86);
+  pthread_mutex_unlock(&sweep->lock);
+  if (result->isLoaded) {
+    StallSim *stallSim =
+      new_stall_sim(y86, &sweep->configs[job / sweep->nPrograms]);
+    StagedSimStats stats;
+    run_loop_sim(y86, stallSim, NULL, NULL, &stats);
+    result->cycles = stats.nCycles;
+    result->nInsns = stats.nInsns;
+    result->status = read_status_y86(y86);
+    free_stall_sim(stallSim);
+  }
+  free_y86(y86);
+}
+
+static void *
+run_thread(void *arg)
+{
+  Sweep *sweep = arg;
+  const int nJobs = sweep->nConfigs * sweep->nPrograms;
+  while (true) {
+    pthread_mutex_lock(&sweep->lock);
+    const int job = sweep->nextJob++;
+    pthread_mutex_unlock(&sweep->lock);
+    if (job >= nJobs) break;
+    run_job(sweep, job);
+  }
+  return NULL;
+}
+
+static const char *
+status_name(Status status)
+{
+  static const char *names[] = { "AOK", "HLT", "ADR", "INS" };
+  return (status < sizeof(names)/sizeof(names[0])) ? names[status] : "?";
+}
+
+static void
+write_csv(const Sweep *sweep, const char *programNames[], FILE *out)
+{
+  fprintf(out, "program");
+  for (int i = 0; i < N_STALL_SIM_PARAMS; i++) {
+    fprintf(out, ",%s", get_param_name_stall_sim(i));
+  }
+  fprintf(out, ",cycles,instructions,cpi,status\n");
+  for (int job = 0; job < sweep->nConfigs * sweep->nPrograms; job++) {
+    const Result *result = &sweep->results[job];
+    if (!result->isLoaded) continue;
+    const StallSimConfig *config = &sweep->configs[job / sweep->nPrograms];
+    fprintf(out, "%s", programNames[job % sweep->nPrograms]);
+    for (int i = 0; i < N_STALL_SIM_PARAMS; i++) {
+      fprintf(out, ",%d", get_param_stall_sim(config, i));
+    }
+    fprintf(out, ",%ld,%ld,", result->cycles, result->nInsns);
+    if (result->nInsns > 0) {
+      fprintf(out, "%.4f", (double)result->cycles / result->nInsns);
+    }
+    fprintf(out, ",%s\n", status_name(result->status));
+  }
+}
+
+bool
+run_sweep(const StallSimConfig *base, int nAxes, const char *axes[],
+          int nPrograms, const char *programNames[],
+          SweepLoadFn *load, void *ctx, int nThreads, FILE *out)
+{
+  Sweep sweep = { .nPrograms = nPrograms, .load = load, .ctx = ctx };
+  StallSimConfig *configs = make_grid(base, nAxes, axes, &sweep.nConfigs);
+  if (!configs) return false;
+  sweep.configs = configs;
+  const int nJobs = sweep.nConfigs * nPrograms;
+  sweep.results = calloc(nJobs, sizeof(Result));
+  if (!sweep.results) fatal("out of memory\n");
+  pthread_mutex_init(&sweep.lock, NULL);
+  if (nThreads <= 0) nThreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nThreads > nJobs) nThreads = nJobs;
+  if (nThreads < 1) nThreads = 1;
+  pthread_t threads[nThreads];
+  for (int i = 0; i < nThreads; i++) {
+    if (pthread_create(&threads[i], NULL, run_thread, &sweep) != 0) {
+      fatal("cannot create sweep thread\n");
+    }
+  }
+  for (int i = 0; i < nThreads; i++) pthread_join(threads[i], NULL);
+  write_csv(&sweep, programNames, out);
+  bool isOk = true;
+  for (int job = 0; job < nJobs; job++) {
+    isOk = isOk && sweep.results[job].isLoaded;
+  }
+  pthread_mutex_destroy(&sweep.lock);
+  free(sweep.results);
+  free(configs);
+  return isOk;
+}
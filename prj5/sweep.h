@@ -0,0 +1,36 @@
+#ifndef _SWEEP_H
+#define _SWEEP_H
+
+#include "stall-sim.h"
+
+#include <stdio.h>
+
+/** Design-space sweep of the StallSim pipeline parameters.  A grid
+ *  of configurations is given by axes, each of the form NAME=VALUES
+ *  where NAME is a StallSimConfig parameter name and VALUES is a
+ *  comma-separated list of values N or ranges LO-HI.  Parameters
+ *  without an axis keep their value in a base configuration.  Every
+ *  program is run to completion under every configuration of the
+ *  grid, with the runs spread over host threads.
+ */
+
+/** Load program # program of a sweep into y86, a new Y86, and set up
+ *  its parameters.  Return false after printing a message on stderr
+ *  on error.  Calls are serialized, so the function need not be
+ *  thread-safe.
+ */
+typedef bool SweepLoadFn(void *ctx, int program, Y86 *y86);
+
+/** Run programNames[nPrograms], loaded by load(ctx, ...), under every
+ *  configuration in the grid given by axes[nAxes] over base, using
+ *  nThreads threads (the # of online processors if nThreads <= 0).
+ *  Write a CSV with a header line and one line per configuration and
+ *  program giving the parameters, # of cycles, # of instructions, CPI
+ *  and final status on out.  Return false after printing a message
+ *  on stderr if an axis is bad or a program cannot be loaded.
+ */
+bool run_sweep(const StallSimConfig *base, int nAxes, const char *axes[],
+               int nPrograms, const char *programNames[],
+               SweepLoadFn *load, void *ctx, int nThreads, FILE *out);
+
+#endif //ifndef _SWEEP_H
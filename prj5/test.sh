@@ -2,19 +2,94 @@
 
 #assumes simulator in current directory
 
+#a test X.ys is run with -v and its output compared with X.out; if
+#there is an X.args, the program is instead run once for each line of
+#options in it and X.out holds the output of all the runs, each after
+#a "## OPTIONS" line and with stderr and any non-zero exit status; if
+#there is also an X.daemon, a daemon started with the options in it
+#serves the runs on the socket $SOCKET; if there is instead an
+#X.cargs, X.ys is translated with -C and compiled, X.out holds the
+#output of the translation run with each line of INT_INPUTS in it,
+#each after a "## -C INPUTS" line and followed by any differences
+#from the final state of a -v run of the simulator with those inputs
+
 TMPDIR=$HOME/tmp
 mkdir -p $TMPDIR
 
 PRG=./stall-sim 
+CC=${CC:-cc}
+
+#start_daemon DAEMON_FILE: start a daemon on $SOCKET with the options
+#in DAEMON_FILE and wait for its socket
+start_daemon() {
+    $PRG -D $SOCKET `cat $1` < /dev/null > /dev/null 2>&1 &
+    daemon=$!
+    for i in `seq 1 50`
+    do
+	[ -S $SOCKET ] && break
+	sleep 0.1
+    done
+}
+
+#run_args ARGS_FILE YS_FILE: run YS_FILE with each line of ARGS_FILE
+run_args() {
+    while read -r opts
+    do
+	echo "## $opts"
+	eval "$PRG $opts $2" < /dev/null 2>&1
+	status=$?
+	if [ $status -ne 0 ]
+	then
+	    echo "## exit $status"
+	fi
+    done < $1
+}
+
+#run_translated CARGS_FILE YS_FILE: run the C translation of YS_FILE
+#with each line of CARGS_FILE and compare its output with the final
+#state of the simulator, dropping the trace lines of its clocks
+run_translated() {
+    $PRG -C $SCRATCH/prog.c $2 &&
+	$CC -o $SCRATCH/prog $SCRATCH/prog.c || return
+    while read -r inputs
+    do
+	echo "## -C $inputs"
+	$SCRATCH/prog $inputs > $SCRATCH/c.out 2>&1
+	cat $SCRATCH/c.out
+	$PRG -v $2 $inputs 2>&1 | grep -v '^ *[0-9]*:	' |
+	    diff $SCRATCH/c.out -
+    done < $1
+}
 
 for f in "$@"
 do
     gold=`echo $f | sed -e 's/\.ys$/.out/'`
+    args=`echo $f | sed -e 's/\.ys$/.args/'`
+    daemonArgs=`echo $f | sed -e 's/\.ys$/.daemon/'`
+    cArgs=`echo $f | sed -e 's/\.ys$/.cargs/'`
 
     if [ -e $gold ]
     then
     	tmp=$TMPDIR/$(basename $gold)
-	if echo $f | grep -q 'main' 
+	if [ -e $args ] && [ -e $daemonArgs ]
+	then
+	    SOCKET=$TMPDIR/$(basename $f .ys).sock
+	    start_daemon $daemonArgs
+	    run_args $args $f | sed -e "s|$SOCKET|\$SOCKET|g" > $tmp
+	    kill $daemon
+	    wait $daemon
+	    rm -f $SOCKET
+	elif [ -e $args ]
+	then
+	    run_args $args $f > $tmp
+	elif [ -e $cArgs ]
+	then
+	    SCRATCH=$TMPDIR/$(basename $f .ys).d
+	    rm -rf $SCRATCH
+	    mkdir -p $SCRATCH
+	    run_translated $cArgs $f > $tmp
+	    rm -rf $SCRATCH
+	elif echo $f | grep -q 'main'
 	then
 	    $PRG -v $f `seq 1 10` > $tmp
 	else
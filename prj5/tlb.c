@@ -0,0 +1,142 @@
+#include "tlb.h"
+
+#include "errors.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+enum {
+  PTE_BITS = 3,          /** log2 of the size of a page table entry */
+  N_RECENT = 2,          /** # of recent hits remembered on the host */
+};
+
+typedef struct {
+  Address vpn;          //virtual page #
+  bool isValid;
+  uint64_t lastUse;     //for LRU replacement
+} Entry;
+
+struct TlbStruct {
+  int nSets;
+  int nWays;
+  int pageBits;
+  int nLevels;          //# of page table levels
+  Entry *entries;       //[nSets * nWays], set by set
+  uint64_t useClock;    //advanced by each lookup
+  Entry *recent[N_RECENT];  //entries of the last hits; NULL if none
+  int nextRecent;       //slot of recent[] to be replaced next
+  long nLookups;
+  long nMisses;
+};
+
+/** Return the # of levels of a radix page table with 2^pageBits-byte
+ *  nodes mapping memSize bytes of memory.
+ */
+static int
+count_levels(int pageBits, Address memSize)
+{
+  int addrBits = 0;
+  while (addrBits < 64 && ((Address)1 << addrBits) < memSize) addrBits++;
+  const int vpnBits = addrBits > pageBits ? addrBits - pageBits : 0;
+  const int bitsPerLevel = pageBits - PTE_BITS;
+  const int nLevels = (vpnBits + bitsPerLevel - 1) / bitsPerLevel;
+  return nLevels > 0 ? nLevels : 1;
+}
+
+/** Return a new empty TLB of nEntries entries in sets of nWays (fully
+ *  associative if nWays is 0 or at least nEntries) for pages of
+ *  2^pageBits bytes over memSize bytes of memory.
+ */
+Tlb *
+new_tlb(int nEntries, int nWays, int pageBits, Address memSize)
+{
+  Tlb *tlb = calloc(1, sizeof(Tlb));
+  if (nWays <= 0 || nWays > nEntries) nWays = nEntries;
+  Entry *entries = calloc(nEntries, sizeof(Entry));
+  if (!tlb || !entries) fatal("out of memory\n");
+  tlb->nSets = nEntries / nWays;
+  tlb->nWays = nWays;
+  tlb->pageBits = pageBits;
+  tlb->nLevels = count_levels(pageBits, memSize);
+  tlb->entries = entries;
+  return tlb;
+}
+
+/** Free all resources allocated by new_tlb() in tlb. */
+void
+free_tlb(Tlb *tlb)
+{
+  free(tlb->entries);
+  free(tlb);
+}
+
+/** Remember entry as one of the last hits of tlb. */
+static void
+remember(Tlb *tlb, Entry *entry)
+{
+  tlb->recent[tlb->nextRecent] = entry;
+  tlb->nextRecent = (tlb->nextRecent + 1) % N_RECENT;
+}
+
+/** Look up the translation of addr in tlb.  Return true on a hit.  On
+ *  a miss, install the translation, evicting the least recently used
+ *  entry of its set, and return false.
+ */
+bool
+lookup_tlb(Tlb *tlb, Address addr)
+{
+  const Address vpn = addr >> tlb->pageBits;
+  tlb->nLookups++;
+  tlb->useClock++;
+  for (int i = 0; i < N_RECENT; i++) {
+    Entry *entry = tlb->recent[i];
+    if (entry && entry->vpn == vpn) {
+      entry->lastUse = tlb->useClock;
+      return true;
+    }
+  }
+  Entry *set = &tlb->entries[(vpn % tlb->nSets) * tlb->nWays];
+  Entry *victim = &set[0];
+  for (int i = 0; i < tlb->nWays; i++) {
+    if (set[i].isValid && set[i].vpn == vpn) {
+      set[i].lastUse = tlb->useClock;
+      remember(tlb, &set[i]);
+      return true;
+    }
+    if (victim->isValid &&
+        (!set[i].isValid || set[i].lastUse < victim->lastUse)) {
+      victim = &set[i];
+    }
+  }
+  //an evicted entry must not be found among the recent hits
+  for (int i = 0; i < N_RECENT; i++) {
+    if (tlb->recent[i] == victim) tlb->recent[i] = NULL;
+  }
+  victim->vpn = vpn;
+  victim->isValid = true;
+  victim->lastUse = tlb->useClock;
+  remember(tlb, victim);
+  tlb->nMisses++;
+  return false;
+}
+
+/** Return the # of page table levels visited by a walk of tlb. */
+int
+get_n_levels_tlb(const Tlb *tlb)
+{
+  return tlb->nLevels;
+}
+
+/** Return the # of lookups in tlb. */
+long
+get_n_lookups_tlb(const Tlb *tlb)
+{
+  return tlb->nLookups;
+}
+
+/** Return the # of lookups in tlb which missed. */
+long
+get_n_misses_tlb(const Tlb *tlb)
+{
+  return tlb->nMisses;
+}
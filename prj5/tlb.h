@@ -0,0 +1,45 @@
+#ifndef _TLB_H
+#define _TLB_H
+
+#include "y86x.h"
+
+/** Timing model of address translation.  Y86 addresses are taken as
+ *  virtual addresses, mapped one-to-one onto physical memory by a
+ *  radix page table with 8-byte entries, one page per table node,
+ *  spanning the memory of the Y86.  A set-associative TLB with LRU
+ *  replacement caches translations; a miss walks every level of the
+ *  page table and installs the translation.  Since the mapping is the
+ *  identity, translation never changes what a program computes, only
+ *  how long it takes.
+ *
+ *  The last two translations which hit are remembered on the host
+ *  side, so that the common case of repeated accesses to the same
+ *  code and data pages does not search the TLB.
+ */
+typedef struct TlbStruct Tlb;
+
+/** Return a new empty TLB of nEntries entries in sets of nWays (fully
+ *  associative if nWays is 0 or at least nEntries) for pages of
+ *  2^pageBits bytes over memSize bytes of memory.
+ */
+Tlb *new_tlb(int nEntries, int nWays, int pageBits, Address memSize);
+
+/** Free all resources allocated by new_tlb() in tlb. */
+void free_tlb(Tlb *tlb);
+
+/** Look up the translation of addr in tlb.  Return true on a hit.  On
+ *  a miss, install the translation, evicting the least recently used
+ *  entry of its set, and return false.
+ */
+bool lookup_tlb(Tlb *tlb, Address addr);
+
+/** Return the # of page table levels visited by a walk of tlb. */
+int get_n_levels_tlb(const Tlb *tlb);
+
+/** Return the # of lookups in tlb. */
+long get_n_lookups_tlb(const Tlb *tlb);
+
+/** Return the # of lookups in tlb which missed. */
+long get_n_misses_tlb(const Tlb *tlb);
+
+#endif //ifndef _TLB_H
@@ -0,0 +1,601 @@
+#include "y86-to-c.h"
+
+#include "dis-yas.h"
+#include "yregs.h"
+
+#include "errors.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*************************** Translation State ***************************/
+
+typedef struct {
+  Y86 *y86;
+  Address memSize;
+  Byte *isSeen;         //bitmap over memory: address queued
+  Byte *isCode;         //bitmap over memory: byte of a translated insn
+  Address *addrs;       //all translated addresses
+  size_t nAddrs, maxAddrs;
+  Address *work;        //addresses still to be translated
+  size_t nWork, maxWork;
+  bool hasRet;          //some translated insn is a ret
+} Translator;
+
+/** Ensure that *items, an array of *max items of size bytes, has
+ *  room for n + 1 items.
+ */
+static void
+ensure_room(void **items, size_t *max, size_t n, size_t size)
+{
+  if (n < *max) return;
+  *max = *max ? 2 * *max : 64;
+  if (!(*items = realloc(*items, *max * size))) fatal("out of memory\n");
+}
+
+static bool
+test_bit(const Byte bits[], Address i)
+{
+  return (bits[i / 8] >> (i % 8)) & 1;
+}
+
+static void
+set_bit(Byte bits[], Address i)
+{
+  bits[i / 8] |= 1 << (i % 8);
+}
+
+/** Queue addr for translation unless it already has been.  Addresses
+ *  outside memory are translated too: they stop with STATUS_ADR.
+ */
+static void
+queue_addr(Translator *t, Address addr)
+{
+  if (addr < t->memSize) {
+    if (test_bit(t->isSeen, addr)) return;
+    set_bit(t->isSeen, addr);
+  }
+  else {
+    for (size_t i = 0; i < t->nAddrs; i++) {
+      if (t->addrs[i] == addr) return;
+    }
+    for (size_t i = 0; i < t->nWork; i++) {
+      if (t->work[i] == addr) return;
+    }
+  }
+  ensure_room((void **)&t->work, &t->maxWork, t->nWork, sizeof(Address));
+  t->work[t->nWork++] = addr;
+}
+
+static int
+compare_addrs(const void *p1, const void *p2)
+{
+  const Address a1 = *(const Address *)p1, a2 = *(const Address *)p2;
+  return (a1 > a2) - (a1 < a2);
+}
+
+/**************************** Decoding *********************************/
+
+/** A decoded instruction. */
+typedef struct {
+  Address pc;
+  Byte op;              //first byte
+  const OpInfo *info;   //NULL if the base op is not in the table
+  bool isTruncated;     //instruction extends past the end of memory
+  Byte regA, regB;
+  Word word;            //immediate, displacement or destination
+  Address next;         //address of the following instruction
+} Insn;
+
+static Word
+read_word_at(Y86 *y86, Address addr)
+{
+  Word word = 0;
+  for (int i = sizeof(Word) - 1; i >= 0; i--) {
+    word = (word << 8) | read_memory_byte_y86(y86, addr + i);
+  }
+  return word;
+}
+
+static void
+decode(const Translator *t, Address pc, Insn *insn)
+{
+  memset(insn, 0, sizeof(Insn));
+  insn->pc = pc;
+  insn->op = read_memory_byte_y86(t->y86, pc);
+  insn->info = get_op_info(insn->op);
+  if (!insn->info) return;
+  const int length = get_op_length(insn->info);
+  insn->next = pc + length;
+  insn->isTruncated = insn->next > t->memSize;
+  if (insn->isTruncated) return;
+  const bool hasRegs = length == 2 || length == 10;
+  if (hasRegs) {
+    const Byte regs = read_memory_byte_y86(t->y86, pc + 1);
+    insn->regA = get_nybble(regs, 1);
+    insn->regB = get_nybble(regs, 0);
+  }
+  if (length > 2) {
+    insn->word = read_word_at(t->y86, pc + (hasRegs ? 2 : 1));
+  }
+}
+
+/** Return true iff insn is a conditional move or jump with a valid
+ *  condition which is not always true.
+ */
+static bool
+is_conditional(const Insn *insn)
+{
+  const BaseOpCode op = insn->info->op;
+  const Byte fn = get_nybble(insn->op, 0);
+  return (op == CMOVxx_CODE || op == Jxx_CODE) && 0 < fn && fn <= 6;
+}
+
+/** Return NULL if insn can be translated, else the reason why not. */
+static const char *
+check_insn(const Insn *insn)
+{
+  const Byte fn = get_nybble(insn->op, 0);
+  const bool isBadA = insn->regA == REG_NONE;
+  const bool isBadB = insn->regB == REG_NONE;
+  switch (insn->info->op) {
+  case CMOVxx_CODE:
+    return (fn > 6) ? "bad condition" : (isBadA || isBadB) ? "register F" : NULL;
+  case IRMOVQ_CODE:
+    return isBadB ? "register F" : NULL;
+  case RMMOVQ_CODE: case MRMOVQ_CODE:
+    return (isBadA || isBadB) ? "register F" : NULL;
+  case OP1_CODE:
+    return (fn > 3) ? "bad operation" : (isBadA || isBadB) ? "register F" : NULL;
+  case Jxx_CODE:
+    return (fn > 6) ? "bad condition" : NULL;
+  case PUSHQ_CODE: case POPQ_CODE:
+    return isBadA ? "register F" : NULL;
+  default:
+    return NULL;
+  }
+}
+
+/** Queue the successors of insn. */
+static void
+queue_successors(Translator *t, const Insn *insn)
+{
+  if (!insn->info) return;
+  const BaseOpCode op = insn->info->op;
+  if (insn->isTruncated) {
+    //only a move or jump whose condition fails proceeds
+    if (is_conditional(insn)) queue_addr(t, insn->next);
+    return;
+  }
+  if (check_insn(insn)) return;
+  switch (op) {
+  case HALT_CODE: case RET_CODE:
+    break;
+  case Jxx_CODE:
+    queue_addr(t, insn->word);
+    if (get_nybble(insn->op, 0) != 0) queue_addr(t, insn->next);
+    break;
+  case CALL_CODE:
+    queue_addr(t, insn->word);
+    queue_addr(t, insn->next);
+    break;
+  default:
+    queue_addr(t, insn->next);
+    break;
+  }
+}
+
+/** Find all instructions reachable from entry, leaving their sorted
+ *  addresses in t->addrs.
+ */
+static void
+find_insns(Translator *t, Address entry)
+{
+  queue_addr(t, entry);
+  while (t->nWork > 0) {
+    const Address pc = t->work[--t->nWork];
+    ensure_room((void **)&t->addrs, &t->maxAddrs, t->nAddrs, sizeof(Address));
+    t->addrs[t->nAddrs++] = pc;
+    if (pc >= t->memSize) continue;
+    Insn insn;
+    decode(t, pc, &insn);
+    if (insn.info && !insn.isTruncated) {
+      for (Address a = pc; a < insn.next; a++) set_bit(t->isCode, a);
+      if (insn.info->op == RET_CODE) t->hasRet = true;
+    }
+    queue_successors(t, &insn);
+  }
+  qsort(t->addrs, t->nAddrs, sizeof(Address), compare_addrs);
+}
+
+/*************************** Code Emission *****************************/
+
+/** C expressions for the conditions of cmovXX and jXX */
+static const char *condExprs[] = {
+  "1", "(SF ^ OF) | ZF", "SF ^ OF", "ZF", "!ZF", "!(SF ^ OF)",
+  "!(SF ^ OF) & !ZF",
+};
+
+static const char *opExprs[] = { "b + a", "b - a", "b & a", "b ^ a", };
+static const char *opCcs[] = {
+  "add_cc(b, a, v)", "sub_cc(b, a, v)", "logic_cc(v)", "logic_cc(v)",
+};
+
+static const char *header =
+  "#include <stdint.h>\n"
+  "#include <stdio.h>\n"
+  "#include <stdlib.h>\n"
+  "#include <string.h>\n"
+  "\n"
+  "typedef uint64_t Word;\n"
+  "typedef uint8_t Byte;\n"
+  "\n"
+  "//not all labels are jumped to\n"
+  "#pragma GCC diagnostic ignored \"-Wunused-label\"\n"
+  "\n";
+
+static const char *prelude =
+  "enum { AOK, HLT, ADR, INS };\n"
+  "\n"
+  "#define ZF ((cc >> 2) & 1)\n"
+  "#define SF ((cc >> 1) & 1)\n"
+  "#define OF (cc & 1)\n"
+  "#define SIGN(w) ((w) >> 63)\n"
+  "\n"
+  "/** stop with status s and pc p */\n"
+  "#define STOP(p, s) do { pc = (p); status = (s); goto done; } while (0)\n"
+  "\n"
+  "static Byte mem[MEM_SIZE];\n"
+  "static Word pc;\n"
+  "static int status;\n"
+  "\n"
+  "static inline int\n"
+  "is_bad(Word a)\n"
+  "{\n"
+  "  return a > MEM_SIZE - sizeof(Word);\n"
+  "}\n"
+  "\n"
+  "static inline Word\n"
+  "load(Word a)\n"
+  "{\n"
+  "  Word w;\n"
+  "  memcpy(&w, &mem[a], sizeof(Word));\n"
+  "  return w;\n"
+  "}\n"
+  "\n"
+  "static inline void\n"
+  "store(Word a, Word w)\n"
+  "{\n"
+  "  if (a < CODE_HI && a + sizeof(Word) > CODE_LO) {\n"
+  "    for (Word i = a; i < a + sizeof(Word); i++) {\n"
+  "      if (i >= CODE_LO && i < CODE_HI &&\n"
+  "          ((codeBits[(i - CODE_LO) / 8] >> ((i - CODE_LO) % 8)) & 1)) {\n"
+  "        fprintf(stderr, \"store to translated code at %08lx\\n\", a);\n"
+  "        exit(1);\n"
+  "      }\n"
+  "    }\n"
+  "  }\n"
+  "  memcpy(&mem[a], &w, sizeof(Word));\n"
+  "}\n"
+  "\n"
+  "static inline Byte\n"
+  "logic_cc(Word v)\n"
+  "{\n"
+  "  return (v == 0) << 2 | SIGN(v) << 1;\n"
+  "}\n"
+  "\n"
+  "/** cc for v == b + a */\n"
+  "static inline Byte\n"
+  "add_cc(Word b, Word a, Word v)\n"
+  "{\n"
+  "  return logic_cc(v) | (SIGN(a) == SIGN(b) && SIGN(v) != SIGN(b));\n"
+  "}\n"
+  "\n"
+  "/** cc for v == b - a */\n"
+  "static inline Byte\n"
+  "sub_cc(Word b, Word a, Word v)\n"
+  "{\n"
+  "  return logic_cc(v) | (SIGN(a) != SIGN(b) && SIGN(v) != SIGN(b));\n"
+  "}\n"
+  "\n"
+  "static inline void\n"
+  "untranslated(Word p, const char *why)\n"
+  "{\n"
+  "  fprintf(stderr, \"%08lx: %s\\n\", p, why);\n"
+  "  exit(1);\n"
+  "}\n"
+  "\n";
+
+static const char *postlude =
+  "static void\n"
+  "dump(void)\n"
+  "{\n"
+  "  static const char *names[] = {\n"
+  "    \"rax\", \"rcx\", \"rdx\", \"rbx\", \"rsp\", \"rbp\", \"rsi\", \"rdi\",\n"
+  "    \" r8\", \" r9\", \"r10\", \"r11\", \"r12\", \"r13\", \"r14\",\n"
+  "  };\n"
+  "  static const char *statuses[] = { \"AOK\", \"HLT\", \"ADR\", \"INS\" };\n"
+  "  for (int i = 0; i < 15; i++) printf(\"%s: %016lx\\n\", names[i], regs[i]);\n"
+  "  printf(\" pc: %016lx\\n\", pc);\n"
+  "  printf(\"status: %s\\n\", statuses[status]);\n"
+  "  printf(\"cc: Z=%d S=%d O=%d\\n\", (cc0 >> 2) & 1, (cc0 >> 1) & 1, cc0 & 1);\n"
+  "  for (long a = MEM_SIZE - sizeof(Word); a >= 0; a -= sizeof(Word)) {\n"
+  "    Word init = 0;\n"
+  "    for (int i = sizeof(Word) - 1; i >= 0; i--) {\n"
+  "      const Word b = a + i;\n"
+  "      init = (init << 8) |\n"
+  "        ((b >= IMAGE_LO && b < IMAGE_HI) ? image[b - IMAGE_LO] : 0);\n"
+  "    }\n"
+  "    const Word w = load(a);\n"
+  "    if (w != init) printf(\"W[%08lx]: %016lx\\n\", a, w);\n"
+  "  }\n"
+  "}\n"
+  "\n"
+  "int\n"
+  "main(int argc, const char *argv[])\n"
+  "{\n"
+  "  memcpy(&mem[IMAGE_LO], image, IMAGE_HI - IMAGE_LO);\n"
+  "  const Word nParams = argc - 1;\n"
+  "  if (nParams > 0) {\n"
+  "    if (nParams > MEM_SIZE / sizeof(Word)) {\n"
+  "      fprintf(stderr, \"too many parameters\\n\");\n"
+  "      return 1;\n"
+  "    }\n"
+  "    const Word params = MEM_SIZE - nParams * sizeof(Word);\n"
+  "    for (Word i = 0; i < nParams; i++) {\n"
+  "      char *p;\n"
+  "      const Word param = strtol(argv[i + 1], &p, 0);\n"
+  "      if (*p != '\\0') {\n"
+  "        fprintf(stderr, \"bad parameter '%s'\\n\", argv[i + 1]);\n"
+  "        return 1;\n"
+  "      }\n"
+  "      printf(\"argvi = %08lx\\n\", params + i * sizeof(Word));\n"
+  "      store(params + i * sizeof(Word), param);\n"
+  "    }\n"
+  "    regs[7] = nParams;\n"
+  "    regs[6] = params;\n"
+  "  }\n"
+  "  run();\n"
+  "  dump();\n"
+  "  return 0;\n"
+  "}\n";
+
+/** Emit bytes[n] as the body of a C array initializer. */
+static void
+emit_bytes(const Byte bytes[], size_t n, FILE *out)
+{
+  for (size_t i = 0; i < n; i++) {
+    fprintf(out, "%s0x%02x,%s", (i % 12 == 0) ? "  " : "", bytes[i],
+            (i % 12 == 11 || i == n - 1) ? "\n" : " ");
+  }
+  if (n == 0) fprintf(out, "  0\n");
+}
+
+/** Emit the memory image and the bitmap of translated code bytes,
+ *  each trimmed to the range of its non-zero bytes.
+ */
+static void
+emit_data(const Translator *t, FILE *out)
+{
+  Y86 *y86 = t->y86;
+  Address lo = t->memSize, hi = 0;
+  for (Address a = 0; a < t->memSize; a++) {
+    if (read_memory_byte_y86(y86, a) != 0) {
+      if (a < lo) lo = a;
+      hi = a + 1;
+    }
+  }
+  if (lo > hi) lo = hi;
+  Address codeLo = t->memSize, codeHi = 0;
+  for (Address a = 0; a < t->memSize; a++) {
+    if (test_bit(t->isCode, a)) {
+      if (a < codeLo) codeLo = a;
+      codeHi = a + 1;
+    }
+  }
+  if (codeLo > codeHi) codeLo = codeHi;
+  fprintf(out, "enum { MEM_SIZE = 0x%lx };\n", t->memSize);
+  fprintf(out, "#define IMAGE_LO 0x%lxUL\n#define IMAGE_HI 0x%lxUL\n", lo, hi);
+  fprintf(out, "#define CODE_LO 0x%lxUL\n#define CODE_HI 0x%lxUL\n\n",
+          codeLo, codeHi);
+  const size_t nImage = hi - lo;
+  Byte *bytes = malloc(nImage + (codeHi - codeLo) / 8 + 1);
+  if (!bytes) fatal("out of memory\n");
+  for (size_t i = 0; i < nImage; i++) {
+    bytes[i] = read_memory_byte_y86(y86, lo + i);
+  }
+  fprintf(out, "static const Byte image[] = {\n");
+  emit_bytes(bytes, nImage, out);
+  fprintf(out, "};\n\n");
+  const size_t nCode = (codeHi - codeLo + 7) / 8;
+  memset(bytes, 0, nCode);
+  for (Address a = codeLo; a < codeHi; a++) {
+    if (test_bit(t->isCode, a)) set_bit(bytes, a - codeLo);
+  }
+  fprintf(out, "/** bit i set iff byte CODE_LO + i was translated */\n");
+  fprintf(out, "static const Byte codeBits[] = {\n");
+  emit_bytes(bytes, nCode, out);
+  fprintf(out, "};\n\n");
+  free(bytes);
+}
+
+/** Emit a jump to the translation of addr, or nothing if it is the
+ *  next one emitted (at index i + 1 of t->addrs).
+ */
+static void
+emit_goto(const Translator *t, size_t i, Address addr, FILE *out)
+{
+  if (i + 1 < t->nAddrs && t->addrs[i + 1] == addr) return;
+  fprintf(out, "  goto L_%lx;\n", addr);
+}
+
+/** Emit the translation of the i'th instruction. */
+static void
+emit_insn(const Translator *t, size_t i, FILE *out)
+{
+  const Address pc = t->addrs[i];
+  if (pc >= t->memSize) {
+    fprintf(out, "L_%lx:\n  STOP(0x%lx, ADR);\n", pc, pc);
+    return;
+  }
+  Insn insn;
+  decode(t, pc, &insn);
+  if (!insn.info) {
+    if (get_nybble(insn.op, 1) == 0xC) {
+      fprintf(out, "L_%lx:\n  untranslated(0x%lx, \"atomic instruction\");\n",
+              pc, pc);
+    }
+    else {
+      fprintf(out, "L_%lx:\n  STOP(0x%lx, INS);\n", pc, pc);
+    }
+    return;
+  }
+  if (insn.isTruncated) {
+    fprintf(out, "L_%lx:\n", pc);
+    if (is_conditional(&insn)) {
+      fprintf(out, "  if (%s) STOP(0x%lx, ADR);\n",
+              condExprs[get_nybble(insn.op, 0)], pc);
+      emit_goto(t, i, insn.next, out);
+    }
+    else {
+      fprintf(out, "  STOP(0x%lx, ADR);\n", pc);
+    }
+    return;
+  }
+  const char *why = check_insn(&insn);
+  if (why) {
+    fprintf(out, "L_%lx:\n  untranslated(0x%lx, \"%s\");\n", pc, pc, why);
+    return;
+  }
+  enum { DIS_YAS_BUF_SIZE = 80 };
+  char buf[DIS_YAS_BUF_SIZE];
+  write_pc_y86(t->y86, pc);
+  fprintf(out, "L_%lx: /* %s */\n", pc, dis_yas(t->y86, buf));
+  const Byte fn = get_nybble(insn.op, 0);
+  const char *regA = regNames[insn.regA < N_REGISTERS ? insn.regA : 0];
+  const char *regB = regNames[insn.regB < N_REGISTERS ? insn.regB : 0];
+  switch (insn.info->op) {
+  case HALT_CODE:
+    fprintf(out, "  STOP(0x%lx, HLT);\n", pc);
+    return;
+  case NOP_CODE:
+    break;
+  case CMOVxx_CODE:
+    if (fn == 0) {
+      fprintf(out, "  %s = %s;\n", regB, regA);
+    }
+    else {
+      fprintf(out, "  if (%s) %s = %s;\n", condExprs[fn], regB, regA);
+    }
+    break;
+  case IRMOVQ_CODE:
+    fprintf(out, "  %s = 0x%lxUL;\n", regB, insn.word);
+    break;
+  case RMMOVQ_CODE:
+    fprintf(out, "  t = %s + 0x%lxUL;\n", regB, insn.word);
+    fprintf(out, "  if (is_bad(t)) STOP(0x%lx, ADR);\n", pc);
+    fprintf(out, "  store(t, %s);\n", regA);
+    break;
+  case MRMOVQ_CODE:
+    fprintf(out, "  t = %s + 0x%lxUL;\n", regB, insn.word);
+    fprintf(out, "  if (is_bad(t)) STOP(0x%lx, ADR);\n", pc);
+    fprintf(out, "  %s = load(t);\n", regA);
+    break;
+  case OP1_CODE:
+    fprintf(out, "  { Word a = %s, b = %s, v = %s; cc = %s; %s = v; }\n",
+            regA, regB, opExprs[fn], opCcs[fn], regB);
+    break;
+  case Jxx_CODE:
+    if (fn == 0) {
+      emit_goto(t, i, insn.word, out);
+      return;
+    }
+    fprintf(out, "  if (%s) goto L_%lx;\n", condExprs[fn], insn.word);
+    break;
+  case CALL_CODE:
+    fprintf(out, "  rsp -= sizeof(Word);\n");
+    fprintf(out, "  if (is_bad(rsp)) STOP(0x%lx, ADR);\n", pc);
+    fprintf(out, "  store(rsp, 0x%lxUL);\n", insn.next);
+    emit_goto(t, i, insn.word, out);
+    return;
+  case RET_CODE:
+    fprintf(out, "  if (is_bad(rsp)) STOP(0x%lx, ADR);\n", pc);
+    fprintf(out, "  t = load(rsp);\n");
+    fprintf(out, "  rsp += sizeof(Word);\n");
+    fprintf(out, "  goto dispatch;\n");
+    return;
+  case PUSHQ_CODE:
+    fprintf(out, "  t = %s;\n", regA);
+    fprintf(out, "  rsp -= sizeof(Word);\n");
+    fprintf(out, "  if (is_bad(rsp)) STOP(0x%lx, ADR);\n", pc);
+    fprintf(out, "  store(rsp, t);\n");
+    break;
+  case POPQ_CODE:
+    fprintf(out, "  if (is_bad(rsp)) STOP(0x%lx, ADR);\n", pc);
+    if (insn.regA == REG_RSP) {
+      fprintf(out, "  rsp = load(rsp);\n");
+    }
+    else {
+      fprintf(out, "  %s = load(rsp);\n", regA);
+      fprintf(out, "  rsp += sizeof(Word);\n");
+    }
+    break;
+  }
+  emit_goto(t, i, insn.next, out);
+}
+
+/** Emit run(), which holds the translated program. */
+static void
+emit_run(const Translator *t, FILE *out)
+{
+  fprintf(out, "static void\nrun(void)\n{\n");
+  for (int r = 0; r < N_REGISTERS; r++) {
+    fprintf(out, "  Word %s = regs[%d];\n", regNames[r], r);
+  }
+  fprintf(out, "  Byte cc = cc0;\n  Word t = 0;\n  (void)t;\n");
+  fprintf(out, "  goto L_%lx;\n", read_pc_y86(t->y86));
+  for (size_t i = 0; i < t->nAddrs; i++) emit_insn(t, i, out);
+  if (t->hasRet) {
+    fprintf(out, "dispatch:\n  switch (t) {\n");
+    for (size_t i = 0; i < t->nAddrs; i++) {
+      fprintf(out, "  case 0x%lx: goto L_%lx;\n", t->addrs[i], t->addrs[i]);
+    }
+    fprintf(out, "  default:\n"
+            "    if (t >= MEM_SIZE) STOP(t, ADR);\n"
+            "    untranslated(t, \"return to untranslated address\");\n"
+            "  }\n");
+  }
+  fprintf(out, "done:\n");
+  for (int r = 0; r < N_REGISTERS; r++) {
+    fprintf(out, "  regs[%d] = %s;\n", r, regNames[r]);
+  }
+  fprintf(out, "  cc0 = cc;\n}\n\n");
+}
+
+/**************************** Translation ******************************/
+
+bool
+y86_to_c(Y86 *y86, const char *srcName, FILE *out)
+{
+  Translator t = { .y86 = y86, .memSize = get_memory_size_y86(y86) };
+  t.isSeen = calloc(t.memSize / 8 + 1, 1);
+  t.isCode = calloc(t.memSize / 8 + 1, 1);
+  if (!t.isSeen || !t.isCode) fatal("out of memory\n");
+  const Address entry = read_pc_y86(y86);
+  find_insns(&t, entry);
+  fprintf(out, "/* Translation of %s: %zu instructions */\n\n",
+          srcName, t.nAddrs);
+  fprintf(out, "%s", header);
+  emit_data(&t, out);
+  fprintf(out, "static Word regs[] = {\n");
+  for (int r = 0; r < N_REGISTERS; r++) {
+    fprintf(out, "  0x%lxUL,\n", read_register_y86(y86, r));
+  }
+  fprintf(out, "};\nstatic Byte cc0 = 0x%x;\n\n", read_cc_y86(y86));
+  fprintf(out, "%s", prelude);
+  emit_run(&t, out);
+  fprintf(out, "%s", postlude);
+  write_pc_y86(y86, entry);
+  free(t.isSeen); free(t.isCode); free(t.addrs); free(t.work);
+  return !ferror(out);
+}
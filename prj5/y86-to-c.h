@@ -0,0 +1,29 @@
+#ifndef _Y86_TO_C_H
+#define _Y86_TO_C_H
+
+#include "y86.h"
+
+#include <stdio.h>
+
+/** Ahead-of-time translation of the program loaded in y86 into a
+ *  standalone C program.  All instructions reachable from the
+ *  current pc of y86 are decoded with the disassembler's OpInfo
+ *  table and each becomes a C label; jumps and calls become direct
+ *  gotos while ret dispatches through a switch over all translated
+ *  addresses.  Memory is a flat byte array initialized from y86 with
+ *  the same bounds checks which make the simulator stop with
+ *  STATUS_ADR.
+ *
+ *  The generated program takes the same INT_INPUTS as the simulator
+ *  and prints the same final state dump as a verbose run.  It exits
+ *  with an error if the program stores into its own code, returns to
+ *  an untranslated address or reaches an instruction which cannot be
+ *  translated (atomics, register F or bad function codes).
+ */
+
+/** Write the translation of the program in y86 to out, naming the
+ *  source srcName in a comment.  Return false on error.
+ */
+bool y86_to_c(Y86 *y86, const char *srcName, FILE *out);
+
+#endif //ifndef _Y86_TO_C_H